@@ -583,8 +583,24 @@ eel_strdup_printf_with_custom (EelPrintfHandler *handlers,
 
 /*********** refcounted strings ****************/
 
-G_LOCK_DEFINE_STATIC (unique_ref_strs);
-static GHashTable *unique_ref_strs = NULL;
+/* The unique strings are spread over shards by their hash, each with its
+ * own lock, so that threads interning different strings, like the
+ * directory loaders and the search engines, rarely wait for each other.
+ */
+#define N_UNIQUE_REF_STR_SHARDS 64
+
+typedef struct {
+	GMutex mutex;
+	GHashTable *table;
+} UniqueRefStrShard;
+
+static UniqueRefStrShard unique_ref_strs[N_UNIQUE_REF_STR_SHARDS];
+
+static UniqueRefStrShard *
+get_unique_ref_str_shard (const char *string)
+{
+	return &unique_ref_strs[g_str_hash (string) % N_UNIQUE_REF_STR_SHARDS];
+}
 
 static eel_ref_str
 eel_ref_str_new_internal (const char *string, int start_count)
@@ -615,27 +631,29 @@ eel_ref_str_new (const char *string)
 eel_ref_str
 eel_ref_str_get_unique (const char *string)
 {
+	UniqueRefStrShard *shard;
 	eel_ref_str res;
 
 	if (string == NULL) {
 		return NULL;
 	}
-	
-	G_LOCK (unique_ref_strs);
-	if (unique_ref_strs == NULL) {
-		unique_ref_strs =
-			g_hash_table_new (g_str_hash, g_str_equal);
+
+	shard = get_unique_ref_str_shard (string);
+
+	g_mutex_lock (&shard->mutex);
+	if (shard->table == NULL) {
+		shard->table = g_hash_table_new (g_str_hash, g_str_equal);
 	}
 
-	res = g_hash_table_lookup (unique_ref_strs, string);
+	res = g_hash_table_lookup (shard->table, string);
 	if (res != NULL) {
 		eel_ref_str_ref (res);
 	} else {
 		res = eel_ref_str_new_internal (string, 0x80000001);
-		g_hash_table_insert (unique_ref_strs, res, res);
+		g_hash_table_insert (shard->table, res, res);
 	}
-	
-	G_UNLOCK (unique_ref_strs);
+
+	g_mutex_unlock (&shard->mutex);
 
 	return res;
 }
@@ -654,6 +672,7 @@ eel_ref_str_ref (eel_ref_str str)
 void
 eel_ref_str_unref (eel_ref_str str)
 {
+	UniqueRefStrShard *shard;
 	volatile gint *count;
 	gint old_ref;
 
@@ -667,13 +686,14 @@ eel_ref_str_unref (eel_ref_str str)
 	if (old_ref == 1) {
 		g_free ((char *)count);
 	} else if (old_ref == 0x80000001) {
-		G_LOCK (unique_ref_strs);
+		shard = get_unique_ref_str_shard (str);
+		g_mutex_lock (&shard->mutex);
 		/* Need to recheck after taking lock to avoid races with _get_unique() */
 		if (g_atomic_int_add (count, -1) == 0x80000001) {
-			g_hash_table_remove (unique_ref_strs, (char *)str);
+			g_hash_table_remove (shard->table, (char *)str);
 			g_free ((char *)count);
-		} 
-		G_UNLOCK (unique_ref_strs);
+		}
+		g_mutex_unlock (&shard->mutex);
 	} else if (!g_atomic_int_compare_and_exchange (count,
 						       old_ref, old_ref - 1)) {
 		goto retry_atomic_decrement;
@@ -753,6 +773,27 @@ verify_custom (const char *orig, const char *format, ...)
 	EEL_CHECK_STRING_RESULT (new, orig);
 }
 
+static void
+verify_unique_ref_str (void)
+{
+	eel_ref_str a, b, c;
+	char *copy;
+
+	a = eel_ref_str_get_unique ("text/plain");
+	copy = g_strdup ("text/plain");
+	b = eel_ref_str_get_unique (copy);
+	g_free (copy);
+	c = eel_ref_str_get_unique ("text/html");
+
+	EEL_CHECK_BOOLEAN_RESULT (a == b, TRUE);
+	EEL_CHECK_BOOLEAN_RESULT (a == c, FALSE);
+	EEL_CHECK_STRING_RESULT (g_strdup (eel_ref_str_peek (b)), "text/plain");
+
+	eel_ref_str_unref (a);
+	eel_ref_str_unref (b);
+	eel_ref_str_unref (c);
+}
+
 void
 eel_self_check_string (void)
 {
@@ -830,6 +871,7 @@ eel_self_check_string (void)
 	verify_custom ("c1-42- bar c2-foo-","%N %s %Y", 42, "bar" ,"foo");
 	verify_custom ("c1-42- bar c2-foo-","%3$N %2$s %1$Y","foo", "bar", 42);
 
+	verify_unique_ref_str ();
 }
 
 #endif /* !EEL_OMIT_SELF_CHECK */
@@ -166,6 +166,7 @@ update_info_from_link (NautilusDesktopIconFile *icon_file)
 	NautilusDesktopLink *link;
 	char *display_name;
 	GMount *mount;
+	NautilusFileColdDetails *cold;
 
 	file = NAUTILUS_FILE (icon_file);
 
@@ -186,11 +187,12 @@ update_info_from_link (NautilusDesktopIconFile *icon_file)
 	file->details->can_mount = FALSE;
 	file->details->can_unmount = FALSE;
 	file->details->can_eject = FALSE;
-	if (file->details->mount) {
-		g_object_unref (file->details->mount);
+	cold = nautilus_file_get_cold_details (file);
+	if (cold->mount) {
+		g_object_unref (cold->mount);
 	}
 	mount = nautilus_desktop_link_get_mount (link);
-	file->details->mount = mount;
+	cold->mount = mount;
 	if (mount) {
 		file->details->can_unmount = g_mount_can_unmount (mount);
 		file->details->can_eject = g_mount_can_eject (mount);
@@ -43,6 +43,7 @@
 #include "nautilus-file-utilities.h"
 #include "nautilus-file-operations.h"
 #include "nautilus-global-preferences.h"
+#include "nautilus-icon-info.h"
 #include "nautilus-lib-self-check-functions.h"
 #include "nautilus-module.h"
 #include "nautilus-profile.h"
@@ -1083,6 +1084,7 @@ void
 nautilus_application_startup_common (NautilusApplication *self)
 {
         NautilusApplicationPrivate *priv;
+	GdkScreen *screen;
 
 	nautilus_profile_start (NULL);
         priv = nautilus_application_get_instance_private (self);
@@ -1098,6 +1100,13 @@ nautilus_application_startup_common (NautilusApplication *self)
 
 	setup_theme_extensions ();
 
+	/* have the icons of the common file types ready by the time the
+	 * first folder is shown
+	 */
+	screen = gdk_screen_get_default ();
+	nautilus_icon_info_preload (gdk_screen_get_monitor_scale_factor (screen,
+									 gdk_screen_get_primary_monitor (screen)));
+
 	/* initialize preferences and create the global GSettings objects */
 	nautilus_global_preferences_init ();
 
@@ -5877,6 +5877,87 @@ nautilus_canvas_container_update_visible_icons (NautilusCanvasContainer *contain
 	}
 }
 
+static int
+compare_icons_in_rows (gconstpointer a,
+		       gconstpointer b,
+		       gpointer      container)
+{
+	return compare_icons_vertical_first (container,
+					     (NautilusCanvasIcon *) a,
+					     (NautilusCanvasIcon *) b);
+}
+
+static GList *
+get_icon_data_in_rows (NautilusCanvasContainer *container,
+		       GList                   *icons)
+{
+	GList *node, *result;
+	NautilusCanvasIcon *icon;
+
+	icons = g_list_sort_with_data (icons, compare_icons_in_rows, container);
+
+	result = NULL;
+	for (node = icons; node != NULL; node = node->next) {
+		icon = node->data;
+		result = g_list_prepend (result, icon->data);
+	}
+	g_list_free (icons);
+
+	return g_list_reverse (result);
+}
+
+/* Returns the data of the icons lying between @start and @end on the
+ * vertical adjustment, row by row. @visible is set to those between
+ * @visible_start and @visible_end, which should lie within, so that
+ * the icons are only gone through once for both.
+ */
+GList *
+nautilus_canvas_container_get_icons_in_range (NautilusCanvasContainer *container,
+					      double                   start,
+					      double                   end,
+					      double                   visible_start,
+					      double                   visible_end,
+					      GList                  **visible)
+{
+	GList *node, *icons, *visible_icons;
+	NautilusCanvasIcon *icon;
+	double x0, y0, x1, y1;
+	double unused;
+
+	eel_canvas_c2w (EEL_CANVAS (container), 0, start, &unused, &start);
+	eel_canvas_c2w (EEL_CANVAS (container), 0, end, &unused, &end);
+	eel_canvas_c2w (EEL_CANVAS (container), 0, visible_start, &unused, &visible_start);
+	eel_canvas_c2w (EEL_CANVAS (container), 0, visible_end, &unused, &visible_end);
+
+	icons = NULL;
+	visible_icons = NULL;
+	for (node = container->details->icons; node != NULL; node = node->next) {
+		icon = node->data;
+
+		if (!icon_is_positioned (icon)) {
+			continue;
+		}
+
+		eel_canvas_item_get_bounds (EEL_CANVAS_ITEM (icon->item),
+					    &x0, &y0, &x1, &y1);
+		eel_canvas_item_i2w (EEL_CANVAS_ITEM (icon->item)->parent,
+				     &x0, &y0);
+		eel_canvas_item_i2w (EEL_CANVAS_ITEM (icon->item)->parent,
+				     &x1, &y1);
+
+		if (y1 >= start && y0 <= end) {
+			icons = g_list_prepend (icons, icon);
+		}
+		if (y1 >= visible_start && y0 <= visible_end) {
+			visible_icons = g_list_prepend (visible_icons, icon);
+		}
+	}
+
+	*visible = get_icon_data_in_rows (container, visible_icons);
+
+	return get_icon_data_in_rows (container, icons);
+}
+
 static void
 handle_vadjustment_changed (GtkAdjustment *adjustment,
 			    NautilusCanvasContainer *container)
@@ -231,6 +231,12 @@ void              nautilus_canvas_container_reveal                        (Nauti
 									   NautilusCanvasIconData       *data);
 gboolean          nautilus_canvas_container_is_empty                      (NautilusCanvasContainer  *container);
 NautilusCanvasIconData *nautilus_canvas_container_get_first_visible_icon        (NautilusCanvasContainer  *container);
+GList     *       nautilus_canvas_container_get_icons_in_range            (NautilusCanvasContainer  *container,
+									   double                  start,
+									   double                  end,
+									   double                  visible_start,
+									   double                  visible_end,
+									   GList                 **visible);
 void              nautilus_canvas_container_scroll_to_canvas                (NautilusCanvasContainer  *container,
 									     NautilusCanvasIconData       *data);
 
@@ -27,6 +27,7 @@
 #include "nautilus-canvas-view-container.h"
 #include "nautilus-error-reporting.h"
 #include "nautilus-files-view-dnd.h"
+#include "nautilus-prefetch.h"
 #include "nautilus-toolbar.h"
 
 #include <stdlib.h>
@@ -97,6 +98,8 @@ struct NautilusCanvasViewDetails
 
 	GtkWidget *canvas_container;
 
+	NautilusPrefetch *prefetch;
+
 	gboolean supports_auto_layout;
 	gboolean supports_manual_layout;
 	gboolean supports_scaling;
@@ -175,6 +178,11 @@ nautilus_canvas_view_destroy (GtkWidget *object)
 
 	nautilus_canvas_view_clear (NAUTILUS_FILES_VIEW (object));
 
+	if (canvas_view->details->prefetch != NULL) {
+		nautilus_prefetch_free (canvas_view->details->prefetch);
+		canvas_view->details->prefetch = NULL;
+	}
+
         if (canvas_view->details->react_to_canvas_change_idle_id != 0) {
                 g_source_remove (canvas_view->details->react_to_canvas_change_idle_id);
 		canvas_view->details->react_to_canvas_change_idle_id = 0;
@@ -349,6 +357,10 @@ nautilus_canvas_view_clear (NautilusFilesView *view)
 	if (!canvas_container)
 		return;
 
+	if (NAUTILUS_CANVAS_VIEW (view)->details->prefetch != NULL) {
+		nautilus_prefetch_cancel (NAUTILUS_CANVAS_VIEW (view)->details->prefetch);
+	}
+
 	/* Clear away the existing icons. */
 	file_list = NULL;
 	nautilus_canvas_container_for_each (canvas_container, list_covers, &file_list);
@@ -997,6 +1009,10 @@ layout_changed_callback (NautilusCanvasContainer *container,
 			 file,
 			 nautilus_canvas_view_using_auto_layout (canvas_view));
 	}
+
+	if (canvas_view->details->prefetch != NULL) {
+		nautilus_prefetch_queue_update (canvas_view->details->prefetch);
+	}
 }
 
 const GActionEntry canvas_view_entries[] = {
@@ -1653,6 +1669,31 @@ real_create_canvas_container (NautilusCanvasView *canvas_view)
         return nautilus_canvas_view_container_new (canvas_view);
 }
 
+static GList *
+get_files_in_range (double   start,
+		    double   end,
+		    double   visible_start,
+		    double   visible_end,
+		    GList  **visible,
+		    gpointer user_data)
+{
+	NautilusCanvasContainer *canvas_container;
+	GList *files;
+
+	*visible = NULL;
+	canvas_container = get_canvas_container (NAUTILUS_CANVAS_VIEW (user_data));
+	if (canvas_container == NULL) {
+		return NULL;
+	}
+
+	files = nautilus_canvas_container_get_icons_in_range (canvas_container, start, end,
+							      visible_start, visible_end,
+							      visible);
+	nautilus_file_list_ref (*visible);
+
+	return nautilus_file_list_ref (files);
+}
+
 static void
 initialize_canvas_container (NautilusCanvasView      *canvas_view,
                              NautilusCanvasContainer *canvas_container)
@@ -1663,6 +1704,12 @@ initialize_canvas_container (NautilusCanvasView      *canvas_view,
 	canvas_view->details->canvas_container = GTK_WIDGET (canvas_container);
 	g_object_add_weak_pointer (G_OBJECT (canvas_container),
 				   (gpointer *) &canvas_view->details->canvas_container);
+
+	/* The container loads the icons of all files, but the thumbnails
+	   of the ones about to be scrolled to should be made first */
+	canvas_view->details->prefetch = nautilus_prefetch_new (GTK_SCROLLABLE (canvas_container),
+								get_files_in_range,
+								canvas_view);
 	
 	gtk_widget_set_can_focus (GTK_WIDGET (canvas_container), TRUE);
 	
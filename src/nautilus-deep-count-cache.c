@@ -0,0 +1,215 @@
+/*
+   Copyright (C) 2016 Red Hat, Inc
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <config.h>
+#include "nautilus-deep-count-cache.h"
+
+#include "nautilus-directory-notify.h"
+
+/* Keep the cache to about this many directories, forgetting the ones
+ * used least recently first.
+ */
+#define MAX_ENTRIES 100000
+
+typedef struct {
+	GFile *location;
+	NautilusDeepCountCacheEntry *entry;
+} CachedDirectory;
+
+/* Both of these are only used from the main thread. The queue is most
+ * recently used first, and the table maps locations to its links.
+ */
+static GHashTable *cached_directories;
+static GQueue lru_queue = G_QUEUE_INIT;
+
+NautilusDeepCountCacheEntry *
+nautilus_deep_count_cache_entry_new (guint64 mtime)
+{
+	NautilusDeepCountCacheEntry *entry;
+
+	entry = g_new0 (NautilusDeepCountCacheEntry, 1);
+	entry->mtime = mtime;
+	entry->linked_files = g_array_new (FALSE, FALSE, sizeof (NautilusDeepCountLinkedFile));
+	entry->subdirectories = g_array_new (FALSE, FALSE, sizeof (NautilusDeepCountSubdirectory));
+
+	return entry;
+}
+
+void
+nautilus_deep_count_cache_entry_free (NautilusDeepCountCacheEntry *entry)
+{
+	guint i;
+
+	for (i = 0; i < entry->subdirectories->len; i++) {
+		g_free (g_array_index (entry->subdirectories, NautilusDeepCountSubdirectory, i).name);
+	}
+	g_array_free (entry->subdirectories, TRUE);
+	g_array_free (entry->linked_files, TRUE);
+	g_free (entry);
+}
+
+void
+nautilus_deep_count_cache_entry_add_linked_file (NautilusDeepCountCacheEntry *entry,
+						 guint64 inode,
+						 guint32 device,
+						 goffset size)
+{
+	NautilusDeepCountLinkedFile linked_file;
+
+	linked_file.inode = inode;
+	linked_file.device = device;
+	linked_file.size = size;
+	g_array_append_val (entry->linked_files, linked_file);
+}
+
+void
+nautilus_deep_count_cache_entry_add_subdirectory (NautilusDeepCountCacheEntry *entry,
+						  const char *name,
+						  const char *fs_id)
+{
+	NautilusDeepCountSubdirectory subdirectory;
+
+	subdirectory.name = g_strdup (name);
+	subdirectory.fs_id = g_intern_string (fs_id);
+	g_array_append_val (entry->subdirectories, subdirectory);
+}
+
+static void
+remove_link (GList *link)
+{
+	CachedDirectory *cached;
+
+	cached = link->data;
+	g_hash_table_remove (cached_directories, cached->location);
+	g_queue_delete_link (&lru_queue, link);
+
+	g_object_unref (cached->location);
+	nautilus_deep_count_cache_entry_free (cached->entry);
+	g_free (cached);
+}
+
+static void
+invalidate (GFile *location)
+{
+	GList *link;
+
+	if (cached_directories == NULL || location == NULL) {
+		return;
+	}
+
+	link = g_hash_table_lookup (cached_directories, location);
+	if (link != NULL) {
+		remove_link (link);
+	}
+}
+
+const NautilusDeepCountCacheEntry *
+nautilus_deep_count_cache_lookup (GFile *location,
+				  guint64 mtime)
+{
+	GList *link;
+	CachedDirectory *cached;
+
+	if (cached_directories == NULL || mtime == 0) {
+		return NULL;
+	}
+
+	link = g_hash_table_lookup (cached_directories, location);
+	if (link == NULL) {
+		return NULL;
+	}
+
+	cached = link->data;
+	if (cached->entry->mtime != mtime) {
+		remove_link (link);
+		return NULL;
+	}
+
+	g_queue_unlink (&lru_queue, link);
+	g_queue_push_head_link (&lru_queue, link);
+
+	return cached->entry;
+}
+
+void
+nautilus_deep_count_cache_insert (GFile *location,
+				  NautilusDeepCountCacheEntry *entry)
+{
+	CachedDirectory *cached;
+
+	if (cached_directories == NULL) {
+		cached_directories = g_hash_table_new (g_file_hash, (GEqualFunc) g_file_equal);
+	}
+
+	invalidate (location);
+
+	cached = g_new (CachedDirectory, 1);
+	cached->location = g_object_ref (location);
+	cached->entry = entry;
+
+	g_queue_push_head (&lru_queue, cached);
+	g_hash_table_insert (cached_directories, cached->location, lru_queue.head);
+
+	while (lru_queue.length > MAX_ENTRIES) {
+		remove_link (lru_queue.tail);
+	}
+}
+
+void
+nautilus_deep_count_cache_clear (void)
+{
+	while (lru_queue.head != NULL) {
+		remove_link (lru_queue.head);
+	}
+}
+
+static void
+invalidate_with_parent (GFile *location)
+{
+	GFile *parent;
+
+	invalidate (location);
+
+	parent = g_file_get_parent (location);
+	if (parent != NULL) {
+		invalidate (parent);
+		g_object_unref (parent);
+	}
+}
+
+void
+nautilus_deep_count_cache_notify_files_changed (GList *files)
+{
+	GList *l;
+
+	for (l = files; l != NULL; l = l->next) {
+		invalidate_with_parent (l->data);
+	}
+}
+
+void
+nautilus_deep_count_cache_notify_files_moved (GList *file_pairs)
+{
+	GList *l;
+	GFilePair *pair;
+
+	for (l = file_pairs; l != NULL; l = l->next) {
+		pair = l->data;
+		invalidate_with_parent (pair->from);
+		invalidate_with_parent (pair->to);
+	}
+}
@@ -0,0 +1,82 @@
+/*
+   Copyright (C) 2016 Red Hat, Inc
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* nautilus-deep-count-cache.h: what deep counts found in each
+   directory, so that counting a tree again only reads the directories
+   that changed since.
+*/
+
+#ifndef NAUTILUS_DEEP_COUNT_CACHE_H
+#define NAUTILUS_DEEP_COUNT_CACHE_H
+
+#include <gio/gio.h>
+
+/* A file with more than one hard link. A deep count adds its size only
+ * once, so it is kept apart from the size of the directory.
+ */
+typedef struct {
+	guint64 inode;
+	guint32 device;
+	goffset size;
+} NautilusDeepCountLinkedFile;
+
+/* Only the name, since the directory may have changed since, and has to
+ * be looked at again to know */
+typedef struct {
+	char *name;
+	/* Interned */
+	const char *fs_id;
+} NautilusDeepCountSubdirectory;
+
+/* The direct children of a directory, as of its @mtime */
+typedef struct {
+	guint64 mtime;
+	guint directory_count;
+	guint file_count;
+	goffset size;
+	GArray *linked_files;
+	GArray *subdirectories;
+} NautilusDeepCountCacheEntry;
+
+NautilusDeepCountCacheEntry *nautilus_deep_count_cache_entry_new               (guint64                      mtime);
+void                         nautilus_deep_count_cache_entry_free              (NautilusDeepCountCacheEntry *entry);
+void                         nautilus_deep_count_cache_entry_add_linked_file   (NautilusDeepCountCacheEntry *entry,
+										guint64                      inode,
+										guint32                      device,
+										goffset                      size);
+void                         nautilus_deep_count_cache_entry_add_subdirectory  (NautilusDeepCountCacheEntry *entry,
+										const char                  *name,
+										const char                  *fs_id);
+
+/* Returns NULL unless the entry was recorded for the same @mtime. The
+ * entry is owned by the cache and only valid until it is changed.
+ */
+const NautilusDeepCountCacheEntry *
+                             nautilus_deep_count_cache_lookup                  (GFile                       *location,
+										guint64                      mtime);
+/* Takes ownership of @entry */
+void                         nautilus_deep_count_cache_insert                  (GFile                       *location,
+										NautilusDeepCountCacheEntry *entry);
+void                         nautilus_deep_count_cache_clear                   (void);
+
+/* A change to a file is not always visible in the modification time of
+ * its directory, so the monitors report them here.
+ */
+void                         nautilus_deep_count_cache_notify_files_changed    (GList                       *files);
+void                         nautilus_deep_count_cache_notify_files_moved      (GList                       *file_pairs);
+
+#endif /* NAUTILUS_DEEP_COUNT_CACHE_H */
@@ -21,12 +21,15 @@
 
 #include <config.h>
 
+#include "nautilus-deep-count-cache.h"
 #include "nautilus-directory-notify.h"
 #include "nautilus-directory-private.h"
+#include "nautilus-embedded-preview.h"
 #include "nautilus-file-attributes.h"
 #include "nautilus-file-private.h"
 #include "nautilus-file-utilities.h"
 #include "nautilus-signaller.h"
+#include "nautilus-thumbnail-cache.h"
 #include "nautilus-global-preferences.h"
 #include "nautilus-link.h"
 #include "nautilus-profile.h"
@@ -35,6 +38,7 @@
 #include <libxml/parser.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 /* turn this on to see messages about each load_directory call: */
 #if 0
@@ -53,8 +57,21 @@
 
 #define DIRECTORY_LOAD_ITEMS_PER_CALLBACK 100
 
+/* Number of subdirectories a deep count enumerates at once */
+#define DEEP_COUNT_MAX_PARALLEL_LOADS 4
+
 /* Keep async. jobs down to this number for all directories. */
-#define MAX_ASYNC_JOBS 10
+#define MAX_ASYNC_JOBS 32
+
+/* Bounds and starting point of the number of async. jobs run at once
+ * on a single backend, see async_backend_add_sample().
+ */
+#define MIN_ASYNC_JOBS_PER_BACKEND 1
+#define MAX_ASYNC_JOBS_PER_BACKEND 16
+#define INITIAL_ASYNC_JOBS_PER_BACKEND 4
+
+/* Read size when streaming an image into a loader */
+#define READ_CHUNK_SIZE (64 * 1024)
 
 struct TopLeftTextReadState {
 	NautilusDirectory *directory;
@@ -73,10 +90,16 @@ struct ThumbnailState {
 	NautilusDirectory *directory;
 	GCancellable *cancellable;
 	NautilusFile *file;
-	gboolean trying_original;
 	gboolean tried_original;
 };
 
+/* Owned by the thread loading the original image */
+typedef struct {
+	GFile *location;
+	int max_thumbnail_size;
+	gboolean try_embedded_preview;
+} ThumbnailOriginalLoad;
+
 struct MountState {
 	NautilusDirectory *directory;
 	GCancellable *cancellable;
@@ -96,8 +119,23 @@ struct DirectoryLoadState {
 	GHashTable *load_mime_list_hash;
 	NautilusFile *load_directory_file;
 	int load_file_count;
+
+	/* Batches of file infos being prepared on worker threads, in the
+	 * order they were enumerated. They are handed to the directory in
+	 * that order, and the load is done once all of them were. */
+	GQueue prepare_batches;
+	int n_preparing;
+	gboolean enumerating;
+	gboolean enumeration_done;
+	GError *load_error;
 };
 
+typedef struct {
+	DirectoryLoadState *state;
+	GList *infos;
+	gboolean prepared;
+} PrepareBatch;
+
 struct MimeListState {
 	NautilusDirectory *directory;
 	NautilusFile *mime_list_file;
@@ -128,13 +166,38 @@ struct DirectoryCountState {
 struct DeepCountState {
 	NautilusDirectory *directory;
 	GCancellable *cancellable;
-	GFileEnumerator *enumerator;
-	GFile *deep_count_location;
-	GList *deep_count_subdirectories;
-	GArray *seen_deep_count_inodes;
+	GQueue deep_count_subdirectories;
+	int n_loading;
+	GHashTable *seen_deep_count_inodes;
 	char *fs_id;
 };
 
+/* A directory a deep count still has to look into */
+typedef struct {
+	GFile *location;
+	guint64 mtime;
+	/* Unknown for the subdirectories of directories counted from the
+	 * cache, which may have changed since */
+	gboolean mtime_known;
+	DeepCountState *state;
+} DeepCountDirectory;
+
+/* One of the directories a deep count is enumerating */
+typedef struct {
+	DeepCountState *state;
+	GFile *location;
+	GFileEnumerator *enumerator;
+
+	/* What to remember about the directory once it was read through */
+	NautilusDeepCountCacheEntry *cache_entry;
+	gboolean complete;
+} DeepCountLoad;
+
+typedef struct {
+	guint64 inode;
+	guint32 device;
+} DeepCountInode;
+
 
 
 typedef struct {
@@ -169,8 +232,48 @@ typedef struct {
 typedef gboolean (* RequestCheck) (Request);
 typedef gboolean (* FileCheck) (NautilusFile *);
 
+/* Directories that have to wait for a job slot are woken in this
+ * order, and first come, first served within the same priority.
+ */
+typedef enum {
+	ASYNC_JOB_PRIORITY_FOCUSED,
+	ASYNC_JOB_PRIORITY_DEFAULT,
+	ASYNC_JOB_PRIORITY_DEEP_COUNT,
+	ASYNC_JOB_N_PRIORITIES
+} AsyncJobPriority;
+
+/* Everything behind the same file system or server shares the jobs
+ * limit of its backend, so a slow network share doesn't hold the slots
+ * local folders need.
+ */
+struct AsyncBackend {
+	const char *key;
+	int running;
+	int limit;
+	int n_waiting[ASYNC_JOB_N_PRIORITIES];
+
+	/* In microseconds */
+	gint64 latency;
+	gint64 base_latency;
+	int samples_since_change;
+};
+
+typedef struct {
+	NautilusDirectory *directory;
+	AsyncBackend *backend;
+	AsyncJobPriority priority;
+} WaitingDirectory;
+
+struct AsyncJob {
+	const char *job;
+	AsyncBackend *backend;
+	gint64 start_time;
+};
+
 /* Current number of async. jobs. */
 static int async_job_count;
+static GHashTable *async_backends;
+static GQueue waiting_queues[ASYNC_JOB_N_PRIORITIES];
 static GHashTable *waiting_directories;
 #ifdef DEBUG_ASYNC_JOBS
 static GHashTable *async_jobs;
@@ -178,7 +281,9 @@ static GHashTable *async_jobs;
 
 /* Forward declarations for functions that need them. */
 static void     deep_count_load                               (DeepCountState         *state,
-							       GFile                  *location);
+							       GFile                  *location,
+							       guint64                 mtime);
+static void     deep_count_next_dir                           (DeepCountState         *state);
 static gboolean request_is_satisfied                          (NautilusDirectory      *directory,
 							       NautilusFile           *file,
 							       Request                 request);
@@ -331,6 +436,233 @@ nautilus_directory_verify_request_counts (NautilusDirectory *directory)
 }
 #endif
 
+/* Sets @is_final to FALSE if the key may still change, as the file
+ * system of a local directory is not known yet.
+ */
+static const char *
+get_async_backend_key (NautilusDirectory *directory,
+		       gboolean *is_final)
+{
+	NautilusFile *file;
+	const char *key;
+	char *uri, *authority_end, *filesystem_key;
+
+	*is_final = TRUE;
+
+	if (g_file_is_native (directory->details->location)) {
+		/* Local mounts are told apart by their file system */
+		key = "file://";
+		*is_final = FALSE;
+
+		file = nautilus_directory_get_existing_corresponding_file (directory);
+		if (file != NULL) {
+			if (file->details->filesystem_id != NULL) {
+				filesystem_key = g_strconcat ("file://", eel_ref_str_peek (file->details->filesystem_id), NULL);
+				key = g_intern_string (filesystem_key);
+				g_free (filesystem_key);
+				*is_final = TRUE;
+			}
+			nautilus_file_unref (file);
+		}
+
+		return key;
+	}
+
+	/* Anything else by scheme and server, like "smb://host" */
+	uri = nautilus_directory_get_uri (directory);
+	authority_end = strstr (uri, "://");
+	if (authority_end != NULL) {
+		authority_end = strchr (authority_end + 3, '/');
+		if (authority_end != NULL) {
+			*authority_end = '\0';
+		}
+	}
+	key = g_intern_string (uri);
+	g_free (uri);
+
+	return key;
+}
+
+static AsyncBackend *
+get_async_backend (NautilusDirectory *directory)
+{
+	AsyncBackend *backend;
+	const char *key;
+	gboolean is_final;
+
+	if (directory->details->async_backend != NULL) {
+		return directory->details->async_backend;
+	}
+
+	key = get_async_backend_key (directory, &is_final);
+
+	if (async_backends == NULL) {
+		async_backends = g_hash_table_new (NULL, NULL);
+	}
+
+	backend = g_hash_table_lookup (async_backends, key);
+	if (backend == NULL) {
+		backend = g_new0 (AsyncBackend, 1);
+		backend->key = key;
+		backend->limit = INITIAL_ASYNC_JOBS_PER_BACKEND;
+		g_hash_table_insert (async_backends, (char *) key, backend);
+	}
+
+	if (is_final) {
+		directory->details->async_backend = backend;
+	}
+
+	return backend;
+}
+
+/* Tunes the jobs limit of @backend after a job took @latency. As long
+ * as jobs finish about as fast as the quickest ones seen lately, and
+ * all the slots are taken, one more job is allowed. Once they get much
+ * slower, the backend is queueing requests, and one job less is
+ * allowed. Each change gets to show its effect before the next one.
+ */
+static void
+async_backend_add_sample (AsyncBackend *backend,
+			  gint64 latency)
+{
+	gboolean saturated;
+
+	latency = MAX (latency, 1);
+	saturated = backend->running >= backend->limit;
+
+	if (backend->latency == 0) {
+		backend->latency = latency;
+	} else {
+		backend->latency += (latency - backend->latency) / 8;
+	}
+
+	if (backend->base_latency == 0 || latency < backend->base_latency) {
+		backend->base_latency = latency;
+	} else {
+		/* Slowly forget it, in case the backend just got slower */
+		backend->base_latency += (backend->latency - backend->base_latency) / 64;
+	}
+
+	backend->samples_since_change++;
+	if (backend->samples_since_change < backend->limit) {
+		return;
+	}
+
+	if (backend->latency > 2 * backend->base_latency) {
+		if (backend->limit > MIN_ASYNC_JOBS_PER_BACKEND) {
+			backend->limit--;
+			backend->samples_since_change = 0;
+		}
+	} else if (saturated &&
+		   backend->latency < backend->base_latency + backend->base_latency / 2) {
+		if (backend->limit < MAX_ASYNC_JOBS_PER_BACKEND) {
+			backend->limit++;
+			backend->samples_since_change = 0;
+		}
+	}
+
+#ifdef DEBUG_ASYNC_JOBS
+	g_message ("%s: latency %" G_GINT64_FORMAT " us, base %" G_GINT64_FORMAT " us, limit %d",
+		   backend->key, backend->latency, backend->base_latency, backend->limit);
+#endif
+}
+
+/* Whether @job asks the backend one thing, so that its run time is the
+ * latency of a request. Reading whole directories takes as long as they
+ * are big, and thumbnails and extensions as long as they compute, which
+ * would look like the backend queueing requests.
+ */
+static gboolean
+async_job_measures_latency (const char *job)
+{
+	return strcmp (job, "file info") == 0 ||
+		strcmp (job, "link info") == 0 ||
+		strcmp (job, "mount") == 0 ||
+		strcmp (job, "filesystem info") == 0;
+}
+
+static AsyncJobPriority
+get_async_job_priority (NautilusDirectory *directory,
+			const char *job)
+{
+	if (strcmp (job, "deep count") == 0) {
+		return ASYNC_JOB_PRIORITY_DEEP_COUNT;
+	}
+	if (directory->details->focus_count > 0) {
+		return ASYNC_JOB_PRIORITY_FOCUSED;
+	}
+	return ASYNC_JOB_PRIORITY_DEFAULT;
+}
+
+static gboolean
+async_backend_has_waiting_before (AsyncBackend *backend,
+				  AsyncJobPriority priority)
+{
+	int i;
+
+	for (i = 0; i < priority; i++) {
+		if (backend->n_waiting[i] > 0) {
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+static void
+stop_waiting (NautilusDirectory *directory)
+{
+	GList *link;
+	WaitingDirectory *waiting;
+
+	if (waiting_directories == NULL) {
+		return;
+	}
+
+	link = g_hash_table_lookup (waiting_directories, directory);
+	if (link == NULL) {
+		return;
+	}
+
+	waiting = link->data;
+	waiting->backend->n_waiting[waiting->priority]--;
+	g_queue_delete_link (&waiting_queues[waiting->priority], link);
+	g_hash_table_remove (waiting_directories, directory);
+	g_free (waiting);
+}
+
+static void
+start_waiting (NautilusDirectory *directory,
+	       AsyncBackend *backend,
+	       AsyncJobPriority priority)
+{
+	GList *link;
+	WaitingDirectory *waiting;
+
+	if (waiting_directories == NULL) {
+		waiting_directories = g_hash_table_new (NULL, NULL);
+	}
+
+	link = g_hash_table_lookup (waiting_directories, directory);
+	if (link != NULL) {
+		waiting = link->data;
+		if (waiting->backend == backend &&
+		    waiting->priority <= priority) {
+			return;
+		}
+		stop_waiting (directory);
+	}
+
+	waiting = g_new (WaitingDirectory, 1);
+	waiting->directory = directory;
+	waiting->backend = backend;
+	waiting->priority = priority;
+
+	backend->n_waiting[priority]++;
+	g_queue_push_tail (&waiting_queues[priority], waiting);
+	g_hash_table_insert (waiting_directories, directory,
+			     g_queue_peek_tail_link (&waiting_queues[priority]));
+}
+
 /* Start a job. This is really just a way of limiting the number of
  * async. requests that we issue at any given time. Without this, the
  * number of requests is unbounded.
@@ -339,6 +671,9 @@ static gboolean
 async_job_start (NautilusDirectory *directory,
 		 const char *job)
 {
+	AsyncBackend *backend;
+	AsyncJobPriority priority;
+	AsyncJob *async_job;
 #ifdef DEBUG_ASYNC_JOBS
 	char *key;
 #endif
@@ -350,15 +685,14 @@ async_job_start (NautilusDirectory *directory,
 	g_assert (async_job_count >= 0);
 	g_assert (async_job_count <= MAX_ASYNC_JOBS);
 
-	if (async_job_count >= MAX_ASYNC_JOBS) {
-		if (waiting_directories == NULL) {
-			waiting_directories = g_hash_table_new (NULL, NULL);
-		}
+	backend = get_async_backend (directory);
+	priority = get_async_job_priority (directory, job);
 
-		g_hash_table_insert (waiting_directories,
-				     directory,
-				     directory);
-		
+	/* Don't take a slot more urgent work is waiting for */
+	if (async_job_count >= MAX_ASYNC_JOBS ||
+	    backend->running >= backend->limit ||
+	    async_backend_has_waiting_before (backend, priority)) {
+		start_waiting (directory, backend, priority);
 		return FALSE;
 	}
 
@@ -379,15 +713,28 @@ async_job_start (NautilusDirectory *directory,
 	}
 #endif	
 
+	async_job = g_new (AsyncJob, 1);
+	async_job->job = job;
+	async_job->backend = backend;
+	async_job->start_time = g_get_monotonic_time ();
+	directory->details->async_jobs_running =
+		g_list_prepend (directory->details->async_jobs_running, async_job);
+
+	backend->running += 1;
 	async_job_count += 1;
 	return TRUE;
 }
 
-/* End a job. */
+/* End a job. Only jobs that completed tell how fast the backend
+ * answers, not the ones that were cancelled.
+ */
 static void
-async_job_end (NautilusDirectory *directory,
-	       const char *job)
+async_job_end_full (NautilusDirectory *directory,
+		    const char *job,
+		    gboolean cancelled)
 {
+	GList *node;
+	AsyncJob *async_job;
 #ifdef DEBUG_ASYNC_JOBS
 	char *key;
 	gpointer table_key, value;
@@ -417,40 +764,53 @@ async_job_end (NautilusDirectory *directory,
 	}
 #endif
 
+	for (node = directory->details->async_jobs_running; node != NULL; node = node->next) {
+		async_job = node->data;
+		if (strcmp (async_job->job, job) == 0) {
+			break;
+		}
+	}
+	g_assert (node != NULL);
+
+	directory->details->async_jobs_running =
+		g_list_delete_link (directory->details->async_jobs_running, node);
+
+	if (!cancelled && async_job_measures_latency (job)) {
+		async_backend_add_sample (async_job->backend,
+					  g_get_monotonic_time () - async_job->start_time);
+	}
+	async_job->backend->running -= 1;
+	g_free (async_job);
+
 	async_job_count -= 1;
 }
 
-/* Helper to get one value from a hash table. */
 static void
-get_one_value_callback (gpointer key, gpointer value, gpointer callback_data)
+async_job_end (NautilusDirectory *directory,
+	       const char *job)
 {
-	gpointer *returned_value;
-
-	returned_value = callback_data;
-	*returned_value = value;
+	async_job_end_full (directory, job, FALSE);
 }
 
-/* return a single value from a hash table. */
-static gpointer
-get_one_value (GHashTable *table)
+static void
+async_job_cancel (NautilusDirectory *directory,
+		  const char *job)
 {
-	gpointer value;
-
-	value = NULL;
-	if (table != NULL) {
-		g_hash_table_foreach (table, get_one_value_callback, &value);
-	}
-	return value;
+	async_job_end_full (directory, job, TRUE);
 }
 
 /* Wake up directories that are "blocked" as long as there are job
- * slots available.
+ * slots available, the most urgent first.
  */
 static void
 async_job_wake_up (void)
 {
 	static gboolean already_waking_up = FALSE;
-	gpointer value;
+	WaitingDirectory *waiting;
+	NautilusDirectory *directory;
+	GList *node;
+	gboolean woke_up;
+	int i;
 
 	g_assert (async_job_count >= 0);
 	g_assert (async_job_count <= MAX_ASYNC_JOBS);
@@ -460,18 +820,59 @@ async_job_wake_up (void)
 	}
 	
 	already_waking_up = TRUE;
-	while (async_job_count < MAX_ASYNC_JOBS) {
-		value = get_one_value (waiting_directories);
-		if (value == NULL) {
-			break;
+	do {
+		/* Waking a directory changes the queues, so start over
+		 * after each one.
+		 */
+		woke_up = FALSE;
+		for (i = 0; i < ASYNC_JOB_N_PRIORITIES && !woke_up; i++) {
+			for (node = waiting_queues[i].head; node != NULL; node = node->next) {
+				waiting = node->data;
+				if (waiting->backend->running >= waiting->backend->limit) {
+					continue;
+				}
+
+				directory = waiting->directory;
+				stop_waiting (directory);
+				nautilus_directory_async_state_changed (directory);
+				woke_up = TRUE;
+				break;
+			}
 		}
-		g_hash_table_remove (waiting_directories, value);
-		nautilus_directory_async_state_changed
-			(NAUTILUS_DIRECTORY (value));
-	}
+	} while (woke_up && async_job_count < MAX_ASYNC_JOBS);
 	already_waking_up = FALSE;
 }
 
+void
+nautilus_directory_set_focused (NautilusDirectory *directory,
+				gboolean focused)
+{
+	GList *link;
+	WaitingDirectory *waiting;
+
+	g_return_if_fail (NAUTILUS_IS_DIRECTORY (directory));
+
+	if (!focused) {
+		g_return_if_fail (directory->details->focus_count > 0);
+		directory->details->focus_count--;
+		return;
+	}
+
+	directory->details->focus_count++;
+
+	/* Move it ahead of the background directories */
+	link = waiting_directories != NULL ?
+		g_hash_table_lookup (waiting_directories, directory) : NULL;
+	if (link != NULL) {
+		waiting = link->data;
+		if (waiting->priority == ASYNC_JOB_PRIORITY_DEFAULT) {
+			start_waiting (directory, waiting->backend,
+				       ASYNC_JOB_PRIORITY_FOCUSED);
+			async_job_wake_up ();
+		}
+	}
+}
+
 static void
 directory_count_cancel (NautilusDirectory *directory)
 {
@@ -514,7 +915,7 @@ link_info_cancel (NautilusDirectory *directory)
 		g_cancellable_cancel (directory->details->link_info_read_state->cancellable);
 		directory->details->link_info_read_state->directory = NULL;
 		directory->details->link_info_read_state = NULL;
-		async_job_end (directory, "link info");
+		async_job_cancel (directory, "link info");
 	}
 }
 
@@ -536,7 +937,7 @@ mount_cancel (NautilusDirectory *directory)
 		g_cancellable_cancel (directory->details->mount_state->cancellable);
 		directory->details->mount_state->directory = NULL;
 		directory->details->mount_state = NULL;
-		async_job_end (directory, "mount");
+		async_job_cancel (directory, "mount");
 	}
 }
 
@@ -549,7 +950,7 @@ file_info_cancel (NautilusDirectory *directory)
 		directory->details->get_info_in_progress = NULL;
 		directory->details->get_info_file = NULL;
 
-		async_job_end (directory, "file info");
+		async_job_cancel (directory, "file info");
 	}
 }
 
@@ -755,6 +1156,9 @@ nautilus_directory_monitor_add_internal (NautilusDirectory *directory,
 	 */
 	if (directory->details->monitor == NULL) {
 		directory->details->monitor = nautilus_monitor_directory (directory->details->location);
+		if (directory->details->n_views_shown > 0) {
+			nautilus_monitor_set_shown (directory->details->monitor, TRUE);
+		}
 	}
 	
 
@@ -805,6 +1209,9 @@ static void
 show_hidden_files_changed_callback (gpointer callback_data)
 {
 	show_hidden_files = g_settings_get_boolean (gtk_filechooser_preferences, NAUTILUS_PREFERENCES_SHOW_HIDDEN_FILES);
+
+	/* Deep counts skip the hidden files */
+	nautilus_deep_count_cache_clear ();
 }
 
 static gboolean
@@ -834,17 +1241,48 @@ should_skip_file (NautilusDirectory *directory, GFileInfo *info)
 	return FALSE;
 }
 
+static guint directory_load_budget_ms = 0;
+
+static void
+directory_load_budget_changed_callback (gpointer callback_data)
+{
+	directory_load_budget_ms = g_settings_get_uint (nautilus_preferences,
+							NAUTILUS_PREFERENCES_DIRECTORY_LOAD_BUDGET);
+}
+
+/* How long adding files may block the main loop at once, in
+ * microseconds, or 0 for no limit */
+static gint64
+get_directory_load_budget (void)
+{
+	static gboolean directory_load_budget_changed_callback_installed = FALSE;
+
+	if (!directory_load_budget_changed_callback_installed) {
+		g_signal_connect_swapped (nautilus_preferences,
+					  "changed::" NAUTILUS_PREFERENCES_DIRECTORY_LOAD_BUDGET,
+					  G_CALLBACK (directory_load_budget_changed_callback),
+					  NULL);
+
+		directory_load_budget_changed_callback_installed = TRUE;
+
+		directory_load_budget_changed_callback (NULL);
+	}
+
+	return directory_load_budget_ms * G_TIME_SPAN_MILLISECOND;
+}
+
 static gboolean
 dequeue_pending_idle_callback (gpointer callback_data)
 {
 	NautilusDirectory *directory;
 	GList *pending_file_info;
-	GList *node, *next;
+	GList *node, *rest;
+	NautilusFileTableIter iter;
 	NautilusFile *file;
 	GList *changed_files, *added_files;
 	GFileInfo *file_info;
-	const char *mimetype, *name;
-	DirectoryLoadState *dir_load_state;
+	const char *name;
+	gint64 budget, end_time;
 
 	directory = NAUTILUS_DIRECTORY (callback_data);
 
@@ -866,33 +1304,26 @@ dequeue_pending_idle_callback (gpointer callback_data)
 
 	added_files = NULL;
 	changed_files = NULL;
+	rest = NULL;
 
-	dir_load_state = directory->details->directory_load_in_progress;
+	budget = get_directory_load_budget ();
+	end_time = g_get_monotonic_time () + budget;
 	
 	/* Build a list of NautilusFile objects. */
 	for (node = pending_file_info; node != NULL; node = node->next) {
 		file_info = node->data;
 
-		name = g_file_info_get_name (file_info);
-		
-		/* Update the file count. */
-		/* FIXME bugzilla.gnome.org 45063: This could count a
-		 * file twice if we get it from both load_directory
-		 * and from new_files_callback. Not too hard to fix by
-		 * moving this into the actual callback instead of
-		 * waiting for the idle function.
-		 */
-		if (dir_load_state &&
-		    !should_skip_file (directory, file_info)) {
-			dir_load_state->load_file_count += 1;
-
-			/* Add the MIME type to the set. */
-			mimetype = g_file_info_get_content_type (file_info);
-			if (mimetype != NULL) {
-				istr_set_insert (dir_load_state->load_mime_list_hash,
-						 mimetype);
-			}
+		/* Leave the rest for the next idle, so that loading a huge
+		 * directory doesn't block the main loop. */
+		if (budget > 0 && node != pending_file_info &&
+		    g_get_monotonic_time () > end_time) {
+			rest = node;
+			node->prev->next = NULL;
+			node->prev = NULL;
+			break;
 		}
+
+		name = g_file_info_get_name (file_info);
 		
 		/* check if the file already exists */
 		file = nautilus_directory_find_file_by_name (directory, name);
@@ -922,15 +1353,22 @@ dequeue_pending_idle_callback (gpointer callback_data)
 		}
 	}
 
+	if (rest != NULL) {
+		/* Keep the pending list newest first */
+		directory->details->pending_file_info =
+			g_list_concat (directory->details->pending_file_info,
+				       g_list_reverse (rest));
+	}
+
 	/* If we are done loading, then we assume that any unconfirmed
          * files are gone.
 	 */
-	if (directory->details->directory_loaded) {
-		for (node = directory->details->file_list;
-		     node != NULL; node = next) {
-			file = NAUTILUS_FILE (node->data);
-			next = node->next;
-
+	if (directory->details->directory_loaded &&
+	    directory->details->pending_file_info == NULL &&
+	    directory->details->confirmed_file_count <
+	    (int) nautilus_file_table_get_length (directory->details->file_table)) {
+		nautilus_file_table_iter_init (&iter, directory->details->file_table);
+		while (nautilus_file_table_iter_next (&iter, &file)) {
 			if (file->details->unconfirmed) {
 				nautilus_file_ref (file);
 				changed_files = g_list_prepend (changed_files, file);
@@ -947,26 +1385,11 @@ dequeue_pending_idle_callback (gpointer callback_data)
 	nautilus_file_list_free (added_files);
 
 	if (directory->details->directory_loaded &&
+	    directory->details->pending_file_info == NULL &&
 	    !directory->details->directory_loaded_sent_notification) {
 		/* Send the done_loading signal. */
 		nautilus_directory_emit_done_loading (directory);
 
-		if (dir_load_state) {
-			file = dir_load_state->load_directory_file;
-			
-			file->details->directory_count = dir_load_state->load_file_count;
-			file->details->directory_count_is_up_to_date = TRUE;
-			file->details->got_directory_count = TRUE;
-
-			file->details->got_mime_list = TRUE;
-			file->details->mime_list_is_up_to_date = TRUE;
-			g_list_free_full (file->details->mime_list, g_free);
-			file->details->mime_list = istr_set_get_as_list
-				(dir_load_state->load_mime_list_hash);
-
-			nautilus_file_changed (file);
-		}
-		
 		nautilus_directory_async_state_changed (directory);
 
 		directory->details->directory_loaded_sent_notification = TRUE;
@@ -975,6 +1398,10 @@ dequeue_pending_idle_callback (gpointer callback_data)
  drain:
 	g_list_free_full (pending_file_info, g_object_unref);
 
+	if (directory->details->pending_file_info != NULL) {
+		nautilus_directory_schedule_dequeue_pending (directory);
+	}
+
 	/* Get the state machine running again. */
 	nautilus_directory_async_state_changed (directory);
 
@@ -997,6 +1424,9 @@ static void
 directory_load_one (NautilusDirectory *directory,
 		    GFileInfo *info)
 {
+	DirectoryLoadState *state;
+	const char *mimetype;
+
 	if (info == NULL) {
 		return;
 	}
@@ -1010,6 +1440,20 @@ directory_load_one (NautilusDirectory *directory,
 		
 		return;
 	}
+
+	/* Update the file count. */
+	state = directory->details->directory_load_in_progress;
+	if (state != NULL &&
+	    !should_skip_file (directory, info)) {
+		state->load_file_count += 1;
+
+		/* Add the MIME type to the set. */
+		mimetype = g_file_info_get_content_type (info);
+		if (mimetype != NULL) {
+			istr_set_insert (state->load_mime_list_hash,
+					 mimetype);
+		}
+	}
 	
 	/* Arrange for the "loading" part of the work. */
 	g_object_ref (info);
@@ -1059,7 +1503,9 @@ static void
 directory_load_done (NautilusDirectory *directory,
 		     GError *error)
 {
-	GList *node;
+	DirectoryLoadState *state;
+	NautilusFileTableIter iter;
+	NautilusFile *file;
 
 	nautilus_profile_start (NULL);
         g_object_ref (directory);
@@ -1067,6 +1513,26 @@ directory_load_done (NautilusDirectory *directory,
 	directory->details->directory_loaded = TRUE;
 	directory->details->directory_loaded_sent_notification = FALSE;
 
+	/* The count is known now, even if some of the files are still
+	 * waiting to be added.
+	 */
+	state = directory->details->directory_load_in_progress;
+	if (state != NULL) {
+		file = state->load_directory_file;
+
+		file->details->directory_count = state->load_file_count;
+		file->details->directory_count_is_up_to_date = TRUE;
+		file->details->got_directory_count = TRUE;
+
+		file->details->got_mime_list = TRUE;
+		file->details->mime_list_is_up_to_date = TRUE;
+		g_list_free_full (file->details->mime_list, g_free);
+		file->details->mime_list = istr_set_get_as_list
+			(state->load_mime_list_hash);
+
+		nautilus_file_changed (file);
+	}
+
 	if (error != NULL) {
 		/* The load did not complete successfully. This means
 		 * we don't know the status of the files in this directory.
@@ -1074,15 +1540,17 @@ directory_load_done (NautilusDirectory *directory,
 		 * they won't be marked "gone" later -- we don't know enough
 		 * about them to know whether they are really gone.
 		 */
-		for (node = directory->details->file_list;
-		     node != NULL; node = node->next) {
-			set_file_unconfirmed (NAUTILUS_FILE (node->data), FALSE);
+		nautilus_file_table_iter_init (&iter, directory->details->file_table);
+		while (nautilus_file_table_iter_next (&iter, &file)) {
+			set_file_unconfirmed (file, FALSE);
 		}
 
 		nautilus_directory_emit_load_error (directory, error);
 	}
 
-	/* Call the idle function right away. */
+	/* Call the idle function right away. If the files don't all fit
+	 * in the time budget, the rest are added from idles as usual.
+	 */
 	if (directory->details->dequeue_pending_idle_id != 0) {
 		g_source_remove (directory->details->dequeue_pending_idle_id);
 	}
@@ -1688,14 +2156,15 @@ lacks_mount (NautilusFile *file)
 static gboolean
 has_problem (NautilusDirectory *directory, NautilusFile *file, FileCheck problem)
 {
-	GList *node;
+	NautilusFileTableIter iter;
 
 	if (file != NULL) {
 		return (* problem) (file);
 	}
 
-	for (node = directory->details->file_list; node != NULL; node = node->next) {
-		if ((* problem) (node->data)) {
+	nautilus_file_table_iter_init (&iter, directory->details->file_table);
+	while (nautilus_file_table_iter_next (&iter, &file)) {
+		if ((* problem) (file)) {
 			return TRUE;
 		}
 	}
@@ -1903,18 +2372,28 @@ nautilus_directory_is_file_list_monitored (NautilusDirectory *directory)
 static void
 mark_all_files_unconfirmed (NautilusDirectory *directory)
 {
-	GList *node;
+	NautilusFileTableIter iter;
 	NautilusFile *file;
 
-	for (node = directory->details->file_list; node != NULL; node = node->next) {
-		file = node->data;
+	nautilus_file_table_iter_init (&iter, directory->details->file_table);
+	while (nautilus_file_table_iter_next (&iter, &file)) {
 		set_file_unconfirmed (file, TRUE);
 	}
 }
 
+static void
+prepare_batch_free (PrepareBatch *batch)
+{
+	g_list_free_full (batch->infos, g_object_unref);
+	g_free (batch);
+}
+
 static void
 directory_load_state_free (DirectoryLoadState *state)
 {
+	g_assert (state->n_preparing == 0);
+	g_assert (!state->enumerating);
+
 	if (state->enumerator) {
 		if (!g_file_enumerator_is_closed (state->enumerator)) {
 			g_file_enumerator_close_async (state->enumerator,
@@ -1923,6 +2402,12 @@ directory_load_state_free (DirectoryLoadState *state)
 		g_object_unref (state->enumerator);
 	}
 
+	g_queue_foreach (&state->prepare_batches, (GFunc) prepare_batch_free, NULL);
+	g_queue_clear (&state->prepare_batches);
+	if (state->load_error != NULL) {
+		g_error_free (state->load_error);
+	}
+
 	if (state->load_mime_list_hash != NULL) {
 		istr_set_destroy (state->load_mime_list_hash);
 	}
@@ -1931,59 +2416,151 @@ directory_load_state_free (DirectoryLoadState *state)
 	g_free (state);
 }
 
+/* Frees @state once the load was cancelled and nothing is running
+ * for it anymore.
+ */
+static gboolean
+directory_load_state_free_if_idle (DirectoryLoadState *state)
+{
+	if (state->directory != NULL ||
+	    state->n_preparing > 0 ||
+	    state->enumerating) {
+		return FALSE;
+	}
+
+	directory_load_state_free (state);
+	return TRUE;
+}
+
+/* Hands the batches that are prepared over to the directory, in the
+ * order they were enumerated, and finishes the load after the last one.
+ */
+static void
+directory_load_flush (DirectoryLoadState *state)
+{
+	NautilusDirectory *directory;
+	PrepareBatch *batch;
+	GList *l;
+
+	if (directory_load_state_free_if_idle (state) ||
+	    state->directory == NULL) {
+		return;
+	}
+
+	directory = nautilus_directory_ref (state->directory);
+
+	g_assert (directory->details->directory_load_in_progress == state);
+
+	while ((batch = g_queue_peek_head (&state->prepare_batches)) != NULL &&
+	       batch->prepared) {
+		g_queue_pop_head (&state->prepare_batches);
+		for (l = batch->infos; l != NULL; l = l->next) {
+			directory_load_one (directory, l->data);
+		}
+		prepare_batch_free (batch);
+	}
+
+	if (state->enumeration_done &&
+	    g_queue_is_empty (&state->prepare_batches)) {
+		directory_load_done (directory, state->load_error);
+		directory_load_state_free_if_idle (state);
+	}
+
+	nautilus_directory_unref (directory);
+}
+
+static void
+prepare_batch_thread (GTask *task,
+		      gpointer source_object,
+		      gpointer task_data,
+		      GCancellable *cancellable)
+{
+	PrepareBatch *batch;
+	GList *l;
+
+	batch = task_data;
+
+	for (l = batch->infos; l != NULL; l = l->next) {
+		if (g_cancellable_is_cancelled (cancellable)) {
+			break;
+		}
+		nautilus_file_prepare_info (l->data);
+	}
+
+	g_task_return_boolean (task, TRUE);
+}
+
+static void
+prepare_batch_done (GObject *source_object,
+		    GAsyncResult *res,
+		    gpointer user_data)
+{
+	PrepareBatch *batch;
+	DirectoryLoadState *state;
+
+	batch = user_data;
+	state = batch->state;
+
+	batch->prepared = TRUE;
+	state->n_preparing--;
+
+	directory_load_flush (state);
+}
+
 static void
 more_files_callback (GObject *source_object,
 		     GAsyncResult *res,
 		     gpointer user_data)
 {
 	DirectoryLoadState *state;
-	NautilusDirectory *directory;
+	PrepareBatch *batch;
+	GTask *task;
 	GError *error;
-	GList *files, *l;
-	GFileInfo *info;
+	GList *files;
 
 	state = user_data;
+	state->enumerating = FALSE;
 
 	if (state->directory == NULL) {
 		/* Operation was cancelled. Bail out */
-		directory_load_state_free (state);
+		directory_load_state_free_if_idle (state);
 		return;
 	}
 
-	directory = nautilus_directory_ref (state->directory);
-
-	g_assert (directory->details->directory_load_in_progress != NULL);
-	g_assert (directory->details->directory_load_in_progress == state);
+	g_assert (state->directory->details->directory_load_in_progress == state);
 
 	error = NULL;
 	files = g_file_enumerator_next_files_finish (state->enumerator,
 						     res, &error);
 
-	for (l = files; l != NULL; l = l->next) {
-		info = l->data;
-		directory_load_one (directory, info);
-		g_object_unref (info);
-	}
-
 	if (files == NULL) {
-		directory_load_done (directory, error);
-		directory_load_state_free (state);
-	} else {
-		g_file_enumerator_next_files_async (state->enumerator,
-						    DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
-						    G_PRIORITY_DEFAULT,
-						    state->cancellable,
-						    more_files_callback,
-						    state);
-	}
-
-	nautilus_directory_unref (directory);
-
-	if (error) {
-		g_error_free (error);
+		state->enumeration_done = TRUE;
+		state->load_error = error;
+		directory_load_flush (state);
+		return;
 	}
 
-	g_list_free (files);
+	/* Prepare the files on a worker thread, while the next ones are
+	 * being enumerated.
+	 */
+	batch = g_new0 (PrepareBatch, 1);
+	batch->state = state;
+	batch->infos = files;
+	g_queue_push_tail (&state->prepare_batches, batch);
+	state->n_preparing++;
+
+	task = g_task_new (NULL, state->cancellable, prepare_batch_done, batch);
+	g_task_set_task_data (task, batch, NULL);
+	g_task_run_in_thread (task, prepare_batch_thread);
+	g_object_unref (task);
+
+	state->enumerating = TRUE;
+	g_file_enumerator_next_files_async (state->enumerator,
+					    DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
+					    G_PRIORITY_DEFAULT,
+					    state->cancellable,
+					    more_files_callback,
+					    state);
 }
 
 static void
@@ -2014,6 +2591,7 @@ enumerate_children_callback (GObject *source_object,
 		return;
 	} else {
 		state->enumerator = enumerator;
+		state->enumerating = TRUE;
 		g_file_enumerator_next_files_async (state->enumerator,
 						    DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
 						    G_PRIORITY_DEFAULT,
@@ -2029,11 +2607,16 @@ static void
 start_monitoring_file_list (NautilusDirectory *directory)
 {
 	DirectoryLoadState *state;
+	NautilusFileTableIter iter;
+	NautilusFile *file;
 	
 	if (!directory->details->file_list_monitored) {
 		g_assert (!directory->details->directory_load_in_progress);
 		directory->details->file_list_monitored = TRUE;
-		nautilus_file_list_ref (directory->details->file_list);
+		nautilus_file_table_iter_init (&iter, directory->details->file_table);
+		while (nautilus_file_table_iter_next (&iter, &file)) {
+			nautilus_file_ref (file);
+		}
 	}
 
 	if (directory->details->directory_loaded  ||
@@ -2078,6 +2661,8 @@ start_monitoring_file_list (NautilusDirectory *directory)
 void
 nautilus_directory_stop_monitoring_file_list (NautilusDirectory *directory)
 {
+	GList *files;
+
 	if (!directory->details->file_list_monitored) {
 		g_assert (directory->details->directory_load_in_progress == NULL);
 		return;
@@ -2085,7 +2670,10 @@ nautilus_directory_stop_monitoring_file_list (NautilusDirectory *directory)
 
 	directory->details->file_list_monitored = FALSE;
 	file_list_cancel (directory);
-	nautilus_file_list_unref (directory->details->file_list);
+	/* Dropping the last reference removes the file from the table */
+	files = nautilus_file_table_get_list (directory->details->file_table);
+	nautilus_file_list_unref (files);
+	g_list_free (files);
 	directory->details->directory_loaded = FALSE;
 }
 
@@ -2134,13 +2722,14 @@ static void
 nautilus_directory_invalidate_file_attributes (NautilusDirectory      *directory,
 					       NautilusFileAttributes  file_attributes)
 {
-	GList *node;
+	NautilusFileTableIter iter;
+	NautilusFile *file;
 
 	cancel_loading_attributes (directory, file_attributes);
 
-	for (node = directory->details->file_list; node != NULL; node = node->next) {
-		nautilus_file_invalidate_attributes_internal (NAUTILUS_FILE (node->data),
-							      file_attributes);
+	nautilus_file_table_iter_init (&iter, directory->details->file_table);
+	while (nautilus_file_table_iter_next (&iter, &file)) {
+		nautilus_file_invalidate_attributes_internal (file, file_attributes);
 	}
 
 	if (directory->details->as_file != NULL) {
@@ -2483,126 +3072,378 @@ directory_count_start (NautilusDirectory *directory,
 	g_object_unref (location);
 }
 
-static inline gboolean
-seen_inode (DeepCountState *state,
-	    GFileInfo *info)
+static guint
+deep_count_inode_hash (gconstpointer key)
+{
+	const DeepCountInode *inode = key;
+
+	return (guint) (inode->inode ^ (inode->inode >> 32)) ^ (inode->device * 16777619u);
+}
+
+static gboolean
+deep_count_inode_equal (gconstpointer a,
+			gconstpointer b)
+{
+	const DeepCountInode *inode_a = a;
+	const DeepCountInode *inode_b = b;
+
+	return inode_a->inode == inode_b->inode &&
+		inode_a->device == inode_b->device;
+}
+
+/* Returns TRUE and fills in @key if the file may show up again through
+ * another hard link. Files with a single link can't, so there is no
+ * need to remember them.
+ */
+static gboolean
+get_linked_inode (GFileInfo *info,
+		  DeepCountInode *key)
+{
+	key->inode = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE);
+	if (key->inode == 0 ||
+	    g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY) {
+		return FALSE;
+	}
+
+	if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_UNIX_NLINK) &&
+	    g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_NLINK) <= 1) {
+		return FALSE;
+	}
+
+	key->device = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_DEVICE);
+	return TRUE;
+}
+
+/* Returns FALSE if the file was seen before, through another hard link */
+static gboolean
+mark_inode_as_seen (DeepCountState *state,
+		    const DeepCountInode *key)
+{
+	if (g_hash_table_contains (state->seen_deep_count_inodes, key)) {
+		return FALSE;
+	}
+
+	g_hash_table_add (state->seen_deep_count_inodes,
+			  g_memdup (key, sizeof (DeepCountInode)));
+	return TRUE;
+}
+
+/* The modification time of a directory, in microseconds, or 0 if it's
+ * not known.
+ */
+static guint64
+get_deep_count_mtime (GFileInfo *info)
+{
+	if (info == NULL ||
+	    !g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_TIME_MODIFIED)) {
+		return 0;
+	}
+
+	return g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC +
+		g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+}
+
+static void
+deep_count_add_directory (DeepCountState *state,
+			  GFile *location,
+			  guint64 mtime)
 {
-	guint64 inode, inode2;
-	guint i;
+	DeepCountDirectory *directory;
 
-	inode = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE);
+	directory = g_new0 (DeepCountDirectory, 1);
+	directory->location = g_object_ref (location);
+	directory->mtime = mtime;
+	directory->mtime_known = TRUE;
+	g_queue_push_head (&state->deep_count_subdirectories, directory);
+}
 
-	if (inode != 0) {
-		for (i = 0; i < state->seen_deep_count_inodes->len; i++) {
-			inode2 = g_array_index (state->seen_deep_count_inodes, guint64, i);
-			if (inode == inode2) {
-				return TRUE;
-			}
-		}
-	}
+/* Adds a directory whose modification time has to be looked up before
+ * its cache entry can be trusted.
+ */
+static void
+deep_count_add_directory_to_check (DeepCountState *state,
+				   GFile *location)
+{
+	DeepCountDirectory *directory;
 
-	return FALSE;
+	directory = g_new0 (DeepCountDirectory, 1);
+	directory->location = g_object_ref (location);
+	g_queue_push_head (&state->deep_count_subdirectories, directory);
 }
 
-static inline void
-mark_inode_as_seen (DeepCountState *state,
-		    GFileInfo *info)
+static void
+deep_count_directory_free (DeepCountDirectory *directory)
 {
-	guint64 inode;
-
-	inode = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE);
-	if (inode != 0) {
-		g_array_append_val (state->seen_deep_count_inodes, inode);
-	}
+	g_object_unref (directory->location);
+	g_free (directory);
 }
 
 static void
-deep_count_one (DeepCountState *state,
+deep_count_one (DeepCountLoad *load,
 		GFileInfo *info)
 {
+	DeepCountState *state;
+	NautilusDeepCountCacheEntry *entry;
 	NautilusFile *file;
 	GFile *subdir;
-	gboolean is_seen_inode;
+	DeepCountInode key;
+	gboolean is_linked, is_seen_inode;
 	const char *fs_id;
+	guint64 mtime;
+	goffset size;
 
 	if (should_skip_file (NULL, info)) {
 		return;
 	}
 
-	is_seen_inode = seen_inode (state, info);
-	if (!is_seen_inode) {
-		mark_inode_as_seen (state, info);
-	}
+	state = load->state;
+	entry = load->cache_entry;
+	is_linked = get_linked_inode (info, &key);
+	is_seen_inode = is_linked && !mark_inode_as_seen (state, &key);
 
 	file = state->directory->details->deep_count_file;
 
 	if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY) {
 		/* Count the directory. */
-		file->details->deep_directory_count += 1;
+		nautilus_file_get_cold_details (file)->deep_directory_count += 1;
 
-		/* Record the fact that we have to descend into this directory. */
 		fs_id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILESYSTEM);
+		mtime = get_deep_count_mtime (info);
+		if (entry != NULL) {
+			entry->directory_count += 1;
+			nautilus_deep_count_cache_entry_add_subdirectory
+				(entry, g_file_info_get_name (info), fs_id);
+		}
+
+		/* Record the fact that we have to descend into this directory. */
 		if (g_strcmp0 (fs_id, state->fs_id) == 0) {
 			/* only if it is on the same filesystem */
-			subdir = g_file_get_child (state->deep_count_location, g_file_info_get_name (info));
-			state->deep_count_subdirectories = g_list_prepend
-				(state->deep_count_subdirectories, subdir);
+			subdir = g_file_get_child (load->location, g_file_info_get_name (info));
+			deep_count_add_directory (state, subdir, mtime);
+			g_object_unref (subdir);
 		}
 	} else {
 		/* Even non-regular files count as files. */
-		file->details->deep_file_count += 1;
+		nautilus_file_get_cold_details (file)->deep_file_count += 1;
+		if (entry != NULL) {
+			entry->file_count += 1;
+		}
 	}
 
 	/* Count the size. */
-	if (!is_seen_inode && g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_STANDARD_SIZE)) {
-		file->details->deep_size += g_file_info_get_size (info);
+	if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_STANDARD_SIZE)) {
+		size = g_file_info_get_size (info);
+		if (!is_seen_inode) {
+			nautilus_file_get_cold_details (file)->deep_size += size;
+		}
+
+		if (entry != NULL) {
+			if (is_linked) {
+				nautilus_deep_count_cache_entry_add_linked_file
+					(entry, key.inode, key.device, size);
+			} else {
+				entry->size += size;
+			}
+		}
+	}
+}
+
+/* Counts @directory from what was found in it last time, if it didn't
+ * change since.
+ */
+static gboolean
+deep_count_use_cache (DeepCountState *state,
+		      DeepCountDirectory *directory)
+{
+	const NautilusDeepCountCacheEntry *entry;
+	const NautilusDeepCountLinkedFile *linked_file;
+	const NautilusDeepCountSubdirectory *subdirectory;
+	NautilusFile *file;
+	GFile *subdir;
+	DeepCountInode key;
+	guint i;
+
+	entry = nautilus_deep_count_cache_lookup (directory->location, directory->mtime);
+	if (entry == NULL) {
+		return FALSE;
+	}
+
+	file = state->directory->details->deep_count_file;
+
+	nautilus_file_get_cold_details (file)->deep_directory_count += entry->directory_count;
+	nautilus_file_get_cold_details (file)->deep_file_count += entry->file_count;
+	nautilus_file_get_cold_details (file)->deep_size += entry->size;
+
+	for (i = 0; i < entry->linked_files->len; i++) {
+		linked_file = &g_array_index (entry->linked_files, NautilusDeepCountLinkedFile, i);
+		key.inode = linked_file->inode;
+		key.device = linked_file->device;
+		if (mark_inode_as_seen (state, &key)) {
+			nautilus_file_get_cold_details (file)->deep_size += linked_file->size;
+		}
 	}
+
+	for (i = 0; i < entry->subdirectories->len; i++) {
+		subdirectory = &g_array_index (entry->subdirectories, NautilusDeepCountSubdirectory, i);
+		if (g_strcmp0 (subdirectory->fs_id, state->fs_id) == 0) {
+			subdir = g_file_get_child (directory->location, subdirectory->name);
+			deep_count_add_directory_to_check (state, subdir);
+			g_object_unref (subdir);
+		}
+	}
+
+	return TRUE;
 }
 
 static void
 deep_count_state_free (DeepCountState *state)
 {
-	if (state->enumerator) {
-		if (!g_file_enumerator_is_closed (state->enumerator)) {
-			g_file_enumerator_close_async (state->enumerator,
+	g_assert (state->n_loading == 0);
+
+	g_object_unref (state->cancellable);
+	g_queue_foreach (&state->deep_count_subdirectories, (GFunc) deep_count_directory_free, NULL);
+	g_queue_clear (&state->deep_count_subdirectories);
+	g_hash_table_destroy (state->seen_deep_count_inodes);
+	g_free (state->fs_id);
+	g_free (state);
+}
+
+/* Finishes @load, and starts loading the next directories, or finishes
+ * the whole count if there are none left.
+ */
+static void
+deep_count_load_done (DeepCountLoad *load)
+{
+	DeepCountState *state;
+
+	state = load->state;
+
+	if (load->enumerator) {
+		if (!g_file_enumerator_is_closed (load->enumerator)) {
+			g_file_enumerator_close_async (load->enumerator,
 						       0, NULL, NULL, NULL);
 		}
-		g_object_unref (state->enumerator);
+		g_object_unref (load->enumerator);
 	}
-	g_object_unref (state->cancellable);
-	if (state->deep_count_location) {
-		g_object_unref (state->deep_count_location);
+
+	if (load->cache_entry != NULL) {
+		if (load->complete && state->directory != NULL) {
+			nautilus_deep_count_cache_insert (load->location, load->cache_entry);
+		} else {
+			nautilus_deep_count_cache_entry_free (load->cache_entry);
+		}
 	}
-	g_list_free_full (state->deep_count_subdirectories, g_object_unref);
-	g_array_free (state->seen_deep_count_inodes, TRUE);
-	g_free (state->fs_id);
-	g_free (state);
+
+	g_object_unref (load->location);
+	g_free (load);
+
+	state->n_loading--;
+
+	if (state->directory == NULL) {
+		/* Operation was cancelled. Bail out once the other
+		 * directories have too.
+		 */
+		if (state->n_loading == 0) {
+			deep_count_state_free (state);
+		}
+		return;
+	}
+
+	deep_count_next_dir (state);
+}
+
+static void
+deep_count_got_mtime (GObject *source_object,
+		      GAsyncResult *res,
+		      gpointer user_data)
+{
+	DeepCountDirectory *directory;
+	DeepCountState *state;
+	GFileInfo *info;
+
+	directory = user_data;
+	state = directory->state;
+	state->n_loading--;
+
+	info = g_file_query_info_finish (G_FILE (source_object), res, NULL);
+
+	if (state->directory == NULL) {
+		/* Operation was cancelled. Bail out once the other
+		 * directories have too.
+		 */
+		g_clear_object (&info);
+		deep_count_directory_free (directory);
+		if (state->n_loading == 0) {
+			deep_count_state_free (state);
+		}
+		return;
+	}
+
+	/* Without a modification time, the directory is read again */
+	directory->mtime = get_deep_count_mtime (info);
+	directory->mtime_known = TRUE;
+	g_clear_object (&info);
+
+	g_queue_push_head (&state->deep_count_subdirectories, directory);
+	deep_count_next_dir (state);
+}
+
+/* Looks up the current modification time of @directory, which the deep
+ * count takes over, and queues it again once it's known.
+ */
+static void
+deep_count_check_mtime (DeepCountState *state,
+			DeepCountDirectory *directory)
+{
+	directory->state = state;
+	state->n_loading++;
+
+	g_file_query_info_async (directory->location,
+				 G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+				 G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+				 G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+				 G_PRIORITY_LOW,
+				 state->cancellable,
+				 deep_count_got_mtime,
+				 directory);
 }
 
 static void
 deep_count_next_dir (DeepCountState *state)
 {
-	GFile *location;
+	DeepCountDirectory *next;
 	NautilusFile *file;
 	NautilusDirectory *directory;
 	gboolean done;
 
 	directory = state->directory;
-	
-	g_object_unref (state->deep_count_location);
-	state->deep_count_location = NULL;
 
 	done = FALSE;
 	file = directory->details->deep_count_file;
 	
-	if (state->deep_count_subdirectories != NULL) {
-		/* Work on a new directory. */
-		location = state->deep_count_subdirectories->data;
-		state->deep_count_subdirectories = g_list_remove
-			(state->deep_count_subdirectories, location);
-		deep_count_load (state, location);
-		g_object_unref (location);
-	} else {
+	/* Work on new directories. The ones that didn't change since
+	 * they were last counted don't need to be read again.
+	 */
+	while ((next = g_queue_pop_head (&state->deep_count_subdirectories)) != NULL) {
+		if (!next->mtime_known) {
+			if (state->n_loading >= DEEP_COUNT_MAX_PARALLEL_LOADS) {
+				g_queue_push_head (&state->deep_count_subdirectories, next);
+				break;
+			}
+			deep_count_check_mtime (state, next);
+			continue;
+		}
+		if (!deep_count_use_cache (state, next)) {
+			if (state->n_loading >= DEEP_COUNT_MAX_PARALLEL_LOADS) {
+				g_queue_push_head (&state->deep_count_subdirectories, next);
+				break;
+			}
+			deep_count_load (state, next->location, next->mtime);
+		}
+		deep_count_directory_free (next);
+	}
+
+	if (state->n_loading == 0) {
 		file->details->deep_counts_status = NAUTILUS_REQUEST_DONE;
 		directory->details->deep_count_file = NULL;
 		directory->details->deep_count_in_progress = NULL;
@@ -2624,16 +3465,19 @@ deep_count_more_files_callback (GObject *source_object,
 				GAsyncResult *res,
 				gpointer user_data)
 {
+	DeepCountLoad *load;
 	DeepCountState *state;
 	NautilusDirectory *directory;
 	GList *files, *l;
 	GFileInfo *info;
+	GError *error;
 
-	state = user_data;
+	load = user_data;
+	state = load->state;
 
 	if (state->directory == NULL) {
 		/* Operation was cancelled. Bail out */
-		deep_count_state_free (state);
+		deep_count_load_done (load);
 		return;
 	}
 
@@ -2642,28 +3486,34 @@ deep_count_more_files_callback (GObject *source_object,
 	g_assert (directory->details->deep_count_in_progress != NULL);
 	g_assert (directory->details->deep_count_in_progress == state);
 
-	files = g_file_enumerator_next_files_finish (state->enumerator,
-						     res, NULL);
+	error = NULL;
+	files = g_file_enumerator_next_files_finish (load->enumerator,
+						     res, &error);
 
 	for (l = files; l != NULL; l = l->next)	{
 		info = l->data;
-		deep_count_one (state, info);
+		deep_count_one (load, info);
 		g_object_unref (info);
 	}
 	
 	if (files == NULL) {
-		g_file_enumerator_close_async (state->enumerator, 0, NULL, NULL, NULL);
-		g_object_unref (state->enumerator);
-		state->enumerator = NULL;
-		
-		deep_count_next_dir (state);
+		/* Only remember directories that were read through */
+		load->complete = error == NULL;
+		g_clear_error (&error);
+		deep_count_load_done (load);
 	} else {
-		g_file_enumerator_next_files_async (state->enumerator,
+		g_file_enumerator_next_files_async (load->enumerator,
 						    DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
 						    G_PRIORITY_LOW,
 						    state->cancellable,
 						    deep_count_more_files_callback,
-						    state);
+						    load);
+
+		/* Start on the subdirectories found so far, if there is room */
+		if (state->n_loading < DEEP_COUNT_MAX_PARALLEL_LOADS &&
+		    !g_queue_is_empty (&state->deep_count_subdirectories)) {
+			deep_count_next_dir (state);
+		}
 	}
 
 	g_list_free (files);
@@ -2676,59 +3526,74 @@ deep_count_callback (GObject *source_object,
 		     GAsyncResult *res,
 		     gpointer user_data)
 {
+	DeepCountLoad *load;
 	DeepCountState *state;
 	GFileEnumerator *enumerator;
 	NautilusFile *file;
 
-	state = user_data;
+	load = user_data;
+	state = load->state;
+
+	enumerator = g_file_enumerate_children_finish  (G_FILE (source_object),	res, NULL);
 
 	if (state->directory == NULL) {
 		/* Operation was cancelled. Bail out */
-		deep_count_state_free (state);
+		load->enumerator = enumerator;
+		deep_count_load_done (load);
 		return;
 	}
 
 	file = state->directory->details->deep_count_file;
-
-	enumerator = g_file_enumerate_children_finish  (G_FILE (source_object),	res, NULL);
 	
 	if (enumerator == NULL) {
-		file->details->deep_unreadable_count += 1;
+		nautilus_file_get_cold_details (file)->deep_unreadable_count += 1;
 		
-		deep_count_next_dir (state);
+		deep_count_load_done (load);
 	} else {
-		state->enumerator = enumerator;
-		g_file_enumerator_next_files_async (state->enumerator,
+		load->enumerator = enumerator;
+		g_file_enumerator_next_files_async (load->enumerator,
 						    DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
 						    G_PRIORITY_LOW,
 						    state->cancellable,
 						    deep_count_more_files_callback,
-						    state);
+						    load);
 	}
 }
 
 
 static void
-deep_count_load (DeepCountState *state, GFile *location)
+deep_count_load (DeepCountState *state, GFile *location, guint64 mtime)
 {
-	state->deep_count_location = g_object_ref (location);
+	DeepCountLoad *load;
+
+	load = g_new0 (DeepCountLoad, 1);
+	load->state = state;
+	load->location = g_object_ref (location);
+	if (mtime != 0) {
+		load->cache_entry = nautilus_deep_count_cache_entry_new (mtime);
+	}
+	state->n_loading++;
 
 #ifdef DEBUG_LOAD_DIRECTORY		
 	g_message ("load_directory called to get deep file count for %p", location);
 #endif	
-	g_file_enumerate_children_async (state->deep_count_location,
+	g_file_enumerate_children_async (load->location,
 					 G_FILE_ATTRIBUTE_STANDARD_NAME ","
 					 G_FILE_ATTRIBUTE_STANDARD_TYPE ","
 					 G_FILE_ATTRIBUTE_STANDARD_SIZE ","
 					 G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN ","
 					 G_FILE_ATTRIBUTE_STANDARD_IS_BACKUP ","
 					 G_FILE_ATTRIBUTE_ID_FILESYSTEM ","
-					 G_FILE_ATTRIBUTE_UNIX_INODE,
+					 G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+					 G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC ","
+					 G_FILE_ATTRIBUTE_UNIX_DEVICE ","
+					 G_FILE_ATTRIBUTE_UNIX_INODE ","
+					 G_FILE_ATTRIBUTE_UNIX_NLINK,
 					 G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, /* flags */
 					 G_PRIORITY_LOW, /* prio */
 					 state->cancellable,
 					 deep_count_callback,
-					 state);
+					 load);
 }
 
 static void
@@ -2760,16 +3625,27 @@ deep_count_got_info (GObject *source_object,
 {
 	GFileInfo *info;
 	const char *id;
+	guint64 mtime;
 	GFile *file = (GFile *)source_object;
 	DeepCountState *state = (DeepCountState *)user_data;
 
+	mtime = 0;
 	info = g_file_query_info_finish (file, res, NULL);
 	if (info != NULL) {
 		id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILESYSTEM);
 		state->fs_id = g_strdup (id);
+		mtime = get_deep_count_mtime (info);
 		g_object_unref (info);
 	}
-	deep_count_load (state, file);
+
+	if (state->directory == NULL) {
+		/* Operation was cancelled. Bail out */
+		deep_count_state_free (state);
+		return;
+	}
+
+	deep_count_add_directory (state, file, mtime);
+	deep_count_next_dir (state);
 }
 
 static void
@@ -2779,6 +3655,7 @@ deep_count_start (NautilusDirectory *directory,
 {
 	GFile *location;
 	DeepCountState *state;
+	NautilusFileColdDetails *cold;
 	
 	if (directory->details->deep_count_in_progress != NULL) {
 		*doing_io = TRUE;
@@ -2805,23 +3682,28 @@ deep_count_start (NautilusDirectory *directory,
 
 	/* Start counting. */
 	file->details->deep_counts_status = NAUTILUS_REQUEST_IN_PROGRESS;
-	file->details->deep_directory_count = 0;
-	file->details->deep_file_count = 0;
-	file->details->deep_unreadable_count = 0;
-	file->details->deep_size = 0;
+	cold = nautilus_file_get_cold_details (file);
+	cold->deep_directory_count = 0;
+	cold->deep_file_count = 0;
+	cold->deep_unreadable_count = 0;
+	cold->deep_size = 0;
 	directory->details->deep_count_file = file;
 
 	state = g_new0 (DeepCountState, 1);
 	state->directory = directory;
 	state->cancellable = g_cancellable_new ();
-	state->seen_deep_count_inodes = g_array_new (FALSE, TRUE, sizeof (guint64));
+	state->seen_deep_count_inodes = g_hash_table_new_full (deep_count_inode_hash,
+							       deep_count_inode_equal,
+							       g_free, NULL);
 	state->fs_id = NULL;
 
 	directory->details->deep_count_in_progress = state;
 	
 	location = nautilus_file_get_location (file);
 	g_file_query_info_async (location,
-				 G_FILE_ATTRIBUTE_ID_FILESYSTEM,
+				 G_FILE_ATTRIBUTE_ID_FILESYSTEM ","
+				 G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+				 G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
 				 G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
 				 G_PRIORITY_DEFAULT,
 				 NULL,
@@ -3460,17 +4342,13 @@ thumbnail_done (NautilusDirectory *directory,
 {
 	const char *thumb_mtime_str;
 	time_t thumb_mtime = 0;
+	char *uri;
 	
 	file->details->thumbnail_is_up_to_date = TRUE;
 	file->details->thumbnail_tried_original  = tried_original;
-	if (file->details->thumbnail) {
-		g_object_unref (file->details->thumbnail);
-		file->details->thumbnail = NULL;
-	}
-	if (file->details->scaled_thumbnail) {
-		g_object_unref (file->details->scaled_thumbnail);
-		file->details->scaled_thumbnail = NULL;
-	}
+	file->details->got_thumbnail = FALSE;
+
+	uri = nautilus_file_get_uri (file);
 
 	if (pixbuf) {
 		if (tried_original) {
@@ -3484,13 +4362,19 @@ thumbnail_done (NautilusDirectory *directory,
 		
 		if (thumb_mtime == 0 ||
 		    thumb_mtime == file->details->mtime) {
-			file->details->thumbnail = g_object_ref (pixbuf);
+			nautilus_thumbnail_cache_insert (uri, file->details->mtime, pixbuf);
+			file->details->got_thumbnail = TRUE;
 			file->details->thumbnail_mtime = thumb_mtime;
 		} else {
 			g_free (file->details->thumbnail_path);
 			file->details->thumbnail_path = NULL;
 		}
 	}
+
+	if (!file->details->got_thumbnail) {
+		nautilus_thumbnail_cache_remove (uri);
+	}
+	g_free (uri);
 	
 	nautilus_directory_async_state_changed (directory);
 }
@@ -3547,6 +4431,13 @@ thumbnail_state_free (ThumbnailState *state)
 
 extern int cached_thumbnail_size;
 
+static int
+get_max_thumbnail_size (void)
+{
+	/* cf. nautilus_file_get_icon() */
+	return NAUTILUS_CANVAS_ICON_SIZE_LARGER * cached_thumbnail_size / NAUTILUS_CANVAS_ICON_SIZE_SMALL;
+}
+
 /* scale very large images down to the max. size we need */
 static void
 thumbnail_loader_size_prepared (GdkPixbufLoader *loader,
@@ -3559,8 +4450,7 @@ thumbnail_loader_size_prepared (GdkPixbufLoader *loader,
 
 	aspect_ratio = ((double) width) / height;
 
-	/* cf. nautilus_file_get_icon() */
-	max_thumbnail_size = NAUTILUS_CANVAS_ICON_SIZE_LARGER * cached_thumbnail_size / NAUTILUS_CANVAS_ICON_SIZE_SMALL;
+	max_thumbnail_size = GPOINTER_TO_INT (user_data);
 	if (MAX (width, height) > max_thumbnail_size) {
 		if (width > height) {
 			width = max_thumbnail_size;
@@ -3587,7 +4477,7 @@ get_pixbuf_for_content (goffset file_len,
 	loader = gdk_pixbuf_loader_new ();
 	g_signal_connect (loader, "size-prepared",
 			  G_CALLBACK (thumbnail_loader_size_prepared),
-			  NULL);
+			  GINT_TO_POINTER (get_max_thumbnail_size ()));
 
 	/* For some reason we have to write in chunks, or gdk-pixbuf fails */
 	res = TRUE;
@@ -3613,6 +4503,54 @@ get_pixbuf_for_content (goffset file_len,
 	return pixbuf;
 }
 
+/* Like get_pixbuf_for_content(), but without having the whole file in
+ * memory at once.
+ */
+static GdkPixbuf *
+get_pixbuf_for_stream (GInputStream *stream,
+		       int max_thumbnail_size,
+		       GCancellable *cancellable)
+{
+	gboolean res;
+	GdkPixbuf *pixbuf, *pixbuf2;
+	GdkPixbufLoader *loader;
+	guchar *buffer;
+	gssize chunk_len;
+
+	pixbuf = NULL;
+
+	loader = gdk_pixbuf_loader_new ();
+	g_signal_connect (loader, "size-prepared",
+			  G_CALLBACK (thumbnail_loader_size_prepared),
+			  GINT_TO_POINTER (max_thumbnail_size));
+
+	buffer = g_malloc (READ_CHUNK_SIZE);
+	res = TRUE;
+	while (res) {
+		chunk_len = g_input_stream_read (stream, buffer, READ_CHUNK_SIZE,
+						 cancellable, NULL);
+		if (chunk_len <= 0) {
+			res = chunk_len == 0;
+			break;
+		}
+		res = gdk_pixbuf_loader_write (loader, buffer, chunk_len, NULL);
+	}
+	g_free (buffer);
+
+	/* The loader has to be closed even when it failed */
+	res = gdk_pixbuf_loader_close (loader, NULL) && res;
+	if (res) {
+		pixbuf = g_object_ref (gdk_pixbuf_loader_get_pixbuf (loader));
+	}
+	g_object_unref (G_OBJECT (loader));
+
+	if (pixbuf) {
+		pixbuf2 = gdk_pixbuf_apply_embedded_orientation (pixbuf);
+		g_object_unref (pixbuf);
+		pixbuf = pixbuf2;
+	}
+	return pixbuf;
+}
 
 static void
 thumbnail_read_callback (GObject *source_object,
@@ -3625,7 +4563,6 @@ thumbnail_read_callback (GObject *source_object,
 	gboolean result;
 	NautilusDirectory *directory;
 	GdkPixbuf *pixbuf;
-	GFile *location;
 
 	state = user_data;
 
@@ -3648,9 +4585,81 @@ thumbnail_read_callback (GObject *source_object,
 		g_free (file_contents);
 	}
 	
-	if (pixbuf == NULL && state->trying_original) {
-		state->trying_original = FALSE;
+	state->directory->details->thumbnail_state = NULL;
+	async_job_end (state->directory, "thumbnail");
 
+	thumbnail_got_pixbuf (state->directory, state->file, pixbuf, state->tried_original);
+
+	thumbnail_state_free (state);
+	
+	nautilus_directory_unref (directory);
+}
+
+static void
+thumbnail_original_thread (GTask *task,
+			   gpointer source_object,
+			   gpointer task_data,
+			   GCancellable *cancellable)
+{
+	ThumbnailOriginalLoad *load;
+	GFileInputStream *stream;
+	GdkPixbuf *pixbuf;
+
+	load = task_data;
+
+	/* A preview large enough for the thumbnail only needs a few
+	   byte ranges of the photo read and decoded */
+	pixbuf = NULL;
+	if (load->try_embedded_preview) {
+		pixbuf = nautilus_embedded_preview_load (load->location,
+							 load->max_thumbnail_size,
+							 cancellable);
+	}
+
+	if (pixbuf == NULL) {
+		stream = g_file_read (load->location, cancellable, NULL);
+		if (stream != NULL) {
+			pixbuf = get_pixbuf_for_stream (G_INPUT_STREAM (stream),
+							load->max_thumbnail_size,
+							cancellable);
+			g_object_unref (stream);
+		}
+	}
+
+	g_task_return_pointer (task, pixbuf, g_object_unref);
+}
+
+static void
+thumbnail_original_load_free (ThumbnailOriginalLoad *load)
+{
+	g_object_unref (load->location);
+	g_free (load);
+}
+
+static void
+thumbnail_original_callback (GObject *source_object,
+			     GAsyncResult *res,
+			     gpointer user_data)
+{
+	ThumbnailState *state;
+	NautilusDirectory *directory;
+	GdkPixbuf *pixbuf;
+	GFile *location;
+
+	state = user_data;
+
+	if (state->directory == NULL) {
+		/* Operation was cancelled. Bail out */
+		thumbnail_state_free (state);
+		return;
+	}
+
+	directory = nautilus_directory_ref (state->directory);
+
+	pixbuf = g_task_propagate_pointer (G_TASK (res), NULL);
+
+	if (pixbuf == NULL) {
+		/* Fall back to the thumbnail */
 		location = g_file_new_for_path (state->file->details->thumbnail_path);
 		g_file_load_contents_async (location,
 					    state->cancellable,
@@ -3660,12 +4669,12 @@ thumbnail_read_callback (GObject *source_object,
 	} else {
 		state->directory->details->thumbnail_state = NULL;
 		async_job_end (state->directory, "thumbnail");
-		
+
 		thumbnail_got_pixbuf (state->directory, state->file, pixbuf, state->tried_original);
-	
+
 		thumbnail_state_free (state);
 	}
-	
+
 	nautilus_directory_unref (directory);
 }
 
@@ -3676,6 +4685,10 @@ thumbnail_start (NautilusDirectory *directory,
 {
 	GFile *location;
 	ThumbnailState *state;
+	ThumbnailOriginalLoad *load;
+	GTask *task;
+	GdkPixbuf *pixbuf;
+	char *uri, *mime_type;
 
 	if (directory->details->thumbnail_state != NULL) {
 		*doing_io = TRUE;
@@ -3689,6 +4702,19 @@ thumbnail_start (NautilusDirectory *directory,
 	}
 	*doing_io = TRUE;
 
+	/* Thumbnails shown recently are still in memory, for example when
+	   going back to a folder */
+	if (!file->details->thumbnail_wants_original) {
+		uri = nautilus_file_get_uri (file);
+		pixbuf = nautilus_thumbnail_cache_lookup (uri, file->details->mtime, 0);
+		g_free (uri);
+
+		if (pixbuf != NULL) {
+			thumbnail_got_pixbuf (directory, file, pixbuf, FALSE);
+			return;
+		}
+	}
+
 	if (!async_job_start (directory, "thumbnail")) {
 		return;
 	}
@@ -3698,16 +4724,26 @@ thumbnail_start (NautilusDirectory *directory,
 	state->file = file;
 	state->cancellable = g_cancellable_new ();
 
+	directory->details->thumbnail_state = state;
+
 	if (file->details->thumbnail_wants_original) {
 		state->tried_original = TRUE;
-		state->trying_original = TRUE;
-		location = nautilus_file_get_location (file);
-	} else {
-		location = g_file_new_for_path (file->details->thumbnail_path);
+
+		load = g_new0 (ThumbnailOriginalLoad, 1);
+		load->location = nautilus_file_get_location (file);
+		load->max_thumbnail_size = get_max_thumbnail_size ();
+		mime_type = nautilus_file_get_mime_type (file);
+		load->try_embedded_preview = nautilus_embedded_preview_is_supported_type (mime_type);
+		g_free (mime_type);
+
+		task = g_task_new (NULL, state->cancellable, thumbnail_original_callback, state);
+		g_task_set_task_data (task, load, (GDestroyNotify) thumbnail_original_load_free);
+		g_task_run_in_thread (task, thumbnail_original_thread);
+		g_object_unref (task);
+		return;
 	}
-	
-	directory->details->thumbnail_state = state;
 
+	location = g_file_new_for_path (file->details->thumbnail_path);
 	g_file_load_contents_async (location,
 				    state->cancellable,
 				    thumbnail_read_callback,
@@ -3910,7 +4946,7 @@ filesystem_info_cancel (NautilusDirectory *directory)
 		g_cancellable_cancel (directory->details->filesystem_info_state->cancellable);
 		directory->details->filesystem_info_state->directory = NULL;
 		directory->details->filesystem_info_state = NULL;
-		async_job_end (directory, "filesystem info");
+		async_job_cancel (directory, "filesystem info");
 	}
 }
 
@@ -3950,6 +4986,7 @@ got_filesystem_info (FilesystemInfoState *state, GFileInfo *info)
 	NautilusDirectory *directory;
 	NautilusFile *file;
         const char *filesystem_type;
+	NautilusFileColdDetails *cold;
 
 	/* careful here, info may be NULL */
 
@@ -3967,9 +5004,10 @@ got_filesystem_info (FilesystemInfoState *state, GFileInfo *info)
 		file->details->filesystem_readonly = 
 			g_file_info_get_attribute_boolean (info, G_FILE_ATTRIBUTE_FILESYSTEM_READONLY);
                 filesystem_type = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_FILESYSTEM_TYPE);
-                if (g_strcmp0 (eel_ref_str_peek (file->details->filesystem_type), filesystem_type) != 0) {
-                        eel_ref_str_unref (file->details->filesystem_type);
-		        file->details->filesystem_type = eel_ref_str_get_unique (filesystem_type);
+                if (g_strcmp0 (eel_ref_str_peek (nautilus_file_peek_cold_details (file)->filesystem_type), filesystem_type) != 0) {
+                        cold = nautilus_file_get_cold_details (file);
+                        eel_ref_str_unref (cold->filesystem_type);
+		        cold->filesystem_type = eel_ref_str_get_unique (filesystem_type);
                 }
 	}
 	
@@ -4330,9 +5368,7 @@ nautilus_directory_cancel (NautilusDirectory *directory)
 	filesystem_info_cancel (directory);
 
 	/* We aren't waiting for anything any more. */
-	if (waiting_directories != NULL) {
-		g_hash_table_remove (waiting_directories, directory);
-	}
+	stop_waiting (directory);
 
 	/* Check if any directories should wake up. */
 	async_job_wake_up ();
@@ -4512,12 +5548,11 @@ nautilus_directory_add_file_to_work_queue (NautilusDirectory *directory,
 static void
 add_all_files_to_work_queue (NautilusDirectory *directory)
 {
-	GList *node;
+	NautilusFileTableIter iter;
 	NautilusFile *file;
-	
-	for (node = directory->details->file_list; node != NULL; node = node->next) {
-		file = NAUTILUS_FILE (node->data);
 
+	nautilus_file_table_iter_init (&iter, directory->details->file_table);
+	while (nautilus_file_table_iter_next (&iter, &file)) {
 		nautilus_directory_add_file_to_work_queue (directory, file);
 	}
 }
@@ -23,6 +23,7 @@
 #include <eel/eel-vfs-extensions.h>
 #include "nautilus-directory.h"
 #include "nautilus-file-queue.h"
+#include "nautilus-file-table.h"
 #include "nautilus-file.h"
 #include "nautilus-monitor.h"
 #include <libnautilus-extension/nautilus-info-provider.h>
@@ -40,6 +41,8 @@ typedef struct MimeListState MimeListState;
 typedef struct ThumbnailState ThumbnailState;
 typedef struct MountState MountState;
 typedef struct FilesystemInfoState FilesystemInfoState;
+typedef struct AsyncJob AsyncJob;
+typedef struct AsyncBackend AsyncBackend;
 
 typedef enum {
 	REQUEST_LINK_INFO,
@@ -69,8 +72,7 @@ struct NautilusDirectoryDetails
 
 	/* The file objects. */
 	NautilusFile *as_file;
-	GList *file_list;
-	GHashTable *file_hash;
+	NautilusFileTable *file_table;
 
 	/* Queues of files needing some I/O done. */
 	NautilusFileQueue *high_priority_queue;
@@ -88,10 +90,16 @@ struct NautilusDirectoryDetails
 
 	NautilusMonitor *monitor;
 	gulong 		 mime_db_monitor;
+	/* Views showing the directory as their location */
+	int n_views_shown;
 
 	gboolean in_async_service_loop;
 	gboolean state_changed;
 
+	GList *async_jobs_running; /* list of AsyncJob * */
+	AsyncBackend *async_backend; /* once its key is known for sure */
+	int focus_count;
+
 	gboolean file_list_monitored;
 	gboolean directory_loaded;
 	gboolean directory_loaded_sent_notification;
@@ -210,11 +218,11 @@ void               nautilus_directory_add_file_monitors               (NautilusD
 								       FileMonitors              *monitors);
 void               nautilus_directory_add_file                        (NautilusDirectory         *directory,
 								       NautilusFile              *file);
-GList *            nautilus_directory_begin_file_name_change          (NautilusDirectory         *directory,
+gint               nautilus_directory_begin_file_name_change          (NautilusDirectory         *directory,
 								       NautilusFile              *file);
 void               nautilus_directory_end_file_name_change            (NautilusDirectory         *directory,
 								       NautilusFile              *file,
-								       GList                     *node);
+								       gint                       slot);
 void               nautilus_directory_moved                           (const char                *from_uri,
 								       const char                *to_uri);
 /* Interface to the work queue. */
@@ -22,12 +22,14 @@
 #include <config.h>
 #include "nautilus-directory-private.h"
 
+#include "nautilus-deep-count-cache.h"
 #include "nautilus-directory-notify.h"
 #include "nautilus-file-attributes.h"
 #include "nautilus-file-private.h"
 #include "nautilus-file-utilities.h"
 #include "nautilus-search-directory.h"
 #include "nautilus-search-directory-file.h"
+#include "nautilus-search-index.h"
 #include "nautilus-vfs-file.h"
 #include "nautilus-global-preferences.h"
 #include "nautilus-lib-self-check-functions.h"
@@ -171,7 +173,7 @@ static void
 nautilus_directory_init (NautilusDirectory *directory)
 {
 	directory->details = G_TYPE_INSTANCE_GET_PRIVATE ((directory), NAUTILUS_TYPE_DIRECTORY, NautilusDirectoryDetails);
-	directory->details->file_hash = g_hash_table_new (g_str_hash, g_str_equal);
+	directory->details->file_table = nautilus_file_table_new ();
 	directory->details->high_priority_queue = nautilus_file_queue_new ();
 	directory->details->low_priority_queue = nautilus_file_queue_new ();
 	directory->details->extension_queue = nautilus_file_queue_new ();
@@ -235,8 +237,8 @@ nautilus_directory_finalize (GObject *object)
 		g_object_unref (directory->details->location);
 	}
 
-	g_assert (directory->details->file_list == NULL);
-	g_hash_table_destroy (directory->details->file_hash);
+	g_assert (nautilus_file_table_get_length (directory->details->file_table) == 0);
+	nautilus_file_table_destroy (directory->details->file_table);
 
 	nautilus_file_queue_destroy (directory->details->high_priority_queue);
 	nautilus_file_queue_destroy (directory->details->low_priority_queue);
@@ -288,7 +290,7 @@ emit_change_signals_for_all_files (NautilusDirectory *directory)
 {
 	GList *files;
 
-	files = g_list_copy (directory->details->file_list);
+	files = nautilus_file_table_get_list (directory->details->file_table);
 	if (directory->details->as_file != NULL) {
 		files = g_list_prepend (files, directory->details->as_file);
 	}
@@ -727,53 +729,18 @@ nautilus_directory_are_all_files_seen (NautilusDirectory *directory)
 	return NAUTILUS_DIRECTORY_CLASS (G_OBJECT_GET_CLASS (directory))->are_all_files_seen (directory);
 }
 
-static void
-add_to_hash_table (NautilusDirectory *directory, NautilusFile *file, GList *node)
-{
-	const char *name;
-
-	name = eel_ref_str_peek (file->details->name);
-
-	g_assert (node != NULL);
-	g_assert (g_hash_table_lookup (directory->details->file_hash,
-				       name) == NULL);
-	g_hash_table_insert (directory->details->file_hash, (char *) name, node);
-}
-
-static GList *
-extract_from_hash_table (NautilusDirectory *directory, NautilusFile *file)
-{
-	const char *name;
-	GList *node;
-
-	name = eel_ref_str_peek (file->details->name);
-	if (name == NULL) {
-		return NULL;
-	}
-
-	/* Find the list node in the hash table. */
-	node = g_hash_table_lookup (directory->details->file_hash, name);
-	g_hash_table_remove (directory->details->file_hash, name);
-
-	return node;
-}
-
 void
 nautilus_directory_add_file (NautilusDirectory *directory, NautilusFile *file)
 {
-	GList *node;
 	gboolean add_to_work_queue;
 
 	g_assert (NAUTILUS_IS_DIRECTORY (directory));
 	g_assert (NAUTILUS_IS_FILE (file));
 	g_assert (file->details->name != NULL);
+	g_assert (nautilus_file_table_lookup (directory->details->file_table,
+					      eel_ref_str_peek (file->details->name)) == NULL);
 
-	/* Add to list. */
-	node = g_list_prepend (directory->details->file_list, file);
-	directory->details->file_list = node;
-
-	/* Add to hash table. */
-	add_to_hash_table (directory, file, node);
+	nautilus_file_table_add (directory->details->file_table, file);
 
 	directory->details->confirmed_file_count++;
 
@@ -797,21 +764,11 @@ nautilus_directory_add_file (NautilusDirectory *directory, NautilusFile *file)
 void
 nautilus_directory_remove_file (NautilusDirectory *directory, NautilusFile *file)
 {
-	GList *node;
-
 	g_assert (NAUTILUS_IS_DIRECTORY (directory));
 	g_assert (NAUTILUS_IS_FILE (file));
 	g_assert (file->details->name != NULL);
 
-	/* Find the list node in the hash table. */
-	node = extract_from_hash_table (directory, file);
-	g_assert (node != NULL);
-	g_assert (node->data == file);
-
-	/* Remove the item from the list. */
-	directory->details->file_list = g_list_remove_link
-		(directory->details->file_list, node);
-	g_list_free_1 (node);
+	nautilus_file_table_remove (directory->details->file_table, file);
 
 	nautilus_directory_remove_file_from_work_queue (directory, file);
 
@@ -825,22 +782,22 @@ nautilus_directory_remove_file (NautilusDirectory *directory, NautilusFile *file
 	}
 }
 
-GList *
+gint
 nautilus_directory_begin_file_name_change (NautilusDirectory *directory,
 					   NautilusFile *file)
 {
-	/* Find the list node in the hash table. */
-	return extract_from_hash_table (directory, file);
+	/* Stop finding the file by its old name. */
+	return nautilus_file_table_unlink_name (directory->details->file_table, file);
 }
 
 void
 nautilus_directory_end_file_name_change (NautilusDirectory *directory,
 					 NautilusFile *file,
-					 GList *node)
+					 gint slot)
 {
-	/* Add the list node to the hash table. */
-	if (node != NULL) {
-		add_to_hash_table (directory, file, node);
+	/* Find the file by its new name. */
+	if (slot >= 0) {
+		nautilus_file_table_link_name (directory->details->file_table, slot);
 	}
 }
 
@@ -848,14 +805,10 @@ NautilusFile *
 nautilus_directory_find_file_by_name (NautilusDirectory *directory,
 				      const char *name)
 {
-	GList *node;
-
 	g_return_val_if_fail (NAUTILUS_IS_DIRECTORY (directory), NULL);
 	g_return_val_if_fail (name != NULL, NULL);
 
-	node = g_hash_table_lookup (directory->details->file_hash,
-				    name);
-	return node == NULL ? NULL : NAUTILUS_FILE (node->data);
+	return nautilus_file_table_lookup (directory->details->file_table, name);
 }
 
 void
@@ -1061,6 +1014,9 @@ nautilus_directory_notify_files_added (GList *files)
 
 	nautilus_profile_start (NULL);
 
+	nautilus_search_index_notify_files_added (files);
+	nautilus_deep_count_cache_notify_files_changed (files);
+
 	/* Make a list of added files in each directory. */
 	added_lists = g_hash_table_new (NULL, NULL);
 
@@ -1142,6 +1098,9 @@ nautilus_directory_notify_files_changed (GList *files)
 	GFile *location;
 	NautilusFile *file;
 
+	nautilus_search_index_notify_files_changed (files);
+	nautilus_deep_count_cache_notify_files_changed (files);
+
 	/* Make a list of changed files in each directory. */
 	changed_lists = g_hash_table_new (NULL, NULL);
 
@@ -1180,6 +1139,9 @@ nautilus_directory_notify_files_removed (GList *files)
 	NautilusFile *file;
 	GFile *location;
 
+	nautilus_search_index_notify_files_removed (files);
+	nautilus_deep_count_cache_notify_files_changed (files);
+
 	/* Make a list of changed files in each directory. */
 	changed_lists = g_hash_table_new (NULL, NULL);
 
@@ -1226,6 +1188,8 @@ set_directory_location (NautilusDirectory *directory,
 		g_object_unref (directory->details->location);
 	}
 	directory->details->location = g_object_ref (location);
+	/* It may have moved to another file system */
+	directory->details->async_backend = NULL;
 
 	g_object_notify_by_pspec (G_OBJECT (directory), properties[PROP_LOCATION]);
 }
@@ -1322,7 +1286,7 @@ nautilus_directory_moved_internal (GFile *old_location,
 			}
 			affected_files = g_list_concat
 				(affected_files,
-				 nautilus_file_list_copy (directory->details->file_list));
+				 nautilus_file_list_ref (nautilus_file_table_get_list (directory->details->file_table)));
 		}
 		
 		nautilus_directory_unref (directory);
@@ -1377,6 +1341,9 @@ nautilus_directory_notify_files_moved (GList *file_pairs)
 	char *name;
 	NautilusFileAttributes cancel_attributes;
 	GFile *to_location, *from_location;
+
+	nautilus_search_index_notify_files_moved (file_pairs);
+	nautilus_deep_count_cache_notify_files_moved (file_pairs);
 	
 	/* Make a list of added and changed files in each directory. */
 	new_files_list = NULL;
@@ -1638,6 +1605,25 @@ nautilus_directory_force_reload (NautilusDirectory *directory)
 	NAUTILUS_DIRECTORY_CLASS (G_OBJECT_GET_CLASS (directory))->force_reload (directory);
 }
 
+void
+nautilus_directory_set_shown_in_view (NautilusDirectory *directory,
+				      gboolean shown)
+{
+	g_return_if_fail (NAUTILUS_IS_DIRECTORY (directory));
+
+	if (shown) {
+		directory->details->n_views_shown++;
+	} else {
+		g_return_if_fail (directory->details->n_views_shown > 0);
+		directory->details->n_views_shown--;
+	}
+
+	if (directory->details->monitor != NULL) {
+		nautilus_monitor_set_shown (directory->details->monitor,
+					    directory->details->n_views_shown > 0);
+	}
+}
+
 gboolean
 nautilus_directory_is_not_empty (NautilusDirectory *directory)
 {
@@ -1668,11 +1654,19 @@ nautilus_directory_get_file_list (NautilusDirectory *directory)
 static GList *
 real_get_file_list (NautilusDirectory *directory)
 {
-	GList *tentative_files, *non_tentative_files;
+	NautilusFileTableIter iter;
+	NautilusFile *file;
+	GList *non_tentative_files;
+
+	non_tentative_files = NULL;
 
-	tentative_files = nautilus_file_list_filter (directory->details->file_list,
-                                                     &non_tentative_files, is_tentative, NULL);
-	nautilus_file_list_free (tentative_files);
+	nautilus_file_table_iter_init (&iter, directory->details->file_table);
+	while (nautilus_file_table_iter_next (&iter, &file)) {
+		if (!is_tentative (file, NULL)) {
+			non_tentative_files = g_list_prepend (non_tentative_files,
+							      nautilus_file_ref (file));
+		}
+	}
 
 	return non_tentative_files;
 }
@@ -1911,7 +1905,7 @@ nautilus_self_check_directory (void)
 		gtk_main_iteration ();
 	}
 
-	EEL_CHECK_BOOLEAN_RESULT (directory->details->file_list == NULL, TRUE);
+	EEL_CHECK_INTEGER_RESULT (nautilus_file_table_get_length (directory->details->file_table), 0);
 
 	EEL_CHECK_INTEGER_RESULT (g_hash_table_size (directories), 1);
 
@@ -207,6 +207,13 @@ void               nautilus_directory_file_monitor_remove      (NautilusDirector
 								gconstpointer              client);
 void               nautilus_directory_force_reload             (NautilusDirectory         *directory);
 
+/* Views call this with TRUE when they start showing @directory as
+ * their location and with FALSE when they stop. These directories keep
+ * being watched for changes when watches run out.
+ */
+void               nautilus_directory_set_shown_in_view        (NautilusDirectory         *directory,
+								gboolean                   shown);
+
 /* Get a list of all files currently known in the directory. */
 GList *            nautilus_directory_get_file_list            (NautilusDirectory         *directory);
 
@@ -227,6 +234,13 @@ gboolean           nautilus_directory_is_in_trash              (NautilusDirector
 gboolean           nautilus_directory_is_in_recent             (NautilusDirectory         *directory);
 gboolean           nautilus_directory_is_remote                (NautilusDirectory         *directory);
 
+/* Mark the directory as shown in the focused view, or not anymore.
+ * Its I/O is scheduled ahead of that of background directories while
+ * focused. Calls have to be balanced.
+ */
+void               nautilus_directory_set_focused              (NautilusDirectory         *directory,
+								gboolean                   focused);
+
 /* Return false if directory contains anything besides a Nautilus metafile.
  * Only valid if directory is monitored. Used by the Trash monitor.
  */
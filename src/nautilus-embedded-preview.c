@@ -0,0 +1,522 @@
+/*
+   Copyright (C) 2016 Red Hat, Inc
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <config.h>
+#include "nautilus-embedded-preview.h"
+
+#include <string.h>
+
+/* The EXIF data of a JPEG is in its first 64 kB, and the frame header
+ * of a preview, with its dimensions, is in its first few.
+ */
+#define HEADER_READ_SIZE (64 * 1024)
+
+/* Limits against corrupt files */
+#define MAX_IFDS 16
+#define MAX_IFD_ENTRIES 1024
+#define MAX_SUB_IFDS 8
+#define MAX_CANDIDATES 16
+#define MAX_PREVIEW_LENGTH (64 * 1024 * 1024)
+
+#define TAG_COMPRESSION 0x0103
+#define TAG_STRIP_OFFSETS 0x0111
+#define TAG_ORIENTATION 0x0112
+#define TAG_STRIP_BYTE_COUNTS 0x0117
+#define TAG_SUB_IFDS 0x014a
+#define TAG_JPEG_OFFSET 0x0201
+#define TAG_JPEG_LENGTH 0x0202
+
+#define TYPE_SHORT 3
+#define TYPE_LONG 4
+#define TYPE_IFD 13
+
+#define COMPRESSION_OLD_JPEG 6
+#define COMPRESSION_JPEG 7
+
+/* Where a Fujifilm RAF file keeps the offset and length of its JPEG */
+#define RAF_JPEG_POSITION 84
+
+typedef struct {
+	goffset offset;
+	gsize length;
+	int width;
+	int height;
+} Candidate;
+
+typedef struct {
+	GInputStream *stream;
+	GCancellable *cancellable;
+
+	/* Where the TIFF structure starts in the file */
+	goffset base;
+	gboolean big_endian;
+	int n_ifds;
+
+	/* Of the photo, as found in the first IFD */
+	int orientation;
+
+	Candidate candidates[MAX_CANDIDATES];
+	int n_candidates;
+} PreviewReader;
+
+gboolean
+nautilus_embedded_preview_is_supported_type (const char *mime_type)
+{
+	/* The raw formats are all subclasses of this one */
+	return g_content_type_is_a (mime_type, "image/x-dcraw") ||
+	       g_content_type_is_a (mime_type, "image/jpeg") ||
+	       g_content_type_is_a (mime_type, "image/tiff");
+}
+
+static gboolean
+read_at (PreviewReader *reader,
+	 goffset        offset,
+	 void          *buffer,
+	 gsize          size,
+	 gsize         *bytes_read)
+{
+	return g_seekable_seek (G_SEEKABLE (reader->stream), offset, G_SEEK_SET,
+				reader->cancellable, NULL) &&
+	       g_input_stream_read_all (reader->stream, buffer, size, bytes_read,
+					reader->cancellable, NULL);
+}
+
+static gboolean
+read_exactly (PreviewReader *reader,
+	      goffset        offset,
+	      void          *buffer,
+	      gsize          size)
+{
+	gsize bytes_read;
+
+	return read_at (reader, offset, buffer, size, &bytes_read) && bytes_read == size;
+}
+
+static guint16
+get_u16 (PreviewReader *reader,
+	 const guchar  *p)
+{
+	return reader->big_endian ?
+		(p[0] << 8) | p[1] :
+		p[0] | (p[1] << 8);
+}
+
+static guint32
+get_u32 (PreviewReader *reader,
+	 const guchar  *p)
+{
+	return reader->big_endian ?
+		((guint32) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3] :
+		p[0] | (p[1] << 8) | (p[2] << 16) | ((guint32) p[3] << 24);
+}
+
+/* Finds the dimensions in the frame header of the JPEG in @data */
+static gboolean
+get_jpeg_size (const guchar *data,
+	       gsize         length,
+	       int          *width,
+	       int          *height)
+{
+	gsize i;
+	guchar marker;
+
+	if (length < 4 || data[0] != 0xff || data[1] != 0xd8) {
+		return FALSE;
+	}
+
+	i = 2;
+	while (i + 4 <= length) {
+		if (data[i] != 0xff) {
+			return FALSE;
+		}
+
+		marker = data[i + 1];
+		if (marker == 0xff) {
+			/* Fill byte */
+			i++;
+			continue;
+		}
+
+		/* Baseline, extended and progressive frames. Raw files
+		   keep their raw data as lossless JPEG, which isn't a
+		   preview, and which gdk-pixbuf can't decode anyway. */
+		if (marker == 0xc0 || marker == 0xc1 || marker == 0xc2) {
+			if (i + 9 > length) {
+				return FALSE;
+			}
+			*height = (data[i + 5] << 8) | data[i + 6];
+			*width = (data[i + 7] << 8) | data[i + 8];
+			return *width > 0 && *height > 0;
+		}
+
+		if (marker == 0xda ||
+		    (marker >= 0xc3 && marker <= 0xcf &&
+		     marker != 0xc4 && marker != 0xc8 && marker != 0xcc)) {
+			return FALSE;
+		}
+
+		i += 2 + ((data[i + 2] << 8) | data[i + 3]);
+	}
+
+	return FALSE;
+}
+
+static void
+add_candidate (PreviewReader *reader,
+	       goffset        offset,
+	       gsize          length)
+{
+	Candidate *candidate;
+	guchar *header;
+	gsize bytes_read;
+
+	if (reader->n_candidates == MAX_CANDIDATES ||
+	    length == 0 || length > MAX_PREVIEW_LENGTH) {
+		return;
+	}
+
+	candidate = &reader->candidates[reader->n_candidates];
+	candidate->offset = offset;
+	candidate->length = length;
+
+	header = g_malloc (MIN (length, HEADER_READ_SIZE));
+	if (read_at (reader, offset, header, MIN (length, HEADER_READ_SIZE), &bytes_read) &&
+	    get_jpeg_size (header, bytes_read, &candidate->width, &candidate->height)) {
+		reader->n_candidates++;
+	}
+	g_free (header);
+}
+
+static void
+read_ifd (PreviewReader *reader,
+	  guint32        offset,
+	  int            depth,
+	  guint32       *next)
+{
+	guchar count[2], *entries, *p;
+	guint n_entries, n_sub_ifds, i, j;
+	guint16 tag, type;
+	guint32 value, value_count;
+	guint32 jpeg_offset, jpeg_length, strip_offset, strip_length, compression;
+	guint32 sub_ifds[MAX_SUB_IFDS];
+	guchar sub_ifd_offsets[MAX_SUB_IFDS * 4];
+	guint32 unused;
+
+	*next = 0;
+
+	if (reader->n_ifds++ >= MAX_IFDS ||
+	    !read_exactly (reader, reader->base + offset, count, 2)) {
+		return;
+	}
+
+	n_entries = get_u16 (reader, count);
+	if (n_entries == 0 || n_entries > MAX_IFD_ENTRIES) {
+		return;
+	}
+
+	/* The entries, followed by the offset of the next IFD */
+	entries = g_malloc (n_entries * 12 + 4);
+	if (!read_exactly (reader, reader->base + offset + 2, entries, n_entries * 12 + 4)) {
+		g_free (entries);
+		return;
+	}
+
+	jpeg_offset = jpeg_length = 0;
+	strip_offset = strip_length = 0;
+	compression = 0;
+	n_sub_ifds = 0;
+
+	for (i = 0; i < n_entries; i++) {
+		p = entries + i * 12;
+		tag = get_u16 (reader, p);
+		type = get_u16 (reader, p + 2);
+		value_count = get_u32 (reader, p + 4);
+		value = type == TYPE_SHORT ? get_u16 (reader, p + 8) : get_u32 (reader, p + 8);
+
+		switch (tag) {
+		case TAG_COMPRESSION:
+			compression = value;
+			break;
+		case TAG_ORIENTATION:
+			if (reader->orientation == 0) {
+				reader->orientation = value;
+			}
+			break;
+		case TAG_STRIP_OFFSETS:
+			if (value_count == 1) {
+				strip_offset = value;
+			}
+			break;
+		case TAG_STRIP_BYTE_COUNTS:
+			if (value_count == 1) {
+				strip_length = value;
+			}
+			break;
+		case TAG_JPEG_OFFSET:
+			jpeg_offset = value;
+			break;
+		case TAG_JPEG_LENGTH:
+			jpeg_length = value;
+			break;
+		case TAG_SUB_IFDS:
+			if (type != TYPE_LONG && type != TYPE_IFD) {
+				break;
+			}
+			n_sub_ifds = MIN (value_count, MAX_SUB_IFDS);
+			if (value_count == 1) {
+				sub_ifds[0] = value;
+			} else if (read_exactly (reader, reader->base + value,
+						 sub_ifd_offsets, n_sub_ifds * 4)) {
+				for (j = 0; j < n_sub_ifds; j++) {
+					sub_ifds[j] = get_u32 (reader, sub_ifd_offsets + j * 4);
+				}
+			} else {
+				n_sub_ifds = 0;
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	*next = get_u32 (reader, entries + n_entries * 12);
+	g_free (entries);
+
+	if (jpeg_offset != 0) {
+		add_candidate (reader, reader->base + jpeg_offset, jpeg_length);
+	} else if ((compression == COMPRESSION_OLD_JPEG || compression == COMPRESSION_JPEG) &&
+		   strip_offset != 0) {
+		add_candidate (reader, reader->base + strip_offset, strip_length);
+	}
+
+	/* Raw files keep their larger previews in SubIFDs */
+	if (depth < 2) {
+		for (i = 0; i < n_sub_ifds; i++) {
+			read_ifd (reader, sub_ifds[i], depth + 1, &unused);
+		}
+	}
+}
+
+static void
+read_tiff (PreviewReader *reader)
+{
+	guchar header[8];
+	guint16 magic;
+	guint32 offset;
+
+	if (!read_exactly (reader, reader->base, header, sizeof (header))) {
+		return;
+	}
+
+	if (header[0] == 'I' && header[1] == 'I') {
+		reader->big_endian = FALSE;
+	} else if (header[0] == 'M' && header[1] == 'M') {
+		reader->big_endian = TRUE;
+	} else {
+		return;
+	}
+
+	/* TIFF, and the variants of Olympus and Panasonic */
+	magic = get_u16 (reader, header + 2);
+	if (magic != 42 && magic != 0x4f52 && magic != 0x5352 && magic != 0x55) {
+		return;
+	}
+
+	offset = get_u32 (reader, header + 4);
+	while (offset != 0 && reader->n_ifds < MAX_IFDS) {
+		read_ifd (reader, offset, 0, &offset);
+	}
+}
+
+/* Finds the EXIF data in the APP1 segment of a JPEG */
+static void
+read_jpeg (PreviewReader *reader)
+{
+	guchar *data;
+	gsize length, i;
+	guchar marker;
+
+	data = g_malloc (HEADER_READ_SIZE);
+	if (!read_at (reader, 0, data, HEADER_READ_SIZE, &length)) {
+		g_free (data);
+		return;
+	}
+
+	i = 2;
+	while (i + 4 <= length && data[i] == 0xff) {
+		marker = data[i + 1];
+		if (marker == 0xda || (marker >= 0xc0 && marker <= 0xcf)) {
+			break;
+		}
+
+		if (marker == 0xe1 && i + 10 <= length &&
+		    memcmp (data + i + 4, "Exif\0\0", 6) == 0) {
+			reader->base = i + 10;
+			read_tiff (reader);
+			break;
+		}
+
+		i += 2 + ((data[i + 2] << 8) | data[i + 3]);
+	}
+
+	g_free (data);
+}
+
+static void
+read_raf (PreviewReader *reader)
+{
+	guchar position[8];
+
+	/* Always big endian */
+	if (read_exactly (reader, RAF_JPEG_POSITION, position, sizeof (position))) {
+		reader->big_endian = TRUE;
+		add_candidate (reader,
+			       get_u32 (reader, position),
+			       get_u32 (reader, position + 4));
+	}
+}
+
+static void
+size_prepared_callback (GdkPixbufLoader *loader,
+			int              width,
+			int              height,
+			gpointer         user_data)
+{
+	int size;
+
+	size = GPOINTER_TO_INT (user_data);
+
+	/* The JPEG loader scales while decoding when asked to up front,
+	   which is most of what makes a large preview fast to load */
+	if (width > size || height > size) {
+		if (width > height) {
+			height = MAX ((gint64) height * size / width, 1);
+			width = size;
+		} else {
+			width = MAX ((gint64) width * size / height, 1);
+			height = size;
+		}
+
+		gdk_pixbuf_loader_set_size (loader, width, height);
+	}
+}
+
+static GdkPixbuf *
+load_candidate (PreviewReader *reader,
+		Candidate     *candidate,
+		int            size)
+{
+	GdkPixbufLoader *loader;
+	GdkPixbuf *pixbuf;
+	guchar *data;
+	gboolean res;
+
+	data = g_malloc (candidate->length);
+	if (!read_exactly (reader, candidate->offset, data, candidate->length)) {
+		g_free (data);
+		return NULL;
+	}
+
+	loader = gdk_pixbuf_loader_new_with_mime_type ("image/jpeg", NULL);
+	if (loader == NULL) {
+		g_free (data);
+		return NULL;
+	}
+
+	g_signal_connect (loader, "size-prepared",
+			  G_CALLBACK (size_prepared_callback),
+			  GINT_TO_POINTER (size));
+
+	res = gdk_pixbuf_loader_write (loader, data, candidate->length, NULL);
+	res = gdk_pixbuf_loader_close (loader, NULL) && res;
+
+	pixbuf = NULL;
+	if (res && gdk_pixbuf_loader_get_pixbuf (loader) != NULL) {
+		pixbuf = g_object_ref (gdk_pixbuf_loader_get_pixbuf (loader));
+	}
+
+	g_object_unref (loader);
+	g_free (data);
+
+	return pixbuf;
+}
+
+GdkPixbuf *
+nautilus_embedded_preview_load (GFile        *location,
+				int           size,
+				GCancellable *cancellable)
+{
+	PreviewReader reader = { NULL };
+	GFileInputStream *stream;
+	Candidate *best;
+	GdkPixbuf *pixbuf, *rotated;
+	guchar header[16];
+	char *orientation;
+	int i;
+
+	stream = g_file_read (location, cancellable, NULL);
+	if (stream == NULL) {
+		return NULL;
+	}
+
+	reader.stream = G_INPUT_STREAM (stream);
+	reader.cancellable = cancellable;
+
+	if (g_seekable_can_seek (G_SEEKABLE (stream)) &&
+	    read_exactly (&reader, 0, header, sizeof (header))) {
+		if (header[0] == 0xff && header[1] == 0xd8) {
+			read_jpeg (&reader);
+		} else if (memcmp (header, "FUJIFILM", 8) == 0) {
+			read_raf (&reader);
+		} else {
+			read_tiff (&reader);
+		}
+	}
+
+	/* The smallest one that is large enough */
+	best = NULL;
+	for (i = 0; i < reader.n_candidates; i++) {
+		if (MAX (reader.candidates[i].width, reader.candidates[i].height) >= size &&
+		    (best == NULL || reader.candidates[i].length < best->length)) {
+			best = &reader.candidates[i];
+		}
+	}
+
+	pixbuf = NULL;
+	if (best != NULL) {
+		pixbuf = load_candidate (&reader, best, size);
+	}
+
+	g_object_unref (stream);
+
+	if (pixbuf == NULL) {
+		return NULL;
+	}
+
+	/* Previews are usually stored the way the sensor was held */
+	if (reader.orientation > 1 &&
+	    gdk_pixbuf_get_option (pixbuf, "orientation") == NULL) {
+		orientation = g_strdup_printf ("%d", reader.orientation);
+		gdk_pixbuf_set_option (pixbuf, "orientation", orientation);
+		g_free (orientation);
+	}
+
+	rotated = gdk_pixbuf_apply_embedded_orientation (pixbuf);
+	g_object_unref (pixbuf);
+
+	return rotated;
+}
@@ -0,0 +1,43 @@
+/*
+   Copyright (C) 2016 Red Hat, Inc
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* nautilus-embedded-preview.h: the preview images cameras embed in
+   JPEG and raw photos.
+*/
+
+#ifndef NAUTILUS_EMBEDDED_PREVIEW_H
+#define NAUTILUS_EMBEDDED_PREVIEW_H
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <gio/gio.h>
+
+/* Whether files of @mime_type may have a preview worth looking for */
+gboolean   nautilus_embedded_preview_is_supported_type (const char   *mime_type);
+
+/* Loads the smallest preview embedded in the JPEG, TIFF or camera raw
+ * file at @location that has at least @size pixels on its longest side,
+ * scaled down to @size and turned the way the photo was taken. Only the
+ * headers and the chosen preview are read, so this is much faster than
+ * decoding the photo. Returns NULL if there is no such preview.
+ *
+ * This blocks, call it from a thread.
+ */
+GdkPixbuf *nautilus_embedded_preview_load              (GFile        *location,
+							int           size,
+							GCancellable *cancellable);
+
+#endif /* NAUTILUS_EMBEDDED_PREVIEW_H */
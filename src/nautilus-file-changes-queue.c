@@ -41,8 +41,13 @@ typedef struct {
 } NautilusFileChange;
 
 typedef struct {
-	GList *head;
-	GList *tail;
+	/* Of NautilusFileChange, oldest first */
+	GQueue changes;
+	/* Maps the locations of added, changed and removed files to the
+	 * link of their last such change, which the next ones are merged
+	 * into when they make the same net change.
+	 */
+	GHashTable *last_changes;
 	GMutex mutex;
 } NautilusFileChangesQueue;
 
@@ -52,6 +57,8 @@ nautilus_file_changes_queue_new (void)
 	NautilusFileChangesQueue *result;
 
 	result = g_new0 (NautilusFileChangesQueue, 1);
+	g_queue_init (&result->changes);
+	result->last_changes = g_hash_table_new (g_file_hash, (GEqualFunc) g_file_equal);
 	g_mutex_init (&result->mutex);
 
 	return result;
@@ -69,6 +76,42 @@ nautilus_file_changes_queue_get (void)
 	return file_changes_queue;
 }
 
+static gboolean
+is_file_change (NautilusFileChange *change)
+{
+	return change->kind == CHANGE_FILE_ADDED ||
+		change->kind == CHANGE_FILE_CHANGED ||
+		change->kind == CHANGE_FILE_REMOVED;
+}
+
+/* Folds a new change of kind @kind into the queued @change of the same
+ * file, if that leaves the same net change. Returns FALSE if it has to
+ * be queued after it instead.
+ */
+static gboolean
+merge_change (NautilusFileChange *change,
+	      NautilusFileChangeKind kind)
+{
+	switch (kind) {
+	case CHANGE_FILE_ADDED:
+		return change->kind == CHANGE_FILE_ADDED;
+
+	case CHANGE_FILE_CHANGED:
+		/* Added files are read after the change anyway */
+		return change->kind == CHANGE_FILE_ADDED ||
+			change->kind == CHANGE_FILE_CHANGED;
+
+	case CHANGE_FILE_REMOVED:
+		/* Whatever happened to it before, the file is gone now */
+		change->kind = CHANGE_FILE_REMOVED;
+		return TRUE;
+
+	default:
+		g_assert_not_reached ();
+		return FALSE;
+	}
+}
+
 static void
 nautilus_file_changes_queue_add_common (NautilusFileChangesQueue *queue, 
 	NautilusFileChange *new_item)
@@ -76,53 +119,64 @@ nautilus_file_changes_queue_add_common (NautilusFileChangesQueue *queue,
 	/* enqueue the new queue item while locking down the list */
 	g_mutex_lock (&queue->mutex);
 
-	queue->head = g_list_prepend (queue->head, new_item);
-	if (queue->tail == NULL)
-		queue->tail = queue->head;
+	g_queue_push_tail (&queue->changes, new_item);
+
+	/* Don't merge changes across a move, the locations queued
+	 * before it may be different files after it.
+	 */
+	if (new_item->kind == CHANGE_FILE_MOVED) {
+		g_hash_table_remove_all (queue->last_changes);
+	}
 
 	g_mutex_unlock (&queue->mutex);
 }
 
-void
-nautilus_file_changes_queue_file_added (GFile *location)
+static void
+nautilus_file_changes_queue_add_file_change (NautilusFileChangeKind kind,
+					     GFile *location)
 {
-	NautilusFileChange *new_item;
 	NautilusFileChangesQueue *queue;
+	NautilusFileChange *new_item;
+	GList *link;
 
-	queue = nautilus_file_changes_queue_get();
+	queue = nautilus_file_changes_queue_get ();
+
+	g_mutex_lock (&queue->mutex);
+
+	/* A build writing the same files over and over again shouldn't
+	   make the views refresh them over and over again */
+	link = g_hash_table_lookup (queue->last_changes, location);
+	if (link != NULL && merge_change (link->data, kind)) {
+		g_mutex_unlock (&queue->mutex);
+		return;
+	}
 
 	new_item = g_new0 (NautilusFileChange, 1);
-	new_item->kind = CHANGE_FILE_ADDED;
+	new_item->kind = kind;
 	new_item->from = g_object_ref (location);
-	nautilus_file_changes_queue_add_common (queue, new_item);
+
+	g_queue_push_tail (&queue->changes, new_item);
+	g_hash_table_replace (queue->last_changes, new_item->from, queue->changes.tail);
+
+	g_mutex_unlock (&queue->mutex);
 }
 
 void
-nautilus_file_changes_queue_file_changed (GFile *location)
+nautilus_file_changes_queue_file_added (GFile *location)
 {
-	NautilusFileChange *new_item;
-	NautilusFileChangesQueue *queue;
-
-	queue = nautilus_file_changes_queue_get();
+	nautilus_file_changes_queue_add_file_change (CHANGE_FILE_ADDED, location);
+}
 
-	new_item = g_new0 (NautilusFileChange, 1);
-	new_item->kind = CHANGE_FILE_CHANGED;
-	new_item->from = g_object_ref (location);
-	nautilus_file_changes_queue_add_common (queue, new_item);
+void
+nautilus_file_changes_queue_file_changed (GFile *location)
+{
+	nautilus_file_changes_queue_add_file_change (CHANGE_FILE_CHANGED, location);
 }
 
 void
 nautilus_file_changes_queue_file_removed (GFile *location)
 {
-	NautilusFileChange *new_item;
-	NautilusFileChangesQueue *queue;
-
-	queue = nautilus_file_changes_queue_get();
-
-	new_item = g_new0 (NautilusFileChange, 1);
-	new_item->kind = CHANGE_FILE_REMOVED;
-	new_item->from = g_object_ref (location);
-	nautilus_file_changes_queue_add_common (queue, new_item);
+	nautilus_file_changes_queue_add_file_change (CHANGE_FILE_REMOVED, location);
 }
 
 void
@@ -176,23 +230,27 @@ nautilus_file_changes_queue_schedule_position_remove (GFile *location)
 static NautilusFileChange *
 nautilus_file_changes_queue_get_change (NautilusFileChangesQueue *queue)
 {
-	GList *new_tail;
+	GList *link;
 	NautilusFileChange *result;
 
 	g_assert (queue != NULL);
 	
-	/* dequeue the tail item while locking down the list */
+	/* dequeue the oldest item while locking down the list */
 	g_mutex_lock (&queue->mutex);
 
-	if (queue->tail == NULL) {
+	link = g_queue_peek_head_link (&queue->changes);
+	if (link == NULL) {
 		result = NULL;
 	} else {
-		new_tail = queue->tail->prev;
-		result = queue->tail->data;
-		queue->head = g_list_remove_link (queue->head,
-						  queue->tail);
-		g_list_free_1 (queue->tail);
-		queue->tail = new_tail;
+		result = link->data;
+
+		/* Later changes can't be merged into it any more */
+		if (is_file_change (result) &&
+		    g_hash_table_lookup (queue->last_changes, result->from) == link) {
+			g_hash_table_remove (queue->last_changes, result->from);
+		}
+
+		g_queue_delete_link (&queue->changes, link);
 	}
 
 	g_mutex_unlock (&queue->mutex);
@@ -200,8 +258,20 @@ nautilus_file_changes_queue_get_change (NautilusFileChangesQueue *queue)
 	return result;
 }
 
+static gboolean
+nautilus_file_changes_queue_is_empty (NautilusFileChangesQueue *queue)
+{
+	gboolean result;
+
+	g_mutex_lock (&queue->mutex);
+	result = g_queue_is_empty (&queue->changes);
+	g_mutex_unlock (&queue->mutex);
+
+	return result;
+}
+
 enum {
-	CONSUME_CHANGES_MAX_CHUNK = 20
+	CONSUME_CHANGES_MAX_CHUNK = 200
 };
 
 static void
@@ -240,7 +310,7 @@ position_set_list_free (GList *list)
 /* go through changes in the change queue, send ones with the same kind
  * in a list to the different nautilus_directory_notify calls
  */ 
-void
+gboolean
 nautilus_file_changes_consume_changes (gboolean consume_all)
 {
 	NautilusFileChange *change;
@@ -267,7 +337,12 @@ nautilus_file_changes_consume_changes (gboolean consume_all)
 	 * arrived.
 	 */
 	for (chunk_count = 0; ; chunk_count++) {
-		change = nautilus_file_changes_queue_get_change (queue);
+		/* Leave the rest to the next main loop iteration */
+		if (!consume_all && chunk_count == CONSUME_CHANGES_MAX_CHUNK) {
+			change = NULL;
+		} else {
+			change = nautilus_file_changes_queue_get_change (queue);
+		}
 
 		/* figure out if we need to flush the pending changes that we collected sofar */
 
@@ -296,9 +371,6 @@ nautilus_file_changes_consume_changes (gboolean consume_all)
 				&& change->kind != CHANGE_POSITION_REMOVE
 				&& change->kind != CHANGE_FILE_ADDED
 				&& change->kind != CHANGE_FILE_MOVED;
-			
-			flush_needed |= !consume_all && chunk_count >= CONSUME_CHANGES_MAX_CHUNK;
-				/* we have reached the chunk maximum */
 		}
 		
 		if (flush_needed) {
@@ -341,7 +413,7 @@ nautilus_file_changes_consume_changes (gboolean consume_all)
 
 		if (change == NULL) {
 			/* we are done */
-			return;
+			return !nautilus_file_changes_queue_is_empty (queue);
 		}
 		
 		/* add the new change to the list */
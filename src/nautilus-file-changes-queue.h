@@ -33,7 +33,8 @@ void nautilus_file_changes_queue_schedule_position_set           (GFile      *lo
 								  int         screen);
 void nautilus_file_changes_queue_schedule_position_remove        (GFile      *location);
 
-void nautilus_file_changes_consume_changes                       (gboolean    consume_all);
+/* Returns TRUE if changes are left, which happens unless @consume_all */
+gboolean nautilus_file_changes_consume_changes                   (gboolean    consume_all);
 
 
 #endif /* NAUTILUS_FILE_CHANGES_QUEUE_H */
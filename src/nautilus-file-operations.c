@@ -55,6 +55,8 @@
 #include "nautilus-file-private.h"
 #include "nautilus-global-preferences.h"
 #include "nautilus-link.h"
+#include "nautilus-native-copy.h"
+#include "nautilus-native-delete.h"
 #include "nautilus-trash-monitor.h"
 #include "nautilus-file-utilities.h"
 #include "nautilus-file-conflict-dialog.h"
@@ -63,6 +65,21 @@
 
 /* TODO: TESTING!!! */
 
+/* What copy, move and delete jobs publish of their progress */
+typedef struct {
+	int num_files;
+	goffset num_bytes;
+	gboolean scanning;
+	int transferred_files;
+	goffset transferred_bytes;
+} ProgressSnapshot;
+
+typedef struct {
+	/* Odd while the job thread is writing the snapshot */
+	volatile gint seq;
+	ProgressSnapshot snapshot;
+} ProgressCounters;
+
 typedef struct {
 	GTimer *time;
 	GtkWindow *parent_window;
@@ -78,8 +95,13 @@ typedef struct {
 	gboolean merge_all;
 	gboolean replace_all;
 	gboolean delete_all;
+	ProgressCounters progress_counters;
+	/* Only used on the main thread */
+	int last_reported_files_left;
 } CommonJob;
 
+typedef struct CopyPipeline CopyPipeline;
+
 typedef struct {
 	CommonJob common;
 	gboolean is_move;
@@ -93,6 +115,7 @@ typedef struct {
 	gchar *target_name;
 	NautilusCopyCallback  done_callback;
 	gpointer done_callback_data;
+	CopyPipeline *pipeline;
 } CopyMoveJob;
 
 typedef struct {
@@ -154,11 +177,17 @@ typedef enum {
 	OP_KIND_TRASH
 } OpKind;
 
+typedef struct SourceScan SourceScan;
+
 typedef struct {
 	int num_files;
 	goffset num_bytes;
 	int num_files_since_progress;
 	OpKind op;
+	/* Set while the totals are still being counted in the background */
+	SourceScan *scan;
+	gboolean scanning;
+	gboolean space_verified;
 } SourceInfo;
 
 typedef struct {
@@ -166,7 +195,6 @@ typedef struct {
 	goffset num_bytes;
 	OpKind op;
 	guint64 last_report_time;
-	int last_reported_files_left;
 } TransferInfo;
 
 #define SECONDS_NEEDED_FOR_RELIABLE_TRANSFER_RATE 8
@@ -209,6 +237,14 @@ static void scan_sources (GList *files,
 			  SourceInfo *source_info,
 			  CommonJob *job,
 			  OpKind kind);
+static void scan_sources_start (GList *files,
+				SourceInfo *source_info,
+				CommonJob *job,
+				OpKind kind);
+static void source_info_update (SourceInfo *source_info);
+static void scan_sources_finish (SourceInfo *source_info,
+				 TransferInfo *transfer_info,
+				 CommonJob *job);
 
 
 static void empty_trash_thread_func (GTask *task,
@@ -954,6 +990,10 @@ init_common (gsize job_size,
 static void
 finalize_common (CommonJob *common)
 {
+	/* Show the final counts, before the job goes away */
+	nautilus_progress_info_run_update_func (common->progress);
+	nautilus_progress_info_set_update_func (common->progress, NULL, NULL);
+
 	nautilus_progress_info_finish (common->progress);
 
 	if (common->inhibit_cookie != 0) {
@@ -1475,40 +1515,88 @@ confirm_delete_directly (CommonJob *job,
 	return response == 1;
 }
 
+/* Publishes the progress of the job, to be picked up by
+ * update_copy_progress() or update_delete_progress() on the main thread.
+ * This is called for every file, so it only copies the counts.
+ */
+static void
+publish_progress (CommonJob *job,
+		  SourceInfo *source_info,
+		  TransferInfo *transfer_info)
+{
+	ProgressCounters *counters;
+
+	source_info_update (source_info);
+
+	counters = &job->progress_counters;
+
+	g_atomic_int_inc (&counters->seq);
+	counters->snapshot.num_files = source_info->num_files;
+	counters->snapshot.num_bytes = source_info->num_bytes;
+	counters->snapshot.scanning = source_info->scanning;
+	counters->snapshot.transferred_files = transfer_info->num_files;
+	counters->snapshot.transferred_bytes = transfer_info->num_bytes;
+	g_atomic_int_inc (&counters->seq);
+}
+
+/* Returns FALSE if nothing was published yet */
+static gboolean
+read_progress (CommonJob *job,
+	       ProgressSnapshot *progress)
+{
+	ProgressCounters *counters;
+	gint seq;
+
+	counters = &job->progress_counters;
+
+	do {
+		seq = g_atomic_int_get (&counters->seq);
+		*progress = counters->snapshot;
+	} while ((seq & 1) != 0 || g_atomic_int_get (&counters->seq) != seq);
+
+	return seq != 0;
+}
+
 static void
 report_delete_progress (CommonJob *job,
 			SourceInfo *source_info,
 			TransferInfo *transfer_info)
 {
+	publish_progress (job, source_info, transfer_info);
+}
+
+static void
+update_delete_progress (NautilusProgressInfo *info,
+			gpointer user_data)
+{
+	CommonJob *job;
+	ProgressSnapshot progress;
 	int files_left;
 	double elapsed, transfer_rate;
 	int remaining_time;
-	gint64 now;
 	char *details;
         char *status;
         DeleteJob *delete_job;
 
+	job = user_data;
         delete_job = (DeleteJob *) job;
-	now = g_get_monotonic_time ();
-	files_left = source_info->num_files - transfer_info->num_files;
+
+	if (!read_progress (job, &progress)) {
+		return;
+	}
+
+	files_left = progress.num_files - progress.transferred_files;
 
 	/* Races and whatnot could cause this to be negative... */
 	if (files_left < 0) {
 		files_left = 0;
 	}
-
-        /* If the number of files left is 0, we want to update the status without
-         * considering this time, since we want to change the status to completed
-         * and probably we won't get more calls to this function */
-	if (transfer_info->last_report_time != 0 &&
-	    ABS ((gint64)(transfer_info->last_report_time - now)) < 100 * NSEC_PER_MICROSEC &&
-            files_left > 0) {
-		return;
+	/* ...and the scan can lag behind the deletion */
+	if (progress.scanning && files_left == 0) {
+		files_left = 1;
 	}
 
-	transfer_info->last_report_time = now;
-
-        if (source_info->num_files == 1) {
+        if (progress.num_files == 1) {
                 if (files_left == 0) {
                         status = _("Deleted “%B”");
                 } else {
@@ -1522,39 +1610,41 @@ report_delete_progress (CommonJob *job,
                 if (files_left == 0) {
                         status = ngettext ("Deleted %'d file",
                                            "Deleted %'d files",
-                                           source_info->num_files);
+                                           progress.num_files);
                 } else {
                         status = ngettext ("Deleting %'d file",
                                            "Deleting %'d files",
-                                           source_info->num_files);
+                                           progress.num_files);
                 }
 	        nautilus_progress_info_take_status (job->progress,
 					            f (status,
-                                                       source_info->num_files));
+                                                       progress.num_files));
         }
 
 	elapsed = g_timer_elapsed (job->time, NULL);
         transfer_rate = 0;
         remaining_time = INT_MAX;
 	if (elapsed > 0) {
-		transfer_rate = transfer_info->num_files / elapsed;
+		transfer_rate = progress.transferred_files / elapsed;
                 if (transfer_rate > 0)
-		        remaining_time = (source_info->num_files - transfer_info->num_files) / transfer_rate;
+		        remaining_time = (progress.num_files - progress.transferred_files) / transfer_rate;
 	}
 
-	if (elapsed < SECONDS_NEEDED_FOR_RELIABLE_TRANSFER_RATE) {
+	/* There is no telling how much is left until the scan is done */
+	if (elapsed < SECONDS_NEEDED_FOR_RELIABLE_TRANSFER_RATE ||
+	    progress.scanning) {
                 if (files_left > 0) {
                         /* To translators: %'d is the number of files completed for the operation,
                          * so it will be something like 2/14. */
                         details = f (_("%'d / %'d"),
-                                     transfer_info->num_files + 1,
-                                     source_info->num_files);
+                                     progress.transferred_files + 1,
+                                     progress.num_files);
                 } else {
                         /* To translators: %'d is the number of files completed for the operation,
                          * so it will be something like 2/14. */
                         details = f (_("%'d / %'d"),
-                                     transfer_info->num_files,
-                                     source_info->num_files);
+                                     progress.transferred_files,
+                                     progress.num_files);
                 }
 	} else {
                 if (files_left > 0) {
@@ -1577,7 +1667,7 @@ report_delete_progress (CommonJob *job,
                         concat_detail = g_strconcat (time_left_message, " ", files_per_second_message, NULL);
 
 	                details = f (concat_detail,
-                                     transfer_info->num_files + 1, source_info->num_files,
+                                     progress.transferred_files + 1, progress.num_files,
                                      remaining_time,
                                      (int) transfer_rate);
 
@@ -1586,21 +1676,22 @@ report_delete_progress (CommonJob *job,
                         /* To translators: %'d is the number of files completed for the operation,
                          * so it will be something like 2/14. */
                         details = f (_("%'d / %'d"),
-                                     transfer_info->num_files,
-                                     source_info->num_files);
+                                     progress.transferred_files,
+                                     progress.num_files);
                 }
 	}
-	nautilus_progress_info_set_details (job->progress, details);
+	nautilus_progress_info_take_details (job->progress, details);
 
-        if (elapsed > SECONDS_NEEDED_FOR_APROXIMATE_TRANSFER_RATE) {
+        if (elapsed > SECONDS_NEEDED_FOR_APROXIMATE_TRANSFER_RATE &&
+            !progress.scanning) {
                 nautilus_progress_info_set_remaining_time (job->progress,
                                                            remaining_time);
                 nautilus_progress_info_set_elapsed_time (job->progress,
                                                          elapsed);
         }
 
-	if (source_info->num_files != 0) {
-		nautilus_progress_info_set_progress (job->progress, transfer_info->num_files, source_info->num_files);
+	if (progress.num_files != 0) {
+		nautilus_progress_info_set_progress (job->progress, progress.transferred_files, progress.num_files);
 	}
 }
 
@@ -1610,6 +1701,61 @@ static void delete_file (CommonJob *job, GFile *file,
 			 TransferInfo *transfer_info,
 			 gboolean toplevel);
 
+typedef struct {
+	CommonJob *job;
+	SourceInfo *source_info;
+	TransferInfo *transfer_info;
+	int num_files;
+} DeleteTreeProgressData;
+
+static void
+delete_tree_progress_callback (int n_deleted,
+			       gpointer user_data)
+{
+	DeleteTreeProgressData *pdata;
+
+	pdata = user_data;
+
+	pdata->transfer_info->num_files = pdata->num_files + n_deleted;
+	report_delete_progress (pdata->job, pdata->source_info, pdata->transfer_info);
+}
+
+/* Returns TRUE if @dir is gone, or the job was cancelled */
+static gboolean
+delete_native_tree (CommonJob *job, GFile *dir,
+		    SourceInfo *source_info,
+		    TransferInfo *transfer_info)
+{
+	DeleteTreeProgressData pdata;
+	GList *removed, *l;
+	GError *error;
+	gboolean res;
+
+	pdata.job = job;
+	pdata.source_info = source_info;
+	pdata.transfer_info = transfer_info;
+	pdata.num_files = transfer_info->num_files;
+
+	error = NULL;
+	res = nautilus_native_delete_tree (dir, job->cancellable,
+					   delete_tree_progress_callback, &pdata,
+					   &removed, &error);
+
+	/* The files in the folders go along with them */
+	for (l = removed; l != NULL; l = l->next) {
+		nautilus_file_changes_queue_file_removed (l->data);
+	}
+	g_list_free_full (removed, g_object_unref);
+
+	if (error != NULL) {
+		/* Cancelled */
+		res = TRUE;
+		g_error_free (error);
+	}
+
+	return res;
+}
+
 static void
 delete_dir (CommonJob *job, GFile *dir,
 	    gboolean *skipped_file,
@@ -1626,6 +1772,14 @@ delete_dir (CommonJob *job, GFile *dir,
 	gboolean skip_error;
 	gboolean local_skipped_file;
 
+	/* Whatever the fast way couldn't delete is handled below, which
+	 * reports the errors.
+	 */
+	if (g_file_is_native (dir) &&
+	    delete_native_tree (job, dir, source_info, transfer_info)) {
+		return;
+	}
+
 	local_skipped_file = FALSE;
 	
 	skip_error = should_skip_readdir_error (job, dir);
@@ -1842,13 +1996,10 @@ delete_files (CommonJob *job, GList *files, int *files_skipped)
 		return;
 	}
 
-	scan_sources (files,
-		      &source_info,
-		      job,
-		      OP_KIND_DELETE);
-	if (job_aborted (job)) {
-		return;
-	}
+	scan_sources_start (files,
+			    &source_info,
+			    job,
+			    OP_KIND_DELETE);
 
 	g_timer_start (job->time);
 	
@@ -1869,6 +2020,11 @@ delete_files (CommonJob *job, GList *files, int *files_skipped)
 			(*files_skipped)++;
 		}
 	}
+
+	scan_sources_finish (&source_info, &transfer_info, job);
+	if (!job_aborted (job)) {
+		report_delete_progress (job, &source_info, &transfer_info);
+	}
 }
 
 static void
@@ -1986,7 +2142,7 @@ report_trash_progress (CommonJob    *job,
                                      source_info->num_files);
                 }
 	}
-	nautilus_progress_info_set_details (job->progress, details);
+	nautilus_progress_info_take_details (job->progress, details);
 
         if (elapsed > SECONDS_NEEDED_FOR_APROXIMATE_TRANSFER_RATE) {
                 nautilus_progress_info_set_remaining_time (job->progress,
@@ -2261,6 +2417,8 @@ trash_or_delete_internal (GList                  *files,
 		job->common.undo_info = nautilus_file_undo_info_trash_new (g_list_length (files));
 	}
 
+	nautilus_progress_info_set_update_func (job->common.progress, update_delete_progress, job);
+
 	task = g_task_new (NULL, NULL, delete_task_done, job);
 	g_task_set_task_data (task, job, NULL);
 	g_task_run_in_thread (task, delete_task_thread_func);
@@ -3007,6 +3165,238 @@ scan_sources (GList *files,
 	report_preparing_count_progress (job, source_info);
 }
 
+/* Scanning a large tree up front can take minutes, during which nothing
+ * is copied or deleted. Jobs that only need the totals for their
+ * progress scan the sources in the background instead, with a few
+ * threads enumerating different directories at once, and fold what was
+ * counted so far into their SourceInfo whenever they report progress.
+ *
+ * The background scan doesn't report errors, the transfer itself does
+ * when it gets to the files that couldn't be read.
+ */
+#define SOURCE_SCAN_MAX_THREADS 4
+
+struct SourceScan {
+	GThreadPool *pool;
+	GCancellable *cancellable;
+
+	GMutex mutex;
+	GCond cond;
+	int num_files;
+	goffset num_bytes;
+	/* Files still to be scanned, queued or running */
+	int n_pending;
+};
+
+typedef struct {
+	GFile *file;
+	gboolean toplevel;
+} SourceScanItem;
+
+static void
+source_scan_push (SourceScan *scan,
+		  GFile *file,
+		  gboolean toplevel)
+{
+	SourceScanItem *item;
+
+	item = g_new0 (SourceScanItem, 1);
+	item->file = g_object_ref (file);
+	item->toplevel = toplevel;
+
+	g_mutex_lock (&scan->mutex);
+	scan->n_pending++;
+	g_mutex_unlock (&scan->mutex);
+
+	g_thread_pool_push (scan->pool, item, NULL);
+}
+
+static void
+source_scan_add (SourceScan *scan,
+		 int num_files,
+		 goffset num_bytes,
+		 gboolean done)
+{
+	g_mutex_lock (&scan->mutex);
+	scan->num_files += num_files;
+	scan->num_bytes += num_bytes;
+	if (done && --scan->n_pending == 0) {
+		g_cond_broadcast (&scan->cond);
+	}
+	g_mutex_unlock (&scan->mutex);
+}
+
+static void
+source_scan_worker (gpointer data,
+		    gpointer user_data)
+{
+	SourceScanItem *item;
+	SourceScan *scan;
+	GFileEnumerator *enumerator;
+	GFileInfo *info;
+	GFile *subdir;
+	int num_files;
+	goffset num_bytes;
+
+	item = data;
+	scan = user_data;
+	num_files = 0;
+	num_bytes = 0;
+
+	if (item->toplevel) {
+		info = g_file_query_info (item->file,
+					  G_FILE_ATTRIBUTE_STANDARD_TYPE","
+					  G_FILE_ATTRIBUTE_STANDARD_SIZE,
+					  G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+					  scan->cancellable,
+					  NULL);
+		if (info == NULL) {
+			goto out;
+		}
+
+		num_files++;
+		num_bytes += g_file_info_get_size (info);
+		if (g_file_info_get_file_type (info) != G_FILE_TYPE_DIRECTORY) {
+			g_object_unref (info);
+			goto out;
+		}
+		g_object_unref (info);
+	}
+
+	enumerator = g_file_enumerate_children (item->file,
+						G_FILE_ATTRIBUTE_STANDARD_NAME","
+						G_FILE_ATTRIBUTE_STANDARD_TYPE","
+						G_FILE_ATTRIBUTE_STANDARD_SIZE,
+						G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+						scan->cancellable,
+						NULL);
+	if (enumerator == NULL) {
+		goto out;
+	}
+
+	while ((info = g_file_enumerator_next_file (enumerator, scan->cancellable, NULL)) != NULL) {
+		num_files++;
+		num_bytes += g_file_info_get_size (info);
+
+		if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY) {
+			subdir = g_file_get_child (item->file,
+						   g_file_info_get_name (info));
+			source_scan_push (scan, subdir, FALSE);
+			g_object_unref (subdir);
+		}
+
+		g_object_unref (info);
+
+		/* Keep the totals moving in large directories */
+		if (num_files >= 1000) {
+			source_scan_add (scan, num_files, num_bytes, FALSE);
+			num_files = 0;
+			num_bytes = 0;
+		}
+	}
+	g_file_enumerator_close (enumerator, scan->cancellable, NULL);
+	g_object_unref (enumerator);
+
+ out:
+	source_scan_add (scan, num_files, num_bytes, TRUE);
+
+	g_object_unref (item->file);
+	g_free (item);
+}
+
+/* Like scan_sources(), but returns right away. The totals in
+ * @source_info grow with each source_info_update(), until
+ * scan_sources_finish() is called.
+ */
+static void
+scan_sources_start (GList *files,
+		    SourceInfo *source_info,
+		    CommonJob *job,
+		    OpKind kind)
+{
+	SourceScan *scan;
+	GList *l;
+
+	memset (source_info, 0, sizeof (SourceInfo));
+	source_info->op = kind;
+
+	if (files == NULL) {
+		return;
+	}
+
+	scan = g_new0 (SourceScan, 1);
+	scan->cancellable = g_cancellable_new ();
+	g_mutex_init (&scan->mutex);
+	g_cond_init (&scan->cond);
+	scan->pool = g_thread_pool_new (source_scan_worker, scan,
+					SOURCE_SCAN_MAX_THREADS, FALSE, NULL);
+
+	source_info->scan = scan;
+	source_info->scanning = TRUE;
+
+	for (l = files; l != NULL; l = l->next) {
+		source_scan_push (scan, l->data, TRUE);
+	}
+}
+
+static void
+source_info_update (SourceInfo *source_info)
+{
+	SourceScan *scan;
+
+	scan = source_info->scan;
+	if (scan == NULL || !source_info->scanning) {
+		return;
+	}
+
+	g_mutex_lock (&scan->mutex);
+	source_info->num_files = scan->num_files;
+	source_info->num_bytes = scan->num_bytes;
+	source_info->scanning = scan->n_pending > 0;
+	g_mutex_unlock (&scan->mutex);
+}
+
+static void
+scan_sources_finish (SourceInfo *source_info,
+		     TransferInfo *transfer_info,
+		     CommonJob *job)
+{
+	SourceScan *scan;
+
+	scan = source_info->scan;
+	if (scan == NULL) {
+		return;
+	}
+
+	/* The totals only matter for the final report now. If the
+	 * transfer was faster than the scan, it is still worth finishing
+	 * it, unless the job was aborted.
+	 */
+	if (job_aborted (job)) {
+		g_cancellable_cancel (scan->cancellable);
+	}
+
+	g_mutex_lock (&scan->mutex);
+	while (scan->n_pending > 0) {
+		g_cond_wait (&scan->cond, &scan->mutex);
+	}
+	g_mutex_unlock (&scan->mutex);
+
+	source_info_update (source_info);
+	source_info->scan = NULL;
+	source_info->scanning = FALSE;
+
+	/* Files deleted before the scan got to them weren't counted */
+	source_info->num_files = MAX (source_info->num_files, transfer_info->num_files);
+	source_info->num_bytes = MAX (source_info->num_bytes, transfer_info->num_bytes);
+
+	g_thread_pool_free (scan->pool, FALSE, TRUE);
+	g_object_unref (scan->cancellable);
+	g_mutex_clear (&scan->mutex);
+	g_cond_clear (&scan->cond);
+	g_free (scan);
+}
+
 static void
 verify_destination (CommonJob *job,
 		    GFile *dest,
@@ -3178,50 +3568,92 @@ verify_destination (CommonJob *job,
 	g_object_unref (fsinfo);
 }
 
+/* Checks the free space on the destination, once the sources it was
+ * copied from are all counted.
+ */
+static void
+verify_destination_space (CopyMoveJob *job,
+			  SourceInfo *source_info,
+			  TransferInfo *transfer_info)
+{
+	GFile *dest;
+
+	if (source_info->space_verified) {
+		return;
+	}
+
+	source_info_update (source_info);
+	if (source_info->scanning) {
+		return;
+	}
+	source_info->space_verified = TRUE;
+
+	if (source_info->num_bytes <= transfer_info->num_bytes) {
+		return;
+	}
+
+	if (job->destination) {
+		dest = g_object_ref (job->destination);
+	} else {
+		dest = g_file_get_parent (job->files->data);
+	}
+
+	verify_destination (&job->common,
+			    dest,
+			    NULL,
+			    source_info->num_bytes - transfer_info->num_bytes);
+	g_object_unref (dest);
+}
+
 static void
 report_copy_progress (CopyMoveJob *copy_job,
 		      SourceInfo *source_info,
 		      TransferInfo *transfer_info)
 {
+	publish_progress ((CommonJob *) copy_job, source_info, transfer_info);
+}
+
+static void
+update_copy_progress (NautilusProgressInfo *info,
+		      gpointer user_data)
+{
+	CopyMoveJob *copy_job;
+	ProgressSnapshot progress;
 	int files_left;
 	goffset total_size;
 	double elapsed, transfer_rate;
 	int remaining_time;
-	guint64 now;
 	CommonJob *job;
 	gboolean is_move;
         gchar *status;
         char *details;
 
+	copy_job = user_data;
 	job = (CommonJob *)copy_job;
 
+	if (!read_progress (job, &progress)) {
+		return;
+	}
+
 	is_move = copy_job->is_move;
-	
-	now = g_get_monotonic_time ();
 
-	files_left = source_info->num_files - transfer_info->num_files;
+	files_left = progress.num_files - progress.transferred_files;
 
 	/* Races and whatnot could cause this to be negative... */
 	if (files_left < 0) {
 		files_left = 0;
 	}
-
-        /* If the number of files left is 0, we want to update the status without
-         * considering this time, since we want to change the status to completed
-         * and probably we won't get more calls to this function */
-	if (transfer_info->last_report_time != 0 &&
-	    ABS ((gint64)(transfer_info->last_report_time - now)) < 100 * NSEC_PER_MICROSEC &&
-            files_left > 0) {
-		return;
+	/* ...and the scan can lag behind the copy */
+	if (progress.scanning && files_left == 0) {
+		files_left = 1;
 	}
-	transfer_info->last_report_time = now;
 
-	if (files_left != transfer_info->last_reported_files_left ||
-	    transfer_info->last_reported_files_left == 0) {
+	if (files_left != job->last_reported_files_left ||
+	    job->last_reported_files_left == 0) {
 		/* Avoid changing this unless files_left changed since last time */
-		transfer_info->last_reported_files_left = files_left;
+		job->last_reported_files_left = files_left;
 
-		if (source_info->num_files == 1) {
+		if (progress.num_files == 1) {
 			if (copy_job->destination != NULL) {
                                 if (is_move) {
                                         if (files_left > 0) {
@@ -3258,29 +3690,29 @@ report_copy_progress (CopyMoveJob *copy_job,
                                         if (is_move) {
                                                 status = ngettext ("Moving %'d file to “%B”",
                                                                    "Moving %'d files to “%B”",
-                                                                    source_info->num_files);
+                                                                    progress.num_files);
                                         } else {
                                                 status = ngettext ("Copying %'d file to “%B”",
                                                                    "Copying %'d files to “%B”",
-                                                                   source_info->num_files);
+                                                                   progress.num_files);
                                         }
 				        nautilus_progress_info_take_status (job->progress,
 								            f (status,
-								               source_info->num_files,
+								               progress.num_files,
 								               (GFile *)copy_job->destination));
                                 } else {
                                         if (is_move) {
                                                 status = ngettext ("Moved %'d file to “%B”",
                                                                    "Moved %'d files to “%B”",
-                                                                   source_info->num_files);
+                                                                   progress.num_files);
                                         } else {
                                                 status = ngettext ("Copied %'d file to “%B”",
                                                                    "Copied %'d files to “%B”",
-                                                                   source_info->num_files);
+                                                                   progress.num_files);
                                         }
 				        nautilus_progress_info_take_status (job->progress,
 								            f (status,
-								               source_info->num_files,
+								               progress.num_files,
 								               (GFile *)copy_job->destination));
                                 }
 			} else {
@@ -3290,18 +3722,18 @@ report_copy_progress (CopyMoveJob *copy_job,
                                 if (files_left > 0) {
                                         status = ngettext ("Duplicating %'d file in “%B”",
                                                            "Duplicating %'d files in “%B”",
-                                                           transfer_info->num_files + 1);
+                                                           progress.transferred_files + 1);
 				        nautilus_progress_info_take_status (job->progress,
 								            f (status,
-								               source_info->num_files + 1,
+								               progress.num_files + 1,
 								               parent));
                                 } else {
                                         status = ngettext ("Duplicated %'d file in “%B”",
                                                            "Duplicated %'d files in “%B”",
-                                                           source_info->num_files);
+                                                           progress.num_files);
 				        nautilus_progress_info_take_status (job->progress,
 								            f (status,
-								               source_info->num_files,
+								               progress.num_files,
 								               parent));
                                 }
                                 g_object_unref (parent);
@@ -3309,39 +3741,41 @@ report_copy_progress (CopyMoveJob *copy_job,
 		}
 	}
 	
-	total_size = MAX (source_info->num_bytes, transfer_info->num_bytes);
+	total_size = MAX (progress.num_bytes, progress.transferred_bytes);
 	
 	elapsed = g_timer_elapsed (job->time, NULL);
 	transfer_rate = 0;
         remaining_time = INT_MAX;
 	if (elapsed > 0) {
-		transfer_rate = transfer_info->num_bytes / elapsed;
+		transfer_rate = progress.transferred_bytes / elapsed;
                 if (transfer_rate > 0)
-		        remaining_time = (total_size - transfer_info->num_bytes) / transfer_rate;
+		        remaining_time = (total_size - progress.transferred_bytes) / transfer_rate;
 	}
 
-  	if (elapsed < SECONDS_NEEDED_FOR_RELIABLE_TRANSFER_RATE &&
+	/* There is no telling how much is left until the scan is done */
+  	if ((elapsed < SECONDS_NEEDED_FOR_RELIABLE_TRANSFER_RATE ||
+	     progress.scanning) &&
             transfer_rate > 0) {
-                if (source_info->num_files == 1) {
+                if (progress.num_files == 1) {
 	                /* To translators: %S will expand to a size like "2 bytes" or "3 MB", so something like "4 kb / 4 MB" */
-	                details = f (_("%S / %S"), transfer_info->num_bytes, total_size);
+	                details = f (_("%S / %S"), progress.transferred_bytes, total_size);
                 } else {
                         if (files_left > 0) {
                                 /* To translators: %'d is the number of files completed for the operation,
                                  * so it will be something like 2/14. */
 	                        details = f (_("%'d / %'d"),
-                                             transfer_info->num_files + 1,
-                                             source_info->num_files);
+                                             progress.transferred_files + 1,
+                                             progress.num_files);
                         } else {
                                 /* To translators: %'d is the number of files completed for the operation,
                                  * so it will be something like 2/14. */
                                 details = f (_("%'d / %'d"),
-                                             transfer_info->num_files,
-                                             source_info->num_files);
+                                             progress.transferred_files,
+                                             progress.num_files);
                         }
                 }
 	} else {
-                if (source_info->num_files == 1) {
+                if (progress.num_files == 1) {
                         if (files_left > 0) {
 		                /* To translators: %S will expand to a size like "2 bytes" or "3 MB", %T to a time duration like
 		                 * "2 minutes". So the whole thing will be something like "2 kb / 4 MB -- 2 hours left (4kb/sec)"
@@ -3351,13 +3785,13 @@ report_copy_progress (CopyMoveJob *copy_job,
 		                details = f (ngettext ("%S / %S \xE2\x80\x94 %T left (%S/sec)",
 		                                       "%S / %S \xE2\x80\x94 %T left (%S/sec)",
 				                       seconds_count_format_time_units (remaining_time)),
-                                             transfer_info->num_bytes, total_size,
+                                             progress.transferred_bytes, total_size,
                                              remaining_time,
                                              (goffset)transfer_rate);
                         } else {
 		                /* To translators: %S will expand to a size like "2 bytes" or "3 MB". */
                                 details = f (_("%S / %S"),
-                                             transfer_info->num_bytes,
+                                             progress.transferred_bytes,
                                              total_size);
                         }
                 } else {
@@ -3370,28 +3804,29 @@ report_copy_progress (CopyMoveJob *copy_job,
 		                details = f (ngettext ("%'d / %'d \xE2\x80\x94 %T left (%S/sec)",
 		                                       "%'d / %'d \xE2\x80\x94 %T left (%S/sec)",
 				                       seconds_count_format_time_units (remaining_time)),
-                                             transfer_info->num_files + 1, source_info->num_files,
+                                             progress.transferred_files + 1, progress.num_files,
                                              remaining_time,
                                              (goffset)transfer_rate);
                         } else {
                                 /* To translators: %'d is the number of files completed for the operation,
                                  * so it will be something like 2/14. */
                                 details = f (_("%'d / %'d"),
-                                             transfer_info->num_files,
-                                             source_info->num_files);
+                                             progress.transferred_files,
+                                             progress.num_files);
                         }
                 }
 	}
 	nautilus_progress_info_take_details (job->progress, details);
 
-        if (elapsed > SECONDS_NEEDED_FOR_APROXIMATE_TRANSFER_RATE) {
+        if (elapsed > SECONDS_NEEDED_FOR_APROXIMATE_TRANSFER_RATE &&
+            !progress.scanning) {
                 nautilus_progress_info_set_remaining_time (job->progress,
                                                            remaining_time);
                 nautilus_progress_info_set_elapsed_time (job->progress,
                                                          elapsed);
         }
 
-	nautilus_progress_info_set_progress (job->progress, transfer_info->num_bytes, total_size);
+	nautilus_progress_info_set_progress (job->progress, progress.transferred_bytes, total_size);
 }
 
 static int
@@ -3806,6 +4241,19 @@ static void copy_move_file (CopyMoveJob *job,
 			    gboolean *skipped_file,
 			    gboolean readonly_source_fs);
 
+static gboolean copy_pipeline_submit (CopyMoveJob *job,
+				      GFile *src,
+				      GFile *dest_dir,
+				      gboolean same_fs,
+				      char **dest_fs_type,
+				      GHashTable *debuting_files,
+				      GdkPoint *position,
+				      gboolean readonly_source_fs);
+static void copy_pipeline_copy_attributes (CopyMoveJob *job,
+					   GFile *src,
+					   GFile *dest,
+					   GFileCopyFlags flags);
+
 typedef enum {
 	CREATE_DEST_DIR_RETRY,
 	CREATE_DEST_DIR_FAILED,
@@ -3982,7 +4430,8 @@ copy_move_directory (CopyMoveJob *copy_job,
  retry:
 	error = NULL;
 	enumerator = g_file_enumerate_children (src,
-						G_FILE_ATTRIBUTE_STANDARD_NAME,
+						G_FILE_ATTRIBUTE_STANDARD_NAME","
+						G_FILE_ATTRIBUTE_STANDARD_TYPE,
 						G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
 						job->cancellable,
 						&error);
@@ -3993,9 +4442,13 @@ copy_move_directory (CopyMoveJob *copy_job,
 		       (info = g_file_enumerator_next_file (enumerator, job->cancellable, skip_error?NULL:&error)) != NULL) {
 			src_file = g_file_get_child (src,
 						     g_file_info_get_name (info));
-			copy_move_file (copy_job, src_file, *dest, same_fs, FALSE, &dest_fs_type,
-					source_info, transfer_info, NULL, NULL, FALSE, &local_skipped_file,
-					readonly_source_fs);
+			if (g_file_info_get_file_type (info) != G_FILE_TYPE_REGULAR ||
+			    !copy_pipeline_submit (copy_job, src_file, *dest, same_fs, &dest_fs_type,
+						   NULL, NULL, readonly_source_fs)) {
+				copy_move_file (copy_job, src_file, *dest, same_fs, FALSE, &dest_fs_type,
+						source_info, transfer_info, NULL, NULL, FALSE, &local_skipped_file,
+						readonly_source_fs);
+			}
 			g_object_unref (src_file);
 			g_object_unref (info);
 		}
@@ -4090,10 +4543,15 @@ copy_move_directory (CopyMoveJob *copy_job,
 	if (create_dest) {
 		flags = (readonly_source_fs) ? G_FILE_COPY_NOFOLLOW_SYMLINKS | G_FILE_COPY_TARGET_DEFAULT_PERMS 
 					     : G_FILE_COPY_NOFOLLOW_SYMLINKS;
-		/* Ignore errors here. Failure to copy metadata is not a hard error */
-		g_file_copy_attributes (src, *dest,
-					flags,
-					job->cancellable, NULL);
+		if (copy_job->pipeline != NULL) {
+			/* The copies into the directory may still be running */
+			copy_pipeline_copy_attributes (copy_job, src, *dest, flags);
+		} else {
+			/* Ignore errors here. Failure to copy metadata is not a hard error */
+			g_file_copy_attributes (src, *dest,
+						flags,
+						job->cancellable, NULL);
+		}
 	}
 
 	if (!job_aborted (job) && copy_job->is_move &&
@@ -4546,8 +5004,11 @@ copy_move_file (CopyMoveJob *copy_job,
 	gboolean handled_invalid_filename;
 
 	job = (CommonJob *)copy_job;
+
+	verify_destination_space (copy_job, source_info, transfer_info);
 	
-	if (should_skip_file (job, src)) {
+	if (job_aborted (job) ||
+	    should_skip_file (job, src)) {
 		*skipped_file = TRUE;
 		return;
 	}
@@ -4651,19 +5112,19 @@ copy_move_file (CopyMoveJob *copy_job,
 	pdata.transfer_info = transfer_info;
 
 	if (copy_job->is_move) {
-		res = g_file_move (src, dest,
-				   flags,
-				   job->cancellable,
-				   copy_file_progress_callback,
-				   &pdata,
-				   &error);
+		res = nautilus_native_move (src, dest,
+					    flags,
+					    job->cancellable,
+					    copy_file_progress_callback,
+					    &pdata,
+					    &error);
 	} else {
-		res = g_file_copy (src, dest,
-				   flags,
-				   job->cancellable,
-				   copy_file_progress_callback,
-				   &pdata,
-				   &error);
+		res = nautilus_native_copy (src, dest,
+					    flags,
+					    job->cancellable,
+					    copy_file_progress_callback,
+					    &pdata,
+					    &error);
 	}
 	
 	if (res) {
@@ -4933,6 +5394,391 @@ copy_move_file (CopyMoveJob *copy_job,
 	g_object_unref (dest);
 }
 
+/* Copying many small files is dominated by the latency of opening,
+ * creating and closing them, not by the bandwidth, especially on network
+ * shares. Plain copies of regular files are therefore handed to a small
+ * pool of workers, which keeps several of them in flight at once, while
+ * the job thread goes on walking the sources and creating directories.
+ * Directories are still created before anything is copied into them.
+ *
+ * The workers only copy. Everything else, the progress, the changes
+ * queue, the undo info and any error or conflict, is handled on the job
+ * thread as the copies finish. A copy that failed is simply done again
+ * by copy_move_file(), which then runs the usual dialogs.
+ */
+#define COPY_PIPELINE_MAX_IN_FLIGHT 8
+
+struct CopyPipeline {
+	CopyMoveJob *job;
+	SourceInfo *source_info;
+	TransferInfo *transfer_info;
+	GThreadPool *pool;
+	GAsyncQueue *done;
+	int n_in_flight;
+
+	/* Bytes copied by the workers, not added to transfer_info yet */
+	GMutex mutex;
+	goffset num_bytes;
+
+	/* Directories whose attributes are copied once the pipeline is
+	 * empty, as they could make them read-only. Most recent first.
+	 */
+	GList *directories;
+
+	/* File system types that copy_move_file() had to query while
+	 * redoing a failed copy, by destination directory, so the names of
+	 * the following copies are made valid up front.
+	 */
+	GHashTable *dest_fs_types;
+};
+
+typedef struct {
+	CopyPipeline *pipeline;
+	GFile *src;
+	GFile *dest;
+	GFile *dest_dir;
+	GFileCopyFlags flags;
+	gboolean same_fs;
+	char *dest_fs_type;
+	gboolean readonly_source_fs;
+	gboolean toplevel;
+	gboolean has_position;
+	GdkPoint position;
+
+	/* Set by the worker */
+	goffset num_bytes;
+	gboolean success;
+	GError *error;
+} PipelinedCopy;
+
+typedef struct {
+	GFile *src;
+	GFile *dest;
+	GFileCopyFlags flags;
+} PipelinedDirectory;
+
+static void
+pipelined_copy_free (PipelinedCopy *copy)
+{
+	g_object_unref (copy->src);
+	g_object_unref (copy->dest);
+	g_object_unref (copy->dest_dir);
+	g_free (copy->dest_fs_type);
+	g_clear_error (&copy->error);
+	g_free (copy);
+}
+
+static void
+pipelined_copy_progress_callback (goffset current_num_bytes,
+				  goffset total_num_bytes,
+				  gpointer user_data)
+{
+	PipelinedCopy *copy;
+	CopyPipeline *pipeline;
+	goffset new_size;
+
+	copy = user_data;
+	pipeline = copy->pipeline;
+
+	new_size = current_num_bytes - copy->num_bytes;
+	if (new_size > 0) {
+		copy->num_bytes = current_num_bytes;
+
+		g_mutex_lock (&pipeline->mutex);
+		pipeline->num_bytes += new_size;
+		g_mutex_unlock (&pipeline->mutex);
+	}
+}
+
+static void
+copy_pipeline_worker (gpointer data,
+		      gpointer user_data)
+{
+	PipelinedCopy *copy;
+	CopyPipeline *pipeline;
+	CommonJob *job;
+	GFile *real;
+
+	copy = data;
+	pipeline = user_data;
+	job = (CommonJob *) pipeline->job;
+
+	copy->success = nautilus_native_copy (copy->src, copy->dest,
+					      copy->flags,
+					      job->cancellable,
+					      pipelined_copy_progress_callback,
+					      copy,
+					      &copy->error);
+	if (copy->success) {
+		real = map_possibly_volatile_file_to_real (copy->dest, job->cancellable, &copy->error);
+		if (real == NULL) {
+			copy->success = FALSE;
+		} else {
+			g_object_unref (copy->dest);
+			copy->dest = real;
+		}
+	}
+
+	g_async_queue_push (pipeline->done, copy);
+}
+
+static CopyPipeline *
+copy_pipeline_new (CopyMoveJob *job,
+		   SourceInfo *source_info,
+		   TransferInfo *transfer_info)
+{
+	CopyPipeline *pipeline;
+
+	pipeline = g_new0 (CopyPipeline, 1);
+	pipeline->job = job;
+	pipeline->source_info = source_info;
+	pipeline->transfer_info = transfer_info;
+	pipeline->done = g_async_queue_new ();
+	pipeline->pool = g_thread_pool_new (copy_pipeline_worker, pipeline,
+					    COPY_PIPELINE_MAX_IN_FLIGHT, FALSE, NULL);
+	g_mutex_init (&pipeline->mutex);
+	pipeline->dest_fs_types = g_hash_table_new_full (g_file_hash, (GEqualFunc) g_file_equal,
+							 g_object_unref, g_free);
+
+	return pipeline;
+}
+
+static void
+copy_pipeline_update_progress (CopyPipeline *pipeline)
+{
+	g_mutex_lock (&pipeline->mutex);
+	pipeline->transfer_info->num_bytes += pipeline->num_bytes;
+	pipeline->num_bytes = 0;
+	g_mutex_unlock (&pipeline->mutex);
+
+	report_copy_progress (pipeline->job, pipeline->source_info, pipeline->transfer_info);
+}
+
+static void
+copy_pipeline_copy_pending_attributes (CopyPipeline *pipeline)
+{
+	CommonJob *job;
+	PipelinedDirectory *directory;
+	GList *l;
+
+	job = (CommonJob *) pipeline->job;
+
+	/* Children before their parents */
+	pipeline->directories = g_list_reverse (pipeline->directories);
+	for (l = pipeline->directories; l != NULL; l = l->next) {
+		directory = l->data;
+
+		/* Ignore errors here. Failure to copy metadata is not a hard error */
+		g_file_copy_attributes (directory->src, directory->dest,
+					directory->flags,
+					job->cancellable, NULL);
+
+		g_object_unref (directory->src);
+		g_object_unref (directory->dest);
+		g_free (directory);
+	}
+	g_list_free (pipeline->directories);
+	pipeline->directories = NULL;
+}
+
+static void
+copy_pipeline_finish_copy (CopyPipeline *pipeline,
+			   PipelinedCopy *copy)
+{
+	CopyMoveJob *copy_job;
+	CommonJob *job;
+	gboolean skipped_file;
+
+	copy_job = pipeline->job;
+	job = (CommonJob *) copy_job;
+
+	pipeline->n_in_flight--;
+
+	if (copy->success) {
+		pipeline->transfer_info->num_files ++;
+		copy_pipeline_update_progress (pipeline);
+
+		if (copy->toplevel) {
+			if (copy->has_position) {
+				nautilus_file_changes_queue_schedule_position_set (copy->dest, copy->position, job->screen_num);
+			} else {
+				nautilus_file_changes_queue_schedule_position_remove (copy->dest);
+			}
+
+			g_hash_table_replace (copy_job->debuting_files, g_object_ref (copy->dest), GINT_TO_POINTER (TRUE));
+		}
+		nautilus_file_changes_queue_file_added (copy->dest);
+
+		if (job->undo_info != NULL) {
+			nautilus_file_undo_info_ext_add_origin_target_pair (NAUTILUS_FILE_UNDO_INFO_EXT (job->undo_info),
+									    copy->src, copy->dest);
+		}
+	} else if (!job_aborted (job) && !IS_IO_ERROR (copy->error, CANCELLED)) {
+		/* Don't count what was copied before the error twice */
+		copy_pipeline_update_progress (pipeline);
+		pipeline->transfer_info->num_bytes -= copy->num_bytes;
+
+		skipped_file = FALSE;
+		copy_move_file (copy_job, copy->src, copy->dest_dir,
+				copy->same_fs, FALSE, &copy->dest_fs_type,
+				pipeline->source_info, pipeline->transfer_info,
+				copy->toplevel ? copy_job->debuting_files : NULL,
+				copy->has_position ? &copy->position : NULL,
+				FALSE, &skipped_file,
+				copy->readonly_source_fs);
+
+		if (copy->dest_fs_type != NULL &&
+		    !g_hash_table_contains (pipeline->dest_fs_types, copy->dest_dir)) {
+			g_hash_table_insert (pipeline->dest_fs_types,
+					     g_object_ref (copy->dest_dir),
+					     g_strdup (copy->dest_fs_type));
+		}
+	}
+
+	pipelined_copy_free (copy);
+
+	if (pipeline->n_in_flight == 0) {
+		copy_pipeline_copy_pending_attributes (pipeline);
+	}
+}
+
+/* Waits for at least one copy to finish */
+static void
+copy_pipeline_wait (CopyPipeline *pipeline)
+{
+	PipelinedCopy *copy;
+
+	g_assert (pipeline->n_in_flight > 0);
+
+	while ((copy = g_async_queue_timeout_pop (pipeline->done, 100 * G_TIME_SPAN_MILLISECOND)) == NULL) {
+		/* Large files take a while, keep the progress moving */
+		copy_pipeline_update_progress (pipeline);
+	}
+	copy_pipeline_finish_copy (pipeline, copy);
+}
+
+static void
+copy_pipeline_collect_finished (CopyPipeline *pipeline)
+{
+	PipelinedCopy *copy;
+
+	while ((copy = g_async_queue_try_pop (pipeline->done)) != NULL) {
+		copy_pipeline_finish_copy (pipeline, copy);
+	}
+}
+
+static void
+copy_pipeline_free (CopyPipeline *pipeline)
+{
+	while (pipeline->n_in_flight > 0) {
+		copy_pipeline_wait (pipeline);
+	}
+	copy_pipeline_copy_pending_attributes (pipeline);
+
+	g_thread_pool_free (pipeline->pool, FALSE, TRUE);
+	g_async_queue_unref (pipeline->done);
+	g_mutex_clear (&pipeline->mutex);
+	g_hash_table_destroy (pipeline->dest_fs_types);
+	g_free (pipeline);
+}
+
+/* Returns FALSE if @src has to be copied with copy_move_file() instead */
+static gboolean
+copy_pipeline_submit (CopyMoveJob *copy_job,
+		      GFile *src,
+		      GFile *dest_dir,
+		      gboolean same_fs,
+		      char **dest_fs_type,
+		      GHashTable *debuting_files,
+		      GdkPoint *position,
+		      gboolean readonly_source_fs)
+{
+	CopyPipeline *pipeline;
+	PipelinedCopy *copy;
+	CommonJob *job;
+	GFile *dest;
+
+	pipeline = copy_job->pipeline;
+	job = (CommonJob *) copy_job;
+
+	if (pipeline == NULL) {
+		return FALSE;
+	}
+
+	verify_destination_space (copy_job, pipeline->source_info, pipeline->transfer_info);
+
+	if (job_aborted (job) ||
+	    copy_job->target_name != NULL ||
+	    should_skip_file (job, src) ||
+	    /* Trusted desktop files need to be marked as such */
+	    (copy_job->desktop_location != NULL &&
+	     g_file_equal (copy_job->desktop_location, dest_dir))) {
+		return FALSE;
+	}
+
+	copy_pipeline_collect_finished (pipeline);
+
+	if (*dest_fs_type == NULL) {
+		*dest_fs_type = g_strdup (g_hash_table_lookup (pipeline->dest_fs_types, dest_dir));
+	}
+
+	dest = get_target_file (src, dest_dir, *dest_fs_type, same_fs);
+	if (test_dir_is_parent (src, dest)) {
+		/* Let copy_move_file() complain */
+		g_object_unref (dest);
+		return FALSE;
+	}
+
+	while (pipeline->n_in_flight >= COPY_PIPELINE_MAX_IN_FLIGHT) {
+		copy_pipeline_wait (pipeline);
+	}
+
+	copy = g_new0 (PipelinedCopy, 1);
+	copy->pipeline = pipeline;
+	copy->src = g_object_ref (src);
+	copy->dest = dest;
+	copy->dest_dir = g_object_ref (dest_dir);
+	copy->flags = G_FILE_COPY_NOFOLLOW_SYMLINKS;
+	if (readonly_source_fs) {
+		copy->flags |= G_FILE_COPY_TARGET_DEFAULT_PERMS;
+	}
+	copy->same_fs = same_fs;
+	copy->dest_fs_type = g_strdup (*dest_fs_type);
+	copy->readonly_source_fs = readonly_source_fs;
+	copy->toplevel = debuting_files != NULL;
+	if (position != NULL) {
+		copy->has_position = TRUE;
+		copy->position = *position;
+	}
+
+	pipeline->n_in_flight++;
+	g_thread_pool_push (pipeline->pool, copy, NULL);
+
+	return TRUE;
+}
+
+static void
+copy_pipeline_copy_attributes (CopyMoveJob *copy_job,
+			       GFile *src,
+			       GFile *dest,
+			       GFileCopyFlags flags)
+{
+	CopyPipeline *pipeline;
+	PipelinedDirectory *directory;
+
+	pipeline = copy_job->pipeline;
+
+	directory = g_new0 (PipelinedDirectory, 1);
+	directory->src = g_object_ref (src);
+	directory->dest = g_object_ref (dest);
+	directory->flags = flags;
+	pipeline->directories = g_list_prepend (pipeline->directories, directory);
+
+	if (pipeline->n_in_flight == 0) {
+		copy_pipeline_copy_pending_attributes (pipeline);
+	}
+}
+
 static void
 copy_files (CopyMoveJob *job,
 	    const char *dest_fs_id,
@@ -4972,6 +5818,14 @@ copy_files (CopyMoveJob *job,
 	}
 
 	unique_names = (job->destination == NULL);
+
+	/* Moves within a file system are renames, and moves across them
+	 * have to delete each source directory after its contents.
+	 */
+	if (!job->is_move) {
+		job->pipeline = copy_pipeline_new (job, source_info, transfer_info);
+	}
+
 	i = 0;
 	for (l = job->files;
 	     l != NULL && !job_aborted (common);
@@ -4997,19 +5851,32 @@ copy_files (CopyMoveJob *job,
 			
 		}
 		if (dest) {
-			skipped_file = FALSE;
-			copy_move_file (job, src, dest,
-					same_fs, unique_names,
-					&dest_fs_type,
-					source_info, transfer_info,
-					job->debuting_files,
-					point, FALSE, &skipped_file,
-					readonly_source_fs);
+			if (unique_names ||
+			    job->pipeline == NULL ||
+			    g_file_query_file_type (src, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+						    common->cancellable) != G_FILE_TYPE_REGULAR ||
+			    !copy_pipeline_submit (job, src, dest, same_fs, &dest_fs_type,
+						   job->debuting_files, point,
+						   readonly_source_fs)) {
+				skipped_file = FALSE;
+				copy_move_file (job, src, dest,
+						same_fs, unique_names,
+						&dest_fs_type,
+						source_info, transfer_info,
+						job->debuting_files,
+						point, FALSE, &skipped_file,
+						readonly_source_fs);
+			}
 			g_object_unref (dest);
 		}
 		i++;
 	}
 
+	if (job->pipeline != NULL) {
+		copy_pipeline_free (job->pipeline);
+		job->pipeline = NULL;
+	}
+
 	g_free (dest_fs_type);
 }
 
@@ -5064,14 +5931,15 @@ copy_task_thread_func (GTask *task,
 	dest_fs_id = NULL;
 	
 	nautilus_progress_info_start (job->common.progress);
-	
-	scan_sources (job->files,
-		      &source_info,
-		      common,
-		      OP_KIND_COPY);
-	if (job_aborted (common)) {
-		goto aborted;
-	}
+
+	/* The copy doesn't wait for the scan, the free space is checked
+	 * once the scan is done.
+	 */
+	scan_sources_start (job->files,
+			    &source_info,
+			    common,
+			    OP_KIND_COPY);
+	memset (&transfer_info, 0, sizeof (transfer_info));
 
 	if (job->destination) {
 		dest = g_object_ref (job->destination);
@@ -5085,7 +5953,7 @@ copy_task_thread_func (GTask *task,
 	verify_destination (&job->common,
 			    dest,
 			    &dest_fs_id,
-			    source_info.num_bytes);
+			    -1);
 	g_object_unref (dest);
 	if (job_aborted (common)) {
 		goto aborted;
@@ -5093,12 +5961,15 @@ copy_task_thread_func (GTask *task,
 
 	g_timer_start (job->common.time);
 	
-	memset (&transfer_info, 0, sizeof (transfer_info));
 	copy_files (job,
 		    dest_fs_id,
 		    &source_info, &transfer_info);
 
  aborted:
+	scan_sources_finish (&source_info, &transfer_info, common);
+	if (!job_aborted (common)) {
+		report_copy_progress (job, &source_info, &transfer_info);
+	}
 	
 	g_free (dest_fs_id);
 }
@@ -5137,6 +6008,8 @@ nautilus_file_operations_copy_file (GFile *source_file,
 
 	inhibit_power_manager ((CommonJob *)job, _("Copying Files"));
 
+	nautilus_progress_info_set_update_func (job->common.progress, update_copy_progress, job);
+
 	task = g_task_new (NULL, job->common.cancellable, copy_task_done, job);
 	g_task_set_task_data (task, job, NULL);
 	g_task_run_in_thread (task, copy_task_thread_func);
@@ -5185,6 +6058,8 @@ nautilus_file_operations_copy (GList *files,
 		g_object_unref (src_dir);
 	}
 
+	nautilus_progress_info_set_update_func (job->common.progress, update_copy_progress, job);
+
 	task = g_task_new (NULL, job->common.cancellable, copy_task_done, job);
 	g_task_set_task_data (task, job, NULL);
 	g_task_run_in_thread (task, copy_task_thread_func);
@@ -5625,6 +6500,8 @@ move_task_thread_func (GTask *task,
 	dest_fs_type = NULL;
 
 	fallbacks = NULL;
+	memset (&source_info, 0, sizeof (source_info));
+	memset (&transfer_info, 0, sizeof (transfer_info));
 	
 	nautilus_progress_info_start (job->common.progress);
 	
@@ -5643,34 +6520,27 @@ move_task_thread_func (GTask *task,
 	}
 
 	/* The rest we need to do deep copy + delete behind on,
-	   so scan for size */
+	   so scan for size, while already moving them. The free space
+	   is checked once the scan is done. */
 
 	fallback_files = get_files_from_fallbacks (fallbacks);
-	scan_sources (fallback_files,
-		      &source_info,
-		      common,
-		      OP_KIND_MOVE);
+	scan_sources_start (fallback_files,
+			    &source_info,
+			    common,
+			    OP_KIND_MOVE);
 	
 	g_list_free (fallback_files);
-	
-	if (job_aborted (common)) {
-		goto aborted;
-	}
 
-	verify_destination (&job->common,
-			    job->destination,
-			    NULL,
-			    source_info.num_bytes);
-	if (job_aborted (common)) {
-		goto aborted;
-	}
-
-	memset (&transfer_info, 0, sizeof (transfer_info));
 	move_files (job,
 		    fallbacks,
 		    dest_fs_id, &dest_fs_type,
 		    &source_info, &transfer_info);
 
+	scan_sources_finish (&source_info, &transfer_info, common);
+	if (!job_aborted (common) && fallbacks != NULL) {
+		report_copy_progress (job, &source_info, &transfer_info);
+	}
+
  aborted:
 	g_list_free_full (fallbacks, g_free);
 
@@ -5727,6 +6597,8 @@ nautilus_file_operations_move (GList *files,
 		g_object_unref (src_dir);
 	}
 
+	nautilus_progress_info_set_update_func (job->common.progress, update_copy_progress, job);
+
 	task = g_task_new (NULL, job->common.cancellable, move_task_done, job);
 	g_task_set_task_data (task, job, NULL);
 	g_task_run_in_thread (task, move_task_thread_func);
@@ -6089,6 +6961,8 @@ nautilus_file_operations_duplicate (GList *files,
 		g_object_unref (src_dir);
 	}
 
+	nautilus_progress_info_set_update_func (job->common.progress, update_copy_progress, job);
+
 	task = g_task_new (NULL, job->common.cancellable, copy_task_done, job);
 	g_task_set_task_data (task, job, NULL);
 	g_task_run_in_thread (task, copy_task_thread_func);
@@ -6527,12 +7401,12 @@ create_task_thread_func (GTask *task,
 
 	} else {
 		if (job->src) {
-			res = g_file_copy (job->src,
-					   dest,
-					   G_FILE_COPY_NONE,
-					   common->cancellable,
-					   NULL, NULL,
-					   &error);
+			res = nautilus_native_copy (job->src,
+						    dest,
+						    G_FILE_COPY_NONE,
+						    common->cancellable,
+						    NULL, NULL,
+						    &error);
 
 			if (res) {
 				GFile *real;
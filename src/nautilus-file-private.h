@@ -41,6 +41,42 @@ typedef enum {
 	UNKNOWN
 } Knowledge;
 
+/* Allocated the first time one of these is set, since there can be
+ * many NautilusFile objects, and few of them are in the trash, being
+ * deep counted, renamed or decorated by extensions. Read them with
+ * nautilus_file_peek_cold_details(), and set them on the result of
+ * nautilus_file_get_cold_details().
+ */
+typedef struct {
+	char *selinux_context;
+
+	char *trash_orig_path;
+	time_t trash_time; /* 0 is unknown */
+
+	guint deep_directory_count;
+	guint deep_file_count;
+	guint deep_unreadable_count;
+	goffset deep_size;
+
+	/* File operations in progress */
+	GList *operations_in_progress;
+
+	/* Emblems provided by extensions */
+	GList *extension_emblems;
+	GList *pending_extension_emblems;
+
+	/* Attributes provided by extensions */
+	GHashTable *extension_attributes;
+	GHashTable *pending_extension_attributes;
+
+	/* Mount for mountpoint or the references GMount for a "mountable" */
+	GMount *mount;
+
+	eel_ref_str filesystem_type;
+	guint64 free_space; /* (guint)-1 for unknown */
+	time_t free_space_read; /* The time free_space was updated, or 0 for never */
+} NautilusFileColdDetails;
+
 struct NautilusFileDetails
 {
 	NautilusDirectory *directory;
@@ -74,27 +110,17 @@ struct NautilusFileDetails
 	
 	eel_ref_str mime_type;
 	
-	char *selinux_context;
 	char *description;
 	
 	GError *get_info_error;
 	
 	guint directory_count;
 
-	guint deep_directory_count;
-	guint deep_file_count;
-	guint deep_unreadable_count;
-	goffset deep_size;
-
 	GIcon *icon;
 	
 	char *thumbnail_path;
-	GdkPixbuf *thumbnail;
 	time_t thumbnail_mtime;
 
-	GdkPixbuf *scaled_thumbnail;
-	double thumbnail_scale;
-
 	GList *mime_list; /* If this is a directory, the list of MIME types in it. */
 
 	/* Info you might get from a link (.desktop, .directory or nautilus link) */
@@ -106,30 +132,13 @@ struct NautilusFileDetails
 	 */
 	eel_ref_str filesystem_id;
 
-	char *trash_orig_path;
-
-	/* The following is for file operations in progress. Since
-	 * there are normally only a few of these, we can move them to
-	 * a separate hash table or something if required to keep the
-	 * file objects small.
-	 */
-	GList *operations_in_progress;
-
 	/* NautilusInfoProviders that need to be run for this file */
 	GList *pending_info_providers;
 
-	/* Emblems provided by extensions */
-	GList *extension_emblems;
-	GList *pending_extension_emblems;
-
-	/* Attributes provided by extensions */
-	GHashTable *extension_attributes;
-	GHashTable *pending_extension_attributes;
-
 	GHashTable *metadata;
 
-	/* Mount for mountpoint or the references GMount for a "mountable" */
-	GMount *mount;
+	/* The details few files have, NULL until one of them is set */
+	NautilusFileColdDetails *cold;
 	
 	/* boolean fields: bitfield to save space, since there can be
            many NautilusFile objects. */
@@ -168,6 +177,8 @@ struct NautilusFileDetails
 	eel_boolean_bit got_custom_activation_uri     : 1;
 
 	eel_boolean_bit thumbnail_is_up_to_date       : 1;
+	/* The thumbnail itself is in the thumbnail cache */
+	eel_boolean_bit got_thumbnail                 : 1;
 	eel_boolean_bit thumbnail_wants_original      : 1;
 	eel_boolean_bit thumbnail_tried_original      : 1;
 	eel_boolean_bit thumbnailing_failed           : 1;
@@ -202,14 +213,8 @@ struct NautilusFileDetails
 	eel_boolean_bit filesystem_readonly           : 1;
 	eel_boolean_bit filesystem_use_preview        : 2; /* GFilesystemPreviewType */
 	eel_boolean_bit filesystem_info_is_up_to_date : 1;
-        eel_ref_str     filesystem_type;
-
-	time_t trash_time; /* 0 is unknown */
 
 	gdouble search_relevance;
-
-	guint64 free_space; /* (guint)-1 for unknown */
-	time_t free_space_read; /* The time free_space was updated, or 0 for never */
 };
 
 typedef struct {
@@ -227,6 +232,10 @@ typedef struct {
 NautilusFile *nautilus_file_new_from_info                  (NautilusDirectory      *directory,
 							    GFileInfo              *info);
 void          nautilus_file_emit_changed                   (NautilusFile           *file);
+
+const NautilusFileColdDetails *nautilus_file_peek_cold_details (NautilusFile *file);
+NautilusFileColdDetails *      nautilus_file_get_cold_details  (NautilusFile *file);
+
 void          nautilus_file_mark_gone                      (NautilusFile           *file);
 
 gboolean      nautilus_file_get_date                       (NautilusFile           *file,
@@ -243,6 +252,7 @@ gboolean      nautilus_file_update_info                    (NautilusFile
 							    GFileInfo              *info);
 gboolean      nautilus_file_update_name                    (NautilusFile           *file,
 							    const char             *name);
+void          nautilus_file_prepare_info                   (GFileInfo              *info);
 gboolean      nautilus_file_update_metadata_from_info      (NautilusFile           *file,
 							    GFileInfo              *info);
 
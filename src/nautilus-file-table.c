@@ -0,0 +1,329 @@
+/*
+   Copyright (C) 2016 Red Hat, Inc
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <config.h>
+#include "nautilus-file-table.h"
+
+#include "nautilus-file-private.h"
+
+#include <string.h>
+
+#define MIN_SLOTS 16
+#define MIN_BUCKETS 32
+
+/* Bucket values are slot + 1, so that zero means empty */
+#define BUCKET_EMPTY 0
+#define BUCKET_REMOVED G_MAXUINT32
+
+/* Files are kept in a single array, in the order they were added, so
+ * walking all of them touches contiguous memory instead of chasing list
+ * nodes. Removed files leave a NULL slot behind, which keeps the other
+ * slots stable while iterating, and the array is compacted when it
+ * fills up. Names map to slots through an open addressing table with
+ * linear probing, which needs no allocation per file either.
+ */
+struct NautilusFileTable {
+	NautilusFile **files;
+	guint *hashes;
+	guint n_slots;
+	guint allocated_slots;
+	guint n_files;
+
+	guint32 *buckets;
+	guint n_buckets;
+	guint n_used_buckets;
+};
+
+static const char *
+slot_name (NautilusFileTable *table,
+	   guint              slot)
+{
+	return eel_ref_str_peek (table->files[slot]->details->name);
+}
+
+NautilusFileTable *
+nautilus_file_table_new (void)
+{
+	return g_new0 (NautilusFileTable, 1);
+}
+
+void
+nautilus_file_table_destroy (NautilusFileTable *table)
+{
+	g_free (table->files);
+	g_free (table->hashes);
+	g_free (table->buckets);
+	g_free (table);
+}
+
+static void
+insert_bucket (NautilusFileTable *table,
+	       guint              slot)
+{
+	guint mask, i;
+
+	mask = table->n_buckets - 1;
+	for (i = table->hashes[slot] & mask;
+	     table->buckets[i] != BUCKET_EMPTY && table->buckets[i] != BUCKET_REMOVED;
+	     i = (i + 1) & mask) {
+	}
+
+	if (table->buckets[i] == BUCKET_EMPTY) {
+		table->n_used_buckets++;
+	}
+	table->buckets[i] = slot + 1;
+}
+
+static void
+rebuild_buckets (NautilusFileTable *table,
+		 guint              n_buckets)
+{
+	guint slot;
+
+	g_free (table->buckets);
+	table->buckets = g_new0 (guint32, n_buckets);
+	table->n_buckets = n_buckets;
+	table->n_used_buckets = 0;
+
+	for (slot = 0; slot < table->n_slots; slot++) {
+		if (table->files[slot] != NULL) {
+			insert_bucket (table, slot);
+		}
+	}
+}
+
+static void
+link_slot (NautilusFileTable *table,
+	   guint              slot)
+{
+	guint n_buckets;
+
+	table->hashes[slot] = g_str_hash (slot_name (table, slot));
+
+	/* Keep the load, counting removed buckets, under one half */
+	if ((table->n_used_buckets + 1) * 2 > table->n_buckets) {
+		n_buckets = MAX (table->n_buckets, MIN_BUCKETS);
+		while ((table->n_files + 1) * 4 > n_buckets) {
+			n_buckets *= 2;
+		}
+		/* This links @slot along with all the others */
+		rebuild_buckets (table, n_buckets);
+		return;
+	}
+
+	insert_bucket (table, slot);
+}
+
+/* Returns the index of the bucket for @name, or -1 */
+static gint
+find_bucket (NautilusFileTable *table,
+	     const char        *name,
+	     guint              hash,
+	     NautilusFile      *file)
+{
+	guint mask, i;
+	guint32 bucket;
+
+	if (table->n_buckets == 0) {
+		return -1;
+	}
+
+	mask = table->n_buckets - 1;
+	for (i = hash & mask; table->buckets[i] != BUCKET_EMPTY; i = (i + 1) & mask) {
+		bucket = table->buckets[i];
+		if (bucket == BUCKET_REMOVED ||
+		    table->hashes[bucket - 1] != hash) {
+			continue;
+		}
+
+		if (file != NULL ?
+		    table->files[bucket - 1] == file :
+		    strcmp (slot_name (table, bucket - 1), name) == 0) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+static void
+compact (NautilusFileTable *table)
+{
+	guint from, to;
+
+	for (from = 0, to = 0; from < table->n_slots; from++) {
+		if (table->files[from] != NULL) {
+			table->files[to] = table->files[from];
+			table->hashes[to] = table->hashes[from];
+			to++;
+		}
+	}
+	table->n_slots = to;
+
+	rebuild_buckets (table, table->n_buckets);
+}
+
+void
+nautilus_file_table_add (NautilusFileTable *table,
+			 NautilusFile      *file)
+{
+	guint slot;
+
+	g_assert (file->details->name != NULL);
+
+	if (table->n_slots == table->allocated_slots) {
+		if (table->n_files < table->n_slots / 2) {
+			compact (table);
+		} else {
+			table->allocated_slots = MAX (table->allocated_slots * 2, MIN_SLOTS);
+			table->files = g_renew (NautilusFile *, table->files, table->allocated_slots);
+			table->hashes = g_renew (guint, table->hashes, table->allocated_slots);
+		}
+	}
+
+	slot = table->n_slots++;
+	table->files[slot] = file;
+	table->n_files++;
+
+	link_slot (table, slot);
+}
+
+void
+nautilus_file_table_remove (NautilusFileTable *table,
+			    NautilusFile      *file)
+{
+	const char *name;
+	gint bucket;
+	guint slot;
+
+	name = eel_ref_str_peek (file->details->name);
+	bucket = find_bucket (table, name, g_str_hash (name), file);
+	g_assert (bucket >= 0);
+
+	slot = table->buckets[bucket] - 1;
+	table->buckets[bucket] = BUCKET_REMOVED;
+	table->files[slot] = NULL;
+	table->n_files--;
+
+	if (table->n_files == 0) {
+		/* Start over, instead of keeping the removed slots around */
+		table->n_slots = 0;
+		table->n_used_buckets = 0;
+		memset (table->buckets, 0, table->n_buckets * sizeof (guint32));
+	}
+}
+
+NautilusFile *
+nautilus_file_table_lookup (NautilusFileTable *table,
+			    const char        *name)
+{
+	gint bucket;
+
+	bucket = find_bucket (table, name, g_str_hash (name), NULL);
+
+	return bucket < 0 ? NULL : table->files[table->buckets[bucket] - 1];
+}
+
+/* Returns the slot of @file, to be passed to
+ * nautilus_file_table_link_name(), or -1 if it's not in the table.
+ */
+gint
+nautilus_file_table_unlink_name (NautilusFileTable *table,
+				 NautilusFile      *file)
+{
+	const char *name;
+	gint bucket;
+	guint slot;
+
+	name = eel_ref_str_peek (file->details->name);
+	if (name == NULL) {
+		return -1;
+	}
+
+	bucket = find_bucket (table, name, g_str_hash (name), file);
+	if (bucket < 0) {
+		return -1;
+	}
+
+	slot = table->buckets[bucket] - 1;
+	table->buckets[bucket] = BUCKET_REMOVED;
+
+	return slot;
+}
+
+void
+nautilus_file_table_link_name (NautilusFileTable *table,
+			       gint               slot)
+{
+	const char *name;
+
+	g_assert (slot >= 0 && (guint) slot < table->n_slots);
+	g_assert (table->files[slot] != NULL);
+
+	name = slot_name (table, slot);
+	g_assert (nautilus_file_table_lookup (table, name) == NULL);
+
+	link_slot (table, slot);
+}
+
+guint
+nautilus_file_table_get_length (NautilusFileTable *table)
+{
+	return table->n_files;
+}
+
+GList *
+nautilus_file_table_get_list (NautilusFileTable *table)
+{
+	GList *list;
+	guint slot;
+
+	list = NULL;
+	for (slot = table->n_slots; slot > 0; slot--) {
+		if (table->files[slot - 1] != NULL) {
+			list = g_list_prepend (list, table->files[slot - 1]);
+		}
+	}
+
+	return list;
+}
+
+void
+nautilus_file_table_iter_init (NautilusFileTableIter *iter,
+			       NautilusFileTable     *table)
+{
+	iter->table = table;
+	iter->slot = 0;
+}
+
+gboolean
+nautilus_file_table_iter_next (NautilusFileTableIter *iter,
+			       NautilusFile         **file)
+{
+	NautilusFileTable *table;
+
+	table = iter->table;
+
+	while (iter->slot < table->n_slots) {
+		*file = table->files[iter->slot++];
+		if (*file != NULL) {
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
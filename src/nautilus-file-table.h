@@ -0,0 +1,68 @@
+/*
+   Copyright (C) 2016 Red Hat, Inc
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* nautilus-file-table.h: the files of a directory, packed in an array
+   and indexed by name.
+*/
+
+#ifndef NAUTILUS_FILE_TABLE_H
+#define NAUTILUS_FILE_TABLE_H
+
+#include "nautilus-file.h"
+
+typedef struct NautilusFileTable NautilusFileTable;
+
+typedef struct {
+	/*< private >*/
+	NautilusFileTable *table;
+	guint slot;
+} NautilusFileTableIter;
+
+NautilusFileTable *nautilus_file_table_new         (void);
+void               nautilus_file_table_destroy     (NautilusFileTable *table);
+
+/* The table doesn't hold references to the files. Files are looked up
+ * by their current name, so a file has to be unlinked before it is
+ * renamed, and linked again afterwards.
+ */
+void               nautilus_file_table_add         (NautilusFileTable *table,
+						    NautilusFile      *file);
+void               nautilus_file_table_remove      (NautilusFileTable *table,
+						    NautilusFile      *file);
+NautilusFile *     nautilus_file_table_lookup      (NautilusFileTable *table,
+						    const char        *name);
+gint               nautilus_file_table_unlink_name (NautilusFileTable *table,
+						    NautilusFile      *file);
+void               nautilus_file_table_link_name   (NautilusFileTable *table,
+						    gint               slot);
+
+guint              nautilus_file_table_get_length  (NautilusFileTable *table);
+
+/* Returns a new list of the files, in the order they were added. The
+ * files are not referenced.
+ */
+GList *            nautilus_file_table_get_list    (NautilusFileTable *table);
+
+/* Files may be removed while iterating, but adding a file invalidates
+ * the iterator.
+ */
+void               nautilus_file_table_iter_init   (NautilusFileTableIter *iter,
+						    NautilusFileTable     *table);
+gboolean           nautilus_file_table_iter_next   (NautilusFileTableIter *iter,
+						    NautilusFile         **file);
+
+#endif /* NAUTILUS_FILE_TABLE_H */
@@ -34,6 +34,7 @@
 #include "nautilus-link.h"
 #include "nautilus-metadata.h"
 #include "nautilus-module.h"
+#include "nautilus-thumbnail-cache.h"
 #include "nautilus-thumbnails.h"
 #include "nautilus-ui-utilities.h"
 #include "nautilus-video-mime-types.h"
@@ -57,6 +58,7 @@
 #include <libxml/parser.h>
 #include <pwd.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/time.h>
 #include <time.h>
 #include <unistd.h>
@@ -170,6 +172,66 @@ G_DEFINE_TYPE_WITH_CODE (NautilusFile, nautilus_file, G_TYPE_OBJECT,
 			 G_IMPLEMENT_INTERFACE (NAUTILUS_TYPE_FILE_INFO,
 						nautilus_file_info_iface_init));
 
+/* What the cold details of files that have none read as, set up in
+ * class_init.
+ */
+static NautilusFileColdDetails default_cold_details;
+
+const NautilusFileColdDetails *
+nautilus_file_peek_cold_details (NautilusFile *file)
+{
+	if (file->details->cold == NULL) {
+		return &default_cold_details;
+	}
+
+	return file->details->cold;
+}
+
+NautilusFileColdDetails *
+nautilus_file_get_cold_details (NautilusFile *file)
+{
+	if (file->details->cold == NULL) {
+		file->details->cold = g_slice_new (NautilusFileColdDetails);
+		*file->details->cold = default_cold_details;
+	}
+
+	return file->details->cold;
+}
+
+static void
+cold_details_free (NautilusFile *file,
+		   NautilusFileColdDetails *cold)
+{
+	g_free (cold->selinux_context);
+	g_free (cold->trash_orig_path);
+
+	if (cold->mount) {
+		g_signal_handlers_disconnect_by_func (cold->mount, file_mount_unmounted, file);
+		g_object_unref (cold->mount);
+	}
+
+	eel_ref_str_unref (cold->filesystem_type);
+
+	g_list_free_full (cold->pending_extension_emblems, g_free);
+	g_list_free_full (cold->extension_emblems, g_free);
+
+	if (cold->pending_extension_attributes) {
+		g_hash_table_destroy (cold->pending_extension_attributes);
+	}
+
+	if (cold->extension_attributes) {
+		g_hash_table_destroy (cold->extension_attributes);
+	}
+
+	g_slice_free (NautilusFileColdDetails, cold);
+}
+
+static GMount *
+peek_mount (NautilusFile *file)
+{
+	return nautilus_file_peek_cold_details (file)->mount;
+}
+
 static void
 nautilus_file_init (NautilusFile *file)
 {
@@ -177,8 +239,6 @@ nautilus_file_init (NautilusFile *file)
 
 	nautilus_file_clear_info (file);
 	nautilus_file_invalidate_extension_info_internal (file);
-
-	file->details->free_space = -1;
 }
 
 static GObject*
@@ -480,13 +540,15 @@ nautilus_file_clear_info (NautilusFile *file)
 	file->details->sort_order = 0;
 	file->details->mtime = 0;
 	file->details->atime = 0;
-	file->details->trash_time = 0;
 	g_free (file->details->symlink_name);
 	file->details->symlink_name = NULL;
 	eel_ref_str_unref (file->details->mime_type);
 	file->details->mime_type = NULL;
-	g_free (file->details->selinux_context);
-	file->details->selinux_context = NULL;
+	if (file->details->cold != NULL) {
+		file->details->cold->trash_time = 0;
+		g_free (file->details->cold->selinux_context);
+		file->details->cold->selinux_context = NULL;
+	}
 	g_free (file->details->description);
 	file->details->description = NULL;
 	eel_ref_str_unref (file->details->owner);
@@ -621,6 +683,103 @@ remove_from_link_hash_table (NautilusFile *file)
 	modify_link_hash_table (file, remove_from_link_hash_table_list);
 }
 
+typedef struct {
+	eel_ref_str name;
+	eel_ref_str display_name;
+	char *display_name_collation_key;
+	eel_ref_str edit_name;
+	eel_ref_str mime_type;
+} PreparedInfo;
+
+static GQuark
+prepared_info_quark (void)
+{
+	static GQuark quark;
+
+	if (g_once_init_enter (&quark)) {
+		g_once_init_leave (&quark,
+				   g_quark_from_static_string ("nautilus-file-prepared-info"));
+	}
+
+	return quark;
+}
+
+static void
+prepared_info_free (PreparedInfo *prepared)
+{
+	eel_ref_str_unref (prepared->name);
+	eel_ref_str_unref (prepared->display_name);
+	g_free (prepared->display_name_collation_key);
+	eel_ref_str_unref (prepared->edit_name);
+	eel_ref_str_unref (prepared->mime_type);
+	g_free (prepared);
+}
+
+/* Does the expensive part of creating a file from @info, like the
+ * collation key of its display name, ahead of time. This may be called
+ * from any thread, as long as no other thread uses @info meanwhile, and
+ * nautilus_file_new_from_info() picks the results up later.
+ */
+void
+nautilus_file_prepare_info (GFileInfo *info)
+{
+	PreparedInfo *prepared;
+	const char *name, *display_name, *edit_name;
+
+	name = g_file_info_get_name (info);
+	if (name == NULL) {
+		return;
+	}
+
+	prepared = g_new0 (PreparedInfo, 1);
+	prepared->name = eel_ref_str_new (name);
+
+	display_name = g_file_info_get_display_name (info);
+	if (display_name != NULL && *display_name != 0) {
+		if (strcmp (name, display_name) == 0) {
+			prepared->display_name = eel_ref_str_ref (prepared->name);
+		} else {
+			prepared->display_name = eel_ref_str_new (display_name);
+		}
+		prepared->display_name_collation_key =
+			g_utf8_collate_key_for_filename (display_name, -1);
+
+		edit_name = g_file_info_get_edit_name (info);
+		if (edit_name == NULL || strcmp (edit_name, display_name) == 0) {
+			prepared->edit_name = eel_ref_str_ref (prepared->display_name);
+		} else {
+			prepared->edit_name = eel_ref_str_new (edit_name);
+		}
+	}
+
+	prepared->mime_type = eel_ref_str_get_unique (g_file_info_get_content_type (info));
+
+	g_object_set_qdata_full (G_OBJECT (info), prepared_info_quark (),
+				 prepared, (GDestroyNotify) prepared_info_free);
+}
+
+/* Moves what nautilus_file_prepare_info() computed into the new @file,
+ * so that updating it from the info finds it all unchanged.
+ */
+static void
+take_prepared_info (NautilusFile *file,
+		    GFileInfo *info)
+{
+	PreparedInfo *prepared;
+
+	prepared = g_object_steal_qdata (G_OBJECT (info), prepared_info_quark ());
+	if (prepared == NULL) {
+		return;
+	}
+
+	file->details->name = prepared->name;
+	file->details->display_name = prepared->display_name;
+	file->details->display_name_collation_key = prepared->display_name_collation_key;
+	file->details->edit_name = prepared->edit_name;
+	file->details->mime_type = prepared->mime_type;
+	g_free (prepared);
+}
+
 NautilusFile *
 nautilus_file_new_from_info (NautilusDirectory *directory,
 			     GFileInfo *info)
@@ -633,6 +792,7 @@ nautilus_file_new_from_info (NautilusDirectory *directory,
 	file = NAUTILUS_FILE (g_object_new (NAUTILUS_TYPE_VFS_FILE, NULL));
 	nautilus_file_set_directory (file, directory);
 
+	take_prepared_info (file, info);
 	update_info_and_name (file, info);
 
 #ifdef NAUTILUS_FILE_DEBUG_REF
@@ -753,7 +913,7 @@ finalize (GObject *object)
 
 	file = NAUTILUS_FILE (object);
 
-	g_assert (file->details->operations_in_progress == NULL);
+	g_assert (nautilus_file_peek_cold_details (file)->operations_in_progress == NULL);
 
 	if (file->details->is_thumbnailing) {
 		uri = nautilus_file_get_uri (file);
@@ -794,39 +954,17 @@ finalize (GObject *object)
 	eel_ref_str_unref (file->details->owner);
 	eel_ref_str_unref (file->details->owner_real);
 	eel_ref_str_unref (file->details->group);
-	g_free (file->details->selinux_context);
 	g_free (file->details->description);
 	g_free (file->details->activation_uri);
 	g_clear_object (&file->details->custom_icon);
 
-	if (file->details->thumbnail) {
-		g_object_unref (file->details->thumbnail);
-	}
-	if (file->details->scaled_thumbnail) {
-		g_object_unref (file->details->scaled_thumbnail);
-	}
-
-	if (file->details->mount) {
-		g_signal_handlers_disconnect_by_func (file->details->mount, file_mount_unmounted, file);
-		g_object_unref (file->details->mount);
-	}
-
 	eel_ref_str_unref (file->details->filesystem_id);
-	eel_ref_str_unref (file->details->filesystem_type);
-        file->details->filesystem_type = NULL;
-	g_free (file->details->trash_orig_path);
 
 	g_list_free_full (file->details->mime_list, g_free);
-	g_list_free_full (file->details->pending_extension_emblems, g_free);
-	g_list_free_full (file->details->extension_emblems, g_free);
 	g_list_free_full (file->details->pending_info_providers, g_object_unref);
 
-	if (file->details->pending_extension_attributes) {
-		g_hash_table_destroy (file->details->pending_extension_attributes);
-	}
-	
-	if (file->details->extension_attributes) {
-		g_hash_table_destroy (file->details->extension_attributes);
+	if (file->details->cold != NULL) {
+		cold_details_free (file, file->details->cold);
 	}
 
 	if (file->details->metadata) {
@@ -1020,8 +1158,8 @@ nautilus_file_can_unmount (NautilusFile *file)
 	g_return_val_if_fail (NAUTILUS_IS_FILE (file), FALSE);
 
 	return file->details->can_unmount ||
-		(file->details->mount != NULL &&
-		 g_mount_can_unmount (file->details->mount));
+		(peek_mount (file) != NULL &&
+		 g_mount_can_unmount (peek_mount (file)));
 }
 	
 gboolean
@@ -1030,8 +1168,8 @@ nautilus_file_can_eject (NautilusFile *file)
 	g_return_val_if_fail (NAUTILUS_IS_FILE (file), FALSE);
 
 	return file->details->can_eject ||
-		(file->details->mount != NULL &&
-		 g_mount_can_eject (file->details->mount));
+		(peek_mount (file) != NULL &&
+		 g_mount_can_eject (peek_mount (file)));
 }
 
 gboolean
@@ -1049,8 +1187,8 @@ nautilus_file_can_start (NautilusFile *file)
 		goto out;
 	}
 
-	if (file->details->mount != NULL) {
-		drive = g_mount_get_drive (file->details->mount);
+	if (peek_mount (file) != NULL) {
+		drive = g_mount_get_drive (peek_mount (file));
 		if (drive != NULL) {
 			ret = g_drive_can_start (drive);
 			g_object_unref (drive);
@@ -1076,8 +1214,8 @@ nautilus_file_can_start_degraded (NautilusFile *file)
 		goto out;
 	}
 
-	if (file->details->mount != NULL) {
-		drive = g_mount_get_drive (file->details->mount);
+	if (peek_mount (file) != NULL) {
+		drive = g_mount_get_drive (peek_mount (file));
 		if (drive != NULL) {
 			ret = g_drive_can_start_degraded (drive);
 			g_object_unref (drive);
@@ -1103,8 +1241,8 @@ nautilus_file_can_poll_for_media (NautilusFile *file)
 		goto out;
 	}
 
-	if (file->details->mount != NULL) {
-		drive = g_mount_get_drive (file->details->mount);
+	if (peek_mount (file) != NULL) {
+		drive = g_mount_get_drive (peek_mount (file));
 		if (drive != NULL) {
 			ret = g_drive_can_poll_for_media (drive);
 			g_object_unref (drive);
@@ -1130,8 +1268,8 @@ nautilus_file_is_media_check_automatic (NautilusFile *file)
 		goto out;
 	}
 
-	if (file->details->mount != NULL) {
-		drive = g_mount_get_drive (file->details->mount);
+	if (peek_mount (file) != NULL) {
+		drive = g_mount_get_drive (peek_mount (file));
 		if (drive != NULL) {
 			ret = g_drive_is_media_check_automatic (drive);
 			g_object_unref (drive);
@@ -1158,8 +1296,8 @@ nautilus_file_can_stop (NautilusFile *file)
 		goto out;
 	}
 
-	if (file->details->mount != NULL) {
-		drive = g_mount_get_drive (file->details->mount);
+	if (peek_mount (file) != NULL) {
+		drive = g_mount_get_drive (peek_mount (file));
 		if (drive != NULL) {
 			ret = g_drive_can_stop (drive);
 			g_object_unref (drive);
@@ -1182,8 +1320,8 @@ nautilus_file_get_start_stop_type (NautilusFile *file)
 	if (ret != G_DRIVE_START_STOP_TYPE_UNKNOWN)
 		goto out;
 
-	if (file->details->mount != NULL) {
-		drive = g_mount_get_drive (file->details->mount);
+	if (peek_mount (file) != NULL) {
+		drive = g_mount_get_drive (peek_mount (file));
 		if (drive != NULL) {
 			ret = g_drive_get_start_stop_type (drive);
 			g_object_unref (drive);
@@ -1257,13 +1395,13 @@ nautilus_file_unmount (NautilusFile                   *file,
 				g_error_free (error);
 			}
 		}
-	} else if (file->details->mount != NULL &&
-		   g_mount_can_unmount (file->details->mount)) {
+	} else if (peek_mount (file) != NULL &&
+		   g_mount_can_unmount (peek_mount (file))) {
 		data = g_new0 (UnmountData, 1);
 		data->file = nautilus_file_ref (file);
 		data->callback = callback;
 		data->callback_data = callback_data;
-		nautilus_file_operations_unmount_mount_full (NULL, file->details->mount, NULL, FALSE, TRUE, unmount_done, data);
+		nautilus_file_operations_unmount_mount_full (NULL, peek_mount (file), NULL, FALSE, TRUE, unmount_done, data);
 	} else if (callback) {
 		callback (file, NULL, NULL, callback_data);
 	}
@@ -1291,13 +1429,13 @@ nautilus_file_eject (NautilusFile                   *file,
 				g_error_free (error);
 			}
 		}
-	} else if (file->details->mount != NULL &&
-		   g_mount_can_eject (file->details->mount)) {
+	} else if (peek_mount (file) != NULL &&
+		   g_mount_can_eject (peek_mount (file))) {
 		data = g_new0 (UnmountData, 1);
 		data->file = nautilus_file_ref (file);
 		data->callback = callback;
 		data->callback_data = callback_data;
-		nautilus_file_operations_unmount_mount_full (NULL, file->details->mount, NULL, TRUE, TRUE, unmount_done, data);
+		nautilus_file_operations_unmount_mount_full (NULL, peek_mount (file), NULL, TRUE, TRUE, unmount_done, data);
 	} else if (callback) {
 		callback (file, NULL, NULL, callback_data);
 	}
@@ -1380,8 +1518,8 @@ nautilus_file_stop (NautilusFile                   *file,
 		GDrive *drive;
 
 		drive = NULL;
-		if (file->details->mount != NULL)
-			drive = g_mount_get_drive (file->details->mount);
+		if (peek_mount (file) != NULL)
+			drive = g_mount_get_drive (peek_mount (file));
 
 		if (drive != NULL && g_drive_can_stop (drive)) {
 			NautilusFileOperation *op;
@@ -1421,9 +1559,9 @@ nautilus_file_poll_for_media (NautilusFile *file)
 		if (NAUTILUS_FILE_GET_CLASS (file)->stop != NULL) {
 			NAUTILUS_FILE_GET_CLASS (file)->poll_for_media (file);
 		}
-	} else if (file->details->mount != NULL) {
+	} else if (peek_mount (file) != NULL) {
 		GDrive *drive;
-		drive = g_mount_get_drive (file->details->mount);
+		drive = g_mount_get_drive (peek_mount (file));
 		if (drive != NULL) {
 			g_drive_poll_for_media (drive,
 						NULL,  /* cancellable */
@@ -1631,6 +1769,7 @@ nautilus_file_operation_new (NautilusFile *file,
 			     gpointer callback_data)
 {
 	NautilusFileOperation *op;
+	NautilusFileColdDetails *cold;
 
 	op = g_new0 (NautilusFileOperation, 1);
 	op->file = nautilus_file_ref (file);
@@ -1638,8 +1777,9 @@ nautilus_file_operation_new (NautilusFile *file,
 	op->callback_data = callback_data;
 	op->cancellable = g_cancellable_new ();
 
-	op->file->details->operations_in_progress = g_list_prepend
-		(op->file->details->operations_in_progress, op);
+	cold = nautilus_file_get_cold_details (file);
+	cold->operations_in_progress = g_list_prepend
+		(cold->operations_in_progress, op);
 
 	return op;
 }
@@ -1647,8 +1787,11 @@ nautilus_file_operation_new (NautilusFile *file,
 static void
 nautilus_file_operation_remove (NautilusFileOperation *op)
 {
-	op->file->details->operations_in_progress = g_list_remove
-		(op->file->details->operations_in_progress, op);
+	NautilusFileColdDetails *cold;
+
+	cold = nautilus_file_get_cold_details (op->file);
+	cold->operations_in_progress = g_list_remove
+		(cold->operations_in_progress, op);
 }
 
 void
@@ -1976,7 +2119,7 @@ nautilus_file_rename_in_progress (NautilusFile *file)
 	GList *node;
 	NautilusFileOperation *op;
 
-	for (node = file->details->operations_in_progress; node != NULL; node = node->next) {
+	for (node = nautilus_file_peek_cold_details (file)->operations_in_progress; node != NULL; node = node->next) {
 		op = node->data;
 		if (op->is_rename) {
 			return TRUE;
@@ -1993,7 +2136,7 @@ nautilus_file_cancel (NautilusFile *file,
 	GList *node, *next;
 	NautilusFileOperation *op;
 
-	for (node = file->details->operations_in_progress; node != NULL; node = next) {
+	for (node = nautilus_file_peek_cold_details (file)->operations_in_progress; node != NULL; node = next) {
 		next = node->next;
 		op = node->data;
 
@@ -2103,7 +2246,7 @@ update_info_internal (NautilusFile *file,
 		      GFileInfo *info,
 		      gboolean update_name)
 {
-	GList *node;
+	gint slot;
 	gboolean changed;
 	gboolean is_symlink, is_hidden, is_mountpoint;
 	gboolean has_permissions;
@@ -2129,6 +2272,7 @@ update_info_internal (NautilusFile *file,
 	const char *trash_orig_path;
 	const char *group, *owner, *owner_real;
 	gboolean free_owner, free_group;
+	NautilusFileColdDetails *cold;
 	
 	if (file->details->is_gone) {
 		return FALSE;
@@ -2401,7 +2545,7 @@ update_info_internal (NautilusFile *file,
 	mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
 	if (file->details->atime != atime ||
 	    file->details->mtime != mtime) {
-		if (file->details->thumbnail == NULL) {
+		if (!file->details->got_thumbnail) {
 			file->details->thumbnail_is_up_to_date = FALSE;
 		}
 
@@ -2410,7 +2554,7 @@ update_info_internal (NautilusFile *file,
 	file->details->atime = atime;
 	file->details->mtime = mtime;
 
-	if (file->details->thumbnail != NULL &&
+	if (file->details->got_thumbnail &&
 	    file->details->thumbnail_mtime != 0 &&
 	    file->details->thumbnail_mtime != mtime) {
 		file->details->thumbnail_is_up_to_date = FALSE;
@@ -2455,10 +2599,11 @@ update_info_internal (NautilusFile *file,
 	}
 	
 	selinux_context = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_SELINUX_CONTEXT);
-	if (g_strcmp0 (file->details->selinux_context, selinux_context) != 0) {
+	if (g_strcmp0 (nautilus_file_peek_cold_details (file)->selinux_context, selinux_context) != 0) {
 		changed = TRUE;
-		g_free (file->details->selinux_context);
-		file->details->selinux_context = g_strdup (selinux_context);
+		cold = nautilus_file_get_cold_details (file);
+		g_free (cold->selinux_context);
+		cold->selinux_context = g_strdup (selinux_context);
 	}
 	
 	description = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_STANDARD_DESCRIPTION);
@@ -2481,16 +2626,17 @@ update_info_internal (NautilusFile *file,
 		g_time_val_from_iso8601 (time_string, &g_trash_time);
 		trash_time = g_trash_time.tv_sec;
 	}
-	if (file->details->trash_time != trash_time) {
+	if (nautilus_file_peek_cold_details (file)->trash_time != trash_time) {
 		changed = TRUE;
-		file->details->trash_time = trash_time;
+		nautilus_file_get_cold_details (file)->trash_time = trash_time;
 	}
 
 	trash_orig_path = g_file_info_get_attribute_byte_string (info, "trash::orig-path");
-	if (g_strcmp0 (file->details->trash_orig_path, trash_orig_path) != 0) {
+	if (g_strcmp0 (nautilus_file_peek_cold_details (file)->trash_orig_path, trash_orig_path) != 0) {
 		changed = TRUE;
-		g_free (file->details->trash_orig_path);
-		file->details->trash_orig_path = g_strdup (trash_orig_path);
+		cold = nautilus_file_get_cold_details (file);
+		g_free (cold->trash_orig_path);
+		cold->trash_orig_path = g_strdup (trash_orig_path);
 	}
 
 	changed |=
@@ -2502,7 +2648,7 @@ update_info_internal (NautilusFile *file,
 		    strcmp (eel_ref_str_peek (file->details->name), name) != 0) {
 			changed = TRUE;
 
-			node = nautilus_directory_begin_file_name_change
+			slot = nautilus_directory_begin_file_name_change
 				(file->details->directory, file);
 			
 			eel_ref_str_unref (file->details->name);
@@ -2523,7 +2669,7 @@ update_info_internal (NautilusFile *file,
 			}
 
 			nautilus_directory_end_file_name_change
-				(file->details->directory, file, node);
+				(file->details->directory, file, slot);
 		}
 	}
 
@@ -2555,7 +2701,7 @@ update_name_internal (NautilusFile *file,
 		      const char *name,
 		      gboolean in_directory)
 {
-	GList *node;
+	gint slot;
 
 	g_assert (name != NULL);
 
@@ -2567,9 +2713,9 @@ update_name_internal (NautilusFile *file,
 		return FALSE;
 	}
 	
-	node = NULL;
+	slot = -1;
 	if (in_directory) {
-		node = nautilus_directory_begin_file_name_change
+		slot = nautilus_directory_begin_file_name_change
 			(file->details->directory, file);
 	}
 	
@@ -2582,7 +2728,7 @@ update_name_internal (NautilusFile *file,
 
 	if (in_directory) {
 		nautilus_directory_end_file_name_change
-			(file->details->directory, file, node);
+			(file->details->directory, file, slot);
 	}
 
 	return TRUE;
@@ -2731,7 +2877,7 @@ get_time (NautilusFile *file,
 		time = file->details->atime;
 		break;
 	case NAUTILUS_DATE_TYPE_TRASHED:
-		time = file->details->trash_time;
+		time = nautilus_file_peek_cold_details (file)->trash_time;
 		break;
 	default:
 		g_assert_not_reached ();
@@ -3199,6 +3345,29 @@ nautilus_file_compare_for_sort (NautilusFile *file_1,
 	return result;
 }
 
+static NautilusFileSortType
+get_sort_type_for_attribute (GQuark attribute)
+{
+	if (attribute == 0 || attribute == attribute_name_q) {
+		return NAUTILUS_FILE_SORT_BY_DISPLAY_NAME;
+	} else if (attribute == attribute_size_q) {
+		return NAUTILUS_FILE_SORT_BY_SIZE;
+	} else if (attribute == attribute_type_q) {
+		return NAUTILUS_FILE_SORT_BY_TYPE;
+	} else if (attribute == attribute_modification_date_q || attribute == attribute_date_modified_q || attribute == attribute_date_modified_with_time_q || attribute == attribute_date_modified_full_q) {
+		return NAUTILUS_FILE_SORT_BY_MTIME;
+	} else if (attribute == attribute_accessed_date_q || attribute == attribute_date_accessed_q || attribute == attribute_date_accessed_full_q) {
+		return NAUTILUS_FILE_SORT_BY_ATIME;
+	} else if (attribute == attribute_trashed_on_q || attribute == attribute_trashed_on_full_q) {
+		return NAUTILUS_FILE_SORT_BY_TRASHED_TIME;
+	} else if (attribute == attribute_search_relevance_q) {
+		return NAUTILUS_FILE_SORT_BY_SEARCH_RELEVANCE;
+	}
+
+	/* A normal attribute, compared by strings */
+	return NAUTILUS_FILE_SORT_NONE;
+}
+
 int
 nautilus_file_compare_for_sort_by_attribute_q   (NautilusFile                   *file_1,
 						 NautilusFile                   *file_2,
@@ -3206,6 +3375,7 @@ nautilus_file_compare_for_sort_by_attribute_q   (NautilusFile
 						 gboolean                        directories_first,
 						 gboolean                        reversed)
 {
+	NautilusFileSortType sort_type;
 	int result;
 
 	if (file_1 == file_2) {
@@ -3215,39 +3385,10 @@ nautilus_file_compare_for_sort_by_attribute_q   (NautilusFile
 	/* Convert certain attributes into NautilusFileSortTypes and use
 	 * nautilus_file_compare_for_sort()
 	 */
-	if (attribute == 0 || attribute == attribute_name_q) {
-		return nautilus_file_compare_for_sort (file_1, file_2,
-						       NAUTILUS_FILE_SORT_BY_DISPLAY_NAME,
-						       directories_first,
-						       reversed);
-	} else if (attribute == attribute_size_q) {
-		return nautilus_file_compare_for_sort (file_1, file_2,
-						       NAUTILUS_FILE_SORT_BY_SIZE,
-						       directories_first,
-						       reversed);
-	} else if (attribute == attribute_type_q) {
-		return nautilus_file_compare_for_sort (file_1, file_2,
-						       NAUTILUS_FILE_SORT_BY_TYPE,
-						       directories_first,
-						       reversed);
-	} else if (attribute == attribute_modification_date_q || attribute == attribute_date_modified_q || attribute == attribute_date_modified_with_time_q || attribute == attribute_date_modified_full_q) {
-		return nautilus_file_compare_for_sort (file_1, file_2,
-						       NAUTILUS_FILE_SORT_BY_MTIME,
-						       directories_first,
-						       reversed);
-        } else if (attribute == attribute_accessed_date_q || attribute == attribute_date_accessed_q || attribute == attribute_date_accessed_full_q) {
+	sort_type = get_sort_type_for_attribute (attribute);
+	if (sort_type != NAUTILUS_FILE_SORT_NONE) {
 		return nautilus_file_compare_for_sort (file_1, file_2,
-						       NAUTILUS_FILE_SORT_BY_ATIME,
-						       directories_first,
-						       reversed);
-        } else if (attribute == attribute_trashed_on_q || attribute == attribute_trashed_on_full_q) {
-		return nautilus_file_compare_for_sort (file_1, file_2,
-						       NAUTILUS_FILE_SORT_BY_TRASHED_TIME,
-						       directories_first,
-						       reversed);
-        } else if (attribute == attribute_search_relevance_q) {
-		return nautilus_file_compare_for_sort (file_1, file_2,
-						       NAUTILUS_FILE_SORT_BY_SEARCH_RELEVANCE,
+						       sort_type,
 						       directories_first,
 						       reversed);
 	}
@@ -3293,6 +3434,339 @@ nautilus_file_compare_for_sort_by_attribute     (NautilusFile
 							      reversed);
 }
 
+/* Sorting lots of files with the comparison functions above is slow,
+ * since they look up the same details again for every comparison. So
+ * each file gets a sort key once, with the details that matter for the
+ * sort criterion packed so that files with different keys compare like
+ * their keys do. The keys are radix sorted, and only the files with the
+ * same keys, like the ones whose names start alike, are compared fully.
+ */
+typedef struct {
+	guint64 low;  /* The sort criterion */
+	guint64 high; /* Directories first, then the sort order of the info */
+	NautilusFile *file;
+} SortItem;
+
+typedef struct {
+	GQuark attribute;
+	gboolean directories_first;
+	gboolean reversed;
+} SortParameters;
+
+#define SORT_KEY_BYTES 16
+
+/* The first 8 bytes of @string, as a number ordered like strcmp() does */
+static guint64
+get_string_sort_key (const char *string)
+{
+	guint64 key;
+	int i;
+
+	key = 0;
+	for (i = 0; i < 8; i++) {
+		key <<= 8;
+		if (string != NULL && *string != '\0') {
+			key |= (guchar) *string++;
+		}
+	}
+
+	return key;
+}
+
+/* Knowledge sorts in reverse, unknown things first */
+static guint64
+get_knowledge_sort_key (Knowledge knowledge)
+{
+	return UNKNOWN - knowledge;
+}
+
+static guint64
+get_sort_key_by_display_name (NautilusFile *file)
+{
+	const char *name;
+	gboolean sort_last;
+
+	name = nautilus_file_peek_display_name (file);
+	sort_last = name[0] == SORT_LAST_CHAR1 || name[0] == SORT_LAST_CHAR2;
+
+	return ((guint64) sort_last << 63) |
+		(get_string_sort_key (nautilus_file_peek_display_name_collation_key (file)) >> 8);
+}
+
+static guint64
+get_sort_key_by_size (NautilusFile *file)
+{
+	Knowledge knowledge;
+	goffset size;
+	guint count;
+
+	if (nautilus_file_is_directory (file)) {
+		count = 0;
+		knowledge = get_item_count (file, &count);
+		return (get_knowledge_sort_key (knowledge) << 61) |
+			(knowledge == KNOWN ? count : 0);
+	}
+
+	size = 0;
+	knowledge = get_size (file, &size);
+	return ((guint64) 1 << 63) |
+		(get_knowledge_sort_key (knowledge) << 61) |
+		(knowledge == KNOWN ? MIN ((guint64) MAX (size, 0), ((guint64) 1 << 61) - 1) : 0);
+}
+
+static guint64
+get_sort_key_by_type (NautilusFile *file)
+{
+	char *type_string;
+	char *collation_key;
+	guint64 key;
+
+	if (nautilus_file_is_directory (file)) {
+		return 0;
+	}
+
+	type_string = nautilus_file_get_type_as_string (file);
+	if (type_string == NULL) {
+		return ((guint64) 1 << 63) | ((guint64) 1 << 62);
+	}
+
+	collation_key = g_utf8_collate_key (type_string, -1);
+	key = ((guint64) 1 << 63) | (get_string_sort_key (collation_key) >> 8);
+
+	g_free (collation_key);
+	g_free (type_string);
+
+	return key;
+}
+
+static guint64
+get_sort_key_by_time (NautilusFile *file, NautilusDateType type)
+{
+	Knowledge knowledge;
+	time_t time;
+	gint64 biased_time;
+
+	time = 0;
+	knowledge = get_time (file, &time, type);
+	if (knowledge != KNOWN) {
+		return get_knowledge_sort_key (knowledge) << 62;
+	}
+
+	/* Make room for times before 1970 */
+	biased_time = CLAMP ((gint64) time, -((gint64) 1 << 60), ((gint64) 1 << 60) - 1) + ((gint64) 1 << 60);
+
+	return (get_knowledge_sort_key (knowledge) << 62) | (guint64) biased_time;
+}
+
+static guint64
+get_sort_key_by_search_relevance (NautilusFile *file)
+{
+	gdouble relevance;
+	guint64 bits;
+
+	get_search_relevance (file, &relevance);
+
+	/* Doubles sort like their bits, once the negative ones have all of
+	 * them flipped and the positive ones their sign */
+	memcpy (&bits, &relevance, sizeof (bits));
+	if (bits & ((guint64) 1 << 63)) {
+		return ~bits;
+	}
+	return bits | ((guint64) 1 << 63);
+}
+
+static void
+set_sort_item (SortItem *item,
+	       NautilusFile *file,
+	       NautilusFileSortType sort_type,
+	       const SortParameters *parameters)
+{
+	guint32 sort_order;
+
+	item->file = file;
+
+	/* Like nautilus_file_compare_for_sort_internal() */
+	sort_order = (guint32) file->details->sort_order ^ 0x80000000;
+	if (parameters->reversed) {
+		sort_order = ~sort_order;
+	}
+	item->high = sort_order;
+	if (parameters->directories_first && !nautilus_file_is_directory (file)) {
+		item->high |= (guint64) 1 << 32;
+	}
+
+	switch (sort_type) {
+	case NAUTILUS_FILE_SORT_BY_DISPLAY_NAME:
+		item->low = get_sort_key_by_display_name (file);
+		break;
+	case NAUTILUS_FILE_SORT_BY_SIZE:
+		item->low = get_sort_key_by_size (file);
+		break;
+	case NAUTILUS_FILE_SORT_BY_TYPE:
+		item->low = get_sort_key_by_type (file);
+		break;
+	case NAUTILUS_FILE_SORT_BY_MTIME:
+		item->low = get_sort_key_by_time (file, NAUTILUS_DATE_TYPE_MODIFIED);
+		break;
+	case NAUTILUS_FILE_SORT_BY_ATIME:
+		item->low = get_sort_key_by_time (file, NAUTILUS_DATE_TYPE_ACCESSED);
+		break;
+	case NAUTILUS_FILE_SORT_BY_TRASHED_TIME:
+		item->low = get_sort_key_by_time (file, NAUTILUS_DATE_TYPE_TRASHED);
+		break;
+	case NAUTILUS_FILE_SORT_BY_SEARCH_RELEVANCE:
+		item->low = get_sort_key_by_search_relevance (file);
+		break;
+	default:
+		/* Strings of other attributes are only compared fully */
+		item->low = 0;
+		break;
+	}
+
+	if (parameters->reversed) {
+		item->low = ~item->low;
+	}
+}
+
+static guint
+get_sort_item_byte (const SortItem *item, int byte)
+{
+	if (byte < 8) {
+		return (item->low >> (byte * 8)) & 0xff;
+	}
+	return (item->high >> ((byte - 8) * 8)) & 0xff;
+}
+
+/* Least significant byte first radix sort, skipping the bytes all the
+ * keys share, which are most of them.
+ */
+static void
+radix_sort_items (SortItem *items, guint n_items)
+{
+	guint (*counts)[256];
+	SortItem *buffer, *from, *to, *swap;
+	guint offset, count;
+	guint i;
+	int byte, value;
+
+	counts = g_malloc0 (SORT_KEY_BYTES * sizeof (*counts));
+	for (i = 0; i < n_items; i++) {
+		for (byte = 0; byte < SORT_KEY_BYTES; byte++) {
+			counts[byte][get_sort_item_byte (&items[i], byte)]++;
+		}
+	}
+
+	buffer = g_new (SortItem, n_items);
+	from = items;
+	to = buffer;
+
+	for (byte = 0; byte < SORT_KEY_BYTES; byte++) {
+		if (counts[byte][get_sort_item_byte (&items[0], byte)] == n_items) {
+			continue;
+		}
+
+		offset = 0;
+		for (value = 0; value < 256; value++) {
+			count = counts[byte][value];
+			counts[byte][value] = offset;
+			offset += count;
+		}
+
+		for (i = 0; i < n_items; i++) {
+			to[counts[byte][get_sort_item_byte (&from[i], byte)]++] = from[i];
+		}
+
+		swap = from;
+		from = to;
+		to = swap;
+	}
+
+	if (from != items) {
+		memcpy (items, from, n_items * sizeof (SortItem));
+	}
+
+	g_free (buffer);
+	g_free (counts);
+}
+
+static int
+compare_sort_items (gconstpointer a,
+		    gconstpointer b,
+		    gpointer user_data)
+{
+	const SortItem *item_1 = a;
+	const SortItem *item_2 = b;
+	const SortParameters *parameters = user_data;
+
+	return nautilus_file_compare_for_sort_by_attribute_q (item_1->file, item_2->file,
+							      parameters->attribute,
+							      parameters->directories_first,
+							      parameters->reversed);
+}
+
+/**
+ * nautilus_file_sort_by_attribute_q:
+ * @files: An array of files
+ * @n_files: The number of files in @files
+ * @attribute: The attribute to sort by
+ * @directories_first: Put all directories before any non-directories
+ * @reversed: Reverse the order of the items, except that
+ * the directories_first flag is still respected.
+ *
+ * Sorts @files in place, in the order nautilus_file_compare_for_sort_by_attribute_q()
+ * gives, but much faster for many files.
+ **/
+void
+nautilus_file_sort_by_attribute_q (NautilusFile **files,
+				   guint n_files,
+				   GQuark attribute,
+				   gboolean directories_first,
+				   gboolean reversed)
+{
+	NautilusFileSortType sort_type;
+	SortParameters parameters;
+	SortItem *items;
+	guint i, start;
+
+	if (n_files <= 1) {
+		return;
+	}
+
+	sort_type = get_sort_type_for_attribute (attribute);
+	parameters.attribute = attribute;
+	parameters.directories_first = directories_first;
+	parameters.reversed = reversed;
+
+	items = g_new (SortItem, n_files);
+	for (i = 0; i < n_files; i++) {
+		set_sort_item (&items[i], files[i], sort_type, &parameters);
+	}
+
+	radix_sort_items (items, n_files);
+
+	/* Files whose keys are the same are in runs now */
+	start = 0;
+	for (i = 1; i <= n_files; i++) {
+		if (i < n_files &&
+		    items[i].low == items[start].low &&
+		    items[i].high == items[start].high) {
+			continue;
+		}
+
+		if (i - start > 1) {
+			g_qsort_with_data (&items[start], i - start, sizeof (SortItem),
+					   compare_sort_items, &parameters);
+		}
+		start = i;
+	}
+
+	for (i = 0; i < n_files; i++) {
+		files[i] = items[i].file;
+	}
+
+	g_free (items);
+}
+
 
 /**
  * nautilus_file_compare_name:
@@ -4078,11 +4552,11 @@ nautilus_file_get_filesystem_type (NautilusFile *file)
         g_assert (NAUTILUS_IS_FILE (file));
 
         if (nautilus_file_is_directory (file)) {
-                filesystem_type = g_strdup (eel_ref_str_peek (file->details->filesystem_type));
+                filesystem_type = g_strdup (eel_ref_str_peek (nautilus_file_peek_cold_details (file)->filesystem_type));
         } else {
                 parent = nautilus_file_get_parent (file);
                 if (parent != NULL) {
-                        filesystem_type = g_strdup (eel_ref_str_peek (parent->details->filesystem_type));
+                        filesystem_type = g_strdup (eel_ref_str_peek (nautilus_file_peek_cold_details (parent)->filesystem_type));
                         nautilus_file_unref (parent);
                 }
         }
@@ -4242,8 +4716,8 @@ nautilus_file_get_keywords (NautilusFile *file)
 
 	g_return_val_if_fail (NAUTILUS_IS_FILE (file), NULL);
 
-	keywords = g_list_copy_deep (file->details->extension_emblems, (GCopyFunc) g_strdup, NULL);
-	keywords = g_list_concat (keywords, g_list_copy_deep (file->details->pending_extension_emblems, (GCopyFunc) g_strdup, NULL));
+	keywords = g_list_copy_deep (nautilus_file_peek_cold_details (file)->extension_emblems, (GCopyFunc) g_strdup, NULL);
+	keywords = g_list_concat (keywords, g_list_copy_deep (nautilus_file_peek_cold_details (file)->pending_extension_emblems, (GCopyFunc) g_strdup, NULL));
 
 	metadata_keywords = nautilus_file_get_metadata_list (file, NAUTILUS_METADATA_KEY_EMBLEMS);
 	clean_up_metadata_keywords (file, &metadata_keywords);
@@ -4458,15 +4932,18 @@ nautilus_file_get_thumbnail_icon (NautilusFile *file,
 				  NautilusFileIconFlags flags)
 {
 	int modified_size;
-	GdkPixbuf *pixbuf;
-	int w, h, s;
+	GdkPixbuf *thumbnail, *pixbuf;
+	int w, h, s, scaled_size;
 	double thumb_scale;
 	GIcon *gicon, *emblemed_icon;
 	NautilusIconInfo *icon;
+	char *uri;
 
 	icon = NULL;
 	gicon = NULL;
 	pixbuf = NULL;
+	thumbnail = NULL;
+	uri = NULL;
 
 	if (flags & NAUTILUS_FILE_ICON_FLAGS_FORCE_THUMBNAIL_SIZE) {
 		modified_size = size * scale;
@@ -4476,9 +4953,20 @@ nautilus_file_get_thumbnail_icon (NautilusFile *file,
 		       modified_size, cached_thumbnail_size);
 	}
 
-	if (file->details->thumbnail) {
-		w = gdk_pixbuf_get_width (file->details->thumbnail);
-		h = gdk_pixbuf_get_height (file->details->thumbnail);
+	/* The thumbnail is kept in the thumbnail cache, which may have
+	   dropped it since, then it is loaded again. */
+	if (file->details->got_thumbnail) {
+		uri = nautilus_file_get_uri (file);
+		thumbnail = nautilus_thumbnail_cache_lookup (uri, file->details->mtime, 0);
+		if (thumbnail == NULL) {
+			file->details->got_thumbnail = FALSE;
+			nautilus_file_invalidate_attributes (file, NAUTILUS_FILE_ATTRIBUTE_THUMBNAIL);
+		}
+	}
+
+	if (thumbnail) {
+		w = gdk_pixbuf_get_width (thumbnail);
+		h = gdk_pixbuf_get_height (thumbnail);
 
 		s = MAX (w, h);
 		/* Don't scale up small thumbnails in the standard view */
@@ -4493,17 +4981,17 @@ nautilus_file_get_thumbnail_icon (NautilusFile *file,
 			thumb_scale = (double) NAUTILUS_LIST_ICON_SIZE_SMALL / s;
 		}
 
-		if (file->details->thumbnail_scale == thumb_scale &&
-		    file->details->scaled_thumbnail != NULL) {
-			pixbuf = file->details->scaled_thumbnail;
-		} else {
-			pixbuf = gdk_pixbuf_scale_simple (file->details->thumbnail,
+		/* The views and zoom levels showing the same size share it */
+		scaled_size = MAX (s * thumb_scale, 1);
+		pixbuf = nautilus_thumbnail_cache_lookup (uri, file->details->mtime, scaled_size);
+		if (pixbuf == NULL) {
+			pixbuf = gdk_pixbuf_scale_simple (thumbnail,
 							  MAX (w * thumb_scale, 1),
 							  MAX (h * thumb_scale, 1),
 							  GDK_INTERP_BILINEAR);
 
 			/* We don't want frames around small icons */
-			if (!gdk_pixbuf_get_has_alpha (file->details->thumbnail) || s >= 128 * scale) {
+			if (!gdk_pixbuf_get_has_alpha (thumbnail) || s >= 128 * scale) {
 				if (nautilus_is_video_file (file)) {
 					nautilus_ui_frame_video (&pixbuf);
 				} else {
@@ -4511,9 +4999,8 @@ nautilus_file_get_thumbnail_icon (NautilusFile *file,
 				}
 			}
 
-			g_clear_object (&file->details->scaled_thumbnail);
-			file->details->scaled_thumbnail = pixbuf;
-			file->details->thumbnail_scale = thumb_scale;
+			nautilus_thumbnail_cache_add_scaled (uri, file->details->mtime,
+							     scaled_size, pixbuf);
 		}
 
 		/* Don't scale up if more than 25%, then read the original
@@ -4557,6 +5044,10 @@ nautilus_file_get_thumbnail_icon (NautilusFile *file,
 		g_object_unref (emblemed_icon);
 	}
 
+	g_clear_object (&pixbuf);
+	g_clear_object (&thumbnail);
+	g_free (uri);
+
 	return icon;
 }
 
@@ -4684,7 +5175,7 @@ nautilus_file_get_trash_original_file_parent_as_string (NautilusFile *file)
 	GFile *location;
 	char *filename;
 
-	if (file->details->trash_orig_path != NULL) {
+	if (nautilus_file_peek_cold_details (file)->trash_orig_path != NULL) {
 		orig_file = nautilus_file_get_trash_original_file (file);
 		parent = nautilus_file_get_parent (orig_file);
 		location = nautilus_file_get_location (parent);
@@ -5280,7 +5771,7 @@ nautilus_file_set_permissions (NautilusFile *file,
 gboolean
 nautilus_file_can_get_selinux_context (NautilusFile *file)
 {
-	return file->details->selinux_context != NULL;
+	return nautilus_file_peek_cold_details (file)->selinux_context != NULL;
 }
 
 
@@ -5306,7 +5797,7 @@ nautilus_file_get_selinux_context (NautilusFile *file)
 		return NULL;
 	}
 
-	raw = file->details->selinux_context;
+	raw = nautilus_file_peek_cold_details (file)->selinux_context;
 
 #ifdef HAVE_SELINUX
 	if (selinux_raw_to_trans_context (raw, &translated) == 0) {
@@ -6227,6 +6718,7 @@ nautilus_file_get_deep_directory_count_as_string (NautilusFile *file)
 char *
 nautilus_file_get_string_attribute_q (NautilusFile *file, GQuark attribute_q)
 {
+	const NautilusFileColdDetails *cold;
 	char *extension_attribute;
 
 	if (attribute_q == attribute_name_q) {
@@ -6329,14 +6821,15 @@ nautilus_file_get_string_attribute_q (NautilusFile *file, GQuark attribute_q)
 	}
 
 	extension_attribute = NULL;
+	cold = nautilus_file_peek_cold_details (file);
 	
-	if (file->details->pending_extension_attributes) {
-		extension_attribute = g_hash_table_lookup (file->details->pending_extension_attributes,
+	if (cold->pending_extension_attributes) {
+		extension_attribute = g_hash_table_lookup (cold->pending_extension_attributes,
 							   GINT_TO_POINTER (attribute_q));
 	} 
 
-	if (extension_attribute == NULL && file->details->extension_attributes) {
-		extension_attribute = g_hash_table_lookup (file->details->extension_attributes,
+	if (extension_attribute == NULL && cold->extension_attributes) {
+		extension_attribute = g_hash_table_lookup (cold->extension_attributes,
 							   GINT_TO_POINTER (attribute_q));
 	}
 		
@@ -6714,8 +7207,8 @@ nautilus_file_is_symbolic_link (NautilusFile *file)
 GMount *
 nautilus_file_get_mount (NautilusFile *file)
 {
-	if (file->details->mount) {
-		return g_object_ref (file->details->mount);
+	if (peek_mount (file)) {
+		return g_object_ref (peek_mount (file));
 	}
 	return NULL;
 }
@@ -6735,14 +7228,17 @@ void
 nautilus_file_set_mount (NautilusFile *file,
 			 GMount *mount)
 {
-	if (file->details->mount) {
-		g_signal_handlers_disconnect_by_func (file->details->mount, file_mount_unmounted, file);
-		g_object_unref (file->details->mount);
-		file->details->mount = NULL;
+	NautilusFileColdDetails *cold;
+
+	cold = file->details->cold;
+	if (cold != NULL && cold->mount) {
+		g_signal_handlers_disconnect_by_func (cold->mount, file_mount_unmounted, file);
+		g_object_unref (cold->mount);
+		cold->mount = NULL;
 	}
 
 	if (mount) {
-		file->details->mount = g_object_ref (mount);
+		nautilus_file_get_cold_details (file)->mount = g_object_ref (mount);
 		g_signal_connect (mount, "unmounted",
 				  G_CALLBACK (file_mount_unmounted), file);
 	}
@@ -6791,8 +7287,8 @@ get_fs_free_cb (GObject *source_object,
 		g_object_unref (info);
 	}
 
-	if (file->details->free_space != free_space) {
-		file->details->free_space = free_space;
+	if (nautilus_file_peek_cold_details (file)->free_space != free_space) {
+		nautilus_file_get_cold_details (file)->free_space = free_space;
 		nautilus_file_emit_changed (file);
 	}
 
@@ -6809,15 +7305,17 @@ get_fs_free_cb (GObject *source_object,
 char *
 nautilus_file_get_volume_free_space (NautilusFile *file)
 {
+	NautilusFileColdDetails *cold;
 	GFile *location;
 	char *res;
 	time_t now;
 
 	now = time (NULL);
+	cold = nautilus_file_get_cold_details (file);
 	/* Update first time and then every 2 seconds */
-	if (file->details->free_space_read == 0 ||
-	    (now - file->details->free_space_read) > 2)  {
-		file->details->free_space_read = now;
+	if (cold->free_space_read == 0 ||
+	    (now - cold->free_space_read) > 2)  {
+		cold->free_space_read = now;
 		location = nautilus_file_get_location (file);
 		g_file_query_filesystem_info_async (location,
 						    G_FILE_ATTRIBUTE_FILESYSTEM_FREE,
@@ -6828,8 +7326,8 @@ nautilus_file_get_volume_free_space (NautilusFile *file)
 	}
 
 	res = NULL;
-	if (file->details->free_space != (guint64)-1) {
-		res = g_format_size (file->details->free_space);
+	if (cold->free_space != (guint64)-1) {
+		res = g_format_size (cold->free_space);
 	}
 
 	return res;
@@ -7200,8 +7698,8 @@ nautilus_file_get_trash_original_file (NautilusFile *file)
 
 	original_file = NULL;
 
-	if (file->details->trash_orig_path != NULL) {
-		location = g_file_new_for_path (file->details->trash_orig_path);
+	if (nautilus_file_peek_cold_details (file)->trash_orig_path != NULL) {
+		location = g_file_new_for_path (nautilus_file_peek_cold_details (file)->trash_orig_path);
 		original_file = nautilus_file_get (location);
 		g_object_unref (location);
 	}
@@ -7593,7 +8091,7 @@ nautilus_file_invalidate_all_attributes (NautilusFile *file)
 void
 nautilus_file_dump (NautilusFile *file)
 {
-	long size = file->details->deep_size;
+	long size = nautilus_file_peek_cold_details (file)->deep_size;
 	char *uri;
 	const char *file_kind;
 
@@ -8009,6 +8507,8 @@ nautilus_file_class_init (NautilusFileClass *class)
 
 	nautilus_file_info_getter = nautilus_file_get_internal;
 
+	default_cold_details.free_space = (guint64) -1;
+
 	attribute_name_q = g_quark_from_static_string ("name");
 	attribute_size_q = g_quark_from_static_string ("size");
 	attribute_type_q = g_quark_from_static_string ("type");
@@ -8106,12 +8606,15 @@ static void
 nautilus_file_add_emblem (NautilusFile *file,
 			  const char *emblem_name)
 {
+	NautilusFileColdDetails *cold;
+
+	cold = nautilus_file_get_cold_details (file);
 	if (file->details->pending_info_providers) {
-		file->details->pending_extension_emblems = g_list_prepend (file->details->pending_extension_emblems,
-									   g_strdup (emblem_name));
+		cold->pending_extension_emblems = g_list_prepend (cold->pending_extension_emblems,
+								  g_strdup (emblem_name));
 	} else {
-		file->details->extension_emblems = g_list_prepend (file->details->extension_emblems,
-								   g_strdup (emblem_name));
+		cold->extension_emblems = g_list_prepend (cold->extension_emblems,
+							  g_strdup (emblem_name));
 	}
 
 	nautilus_file_changed (file);
@@ -8122,25 +8625,28 @@ nautilus_file_add_string_attribute (NautilusFile *file,
 				    const char *attribute_name,
 				    const char *value)
 {
+	NautilusFileColdDetails *cold;
+
+	cold = nautilus_file_get_cold_details (file);
 	if (file->details->pending_info_providers) {
 		/* Lazily create hashtable */
-		if (!file->details->pending_extension_attributes) {
-			file->details->pending_extension_attributes = 
+		if (!cold->pending_extension_attributes) {
+			cold->pending_extension_attributes = 
 				g_hash_table_new_full (g_direct_hash, g_direct_equal,
 						       NULL, 
 						       (GDestroyNotify)g_free);
 		}
-		g_hash_table_insert (file->details->pending_extension_attributes,
+		g_hash_table_insert (cold->pending_extension_attributes,
 				     GINT_TO_POINTER (g_quark_from_string (attribute_name)),
 				     g_strdup (value));
 	} else {
-		if (!file->details->extension_attributes) {
-			file->details->extension_attributes = 
+		if (!cold->extension_attributes) {
+			cold->extension_attributes = 
 				g_hash_table_new_full (g_direct_hash, g_direct_equal,
 						       NULL, 
 						       (GDestroyNotify)g_free);
 		}
-		g_hash_table_insert (file->details->extension_attributes,
+		g_hash_table_insert (cold->extension_attributes,
 				     GINT_TO_POINTER (g_quark_from_string (attribute_name)),
 				     g_strdup (value));
 	}
@@ -8157,16 +8663,22 @@ nautilus_file_invalidate_extension_info (NautilusFile *file)
 void
 nautilus_file_info_providers_done (NautilusFile *file)
 {
-	g_list_free_full (file->details->extension_emblems, g_free);
-	file->details->extension_emblems = file->details->pending_extension_emblems;
-	file->details->pending_extension_emblems = NULL;
+	NautilusFileColdDetails *cold;
 
-	if (file->details->extension_attributes) {
-		g_hash_table_destroy (file->details->extension_attributes);
+	/* Most files don't get any emblems or attributes */
+	cold = file->details->cold;
+	if (cold != NULL) {
+		g_list_free_full (cold->extension_emblems, g_free);
+		cold->extension_emblems = cold->pending_extension_emblems;
+		cold->pending_extension_emblems = NULL;
+
+		if (cold->extension_attributes) {
+			g_hash_table_destroy (cold->extension_attributes);
+		}
+
+		cold->extension_attributes = cold->pending_extension_attributes;
+		cold->pending_extension_attributes = NULL;
 	}
-	
-	file->details->extension_attributes = file->details->pending_extension_attributes;
-	file->details->pending_extension_attributes = NULL;
 
 	nautilus_file_changed (file);
 }
@@ -425,6 +425,11 @@ int                     nautilus_file_compare_for_sort_by_attribute_q   (Nautilu
 									 GQuark                          attribute,
 									 gboolean                        directories_first,
 									 gboolean                        reversed);
+void                    nautilus_file_sort_by_attribute_q               (NautilusFile                  **files,
+									 guint                           n_files,
+									 GQuark                          attribute,
+									 gboolean                        directories_first,
+									 gboolean                        reversed);
 gboolean                nautilus_file_is_date_sort_attribute_q          (GQuark                          attribute);
 
 int                     nautilus_file_compare_display_name              (NautilusFile                   *file_1,
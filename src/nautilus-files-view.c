@@ -213,6 +213,8 @@ struct NautilusFilesViewDetails
 
         /* whether we are in the active slot */
         gboolean active;
+        /* the model, while it's marked as focused */
+        NautilusDirectory *focused_model;
 
         /* loading indicates whether this view has begun loading a directory.
          * This flag should need not be set inside subclasses. NautilusFilesView automatically
@@ -2722,6 +2724,33 @@ remove_directory_from_templates_directory_list (NautilusFilesView *view,
                                               G_CALLBACK (templates_added_or_changed_callback));
 }
 
+/* Lets the directory of the active view do its I/O first */
+static void
+update_model_focus (NautilusFilesView *view)
+{
+        NautilusDirectory *focused_model;
+
+        focused_model = NULL;
+        if (view->details->active && !view->details->in_destruction) {
+                focused_model = view->details->model;
+        }
+
+        if (view->details->focused_model == focused_model) {
+                return;
+        }
+
+        if (view->details->focused_model != NULL) {
+                nautilus_directory_set_focused (view->details->focused_model, FALSE);
+                nautilus_directory_unref (view->details->focused_model);
+        }
+
+        view->details->focused_model = nautilus_directory_ref (focused_model);
+
+        if (focused_model != NULL) {
+                nautilus_directory_set_focused (focused_model, TRUE);
+        }
+}
+
 static void
 slot_active (NautilusWindowSlot *slot,
              NautilusFilesView  *view)
@@ -2731,6 +2760,7 @@ slot_active (NautilusWindowSlot *slot,
         }
 
         view->details->active = TRUE;
+        update_model_focus (view);
 
         /* Avoid updating the toolbar withouth making sure the toolbar
          * zoom slider has the correct adjustment that changes when the
@@ -2755,6 +2785,7 @@ slot_inactive (NautilusWindowSlot *slot,
         }
 
         view->details->active = FALSE;
+        update_model_focus (view);
 
         remove_update_context_menus_timeout_callback (view);
         gtk_widget_insert_action_group (GTK_WIDGET (nautilus_files_view_get_window (view)),
@@ -2833,6 +2864,7 @@ nautilus_files_view_destroy (GtkWidget *object)
 
         view->details->in_destruction = TRUE;
         nautilus_files_view_stop_loading (view);
+        update_model_focus (view);
 
         if (view->details->model) {
                 nautilus_directory_unref (view->details->model);
@@ -3640,6 +3672,36 @@ on_end_file_changes (NautilusFilesView *view)
         }
 }
 
+/* Hands the added files to the view a directory at a time, for the views
+ * that add many files faster at once than one by one.
+ */
+static void
+add_files_at_once (NautilusFilesView *view,
+                   GList             *files_added)
+{
+        GHashTable *files_by_directory;
+        GHashTableIter iter;
+        NautilusDirectory *directory;
+        FileAndDirectory *pending;
+        GList *files, *node;
+
+        files_by_directory = g_hash_table_new (NULL, NULL);
+        for (node = files_added; node != NULL; node = node->next) {
+                pending = node->data;
+                files = g_hash_table_lookup (files_by_directory, pending->directory);
+                g_hash_table_insert (files_by_directory, pending->directory,
+                                     g_list_prepend (files, pending->file));
+        }
+
+        g_hash_table_iter_init (&iter, files_by_directory);
+        while (g_hash_table_iter_next (&iter, (gpointer *) &directory, (gpointer *) &files)) {
+                NAUTILUS_FILES_VIEW_CLASS (G_OBJECT_GET_CLASS (view))->add_files (view, files, directory);
+                g_list_free (files);
+        }
+
+        g_hash_table_destroy (files_by_directory);
+}
+
 static void
 process_old_files (NautilusFilesView *view)
 {
@@ -3656,6 +3718,11 @@ process_old_files (NautilusFilesView *view)
 
                 g_signal_emit (view, signals[BEGIN_FILE_CHANGES], 0);
 
+                if (files_added != NULL &&
+                    NAUTILUS_FILES_VIEW_CLASS (G_OBJECT_GET_CLASS (view))->add_files != NULL) {
+                        add_files_at_once (view, files_added);
+                }
+
                 for (node = files_added; node != NULL; node = node->next) {
                         pending = node->data;
                         g_signal_emit (view,
@@ -7155,6 +7222,7 @@ load_directory (NautilusFilesView *view,
                 nautilus_directory_unref (view->details->model);
                 view->details->model = nautilus_directory_ref (directory);
         }
+        update_model_focus (view);
 
         nautilus_file_unref (view->details->directory_as_file);
         view->details->directory_as_file = nautilus_directory_get_corresponding_file (directory);
@@ -7256,6 +7324,7 @@ finish_loading (NautilusFilesView *view)
                                              view->details->show_hidden_files,
                                              attributes,
                                              files_added_callback, view);
+        nautilus_directory_set_shown_in_view (view->details->model, TRUE);
 
             view->details->files_added_handler_id = g_signal_connect
                 (view->details->model, "files-added",
@@ -7358,6 +7427,7 @@ disconnect_model_handlers (NautilusFilesView *view)
         nautilus_directory_cancel_callback (view->details->model,
                                             metadata_for_files_in_directory_ready_callback,
                                             view);
+        nautilus_directory_set_shown_in_view (view->details->model, FALSE);
         nautilus_directory_file_monitor_remove (view->details->model,
                                                 &view->details->model);
         nautilus_file_monitor_remove (view->details->directory_as_file,
@@ -7814,6 +7884,7 @@ nautilus_files_view_parent_set (GtkWidget *widget,
 
                 if (view->details->slot == nautilus_window_get_active_slot (window)) {
                         view->details->active = TRUE;
+                        update_model_focus (view);
                         gtk_widget_insert_action_group (GTK_WIDGET (nautilus_files_view_get_window (view)),
                                                         "view",
                                                         G_ACTION_GROUP (view->details->view_action_group));
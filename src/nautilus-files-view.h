@@ -87,6 +87,16 @@ struct NautilusFilesViewClass {
         void    (* add_file)                    (NautilusFilesView *view,
                                                  NautilusFile      *file,
                                                  NautilusDirectory *directory);
+
+        /* The 'add_files' function is optional. If a subclass has it, it
+         * is called with all the files of a directory added to the view at
+         * once, before the 'add_file' signal is emitted for each of them,
+         * which the subclass then ignores until 'end_file_changes'. It is
+         * for views that add many files much faster at once.
+         */
+        void    (* add_files)                   (NautilusFilesView *view,
+                                                 GList             *files,
+                                                 NautilusDirectory *directory);
         void    (* remove_file)                 (NautilusFilesView *view,
                                                  NautilusFile      *file,
                                                  NautilusDirectory *directory);
@@ -34,6 +34,7 @@ G_BEGIN_DECLS
 
 /* Display  */
 #define NAUTILUS_PREFERENCES_SHOW_HIDDEN_FILES			"show-hidden"
+#define NAUTILUS_PREFERENCES_DIRECTORY_LOAD_BUDGET		"directory-load-budget"
 
 /* Mouse */
 #define NAUTILUS_PREFERENCES_MOUSE_USE_EXTRA_BUTTONS		"mouse-use-extra-buttons"
@@ -119,6 +120,8 @@ typedef enum
 #define NAUTILUS_PREFERENCES_SHOW_DIRECTORY_ITEM_COUNTS "show-directory-item-counts"
 #define NAUTILUS_PREFERENCES_SHOW_FILE_THUMBNAILS	"show-image-thumbnails"
 #define NAUTILUS_PREFERENCES_FILE_THUMBNAIL_LIMIT	"thumbnail-limit"
+#define NAUTILUS_PREFERENCES_THUMBNAIL_THREADS	"thumbnail-threads"
+#define NAUTILUS_PREFERENCES_THUMBNAIL_CACHE_SIZE	"thumbnail-cache-size"
 
 typedef enum
 {
@@ -156,6 +159,14 @@ typedef enum
 
 /* Search behaviour */
 #define NAUTILUS_PREFERENCES_RECURSIVE_SEARCH "recursive-search"
+#define NAUTILUS_PREFERENCES_SEARCH_INDEX "search-index"
+
+typedef enum
+{
+	NAUTILUS_SEARCH_INDEX_NEVER,
+	NAUTILUS_SEARCH_INDEX_HOME_ONLY,
+	NAUTILUS_SEARCH_INDEX_ALWAYS
+} NautilusSearchIndexLocations;
 
 /* Context menu options */
 #define NAUTILUS_PREFERENCES_SHOW_DELETE_PERMANENTLY "show-delete-permanently"
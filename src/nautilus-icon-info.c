@@ -27,8 +27,6 @@ struct _NautilusIconInfo
 {
 	GObject parent;
 
-	gboolean sole_owner;
-	gint64 last_use_time;
 	GdkPixbuf *pixbuf;
 	
         char *icon_name;
@@ -41,8 +39,6 @@ struct _NautilusIconInfoClass
 	GObjectClass parent_class;
 };
 
-static void schedule_reap_cache (void);
-
 G_DEFINE_TYPE (NautilusIconInfo,
 	       nautilus_icon_info,
 	       G_TYPE_OBJECT);
@@ -50,8 +46,6 @@ G_DEFINE_TYPE (NautilusIconInfo,
 static void
 nautilus_icon_info_init (NautilusIconInfo *icon)
 {
-	icon->last_use_time = g_get_monotonic_time ();
-	icon->sole_owner = TRUE;
 }
 
 gboolean
@@ -60,23 +54,6 @@ nautilus_icon_info_is_fallback (NautilusIconInfo  *icon)
   return icon->pixbuf == NULL;
 }
 
-static void
-pixbuf_toggle_notify (gpointer      info,
-		      GObject      *object,
-		      gboolean      is_last_ref)
-{
-	NautilusIconInfo  *icon = info;
-	
-	if (is_last_ref) {
-		icon->sole_owner = TRUE;	
-		g_object_remove_toggle_ref (object,
-					    pixbuf_toggle_notify,
-					    info);
-		icon->last_use_time = g_get_monotonic_time ();
-		schedule_reap_cache ();
-	}
-}
-
 static void
 nautilus_icon_info_finalize (GObject *object)
 {
@@ -84,12 +61,6 @@ nautilus_icon_info_finalize (GObject *object)
 
         icon = NAUTILUS_ICON_INFO (object);
 
-	if (!icon->sole_owner && icon->pixbuf) {
-		g_object_remove_toggle_ref (G_OBJECT (icon->pixbuf),
-					    pixbuf_toggle_notify,
-					    icon);
-	}
-
 	if (icon->pixbuf) {
 		g_object_unref (icon->pixbuf);
 	}
@@ -157,97 +128,107 @@ nautilus_icon_info_new_for_icon_info (GtkIconInfo *icon_info,
 typedef struct  {
 	GIcon *icon;
 	int size;
+	int scale;
 } LoadableIconKey;
 
 typedef struct {
 	char *filename;
 	int size;
+	int scale;
 } ThemedIconKey;
 
+typedef struct {
+	GHashTable *table;
+	gpointer key;
+	NautilusIconInfo *icon;
+	gsize n_bytes;
+} CachedIcon;
+
+/* The icons of both tables, most recently used first. The tables own
+ * their keys, and map them to the links of this queue.
+ */
 static GHashTable *loadable_icon_cache = NULL;
 static GHashTable *themed_icon_cache = NULL;
-static guint reap_cache_timeout = 0;
+static GQueue lru_queue = G_QUEUE_INIT;
 
-#define MICROSEC_PER_SEC ((guint64)1000000L)
+static gsize cached_bytes;
 
-static guint time_now;
+/* Memory the cached icons may hold. Views keep their own references to
+ * the pixbufs they show, so evicting those only stops sharing them.
+ */
+#define MAX_CACHED_BYTES (16 * 1024 * 1024)
 
-static gboolean
-reap_old_icon (gpointer  key,
-	       gpointer  value,
-	       gpointer  user_info)
+static void
+remove_link (GList *link)
 {
-	NautilusIconInfo *icon = value;
-	gboolean *reapable_icons_left = user_info;
-
-	if (icon->sole_owner) {
-		if (time_now - icon->last_use_time > 30 * MICROSEC_PER_SEC) {
-			/* This went unused 30 secs ago. reap */
-			return TRUE;
-		} else {
-			/* We can reap this soon */
-			*reapable_icons_left = TRUE;
-		}
-	}
-	
-	return FALSE;
+	CachedIcon *cached;
+
+	cached = link->data;
+	g_queue_delete_link (&lru_queue, link);
+	g_hash_table_remove (cached->table, cached->key);
+	cached_bytes -= cached->n_bytes;
+
+	g_object_unref (cached->icon);
+	g_free (cached);
 }
 
-static gboolean
-reap_cache (gpointer data)
+static NautilusIconInfo *
+cache_lookup (GHashTable    *table,
+	      gconstpointer  key)
 {
-	gboolean reapable_icons_left;
-
-	reapable_icons_left = TRUE;
+	GList *link;
+	CachedIcon *cached;
 
-	time_now = g_get_monotonic_time ();
-	
-	if (loadable_icon_cache) {
-		g_hash_table_foreach_remove (loadable_icon_cache,
-					     reap_old_icon,
-					     &reapable_icons_left);
-	}
-	
-	if (themed_icon_cache) {
-		g_hash_table_foreach_remove (themed_icon_cache,
-					     reap_old_icon,
-					     &reapable_icons_left);
-	}
-	
-	if (reapable_icons_left) {
-		return TRUE;
-	} else {
-		reap_cache_timeout = 0;
-		return FALSE;
+	link = g_hash_table_lookup (table, key);
+	if (link == NULL) {
+		return NULL;
 	}
+
+	g_queue_unlink (&lru_queue, link);
+	g_queue_push_head_link (&lru_queue, link);
+
+	cached = link->data;
+	return g_object_ref (cached->icon);
 }
 
+/* Takes ownership of @key */
 static void
-schedule_reap_cache (void)
+cache_insert (GHashTable       *table,
+	      gpointer          key,
+	      NautilusIconInfo *icon)
 {
-	if (reap_cache_timeout == 0) {
-		reap_cache_timeout = g_timeout_add_seconds_full (0, 5,
-								 reap_cache,
-								 NULL, NULL);
+	CachedIcon *cached;
+
+	cached = g_new (CachedIcon, 1);
+	cached->table = table;
+	cached->key = key;
+	cached->icon = g_object_ref (icon);
+	cached->n_bytes = sizeof (CachedIcon);
+	if (icon->pixbuf != NULL) {
+		cached->n_bytes += gdk_pixbuf_get_byte_length (icon->pixbuf);
+	}
+	cached_bytes += cached->n_bytes;
+
+	g_queue_push_head (&lru_queue, cached);
+	g_hash_table_insert (table, key, lru_queue.head);
+
+	while (cached_bytes > MAX_CACHED_BYTES && lru_queue.length > 1) {
+		remove_link (lru_queue.tail);
 	}
 }
 
 void
 nautilus_icon_info_clear_caches (void)
 {
-	if (loadable_icon_cache) {
-		g_hash_table_remove_all (loadable_icon_cache);
-	}
-	
-	if (themed_icon_cache) {
-		g_hash_table_remove_all (themed_icon_cache);
+	while (lru_queue.head != NULL) {
+		remove_link (lru_queue.head);
 	}
 }
 
 static guint
 loadable_icon_key_hash (LoadableIconKey *key)
 {
-	return g_icon_hash (key->icon) ^ key->size;
+	return g_icon_hash (key->icon) ^ key->size ^ (key->scale << 16);
 }
 
 static gboolean
@@ -255,17 +236,19 @@ loadable_icon_key_equal (const LoadableIconKey *a,
 			 const LoadableIconKey *b)
 {
 	return a->size == b->size &&
+		a->scale == b->scale &&
 		g_icon_equal (a->icon, b->icon);
 }
 
 static LoadableIconKey *
-loadable_icon_key_new (GIcon *icon, int size)
+loadable_icon_key_new (GIcon *icon, int size, int scale)
 {
 	LoadableIconKey *key;
 
 	key = g_slice_new (LoadableIconKey);
 	key->icon = g_object_ref (icon);
 	key->size = size;
+	key->scale = scale;
 
 	return key;
 }
@@ -280,7 +263,7 @@ loadable_icon_key_free (LoadableIconKey *key)
 static guint
 themed_icon_key_hash (ThemedIconKey *key)
 {
-	return g_str_hash (key->filename) ^ key->size;
+	return g_str_hash (key->filename) ^ key->size ^ (key->scale << 16);
 }
 
 static gboolean
@@ -288,17 +271,19 @@ themed_icon_key_equal (const ThemedIconKey *a,
 		       const ThemedIconKey *b)
 {
 	return a->size == b->size &&
+		a->scale == b->scale &&
 		g_str_equal (a->filename, b->filename);
 }
 
 static ThemedIconKey *
-themed_icon_key_new (const char *filename, int size)
+themed_icon_key_new (const char *filename, int size, int scale)
 {
 	ThemedIconKey *key;
 
 	key = g_slice_new (ThemedIconKey);
 	key->filename = g_strdup (filename);
 	key->size = size;
+	key->scale = scale;
 
 	return key;
 }
@@ -328,15 +313,16 @@ nautilus_icon_info_lookup (GIcon *icon,
 				g_hash_table_new_full ((GHashFunc)loadable_icon_key_hash,
 						       (GEqualFunc)loadable_icon_key_equal,
 						       (GDestroyNotify) loadable_icon_key_free,
-						       (GDestroyNotify) g_object_unref);
+						       NULL);
 		}
 		
 		lookup_key.icon = icon;
 		lookup_key.size = size;
+		lookup_key.scale = scale;
 
-		icon_info = g_hash_table_lookup (loadable_icon_cache, &lookup_key);
+		icon_info = cache_lookup (loadable_icon_cache, &lookup_key);
 		if (icon_info) {
-			return g_object_ref (icon_info);
+			return icon_info;
 		}
 
 		pixbuf = NULL;
@@ -354,10 +340,10 @@ nautilus_icon_info_lookup (GIcon *icon,
 
 		icon_info = nautilus_icon_info_new_for_pixbuf (pixbuf, scale);
 
-		key = loadable_icon_key_new (icon, size);
-		g_hash_table_insert (loadable_icon_cache, key, icon_info);
+		key = loadable_icon_key_new (icon, size, scale);
+		cache_insert (loadable_icon_cache, key, icon_info);
 
-		return g_object_ref (icon_info);
+		return icon_info;
 	} else if (G_IS_THEMED_ICON (icon)) {
 		const char * const *names;
 		ThemedIconKey lookup_key;
@@ -371,7 +357,7 @@ nautilus_icon_info_lookup (GIcon *icon,
 				g_hash_table_new_full ((GHashFunc)themed_icon_key_hash,
 						       (GEqualFunc)themed_icon_key_equal,
 						       (GDestroyNotify) themed_icon_key_free,
-						       (GDestroyNotify) g_object_unref);
+						       NULL);
 		}
 		
 		names = g_themed_icon_get_names (G_THEMED_ICON (icon));
@@ -392,21 +378,22 @@ nautilus_icon_info_lookup (GIcon *icon,
 
 		lookup_key.filename = (char *)filename;
 		lookup_key.size = size;
+		lookup_key.scale = scale;
 
-		icon_info = g_hash_table_lookup (themed_icon_cache, &lookup_key);
+		icon_info = cache_lookup (themed_icon_cache, &lookup_key);
 		if (icon_info) {
 			g_object_unref (gtkicon_info);
-			return g_object_ref (icon_info);
+			return icon_info;
 		}
 		
 		icon_info = nautilus_icon_info_new_for_icon_info (gtkicon_info, scale);
 		
-		key = themed_icon_key_new (filename, size);
-		g_hash_table_insert (themed_icon_cache, key, icon_info);
+		key = themed_icon_key_new (filename, size, scale);
+		cache_insert (themed_icon_cache, key, icon_info);
 
 		g_object_unref (gtkicon_info);
 
-		return g_object_ref (icon_info);
+		return icon_info;
 	} else {
                 GdkPixbuf *pixbuf;
                 GtkIconInfo *gtk_icon_info;
@@ -447,6 +434,64 @@ nautilus_icon_info_lookup_from_name (const char *name,
 	return info;
 }
 
+/* The icons most files in a folder have, at the sizes of the zoom levels */
+static const char * const preload_icon_names[] = {
+	NAUTILUS_ICON_FULLCOLOR_FOLDER,
+	"text-x-generic",
+	"image-x-generic",
+	"audio-x-generic",
+	"video-x-generic",
+	"x-office-document",
+	"package-x-generic",
+	"application-x-executable",
+};
+
+static const int preload_icon_sizes[] = {
+	NAUTILUS_LIST_ICON_SIZE_SMALL,
+	NAUTILUS_LIST_ICON_SIZE_STANDARD,
+	NAUTILUS_LIST_ICON_SIZE_LARGE,
+	NAUTILUS_LIST_ICON_SIZE_LARGER,
+	NAUTILUS_CANVAS_ICON_SIZE_LARGE,
+	NAUTILUS_CANVAS_ICON_SIZE_LARGER,
+};
+
+static guint preload_id;
+static guint preload_next;
+static int preload_scale;
+
+static gboolean
+preload_next_icon (gpointer user_data)
+{
+	NautilusIconInfo *icon;
+	guint n_sizes;
+
+	n_sizes = G_N_ELEMENTS (preload_icon_sizes);
+	if (preload_next == G_N_ELEMENTS (preload_icon_names) * n_sizes) {
+		preload_id = 0;
+		return G_SOURCE_REMOVE;
+	}
+
+	icon = nautilus_icon_info_lookup_from_name (preload_icon_names[preload_next / n_sizes],
+						    preload_icon_sizes[preload_next % n_sizes],
+						    preload_scale);
+	g_object_unref (icon);
+	preload_next++;
+
+	return G_SOURCE_CONTINUE;
+}
+
+void
+nautilus_icon_info_preload (int scale)
+{
+	preload_scale = scale;
+	preload_next = 0;
+
+	/* One icon at a time, when there is nothing else to do */
+	if (preload_id == 0) {
+		preload_id = g_idle_add_full (G_PRIORITY_LOW, preload_next_icon, NULL, NULL);
+	}
+}
+
 NautilusIconInfo *
 nautilus_icon_info_lookup_from_path (const char *path,
 				     int size,
@@ -467,22 +512,11 @@ nautilus_icon_info_lookup_from_path (const char *path,
 GdkPixbuf *
 nautilus_icon_info_get_pixbuf_nodefault (NautilusIconInfo  *icon)
 {
-	GdkPixbuf *res;
-
 	if (icon->pixbuf == NULL) {
-		res = NULL;
-	} else {
-		res = g_object_ref (icon->pixbuf);
-
-		if (icon->sole_owner) {
-			icon->sole_owner = FALSE;
-			g_object_add_toggle_ref (G_OBJECT (res),
-						 pixbuf_toggle_notify,
-						 icon);
-		}
+		return NULL;
 	}
-	
-	return res;
+
+	return g_object_ref (icon->pixbuf);
 }
 
 
@@ -81,6 +81,8 @@ GdkPixbuf *           nautilus_icon_info_get_pixbuf_at_size           (NautilusI
 const char *          nautilus_icon_info_get_used_name                (NautilusIconInfo  *icon);
 
 void                  nautilus_icon_info_clear_caches                 (void);
+/* Loads the icons of common file types for all zoom levels in idle time */
+void                  nautilus_icon_info_preload                      (int                scale);
 
 /* Relationship between zoom levels and icons sizes. */
 guint nautilus_get_list_icon_size_for_zoom_level          (NautilusListZoomLevel  zoom_level);
@@ -662,10 +662,55 @@ nautilus_list_model_compare_func (NautilusListModel *model,
 	return result;
 }
 
+/* Like g_sequence_sort() with nautilus_list_model_file_entry_compare_func(),
+ * but sorting many files is much faster with nautilus_file_sort_by_attribute_q().
+ */
+static void
+nautilus_list_model_sort_sequence (NautilusListModel *model, GSequence *files,
+				   GSequenceIter **ptrs, int length)
+{
+	NautilusFile **sorted_files;
+	GHashTable *reverse_map;
+	GSequenceIter *end, *ptr;
+	FileEntry *file_entry;
+	int n_files;
+	int i;
+
+	file_entry = g_sequence_get (ptrs[0]);
+	reverse_map = file_entry->parent != NULL ?
+		file_entry->parent->reverse_map : model->details->top_reverse_map;
+	end = g_sequence_get_end_iter (files);
+
+	/* The dummy rows, without a file, go first */
+	sorted_files = g_new (NautilusFile *, length);
+	n_files = 0;
+	for (i = 0; i < length; ++i) {
+		file_entry = g_sequence_get (ptrs[i]);
+		if (file_entry->file == NULL) {
+			g_sequence_move (ptrs[i], end);
+		} else {
+			sorted_files[n_files++] = file_entry->file;
+		}
+	}
+
+	nautilus_file_sort_by_attribute_q (sorted_files, n_files,
+					   model->details->sort_attribute,
+					   model->details->sort_directories_first,
+					   (model->details->order == GTK_SORT_DESCENDING));
+
+	for (i = 0; i < n_files; ++i) {
+		ptr = g_hash_table_lookup (reverse_map, sorted_files[i]);
+		g_sequence_move (ptr, end);
+	}
+
+	g_free (sorted_files);
+}
+
 static void
 nautilus_list_model_sort_file_entries (NautilusListModel *model, GSequence *files, GtkTreePath *path)
 {
 	GSequenceIter **old_order;
+	GSequenceIter *ptr;
 	GtkTreeIter iter;
 	int *new_order;
 	int length;
@@ -681,9 +726,8 @@ nautilus_list_model_sort_file_entries (NautilusListModel *model, GSequence *file
 	
 	/* generate old order of GSequenceIter's */
 	old_order = g_new (GSequenceIter *, length);
-	for (i = 0; i < length; ++i) {
-		GSequenceIter *ptr = g_sequence_get_iter_at_pos (files, i);
-		
+	ptr = g_sequence_get_begin_iter (files);
+	for (i = 0; i < length; ++i, ptr = g_sequence_iter_next (ptr)) {
 		file_entry = g_sequence_get (ptr);
 		if (file_entry->files != NULL) {
 			gtk_tree_path_append_index (path, i);
@@ -695,7 +739,7 @@ nautilus_list_model_sort_file_entries (NautilusListModel *model, GSequence *file
 	}
 
 	/* sort */
-	g_sequence_sort (files, nautilus_list_model_file_entry_compare_func, model);
+	nautilus_list_model_sort_sequence (model, files, old_order, length);
 
 	/* generate new order */
 	new_order = g_new (int, length);
@@ -803,12 +847,39 @@ add_dummy_row (NautilusListModel *model, FileEntry *parent_entry)
 	gtk_tree_path_free (path);
 }
 
+/* Tells the view about a file entry just added to the model */
+static void
+announce_file_entry (NautilusListModel *model, FileEntry *file_entry,
+		     gboolean replace_dummy)
+{
+	GtkTreeIter iter;
+	GtkTreePath *path;
+
+	iter.stamp = model->details->stamp;
+	iter.user_data = file_entry->ptr;
+
+	path = gtk_tree_model_get_path (GTK_TREE_MODEL (model), &iter);
+	if (replace_dummy) {
+		gtk_tree_model_row_changed (GTK_TREE_MODEL (model), path, &iter);
+	} else {
+		gtk_tree_model_row_inserted (GTK_TREE_MODEL (model), path, &iter);
+	}
+
+	if (nautilus_file_is_directory (file_entry->file)) {
+		file_entry->files = g_sequence_new ((GDestroyNotify)file_entry_free);
+
+		add_dummy_row (model, file_entry);
+
+		gtk_tree_model_row_has_child_toggled (GTK_TREE_MODEL (model),
+						      path, &iter);
+	}
+	gtk_tree_path_free (path);
+}
+
 gboolean
 nautilus_list_model_add_file (NautilusListModel *model, NautilusFile *file,
 			      NautilusDirectory *directory)
 {
-	GtkTreeIter iter;
-	GtkTreePath *path;
 	FileEntry *file_entry;
 	GSequenceIter *ptr, *parent_ptr;
 	GSequence *files;
@@ -868,28 +939,138 @@ nautilus_list_model_add_file (NautilusListModel *model, NautilusFile *file,
 					    nautilus_list_model_file_entry_compare_func, model);
 
 	g_hash_table_insert (parent_hash, file, file_entry->ptr);
-	
-	iter.stamp = model->details->stamp;
-	iter.user_data = file_entry->ptr;
 
-	path = gtk_tree_model_get_path (GTK_TREE_MODEL (model), &iter);
-	if (replace_dummy) {
-		gtk_tree_model_row_changed (GTK_TREE_MODEL (model), path, &iter);
-	} else {
-		gtk_tree_model_row_inserted (GTK_TREE_MODEL (model), path, &iter);
+	announce_file_entry (model, file_entry, replace_dummy);
+
+	return TRUE;
+}
+
+/* Merges the files, sorted, into the sequence in one pass when there are
+ * enough of them, and looks up the place of each one otherwise. Returns
+ * the entries of the files added in their order in the sequence.
+ */
+static GPtrArray *
+insert_file_entries (NautilusListModel *model,
+		     GSequence *files,
+		     GHashTable *parent_hash,
+		     FileEntry *parent_entry,
+		     NautilusFile **new_files,
+		     guint n_new_files)
+{
+	GPtrArray *file_entries;
+	FileEntry *file_entry;
+	GSequenceIter *ptr, *end;
+	gboolean merge;
+	guint length, i;
+
+	nautilus_file_sort_by_attribute_q (new_files, n_new_files,
+					   model->details->sort_attribute,
+					   model->details->sort_directories_first,
+					   (model->details->order == GTK_SORT_DESCENDING));
+
+	length = g_sequence_get_length (files);
+	merge = n_new_files * g_bit_storage (length) >= length;
+
+	file_entries = g_ptr_array_sized_new (n_new_files);
+	ptr = g_sequence_get_begin_iter (files);
+	end = g_sequence_get_end_iter (files);
+
+	for (i = 0; i < n_new_files; i++) {
+		if (g_hash_table_lookup (parent_hash, new_files[i]) != NULL) {
+			g_warning ("file already in tree (parent_entry: %p)!!!\n", parent_entry);
+			continue;
+		}
+
+		file_entry = g_new0 (FileEntry, 1);
+		file_entry->file = nautilus_file_ref (new_files[i]);
+		file_entry->parent = parent_entry;
+
+		if (merge) {
+			while (ptr != end &&
+			       nautilus_list_model_file_entry_compare_func (g_sequence_get (ptr),
+									    file_entry, model) <= 0) {
+				ptr = g_sequence_iter_next (ptr);
+			}
+			file_entry->ptr = g_sequence_insert_before (ptr, file_entry);
+		} else {
+			file_entry->ptr = g_sequence_insert_sorted (files, file_entry,
+								    nautilus_list_model_file_entry_compare_func, model);
+		}
+
+		g_hash_table_insert (parent_hash, file_entry->file, file_entry->ptr);
+		g_ptr_array_add (file_entries, file_entry);
 	}
 
-	if (nautilus_file_is_directory (file)) {
-		file_entry->files = g_sequence_new ((GDestroyNotify)file_entry_free);
+	return file_entries;
+}
 
-		add_dummy_row (model, file_entry);
+/* Like nautilus_list_model_add_file() for each of @files, but much faster
+ * for many files, like the ones of a directory being loaded.
+ */
+void
+nautilus_list_model_add_files (NautilusListModel *model, GList *files,
+			       NautilusDirectory *directory)
+{
+	GSequenceIter *parent_ptr, *dummy_ptr;
+	FileEntry *parent_entry, *dummy_entry;
+	GHashTable *parent_hash;
+	GSequence *sequence;
+	NautilusFile **new_files;
+	GPtrArray *file_entries;
+	gboolean replace_dummy;
+	guint n_new_files, i;
+	GList *l;
 
-		gtk_tree_model_row_has_child_toggled (GTK_TREE_MODEL (model),
-						      path, &iter);
+	if (files == NULL) {
+		return;
 	}
-	gtk_tree_path_free (path);
-	
-	return TRUE;
+
+	parent_ptr = g_hash_table_lookup (model->details->directory_reverse_map,
+					  directory);
+
+	parent_entry = NULL;
+	sequence = model->details->files;
+	parent_hash = model->details->top_reverse_map;
+
+	replace_dummy = FALSE;
+
+	if (parent_ptr != NULL) {
+		parent_entry = g_sequence_get (parent_ptr);
+		parent_entry->loaded = 1;
+		parent_hash = parent_entry->reverse_map;
+		sequence = parent_entry->files;
+		if (g_sequence_get_length (sequence) == 1) {
+			dummy_ptr = g_sequence_get_begin_iter (sequence);
+			dummy_entry = g_sequence_get (dummy_ptr);
+			if (dummy_entry->file == NULL) {
+				/* replace the dummy loading entry with the
+				 * first file */
+				model->details->stamp++;
+				g_sequence_remove (dummy_ptr);
+
+				replace_dummy = TRUE;
+			}
+		}
+	}
+
+	n_new_files = g_list_length (files);
+	new_files = g_new (NautilusFile *, n_new_files);
+	for (l = files, i = 0; l != NULL; l = l->next, i++) {
+		new_files[i] = l->data;
+	}
+
+	file_entries = insert_file_entries (model, sequence, parent_hash, parent_entry,
+					    new_files, n_new_files);
+
+	/* All the files are in place, so let the view know about them in
+	 * their order, without a search for each one */
+	for (i = 0; i < file_entries->len; i++) {
+		announce_file_entry (model, g_ptr_array_index (file_entries, i),
+				     replace_dummy && i == 0);
+	}
+
+	g_ptr_array_free (file_entries, TRUE);
+	g_free (new_files);
 }
 
 void
@@ -70,6 +70,9 @@ GType    nautilus_list_model_get_type                          (void);
 gboolean nautilus_list_model_add_file                          (NautilusListModel          *model,
 								NautilusFile         *file,
 								NautilusDirectory    *directory);
+void     nautilus_list_model_add_files                         (NautilusListModel          *model,
+								GList                *files,
+								NautilusDirectory    *directory);
 void     nautilus_list_model_file_changed                      (NautilusListModel          *model,
 								NautilusFile         *file,
 								NautilusDirectory    *directory);
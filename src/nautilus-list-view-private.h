@@ -21,6 +21,7 @@
 #include "nautilus-list-model.h"
 #include "nautilus-tree-view-drag-dest.h"
 #include "nautilus-dnd.h"
+#include "nautilus-prefetch.h"
 
 struct NautilusListViewDetails {
   GtkTreeView *tree_view;
@@ -37,10 +38,14 @@ struct NautilusListViewDetails {
 
   NautilusTreeViewDragDest *drag_dest;
 
+  NautilusPrefetch *prefetch;
+
   GtkTreePath *double_click_path[2]; /* Both clicks in a double click need to be on the same row */
 
   GtkTreePath *new_selection_path;   /* Path of the new selection after removing a file */
 
+  gboolean added_files_at_once;      /* So the add_file signals of these changes are ignored */
+
   GtkTreePath *hover_path;
 
   gint last_event_button_x;
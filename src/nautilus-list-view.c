@@ -33,6 +33,7 @@
 #include "nautilus-toolbar.h"
 #include "nautilus-list-view-dnd.h"
 
+#include <math.h>
 #include <string.h>
 #include <eel/eel-vfs-extensions.h>
 #include <eel/eel-gdk-extensions.h>
@@ -1564,6 +1565,15 @@ set_up_pixbuf_size (NautilusListView *view)
 	gtk_cell_renderer_set_fixed_size (GTK_CELL_RENDERER (view->details->pixbuf_cell),
 					  -1, icon_size + 2 * icon_padding);
 
+	/* The same icons as the model gives the rows */
+	nautilus_prefetch_set_icon_size (view->details->prefetch,
+					 icon_size,
+					 gtk_widget_get_scale_factor (GTK_WIDGET (view->details->tree_view)),
+					 NAUTILUS_FILE_ICON_FLAGS_USE_THUMBNAILS |
+					 NAUTILUS_FILE_ICON_FLAGS_FORCE_THUMBNAIL_SIZE |
+					 NAUTILUS_FILE_ICON_FLAGS_USE_EMBLEMS |
+					 NAUTILUS_FILE_ICON_FLAGS_USE_ONE_EMBLEM);
+
 	/* FIXME: https://bugzilla.gnome.org/show_bug.cgi?id=641518 */
 	gtk_tree_view_columns_autosize (view->details->tree_view);
 }
@@ -1575,6 +1585,125 @@ get_icon_scale_callback (NautilusListModel *model,
 	return gtk_widget_get_scale_factor (GTK_WIDGET (view->details->tree_view));
 }
 
+/* Moves @path to the row below or above it, going into expanded folders */
+static gboolean
+step_row (GtkTreeView *tree_view,
+	  GtkTreePath *path,
+	  gboolean     forward)
+{
+	GtkTreeModel *model;
+	GtkTreeIter iter;
+	int n_children;
+
+	model = gtk_tree_view_get_model (tree_view);
+
+	if (forward) {
+		if (gtk_tree_view_row_expanded (tree_view, path)) {
+			gtk_tree_path_down (path);
+			return TRUE;
+		}
+
+		do {
+			gtk_tree_path_next (path);
+			if (gtk_tree_model_get_iter (model, &iter, path)) {
+				return TRUE;
+			}
+		} while (gtk_tree_path_up (path) && gtk_tree_path_get_depth (path) > 0);
+
+		return FALSE;
+	}
+
+	if (!gtk_tree_path_prev (path)) {
+		return gtk_tree_path_get_depth (path) > 1 && gtk_tree_path_up (path);
+	}
+
+	while (gtk_tree_view_row_expanded (tree_view, path) &&
+	       gtk_tree_model_get_iter (model, &iter, path)) {
+		n_children = gtk_tree_model_iter_n_children (model, &iter);
+		gtk_tree_path_append_index (path, n_children - 1);
+	}
+
+	return TRUE;
+}
+
+static GList *
+get_files_in_range (double   start,
+		    double   end,
+		    double   visible_start,
+		    double   visible_end,
+		    GList  **visible,
+		    gpointer user_data)
+{
+	NautilusListView *view;
+	GtkTreeModel *model;
+	GtkTreePath *path;
+	GtkTreeIter iter;
+	GdkRectangle area;
+	NautilusFile *file;
+	GList *files;
+	double row_y;
+	int y, first, n_rows, row, i;
+
+	*visible = NULL;
+	view = NAUTILUS_LIST_VIEW (user_data);
+	model = gtk_tree_view_get_model (view->details->tree_view);
+
+	if (model == NULL ||
+	    !gtk_tree_view_get_visible_range (view->details->tree_view, &path, NULL)) {
+		return NULL;
+	}
+
+	/* All the rows have the same height, see set_up_pixbuf_size(), so
+	   count the rows from the first visible one */
+	gtk_tree_view_get_background_area (view->details->tree_view, path, NULL, &area);
+	if (area.height <= 0) {
+		gtk_tree_path_free (path);
+		return NULL;
+	}
+	gtk_tree_view_convert_bin_window_to_tree_coords (view->details->tree_view,
+							 0, area.y, NULL, &y);
+
+	first = floor ((start - y) / area.height);
+	n_rows = ceil ((end - start) / area.height) + 1;
+
+	/* The row at path, counted from the first visible one */
+	row = 0;
+	while (row != first) {
+		if (!step_row (view->details->tree_view, path, first > 0)) {
+			break;
+		}
+		row += first > 0 ? 1 : -1;
+	}
+
+	files = NULL;
+	for (i = 0; i < n_rows; i++) {
+		if (gtk_tree_model_get_iter (model, &iter, path)) {
+			gtk_tree_model_get (model, &iter,
+					    NAUTILUS_LIST_MODEL_FILE_COLUMN, &file,
+					    -1);
+			/* Loading and empty folders have a row without a file */
+			if (file != NULL) {
+				files = g_list_prepend (files, file);
+
+				row_y = y + (double) row * area.height;
+				if (row_y + area.height > visible_start && row_y <= visible_end) {
+					*visible = g_list_prepend (*visible, nautilus_file_ref (file));
+				}
+			}
+		}
+
+		if (!step_row (view->details->tree_view, path, TRUE)) {
+			break;
+		}
+		row++;
+	}
+
+	gtk_tree_path_free (path);
+
+	*visible = g_list_reverse (*visible);
+	return g_list_reverse (files);
+}
+
 static void
 create_and_set_up_tree_view (NautilusListView *view)
 {
@@ -1594,6 +1723,10 @@ create_and_set_up_tree_view (NautilusListView *view)
 							NULL);
 	gtk_tree_view_set_enable_search (view->details->tree_view, FALSE);
 
+	view->details->prefetch = nautilus_prefetch_new (GTK_SCROLLABLE (view->details->tree_view),
+							 get_files_in_range,
+							 view);
+
 	view->details->drag_dest = 
 		nautilus_tree_view_drag_dest_new (view->details->tree_view);
 
@@ -1827,10 +1960,24 @@ nautilus_list_view_add_file (NautilusFilesView *view, NautilusFile *file, Nautil
 {
 	NautilusListModel *model;
 
+	if (NAUTILUS_LIST_VIEW (view)->details->added_files_at_once) {
+		return;
+	}
+
 	model = NAUTILUS_LIST_VIEW (view)->details->model;
 	nautilus_list_model_add_file (model, file, directory);
 }
 
+static void
+nautilus_list_view_add_files (NautilusFilesView *view, GList *files, NautilusDirectory *directory)
+{
+	NautilusListView *list_view;
+
+	list_view = NAUTILUS_LIST_VIEW (view);
+	nautilus_list_model_add_files (list_view->details->model, files, directory);
+	list_view->details->added_files_at_once = TRUE;
+}
+
 static char **
 get_default_visible_columns (NautilusListView *list_view)
 {
@@ -2058,6 +2205,10 @@ nautilus_list_view_clear (NautilusFilesView *view)
 	if (list_view->details->model != NULL) {
 		nautilus_list_model_clear (list_view->details->model);
 	}
+
+	if (list_view->details->prefetch != NULL) {
+		nautilus_prefetch_cancel (list_view->details->prefetch);
+	}
 }
 
 static void
@@ -2314,6 +2465,8 @@ nautilus_list_view_end_file_changes (NautilusFilesView *view)
 
 	list_view = NAUTILUS_LIST_VIEW (view);
 
+	list_view->details->added_files_at_once = FALSE;
+
 	if (list_view->details->new_selection_path) {
 		gtk_tree_view_set_cursor (list_view->details->tree_view,
 					  list_view->details->new_selection_path,
@@ -2898,6 +3051,11 @@ nautilus_list_view_dispose (GObject *object)
 		list_view->details->drag_dest = NULL;
 	}
 
+	if (list_view->details->prefetch) {
+		nautilus_prefetch_free (list_view->details->prefetch);
+		list_view->details->prefetch = NULL;
+	}
+
 	if (list_view->details->clipboard_handler_id != 0) {
 		g_signal_handler_disconnect (nautilus_clipboard_monitor_get (),
 		                             list_view->details->clipboard_handler_id);
@@ -3124,6 +3282,7 @@ nautilus_list_view_class_init (NautilusListViewClass *class)
 	G_OBJECT_CLASS (class)->finalize = nautilus_list_view_finalize;
 
 	nautilus_files_view_class->add_file = nautilus_list_view_add_file;
+	nautilus_files_view_class->add_files = nautilus_list_view_add_files;
 	nautilus_files_view_class->begin_loading = nautilus_list_view_begin_loading;
 	nautilus_files_view_class->end_loading = nautilus_list_view_end_loading;
 	nautilus_files_view_class->bump_zoom_level = nautilus_list_view_bump_zoom_level;
@@ -25,23 +25,53 @@
 
 #include <config.h>
 #include "nautilus-monitor.h"
+#include "nautilus-directory-private.h"
 #include "nautilus-file-changes-queue.h"
 #include "nautilus-file-utilities.h"
 
 #include <gio/gio.h>
 
+/* Used when the kernel doesn't say how many inotify watches a user may
+ * have, the default of older kernels.
+ */
+#define DEFAULT_MAX_USER_WATCHES 8192
+
 struct NautilusMonitor {
 	GFileMonitor *monitor;
 	GVolumeMonitor *volume_monitor;
 	GFile *location;
+
+	/* Of watched_monitors, or of waiting_monitors if waiting */
+	GList *link;
+	gboolean waiting;
+	/* The location of a view, so never made to wait */
+	gboolean shown;
 };
 
+/* Local directories are watched with inotify, and the kernel limits
+ * the watches of a user for all of their applications. Past our share
+ * of them, only the most recently used directories are watched, and the
+ * others wait for a watch to be free. The locations of the views are
+ * always watched, but not the subfolders they expand or the folders of
+ * the files they show. Both queues are most recently used first.
+ */
+static GQueue watched_monitors = G_QUEUE_INIT;
+static GQueue waiting_monitors = G_QUEUE_INIT;
+
+static GList *locations_to_reload;
+static guint reload_idle_id = 0;
+
 static gboolean call_consume_changes_idle_id = 0;
 
 static gboolean
 call_consume_changes_idle_cb (gpointer not_used)
 {
-	nautilus_file_changes_consume_changes (TRUE);
+	/* A batch at a time, so that lots of changes at once don't
+	   keep the main loop from drawing */
+	if (nautilus_file_changes_consume_changes (FALSE)) {
+		return TRUE;
+	}
+
 	call_consume_changes_idle_id = 0;
 	return FALSE;
 }
@@ -112,6 +142,144 @@ dir_changed (GFileMonitor* monitor,
 	schedule_call_consume_changes ();
 }
  
+static guint
+get_max_watches (void)
+{
+	static guint max_watches = 0;
+	char *contents;
+	guint64 max_user_watches;
+
+	if (max_watches == 0) {
+		max_user_watches = 0;
+		if (g_file_get_contents ("/proc/sys/fs/inotify/max_user_watches",
+					 &contents, NULL, NULL)) {
+			max_user_watches = g_ascii_strtoull (contents, NULL, 10);
+			g_free (contents);
+		}
+		if (max_user_watches == 0) {
+			max_user_watches = DEFAULT_MAX_USER_WATCHES;
+		}
+
+		/* Leave half of them to the other applications */
+		max_watches = MIN (max_user_watches / 2, G_MAXUINT);
+	}
+
+	return max_watches;
+}
+
+static void
+start_watching (NautilusMonitor *monitor)
+{
+	monitor->monitor = g_file_monitor_directory (monitor->location, G_FILE_MONITOR_WATCH_MOUNTS, NULL, NULL);
+	if (monitor->monitor != NULL) {
+		g_signal_connect (monitor->monitor, "changed",
+				  G_CALLBACK (dir_changed), monitor);
+	}
+}
+
+static void
+stop_watching (NautilusMonitor *monitor)
+{
+	if (monitor->monitor != NULL) {
+		g_signal_handlers_disconnect_by_func (monitor->monitor, dir_changed, monitor);
+		g_file_monitor_cancel (monitor->monitor);
+		g_clear_object (&monitor->monitor);
+	}
+}
+
+static gboolean
+reload_idle_cb (gpointer not_used)
+{
+	NautilusDirectory *directory;
+	GList *l;
+
+	for (l = locations_to_reload; l != NULL; l = l->next) {
+		directory = nautilus_directory_get_existing (l->data);
+		if (directory != NULL) {
+			nautilus_directory_force_reload (directory);
+			nautilus_directory_unref (directory);
+		}
+	}
+
+	g_list_free_full (locations_to_reload, g_object_unref);
+	locations_to_reload = NULL;
+	reload_idle_id = 0;
+
+	return FALSE;
+}
+
+static void
+schedule_reload (NautilusMonitor *monitor)
+{
+	locations_to_reload = g_list_prepend (locations_to_reload,
+					      g_object_ref (monitor->location));
+	if (reload_idle_id == 0) {
+		reload_idle_id = g_idle_add (reload_idle_cb, NULL);
+	}
+}
+
+/* Makes the least recently used directory that isn't shown wait, if
+ * there are no watches left. When all are shown, they stay watched past
+ * the limit.
+ */
+static void
+make_room (void)
+{
+	NautilusMonitor *monitor;
+	GList *l;
+
+	if (watched_monitors.length < get_max_watches ()) {
+		return;
+	}
+
+	for (l = watched_monitors.tail; l != NULL; l = l->prev) {
+		monitor = l->data;
+		if (!monitor->shown) {
+			break;
+		}
+	}
+	if (l == NULL) {
+		return;
+	}
+
+	g_queue_delete_link (&watched_monitors, l);
+	stop_watching (monitor);
+	monitor->waiting = TRUE;
+	g_queue_push_head (&waiting_monitors, monitor);
+	monitor->link = waiting_monitors.head;
+}
+
+/* Gives the watch just freed to the most recent waiting directory, which
+ * has to be reloaded for the changes it missed.
+ */
+static void
+watch_next_waiting (void)
+{
+	NautilusMonitor *monitor;
+
+	monitor = g_queue_pop_head (&waiting_monitors);
+	if (monitor == NULL) {
+		return;
+	}
+
+	monitor->waiting = FALSE;
+	g_queue_push_tail (&watched_monitors, monitor);
+	monitor->link = watched_monitors.tail;
+	start_watching (monitor);
+
+	schedule_reload (monitor);
+}
+
+static void
+watch_local_directory (NautilusMonitor *monitor)
+{
+	make_room ();
+
+	g_queue_push_head (&watched_monitors, monitor);
+	monitor->link = watched_monitors.head;
+	start_watching (monitor);
+}
+
 NautilusMonitor *
 nautilus_monitor_directory (GFile *location)
 {
@@ -119,11 +287,17 @@ nautilus_monitor_directory (GFile *location)
 	NautilusMonitor *ret;
 
 	ret = g_slice_new0 (NautilusMonitor);
+
+	if (g_file_is_native (location)) {
+		ret->location = g_object_ref (location);
+		watch_local_directory (ret);
+		return ret;
+	}
 	dir_monitor = g_file_monitor_directory (location, G_FILE_MONITOR_WATCH_MOUNTS, NULL, NULL);
 
 	if (dir_monitor != NULL) {
 		ret->monitor = dir_monitor;
-	} else if (!g_file_is_native (location)) {
+	} else {
 		ret->location = g_object_ref (location);
 		ret->volume_monitor = g_volume_monitor_get ();
 	}
@@ -142,13 +316,45 @@ nautilus_monitor_directory (GFile *location)
 	return ret;
 }
 
+void
+nautilus_monitor_set_shown (NautilusMonitor *monitor,
+			    gboolean shown)
+{
+	monitor->shown = shown;
+
+	/* Only local directories are queued */
+	if (!shown || monitor->link == NULL) {
+		return;
+	}
+
+	/* Being shown counts as being used */
+	if (monitor->waiting) {
+		g_queue_delete_link (&waiting_monitors, monitor->link);
+		monitor->waiting = FALSE;
+		make_room ();
+		g_queue_push_head (&watched_monitors, monitor);
+		monitor->link = watched_monitors.head;
+		start_watching (monitor);
+
+		schedule_reload (monitor);
+	} else {
+		g_queue_unlink (&watched_monitors, monitor->link);
+		g_queue_push_head_link (&watched_monitors, monitor->link);
+	}
+}
+
 void 
 nautilus_monitor_cancel (NautilusMonitor *monitor)
 {
-	if (monitor->monitor != NULL) {
-		g_signal_handlers_disconnect_by_func (monitor->monitor, dir_changed, monitor);
-		g_file_monitor_cancel (monitor->monitor);
-		g_object_unref (monitor->monitor);
+	stop_watching (monitor);
+
+	if (monitor->link != NULL) {
+		if (monitor->waiting) {
+			g_queue_delete_link (&waiting_monitors, monitor->link);
+		} else {
+			g_queue_delete_link (&watched_monitors, monitor->link);
+			watch_next_waiting ();
+		}
 	}
 
 	if (monitor->volume_monitor != NULL) {
@@ -30,7 +30,11 @@
 
 typedef struct NautilusMonitor NautilusMonitor;
 
-NautilusMonitor *nautilus_monitor_directory (GFile *location);
+NautilusMonitor *nautilus_monitor_directory (GFile           *location);
+/* Directories a view shows as its location keep their watch when
+ * watches run out */
+void             nautilus_monitor_set_shown (NautilusMonitor *monitor,
+					     gboolean         shown);
 void             nautilus_monitor_cancel    (NautilusMonitor *monitor);
 
 #endif /* NAUTILUS_MONITOR_H */
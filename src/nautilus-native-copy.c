@@ -0,0 +1,450 @@
+/*
+   Copyright (C) 2016 Red Hat, Inc
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* For copy_file_range() */
+#define _GNU_SOURCE
+
+#include <config.h>
+#include "nautilus-native-copy.h"
+
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
+#ifdef HAVE_LINUX_FS_H
+#include <linux/fs.h>
+#endif
+
+/* Bytes moved per system call, so that progress is reported and
+ * cancellation noticed often enough.
+ */
+#define CHUNK_SIZE (8 * 1024 * 1024)
+
+/* The buffer of the plain read and write copy */
+#define BUFFER_SIZE (1024 * 1024)
+#define BUFFER_ALIGNMENT 4096
+
+typedef enum {
+	COPY_DONE,
+	/* The method doesn't work for these files, the next one can go
+	 * on from the current offset. */
+	COPY_UNSUPPORTED,
+	COPY_FAILED
+} CopyResult;
+
+typedef struct {
+	int in_fd;
+	int out_fd;
+	goffset size;
+	goffset offset;
+	GCancellable *cancellable;
+	GFileProgressCallback progress_callback;
+	gpointer progress_callback_data;
+} CopyState;
+
+static void
+set_error_from_errno (GError **error,
+		      int errsv)
+{
+	g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+		     _("Error while copying: %s"), g_strerror (errsv));
+}
+
+/* Returns FALSE if the copy was cancelled */
+static gboolean
+report_progress (CopyState *state,
+		 GError **error)
+{
+	if (state->progress_callback != NULL) {
+		state->progress_callback (state->offset,
+					  MAX (state->size, state->offset),
+					  state->progress_callback_data);
+	}
+
+	return !g_cancellable_set_error_if_cancelled (state->cancellable, error);
+}
+
+/* Called when the kernel reports the end of the source. Some file
+ * systems return nothing instead of an error when they can't do it, so
+ * reading the rest is left to the next method if nothing was copied
+ * yet. */
+#if defined (HAVE_COPY_FILE_RANGE) || defined (HAVE_SYS_SENDFILE_H)
+static CopyResult
+copy_ended (CopyState *state,
+	    goffset start,
+	    GError **error)
+{
+	if (state->offset >= state->size) {
+		return COPY_DONE;
+	}
+	if (state->offset == start) {
+		return COPY_UNSUPPORTED;
+	}
+
+	g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+			     _("Error while copying: the file ended early"));
+	return COPY_FAILED;
+}
+#endif
+
+/* Shares the data blocks of the source, on file systems that can, like
+ * btrfs and XFS. */
+static CopyResult
+copy_clone (CopyState *state,
+	    GError **error)
+{
+#ifdef FICLONE
+	if (state->offset == 0 &&
+	    ioctl (state->out_fd, FICLONE, state->in_fd) == 0) {
+		state->offset = state->size;
+		return COPY_DONE;
+	}
+#endif
+	return COPY_UNSUPPORTED;
+}
+
+/* Lets the kernel copy, or the file system, when it can do it on its
+ * own, like NFS and SMB servers. */
+static CopyResult
+copy_range (CopyState *state,
+	    GError **error)
+{
+#ifdef HAVE_COPY_FILE_RANGE
+	loff_t in_offset, out_offset;
+	goffset start;
+	ssize_t n;
+
+	start = state->offset;
+
+	for (;;) {
+		in_offset = out_offset = state->offset;
+		n = copy_file_range (state->in_fd, &in_offset,
+				     state->out_fd, &out_offset,
+				     CHUNK_SIZE, 0);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno == ENOSYS || errno == EXDEV ||
+			    errno == EINVAL || errno == EOPNOTSUPP) {
+				return COPY_UNSUPPORTED;
+			}
+			set_error_from_errno (error, errno);
+			return COPY_FAILED;
+		}
+		if (n == 0) {
+			return copy_ended (state, start, error);
+		}
+
+		state->offset += n;
+		if (!report_progress (state, error)) {
+			return COPY_FAILED;
+		}
+	}
+#else
+	return COPY_UNSUPPORTED;
+#endif
+}
+
+static CopyResult
+copy_sendfile (CopyState *state,
+	       GError **error)
+{
+#ifdef HAVE_SYS_SENDFILE_H
+	off_t in_offset;
+	goffset start;
+	ssize_t n;
+
+	start = state->offset;
+	if (lseek (state->out_fd, state->offset, SEEK_SET) < 0) {
+		return COPY_UNSUPPORTED;
+	}
+
+	for (;;) {
+		in_offset = state->offset;
+		n = sendfile (state->out_fd, state->in_fd, &in_offset, CHUNK_SIZE);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno == ENOSYS || errno == EINVAL) {
+				return COPY_UNSUPPORTED;
+			}
+			set_error_from_errno (error, errno);
+			return COPY_FAILED;
+		}
+		if (n == 0) {
+			return copy_ended (state, start, error);
+		}
+
+		state->offset += n;
+		if (!report_progress (state, error)) {
+			return COPY_FAILED;
+		}
+	}
+#else
+	return COPY_UNSUPPORTED;
+#endif
+}
+
+static CopyResult
+copy_buffered (CopyState *state,
+	       GError **error)
+{
+	CopyResult result;
+	char *buffer;
+	ssize_t n, written, w;
+
+	if (posix_memalign ((void **) &buffer, BUFFER_ALIGNMENT, BUFFER_SIZE) != 0) {
+		set_error_from_errno (error, ENOMEM);
+		return COPY_FAILED;
+	}
+
+#ifdef POSIX_FADV_SEQUENTIAL
+	posix_fadvise (state->in_fd, state->offset, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+	result = COPY_DONE;
+	for (;;) {
+		n = pread (state->in_fd, buffer, BUFFER_SIZE, state->offset);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			set_error_from_errno (error, errno);
+			result = COPY_FAILED;
+			break;
+		}
+		if (n == 0) {
+			break;
+		}
+
+		for (written = 0; written < n; written += w) {
+			w = pwrite (state->out_fd, buffer + written, n - written,
+				    state->offset + written);
+			if (w < 0) {
+				if (errno == EINTR) {
+					w = 0;
+					continue;
+				}
+				set_error_from_errno (error, errno);
+				result = COPY_FAILED;
+				break;
+			}
+		}
+		if (result == COPY_FAILED) {
+			break;
+		}
+
+		state->offset += n;
+		if (!report_progress (state, error)) {
+			result = COPY_FAILED;
+			break;
+		}
+	}
+
+	free (buffer);
+	return result;
+}
+
+/* Sets @handled to FALSE, and returns FALSE, for files GIO has to copy */
+static gboolean
+native_copy (GFile *source,
+	     GFile *destination,
+	     GFileCopyFlags flags,
+	     GCancellable *cancellable,
+	     GFileProgressCallback progress_callback,
+	     gpointer progress_callback_data,
+	     gboolean *handled,
+	     GError **error)
+{
+	CopyState state;
+	CopyResult result;
+	struct stat statbuf;
+	char *source_path, *destination_path;
+	mode_t mode;
+	int errsv;
+
+	*handled = FALSE;
+	result = COPY_FAILED;
+
+	/* Replacing files, and the errors on conflicts, are left to GIO */
+	if (flags & (G_FILE_COPY_OVERWRITE | G_FILE_COPY_BACKUP)) {
+		return FALSE;
+	}
+
+	source_path = g_file_get_path (source);
+	destination_path = g_file_get_path (destination);
+	if (source_path == NULL || destination_path == NULL) {
+		goto out;
+	}
+
+	if (g_lstat (source_path, &statbuf) != 0 ||
+	    !S_ISREG (statbuf.st_mode) ||
+	    g_lstat (destination_path, &statbuf) == 0 ||
+	    errno != ENOENT) {
+		goto out;
+	}
+
+	state.in_fd = g_open (source_path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW, 0);
+	if (state.in_fd < 0) {
+		goto out;
+	}
+	if (fstat (state.in_fd, &statbuf) != 0 ||
+	    !S_ISREG (statbuf.st_mode)) {
+		close (state.in_fd);
+		goto out;
+	}
+
+	if (flags & G_FILE_COPY_TARGET_DEFAULT_PERMS) {
+		mode = 0666;
+	} else {
+		mode = statbuf.st_mode & 0777;
+	}
+	state.out_fd = g_open (destination_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, mode);
+	if (state.out_fd < 0) {
+		close (state.in_fd);
+		goto out;
+	}
+
+	*handled = TRUE;
+
+	state.size = statbuf.st_size;
+	state.offset = 0;
+	state.cancellable = cancellable;
+	state.progress_callback = progress_callback;
+	state.progress_callback_data = progress_callback_data;
+
+	/* From the fastest to the one that always works */
+	result = copy_clone (&state, error);
+	if (result == COPY_UNSUPPORTED) {
+		result = copy_range (&state, error);
+	}
+	if (result == COPY_UNSUPPORTED) {
+		result = copy_sendfile (&state, error);
+	}
+	if (result == COPY_UNSUPPORTED) {
+		result = copy_buffered (&state, error);
+	}
+
+	close (state.in_fd);
+	if (close (state.out_fd) != 0 && result == COPY_DONE) {
+		errsv = errno;
+		set_error_from_errno (error, errsv);
+		result = COPY_FAILED;
+	}
+
+	if (result != COPY_DONE) {
+		g_unlink (destination_path);
+		goto out;
+	}
+
+	if (progress_callback != NULL) {
+		progress_callback (state.offset, state.offset, progress_callback_data);
+	}
+
+	/* Like g_file_copy(), don't fail on what the destination can't keep */
+	g_file_copy_attributes (source, destination, flags, cancellable, NULL);
+
+ out:
+	g_free (source_path);
+	g_free (destination_path);
+
+	return *handled && result == COPY_DONE;
+}
+
+gboolean
+nautilus_native_copy (GFile *source,
+		      GFile *destination,
+		      GFileCopyFlags flags,
+		      GCancellable *cancellable,
+		      GFileProgressCallback progress_callback,
+		      gpointer progress_callback_data,
+		      GError **error)
+{
+	gboolean handled, res;
+
+	res = native_copy (source, destination, flags, cancellable,
+			   progress_callback, progress_callback_data,
+			   &handled, error);
+	if (handled) {
+		return res;
+	}
+
+	return g_file_copy (source, destination, flags, cancellable,
+			    progress_callback, progress_callback_data,
+			    error);
+}
+
+gboolean
+nautilus_native_move (GFile *source,
+		      GFile *destination,
+		      GFileCopyFlags flags,
+		      GCancellable *cancellable,
+		      GFileProgressCallback progress_callback,
+		      gpointer progress_callback_data,
+		      GError **error)
+{
+	GError *local_error;
+	gboolean handled, res;
+
+	if (!g_file_is_native (source) || !g_file_is_native (destination)) {
+		return g_file_move (source, destination, flags, cancellable,
+				    progress_callback, progress_callback_data,
+				    error);
+	}
+
+	/* Renaming is as fast as it gets */
+	local_error = NULL;
+	if (g_file_move (source, destination,
+			 flags | G_FILE_COPY_NO_FALLBACK_FOR_MOVE,
+			 cancellable,
+			 progress_callback, progress_callback_data,
+			 &local_error)) {
+		return TRUE;
+	}
+
+	if (!g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED)) {
+		g_propagate_error (error, local_error);
+		return FALSE;
+	}
+	g_clear_error (&local_error);
+
+	/* Between file systems, copy and delete the source, like
+	 * g_file_move() would.
+	 */
+	res = native_copy (source, destination, flags | G_FILE_COPY_ALL_METADATA,
+			   cancellable,
+			   progress_callback, progress_callback_data,
+			   &handled, error);
+	if (!handled) {
+		return g_file_move (source, destination, flags, cancellable,
+				    progress_callback, progress_callback_data,
+				    error);
+	}
+
+	return res && g_file_delete (source, cancellable, error);
+}
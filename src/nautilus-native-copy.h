@@ -0,0 +1,46 @@
+/*
+   Copyright (C) 2016 Red Hat, Inc
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* nautilus-native-copy.h: copying regular local files with what the
+   kernel offers, rather than through GIO streams.
+*/
+
+#ifndef NAUTILUS_NATIVE_COPY_H
+#define NAUTILUS_NATIVE_COPY_H
+
+#include <gio/gio.h>
+
+/* These work like g_file_copy() and g_file_move(), and fall back to
+ * them for anything but a regular local file copied to a name that is
+ * not taken yet, so conflicts are reported with the same errors.
+ */
+gboolean nautilus_native_copy (GFile                  *source,
+			       GFile                  *destination,
+			       GFileCopyFlags          flags,
+			       GCancellable           *cancellable,
+			       GFileProgressCallback   progress_callback,
+			       gpointer                progress_callback_data,
+			       GError                **error);
+gboolean nautilus_native_move (GFile                  *source,
+			       GFile                  *destination,
+			       GFileCopyFlags          flags,
+			       GCancellable           *cancellable,
+			       GFileProgressCallback   progress_callback,
+			       gpointer                progress_callback_data,
+			       GError                **error);
+
+#endif /* NAUTILUS_NATIVE_COPY_H */
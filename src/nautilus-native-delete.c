@@ -0,0 +1,321 @@
+/*
+   Copyright (C) 2016 Red Hat, Inc
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <config.h>
+#include "nautilus-native-delete.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#define MAX_THREADS 4
+
+/* How often progress is reported */
+#define PROGRESS_INTERVAL (100 * G_TIME_SPAN_MILLISECOND)
+
+/* Folders are opened and removed relative to the top folder, by their
+ * relative path, so that only the folders being read are open at any
+ * time, whatever the shape of the tree. The files in a folder are
+ * deleted relative to the folder, while it is open.
+ *
+ * A folder is removed once it is read and all its subfolders are gone,
+ * which is tracked by the number of those still pending, plus one for
+ * reading the folder itself.
+ */
+typedef struct DeleteDirectory DeleteDirectory;
+
+typedef struct {
+	int top_fd;
+	char *top_path;
+	GCancellable *cancellable;
+	GThreadPool *pool;
+
+	volatile gint n_deleted;
+	/* Once set, nothing more is deleted */
+	volatile gint failed;
+
+	GMutex mutex;
+	GCond cond;
+	gboolean done;
+	/* Only set when cancelled */
+	GError *error;
+	GList *removed_directories;
+} DeleteState;
+
+struct DeleteDirectory {
+	DeleteState *state;
+	DeleteDirectory *parent;
+	/* Relative to the top folder, NULL for the top folder itself */
+	char *path;
+	volatile gint n_pending;
+};
+
+/* The caller deletes what is left the slow way, which reports the
+ * errors, so only the failure is recorded here. */
+static void
+set_failed (DeleteState *state)
+{
+	g_atomic_int_set (&state->failed, TRUE);
+}
+
+static gboolean
+check_cancelled (DeleteState *state)
+{
+	GError *error;
+
+	if (g_atomic_int_get (&state->failed)) {
+		return TRUE;
+	}
+
+	error = NULL;
+	if (g_cancellable_set_error_if_cancelled (state->cancellable, &error)) {
+		g_atomic_int_set (&state->failed, TRUE);
+
+		g_mutex_lock (&state->mutex);
+		if (state->error == NULL) {
+			state->error = error;
+		} else {
+			g_error_free (error);
+		}
+		g_mutex_unlock (&state->mutex);
+
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+static char *
+get_full_path (DeleteState *state,
+	       const char *path)
+{
+	return path == NULL ? g_strdup (state->top_path) :
+		g_build_filename (state->top_path, path, NULL);
+}
+
+static DeleteDirectory *
+delete_directory_new (DeleteState *state,
+		      DeleteDirectory *parent,
+		      const char *name)
+{
+	DeleteDirectory *directory;
+
+	directory = g_new0 (DeleteDirectory, 1);
+	directory->state = state;
+	directory->parent = parent;
+	if (parent != NULL) {
+		directory->path = parent->path == NULL ? g_strdup (name) :
+			g_build_filename (parent->path, name, NULL);
+		g_atomic_int_inc (&parent->n_pending);
+	}
+	directory->n_pending = 1;
+
+	return directory;
+}
+
+/* Drops one pending reference on @directory, removing it and going on
+ * with its parent if that was the last one.
+ */
+static void
+delete_directory_unref (DeleteDirectory *directory)
+{
+	DeleteState *state;
+	DeleteDirectory *parent;
+	char *full_path;
+	int res;
+
+	state = directory->state;
+
+	while (directory != NULL &&
+	       g_atomic_int_dec_and_test (&directory->n_pending)) {
+		if (!check_cancelled (state)) {
+			if (directory->path == NULL) {
+				res = rmdir (state->top_path);
+			} else {
+				res = unlinkat (state->top_fd, directory->path, AT_REMOVEDIR);
+			}
+
+			if (res == 0) {
+				g_atomic_int_inc (&state->n_deleted);
+
+				full_path = get_full_path (state, directory->path);
+				g_mutex_lock (&state->mutex);
+				state->removed_directories = g_list_prepend (state->removed_directories,
+									     g_file_new_for_path (full_path));
+				g_mutex_unlock (&state->mutex);
+				g_free (full_path);
+			} else {
+				set_failed (state);
+			}
+		}
+
+		parent = directory->parent;
+		if (parent == NULL) {
+			g_mutex_lock (&state->mutex);
+			state->done = TRUE;
+			g_cond_signal (&state->cond);
+			g_mutex_unlock (&state->mutex);
+		}
+
+		g_free (directory->path);
+		g_free (directory);
+
+		directory = parent;
+	}
+}
+
+static gboolean
+is_directory (int dir_fd,
+	      struct dirent *entry)
+{
+	struct stat statbuf;
+
+#ifdef _DIRENT_HAVE_D_TYPE
+	if (entry->d_type != DT_UNKNOWN) {
+		return entry->d_type == DT_DIR;
+	}
+#endif
+
+	return fstatat (dir_fd, entry->d_name, &statbuf, AT_SYMLINK_NOFOLLOW) == 0 &&
+	       S_ISDIR (statbuf.st_mode);
+}
+
+static void
+delete_directory_contents (gpointer data,
+			   gpointer user_data)
+{
+	DeleteDirectory *directory, *subdirectory;
+	DeleteState *state;
+	struct dirent *entry;
+	DIR *dir;
+	int fd;
+
+	directory = data;
+	state = user_data;
+
+	if (check_cancelled (state)) {
+		goto out;
+	}
+
+	fd = openat (state->top_fd,
+		     directory->path != NULL ? directory->path : ".",
+		     O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd < 0 || (dir = fdopendir (fd)) == NULL) {
+		set_failed (state);
+		if (fd >= 0) {
+			close (fd);
+		}
+		goto out;
+	}
+
+	while (!check_cancelled (state) &&
+	       (entry = readdir (dir)) != NULL) {
+		if (strcmp (entry->d_name, ".") == 0 ||
+		    strcmp (entry->d_name, "..") == 0) {
+			continue;
+		}
+
+		if (is_directory (fd, entry)) {
+			subdirectory = delete_directory_new (state, directory, entry->d_name);
+			g_thread_pool_push (state->pool, subdirectory, NULL);
+		} else if (unlinkat (fd, entry->d_name, 0) == 0) {
+			g_atomic_int_inc (&state->n_deleted);
+		} else {
+			set_failed (state);
+		}
+	}
+
+	closedir (dir);
+
+ out:
+	delete_directory_unref (directory);
+}
+
+gboolean
+nautilus_native_delete_tree (GFile *directory,
+			     GCancellable *cancellable,
+			     NautilusNativeDeleteProgressCallback progress_callback,
+			     gpointer progress_callback_data,
+			     GList **removed_directories,
+			     GError **error)
+{
+	DeleteState state = { 0 };
+	gint64 end_time;
+	gboolean success;
+
+	*removed_directories = NULL;
+
+	state.top_path = g_file_get_path (directory);
+	if (state.top_path == NULL) {
+		return FALSE;
+	}
+
+	state.cancellable = cancellable;
+	g_mutex_init (&state.mutex);
+	g_cond_init (&state.cond);
+
+	state.top_fd = open (state.top_path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if (state.top_fd < 0) {
+		g_mutex_clear (&state.mutex);
+		g_cond_clear (&state.cond);
+		g_free (state.top_path);
+		return FALSE;
+	}
+
+	state.pool = g_thread_pool_new (delete_directory_contents, &state,
+					MAX_THREADS, FALSE, NULL);
+
+	g_thread_pool_push (state.pool, delete_directory_new (&state, NULL, NULL), NULL);
+
+	/* The top folder is only removed once everything else is done */
+	g_mutex_lock (&state.mutex);
+	while (!state.done) {
+		end_time = g_get_monotonic_time () + PROGRESS_INTERVAL;
+		if (!g_cond_wait_until (&state.cond, &state.mutex, end_time) &&
+		    progress_callback != NULL) {
+			g_mutex_unlock (&state.mutex);
+			progress_callback (g_atomic_int_get (&state.n_deleted),
+					   progress_callback_data);
+			g_mutex_lock (&state.mutex);
+		}
+	}
+	g_mutex_unlock (&state.mutex);
+
+	g_thread_pool_free (state.pool, FALSE, TRUE);
+	close (state.top_fd);
+
+	if (progress_callback != NULL) {
+		progress_callback (state.n_deleted, progress_callback_data);
+	}
+
+	success = !state.failed;
+	if (state.error != NULL) {
+		g_propagate_error (error, state.error);
+	}
+
+	*removed_directories = state.removed_directories;
+
+	g_mutex_clear (&state.mutex);
+	g_cond_clear (&state.cond);
+	g_free (state.top_path);
+
+	return success;
+}
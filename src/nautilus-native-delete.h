@@ -0,0 +1,50 @@
+/*
+   Copyright (C) 2016 Red Hat, Inc
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* nautilus-native-delete.h: deleting local folders with their contents,
+   directly with the system calls.
+*/
+
+#ifndef NAUTILUS_NATIVE_DELETE_H
+#define NAUTILUS_NATIVE_DELETE_H
+
+#include <gio/gio.h>
+
+/* Called on the thread that is deleting, with the number of files and
+ * folders deleted so far, a few times per second.
+ */
+typedef void (*NautilusNativeDeleteProgressCallback) (int      n_deleted,
+						      gpointer user_data);
+
+/* Deletes the local folder @directory and everything in it, without
+ * following symbolic links. Independent subfolders are deleted in
+ * parallel.
+ *
+ * On failure or cancellation, whatever couldn't be deleted is left in
+ * place and FALSE is returned. @error is only set on cancellation, the
+ * caller is expected to report other errors while deleting the rest.
+ * @removed_directories is set to a list of the folders that were
+ * deleted, the deleted files in them are not listed.
+ */
+gboolean nautilus_native_delete_tree (GFile                                 *directory,
+				      GCancellable                          *cancellable,
+				      NautilusNativeDeleteProgressCallback   progress_callback,
+				      gpointer                               progress_callback_data,
+				      GList                                **removed_directories,
+				      GError                               **error);
+
+#endif /* NAUTILUS_NATIVE_DELETE_H */
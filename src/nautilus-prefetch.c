@@ -0,0 +1,396 @@
+/*
+   Copyright (C) 2016 Red Hat, Inc
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <config.h>
+#include "nautilus-prefetch.h"
+
+#include "nautilus-file-private.h"
+#include "nautilus-icon-info.h"
+#include "nautilus-thumbnails.h"
+
+#include <math.h>
+
+/* Look as far ahead as the view scrolls in this time, but at least a
+ * page and at most two. */
+#define PREFETCH_HORIZON_SECS 0.5
+#define MAX_PREFETCH_PAGES 2
+
+/* Moving by more than this many pages at once is a jump, which says
+ * nothing about where the view is going next. */
+#define JUMP_PAGES 2
+
+/* Scroll steps further apart than this start a new scroll */
+#define SCROLL_STEP_TIMEOUT_SECS 0.25
+
+/* Slower than this, in pages per second, is standing still */
+#define MIN_PAGES_PER_SEC 0.1
+
+struct NautilusPrefetch {
+	GtkScrollable *scrollable;
+	GtkAdjustment *adjustment;
+
+	NautilusPrefetchGetFilesFunc get_files;
+	gpointer user_data;
+
+	int icon_size;
+	int icon_scale;
+	NautilusFileIconFlags icon_flags;
+
+	double last_value;
+	gint64 last_time;
+	/* In adjustment units per second, positive when scrolling down */
+	double velocity;
+
+	guint update_id;
+
+	/* Files waiting for the attributes of their icons, and files we
+	   queued thumbnails for, both with a reference */
+	GHashTable *pending;
+	GHashTable *queued;
+};
+
+static void
+file_ready_callback (NautilusFile *file,
+		     gpointer      callback_data);
+
+static void
+cancel_file (NautilusPrefetch *prefetch,
+	     NautilusFile     *file)
+{
+	char *uri;
+
+	if (g_hash_table_contains (prefetch->pending, file)) {
+		nautilus_file_cancel_call_when_ready (file, file_ready_callback, prefetch);
+	}
+
+	/* Thumbnails already being made are left to finish */
+	if (g_hash_table_contains (prefetch->queued, file) &&
+	    nautilus_file_is_thumbnailing (file)) {
+		uri = nautilus_file_get_uri (file);
+		if (nautilus_thumbnail_remove_from_queue (uri)) {
+			/* So it is queued again when it is shown */
+			nautilus_file_set_is_thumbnailing (file, FALSE);
+		}
+		g_free (uri);
+	}
+}
+
+static void
+load_icon (NautilusPrefetch *prefetch,
+	   NautilusFile     *file)
+{
+	NautilusIconInfo *icon;
+	gboolean was_thumbnailing;
+	char *uri;
+
+	if (prefetch->icon_size == 0) {
+		return;
+	}
+
+	/* Getting the icon scales the thumbnail, or queues one */
+	was_thumbnailing = nautilus_file_is_thumbnailing (file);
+	icon = nautilus_file_get_icon (file,
+				       prefetch->icon_size,
+				       prefetch->icon_scale,
+				       prefetch->icon_flags);
+	g_clear_object (&icon);
+
+	if (!was_thumbnailing && nautilus_file_is_thumbnailing (file)) {
+		g_hash_table_add (prefetch->queued, nautilus_file_ref (file));
+
+		uri = nautilus_file_get_uri (file);
+		nautilus_thumbnail_prioritize (uri);
+		g_free (uri);
+	}
+}
+
+static void
+file_ready_callback (NautilusFile *file,
+		     gpointer      callback_data)
+{
+	NautilusPrefetch *prefetch;
+
+	prefetch = callback_data;
+
+	load_icon (prefetch, file);
+	g_hash_table_remove (prefetch->pending, file);
+}
+
+static void
+prefetch_file (NautilusPrefetch *prefetch,
+	       NautilusFile     *file)
+{
+	char *uri;
+
+	if (nautilus_file_is_thumbnailing (file)) {
+		uri = nautilus_file_get_uri (file);
+		nautilus_thumbnail_prioritize (uri);
+		g_free (uri);
+	} else if (prefetch->icon_size != 0 &&
+		   !g_hash_table_contains (prefetch->pending, file)) {
+		/* This may call back right away */
+		g_hash_table_add (prefetch->pending, nautilus_file_ref (file));
+		nautilus_file_call_when_ready (file,
+					       NAUTILUS_FILE_ATTRIBUTES_FOR_ICON,
+					       file_ready_callback,
+					       prefetch);
+	}
+}
+
+static void
+forget_stale_files (NautilusPrefetch *prefetch,
+		    GHashTable       *table,
+		    GHashTable       *window)
+{
+	GHashTableIter iter;
+	NautilusFile *file;
+	GList *stale, *l;
+
+	/* Canceling may call back, so collect the files first */
+	stale = NULL;
+	g_hash_table_iter_init (&iter, table);
+	while (g_hash_table_iter_next (&iter, (gpointer *) &file, NULL)) {
+		if (window == NULL || !g_hash_table_contains (window, file) ||
+		    (table == prefetch->queued && !nautilus_file_is_thumbnailing (file))) {
+			stale = g_list_prepend (stale, nautilus_file_ref (file));
+		}
+	}
+
+	for (l = stale; l != NULL; l = l->next) {
+		if (window == NULL || !g_hash_table_contains (window, l->data)) {
+			cancel_file (prefetch, l->data);
+		}
+		g_hash_table_remove (table, l->data);
+	}
+
+	nautilus_file_list_free (stale);
+}
+
+static gboolean
+update_callback (gpointer data)
+{
+	NautilusPrefetch *prefetch;
+	GHashTable *window;
+	GList *visible, *files, *l;
+	double value, page_size, ahead, start, end, speed;
+
+	prefetch = data;
+	prefetch->update_id = 0;
+
+	if (prefetch->adjustment == NULL) {
+		return G_SOURCE_REMOVE;
+	}
+
+	value = gtk_adjustment_get_value (prefetch->adjustment);
+	page_size = gtk_adjustment_get_page_size (prefetch->adjustment);
+	if (page_size <= 0) {
+		return G_SOURCE_REMOVE;
+	}
+
+	ahead = CLAMP (fabs (prefetch->velocity) * PREFETCH_HORIZON_SECS,
+		       page_size, MAX_PREFETCH_PAGES * page_size);
+	speed = prefetch->velocity / page_size;
+	if (speed > MIN_PAGES_PER_SEC) {
+		start = value;
+		end = value + page_size + ahead;
+	} else if (speed < -MIN_PAGES_PER_SEC) {
+		start = value - ahead;
+		end = value + page_size;
+	} else {
+		/* Could go either way */
+		start = value - page_size / 2;
+		end = value + page_size + page_size / 2;
+	}
+
+	start = MAX (start, gtk_adjustment_get_lower (prefetch->adjustment));
+	end = MIN (end, gtk_adjustment_get_upper (prefetch->adjustment));
+
+	/* Both at once, finding the files may go through all of them */
+	files = prefetch->get_files (start, end, value, value + page_size,
+				     &visible, prefetch->user_data);
+
+	window = g_hash_table_new (NULL, NULL);
+	for (l = files; l != NULL; l = l->next) {
+		g_hash_table_add (window, l->data);
+	}
+
+	forget_stale_files (prefetch, prefetch->pending, window);
+	forget_stale_files (prefetch, prefetch->queued, window);
+
+	/* Prioritizing puts a thumbnail at the front of the queue, so go
+	   from the furthest file to the nearest one, and end with the
+	   visible files from the bottom up. */
+	if (speed >= -MIN_PAGES_PER_SEC) {
+		files = g_list_reverse (files);
+	}
+	for (l = files; l != NULL; l = l->next) {
+		prefetch_file (prefetch, l->data);
+	}
+
+	visible = g_list_reverse (visible);
+	for (l = visible; l != NULL; l = l->next) {
+		prefetch_file (prefetch, l->data);
+	}
+
+	g_hash_table_destroy (window);
+	nautilus_file_list_free (files);
+	nautilus_file_list_free (visible);
+
+	return G_SOURCE_REMOVE;
+}
+
+void
+nautilus_prefetch_queue_update (NautilusPrefetch *prefetch)
+{
+	/* Run before the view is redrawn, so the newly shown files are
+	   already on their way when the view asks for their icons. */
+	if (prefetch->update_id == 0) {
+		prefetch->update_id = g_idle_add_full (G_PRIORITY_HIGH_IDLE,
+						       update_callback,
+						       prefetch, NULL);
+	}
+}
+
+static void
+value_changed_callback (GtkAdjustment    *adjustment,
+			NautilusPrefetch *prefetch)
+{
+	double value, page_size, delta, elapsed;
+	gint64 now;
+
+	value = gtk_adjustment_get_value (adjustment);
+	page_size = gtk_adjustment_get_page_size (adjustment);
+	now = g_get_monotonic_time ();
+
+	delta = value - prefetch->last_value;
+	elapsed = (double) (now - prefetch->last_time) / G_USEC_PER_SEC;
+
+	if (fabs (delta) > JUMP_PAGES * page_size) {
+		prefetch->velocity = 0;
+	} else if (elapsed > SCROLL_STEP_TIMEOUT_SECS) {
+		prefetch->velocity = delta / elapsed;
+	} else if (elapsed > 0) {
+		/* Smooth out uneven steps */
+		prefetch->velocity = (prefetch->velocity + delta / elapsed) / 2;
+	}
+
+	prefetch->last_value = value;
+	prefetch->last_time = now;
+
+	nautilus_prefetch_queue_update (prefetch);
+}
+
+static void
+set_adjustment (NautilusPrefetch *prefetch,
+		GtkAdjustment    *adjustment)
+{
+	if (prefetch->adjustment == adjustment) {
+		return;
+	}
+
+	if (prefetch->adjustment != NULL) {
+		g_signal_handlers_disconnect_by_data (prefetch->adjustment, prefetch);
+		g_object_unref (prefetch->adjustment);
+	}
+
+	prefetch->adjustment = adjustment;
+	prefetch->velocity = 0;
+
+	if (adjustment != NULL) {
+		g_object_ref (adjustment);
+		prefetch->last_value = gtk_adjustment_get_value (adjustment);
+		prefetch->last_time = g_get_monotonic_time ();
+
+		g_signal_connect (adjustment, "value-changed",
+				  G_CALLBACK (value_changed_callback), prefetch);
+		g_signal_connect_swapped (adjustment, "changed",
+					  G_CALLBACK (nautilus_prefetch_queue_update), prefetch);
+	}
+}
+
+static void
+vadjustment_changed_callback (GObject          *scrollable,
+			      GParamSpec       *pspec,
+			      NautilusPrefetch *prefetch)
+{
+	set_adjustment (prefetch,
+			gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (scrollable)));
+}
+
+NautilusPrefetch *
+nautilus_prefetch_new (GtkScrollable               *scrollable,
+		       NautilusPrefetchGetFilesFunc get_files,
+		       gpointer                     user_data)
+{
+	NautilusPrefetch *prefetch;
+
+	prefetch = g_new0 (NautilusPrefetch, 1);
+	prefetch->scrollable = g_object_ref (scrollable);
+	prefetch->get_files = get_files;
+	prefetch->user_data = user_data;
+	prefetch->pending = g_hash_table_new_full (NULL, NULL,
+						   (GDestroyNotify) nautilus_file_unref,
+						   NULL);
+	prefetch->queued = g_hash_table_new_full (NULL, NULL,
+						  (GDestroyNotify) nautilus_file_unref,
+						  NULL);
+
+	g_signal_connect (scrollable, "notify::vadjustment",
+			  G_CALLBACK (vadjustment_changed_callback), prefetch);
+	set_adjustment (prefetch, gtk_scrollable_get_vadjustment (scrollable));
+
+	return prefetch;
+}
+
+void
+nautilus_prefetch_free (NautilusPrefetch *prefetch)
+{
+	nautilus_prefetch_cancel (prefetch);
+
+	g_signal_handlers_disconnect_by_data (prefetch->scrollable, prefetch);
+	set_adjustment (prefetch, NULL);
+	g_object_unref (prefetch->scrollable);
+
+	g_hash_table_destroy (prefetch->pending);
+	g_hash_table_destroy (prefetch->queued);
+	g_free (prefetch);
+}
+
+void
+nautilus_prefetch_set_icon_size (NautilusPrefetch     *prefetch,
+				 int                   size,
+				 int                   scale,
+				 NautilusFileIconFlags flags)
+{
+	prefetch->icon_size = size;
+	prefetch->icon_scale = scale;
+	prefetch->icon_flags = flags;
+
+	nautilus_prefetch_queue_update (prefetch);
+}
+
+void
+nautilus_prefetch_cancel (NautilusPrefetch *prefetch)
+{
+	if (prefetch->update_id != 0) {
+		g_source_remove (prefetch->update_id);
+		prefetch->update_id = 0;
+	}
+
+	forget_stale_files (prefetch, prefetch->pending, NULL);
+	forget_stale_files (prefetch, prefetch->queued, NULL);
+}
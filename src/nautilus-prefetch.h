@@ -0,0 +1,69 @@
+/*
+   Copyright (C) 2016 Red Hat, Inc
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* nautilus-prefetch.h: loading the icons and thumbnails of the files a
+   view is about to scroll to.
+*/
+
+#ifndef NAUTILUS_PREFETCH_H
+#define NAUTILUS_PREFETCH_H
+
+#include <gtk/gtk.h>
+
+#include "nautilus-file.h"
+
+typedef struct NautilusPrefetch NautilusPrefetch;
+
+/* Returns a new list of the files lying between @start and @end on the
+ * vertical adjustment of the view, ordered from @start to @end, and sets
+ * @visible to a new list of those between @visible_start and
+ * @visible_end, in the same order. The visible range lies within the
+ * other one.
+ */
+typedef GList * (* NautilusPrefetchGetFilesFunc) (double   start,
+						  double   end,
+						  double   visible_start,
+						  double   visible_end,
+						  GList  **visible,
+						  gpointer user_data);
+
+/* Follows the vertical scrolling of @scrollable, and predicts where it
+ * is going from how fast it scrolls. The files about to be shown get
+ * their thumbnails moved to the front of the thumbnail queue, and the
+ * thumbnails the prefetcher queued itself are taken off it again when
+ * the view has moved elsewhere before they were made.
+ */
+NautilusPrefetch *nautilus_prefetch_new           (GtkScrollable               *scrollable,
+						   NautilusPrefetchGetFilesFunc get_files,
+						   gpointer                     user_data);
+void              nautilus_prefetch_free          (NautilusPrefetch            *prefetch);
+
+/* Also loads the icons of the files at this size ahead of time, for
+ * views that only ask for the icons of what they show. A @size of 0,
+ * the default, only loads the thumbnails.
+ */
+void              nautilus_prefetch_set_icon_size (NautilusPrefetch            *prefetch,
+						   int                          size,
+						   int                          scale,
+						   NautilusFileIconFlags        flags);
+
+/* Call when the files have moved in the view without it scrolling */
+void              nautilus_prefetch_queue_update  (NautilusPrefetch            *prefetch);
+/* Forgets all the files, e.g. when the view is cleared */
+void              nautilus_prefetch_cancel        (NautilusPrefetch            *prefetch);
+
+#endif /* NAUTILUS_PREFETCH_H */
@@ -71,6 +71,11 @@ struct _NautilusProgressInfo
 	gboolean progress_at_idle;
 
         GFile *destination;
+
+	/* Only used on the main thread */
+	NautilusProgressInfoUpdateFunc update_func;
+	gpointer update_func_data;
+	guint update_id;
 };
 
 struct _NautilusProgressInfoClass
@@ -110,6 +115,8 @@ nautilus_progress_info_dispose (GObject *object)
 	
 	info = NAUTILUS_PROGRESS_INFO (object);
 
+	nautilus_progress_info_set_update_func (info, NULL, NULL);
+
 	G_LOCK (progress_info);
 
 	/* Destroy source in dispose, because the callback
@@ -735,3 +742,49 @@ nautilus_progress_info_get_destination (NautilusProgressInfo *info)
 
         return destination;
 }
+
+static gboolean
+update_callback (gpointer data)
+{
+	NautilusProgressInfo *info;
+	gboolean started, finished;
+
+	info = data;
+
+	G_LOCK (progress_info);
+	started = info->started;
+	finished = info->finished;
+	G_UNLOCK (progress_info);
+
+	if (started && !finished) {
+		info->update_func (info, info->update_func_data);
+	}
+
+	return G_SOURCE_CONTINUE;
+}
+
+void
+nautilus_progress_info_set_update_func (NautilusProgressInfo          *info,
+					NautilusProgressInfoUpdateFunc func,
+					gpointer                       user_data)
+{
+	if (info->update_id != 0) {
+		g_source_remove (info->update_id);
+		info->update_id = 0;
+	}
+
+	info->update_func = func;
+	info->update_func_data = user_data;
+
+	if (func != NULL) {
+		info->update_id = g_timeout_add (SIGNAL_DELAY_MSEC, update_callback, info);
+	}
+}
+
+void
+nautilus_progress_info_run_update_func (NautilusProgressInfo *info)
+{
+	if (info->update_func != NULL) {
+		info->update_func (info, info->update_func_data);
+	}
+}
@@ -86,6 +86,20 @@ void          nautilus_progress_info_set_elapsed_time (NautilusProgressInfo *inf
 gdouble       nautilus_progress_info_get_elapsed_time (NautilusProgressInfo *info);
 gdouble       nautilus_progress_info_get_total_elapsed_time (NautilusProgressInfo *info);
 
+/* Operations that go through many small steps can keep their progress
+ * in counters, and format the status and details from them in @func,
+ * which is called on the main thread a few times per second once the
+ * operation is started, instead of formatting them at every step.
+ * These two have to be called on the main thread.
+ */
+typedef void (* NautilusProgressInfoUpdateFunc) (NautilusProgressInfo *info,
+						  gpointer              user_data);
+
+void          nautilus_progress_info_set_update_func (NautilusProgressInfo          *info,
+						      NautilusProgressInfoUpdateFunc func,
+						      gpointer                       user_data);
+void          nautilus_progress_info_run_update_func (NautilusProgressInfo          *info);
+
 void nautilus_progress_info_set_destination (NautilusProgressInfo *info,
                                              GFile                *file);
 GFile *nautilus_progress_info_get_destination (NautilusProgressInfo *info);
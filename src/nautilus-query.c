@@ -22,6 +22,10 @@
 #include <config.h>
 #include <string.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include <eel/eel-glib-extensions.h>
 #include <glib/gi18n.h>
 
@@ -44,10 +48,35 @@ struct _NautilusQuery {
 
         gboolean searching;
         gboolean recursive;
-	char **prepared_words;
-        GMutex prepared_words_mutex;
+        /* Only the pointer swap is protected, the matcher itself is immutable */
+        NautilusQueryMatcher *matcher;
+        GMutex matcher_mutex;
 };
 
+struct _NautilusQueryMatcher {
+        gint ref_count;
+
+        guint n_words;
+        char **words;
+        gsize *word_lengths;
+};
+
+typedef struct {
+        char *data;
+        gsize size;
+} FoldBuffer;
+
+static void
+fold_buffer_free (FoldBuffer *buffer)
+{
+        g_free (buffer->data);
+        g_free (buffer);
+}
+
+/* Candidate names are folded into a buffer owned by the calling thread,
+ * so matching doesn't allocate and doesn't need any locking. */
+static GPrivate fold_buffer_key = G_PRIVATE_INIT ((GDestroyNotify) fold_buffer_free);
+
 static void  nautilus_query_class_init       (NautilusQueryClass *class);
 static void  nautilus_query_init             (NautilusQuery      *query);
 
@@ -74,10 +103,10 @@ finalize (GObject *object)
 	query = NAUTILUS_QUERY (object);
 
         g_free (query->text);
-        g_strfreev (query->prepared_words);
+        g_clear_pointer (&query->matcher, nautilus_query_matcher_unref);
         g_clear_object (&query->location);
         g_clear_pointer (&query->date_range, g_ptr_array_unref);
-        g_mutex_clear (&query->prepared_words_mutex);
+        g_mutex_clear (&query->matcher_mutex);
 
 	G_OBJECT_CLASS (nautilus_query_parent_class)->finalize (object);
 }
@@ -302,7 +331,7 @@ nautilus_query_init (NautilusQuery *query)
         query->location = g_file_new_for_path (g_get_home_dir ());
         query->search_type = g_settings_get_enum (nautilus_preferences, "search-filter-time-type");
         query->search_content = NAUTILUS_QUERY_SEARCH_CONTENT_SIMPLE;
-        g_mutex_init (&query->prepared_words_mutex);
+        g_mutex_init (&query->matcher_mutex);
 }
 
 static gchar *
@@ -317,50 +346,282 @@ prepare_string_for_compare (const gchar *string)
 	return res;
 }
 
+static FoldBuffer *
+get_fold_buffer (gsize size)
+{
+        FoldBuffer *buffer;
+
+        buffer = g_private_get (&fold_buffer_key);
+        if (buffer == NULL) {
+                buffer = g_new0 (FoldBuffer, 1);
+                g_private_set (&fold_buffer_key, buffer);
+        }
+
+        if (buffer->size < size) {
+                buffer->size = MAX (size, 256);
+                buffer->data = g_realloc (buffer->data, buffer->size);
+        }
+
+        return buffer;
+}
+
+/* Whether the locale lowercases the ASCII letters like the C locale.
+ * Turkish and Azerbaijani lowercase "I" to a dotless "ı". */
+static gboolean
+locale_has_ascii_case_mapping (void)
+{
+        static gsize initialized = 0;
+        static gboolean ascii_case_mapping;
+        gchar upper[2], *lower;
+        gchar c;
+
+        if (g_once_init_enter (&initialized)) {
+                ascii_case_mapping = TRUE;
+                upper[1] = '\0';
+                for (c = 'A'; c <= 'Z' && ascii_case_mapping; c++) {
+                        upper[0] = c;
+                        lower = g_utf8_strdown (upper, -1);
+                        ascii_case_mapping = lower[0] == g_ascii_tolower (c) && lower[1] == '\0';
+                        g_free (lower);
+                }
+                g_once_init_leave (&initialized, 1);
+        }
+
+        return ascii_case_mapping;
+}
+
+/* Folds @string the same way as prepare_string_for_compare(), into the
+ * per-thread buffer. Pure ASCII strings are unchanged by NFD, so for
+ * them lowercasing byte by byte gives the same result without any
+ * allocation, unless the locale lowercases them differently. */
+static const char *
+fold_string (const char *string,
+             gsize      *length)
+{
+        FoldBuffer *buffer;
+        gchar *prepared;
+        gsize i;
+
+        for (i = 0; string[i] != '\0'; i++) {
+                if ((guchar) string[i] >= 0x80) {
+                        break;
+                }
+        }
+
+        if (string[i] == '\0' && locale_has_ascii_case_mapping ()) {
+                buffer = get_fold_buffer (i + 1);
+                for (i = 0; string[i] != '\0'; i++) {
+                        buffer->data[i] = g_ascii_tolower (string[i]);
+                }
+                buffer->data[i] = '\0';
+                *length = i;
+
+                return buffer->data;
+        }
+
+        prepared = prepare_string_for_compare (string);
+        *length = strlen (prepared);
+        buffer = get_fold_buffer (*length + 1);
+        memcpy (buffer->data, prepared, *length + 1);
+        g_free (prepared);
+
+        return buffer->data;
+}
+
+/* Returns the first occurrence of @needle in @haystack, like strstr(). */
+static const char *
+find_substring (const char *haystack,
+                gsize       haystack_length,
+                const char *needle,
+                gsize       needle_length)
+{
+        const char *p, *end;
+        gsize i;
+
+        if (needle_length == 0) {
+                return haystack;
+        }
+
+        if (needle_length > haystack_length) {
+                return NULL;
+        }
+
+        i = 0;
+
+#ifdef __SSE2__
+        /* Compare the first and last byte of the needle against 16
+         * candidate positions at once, and only check the rest of the
+         * needle where both match. */
+        if (needle_length > 1) {
+                __m128i first, last, block_first, block_last;
+                guint mask;
+                gint bit;
+
+                first = _mm_set1_epi8 (needle[0]);
+                last = _mm_set1_epi8 (needle[needle_length - 1]);
+
+                for (; i + needle_length - 1 + 16 <= haystack_length; i += 16) {
+                        block_first = _mm_loadu_si128 ((const __m128i *) (haystack + i));
+                        block_last = _mm_loadu_si128 ((const __m128i *) (haystack + i + needle_length - 1));
+                        mask = _mm_movemask_epi8 (_mm_and_si128 (_mm_cmpeq_epi8 (first, block_first),
+                                                                 _mm_cmpeq_epi8 (last, block_last)));
+
+                        while (mask != 0) {
+                                bit = g_bit_nth_lsf (mask, -1);
+                                if (memcmp (haystack + i + bit + 1, needle + 1, needle_length - 2) == 0) {
+                                        return haystack + i + bit;
+                                }
+                                mask &= mask - 1;
+                        }
+                }
+        }
+#endif
+
+        end = haystack + haystack_length - needle_length + 1;
+        for (p = haystack + i; p < end; p++) {
+                p = memchr (p, needle[0], end - p);
+                if (p == NULL) {
+                        return NULL;
+                }
+                if (memcmp (p + 1, needle + 1, needle_length - 1) == 0) {
+                        return p;
+                }
+        }
+
+        return NULL;
+}
+
+/**
+ * nautilus_query_matcher_new:
+ * @text: the search text
+ *
+ * Compiles @text into a matcher. Matchers are immutable, so they can be
+ * used from any number of threads at once without locking.
+ *
+ * Returns: (transfer full): a new #NautilusQueryMatcher
+ */
+NautilusQueryMatcher *
+nautilus_query_matcher_new (const char *text)
+{
+        NautilusQueryMatcher *matcher;
+        gchar *prepared_string;
+        guint i;
+
+        matcher = g_new0 (NautilusQueryMatcher, 1);
+        matcher->ref_count = 1;
+
+        prepared_string = prepare_string_for_compare (text);
+        matcher->words = g_strsplit (prepared_string, " ", -1);
+        g_free (prepared_string);
+
+        matcher->n_words = g_strv_length (matcher->words);
+        matcher->word_lengths = g_new (gsize, matcher->n_words);
+        for (i = 0; i < matcher->n_words; i++) {
+                matcher->word_lengths[i] = strlen (matcher->words[i]);
+        }
+
+        return matcher;
+}
+
+NautilusQueryMatcher *
+nautilus_query_matcher_ref (NautilusQueryMatcher *matcher)
+{
+        g_atomic_int_inc (&matcher->ref_count);
+
+        return matcher;
+}
+
+void
+nautilus_query_matcher_unref (NautilusQueryMatcher *matcher)
+{
+        if (!g_atomic_int_dec_and_test (&matcher->ref_count)) {
+                return;
+        }
+
+        g_strfreev (matcher->words);
+        g_free (matcher->word_lengths);
+        g_free (matcher);
+}
+
+/**
+ * nautilus_query_matcher_match:
+ * @matcher: (nullable): a #NautilusQueryMatcher
+ * @string: the candidate, usually a file name
+ *
+ * Returns: the relevance of @string for the query, or -1 if it doesn't
+ * match. Does not allocate for ASCII candidates.
+ */
 gdouble
-nautilus_query_matches_string (NautilusQuery *query,
-			       const gchar *string)
+nautilus_query_matcher_match (NautilusQueryMatcher *matcher,
+                              const gchar          *string)
 {
-	gchar *prepared_string, *ptr;
-	gboolean found;
-	gdouble retval;
-	gint idx, nonexact_malus;
+        const char *prepared_string, *ptr;
+        gsize length;
+        gint nonexact_malus;
+        guint idx;
 
-        if (!query->text) {
-		return -1;
-	}
+        if (matcher == NULL) {
+                return -1;
+        }
+
+        prepared_string = fold_string (string, &length);
+        ptr = prepared_string;
+        nonexact_malus = 0;
+
+        for (idx = 0; idx < matcher->n_words; idx++) {
+                ptr = find_substring (prepared_string, length,
+                                      matcher->words[idx], matcher->word_lengths[idx]);
+                if (ptr == NULL) {
+                        return -1;
+                }
+
+                nonexact_malus += length - (ptr - prepared_string) - matcher->word_lengths[idx];
+        }
+
+        return MAX (10.0, 50.0 - (gdouble) (ptr - prepared_string) - nonexact_malus);
+}
+
+/**
+ * nautilus_query_get_matcher:
+ * @query: a #NautilusQuery
+ *
+ * Retrieves the compiled form of the query text. Searches running on
+ * other threads should get it once and match against it, instead of
+ * calling nautilus_query_matches_string() for every candidate.
+ *
+ * Returns: (transfer full) (nullable): the matcher, or %NULL if the
+ * query has no text.
+ */
+NautilusQueryMatcher *
+nautilus_query_get_matcher (NautilusQuery *query)
+{
+        NautilusQueryMatcher *matcher;
 
-        g_mutex_lock (&query->prepared_words_mutex);
-        if (!query->prepared_words) {
-                prepared_string = prepare_string_for_compare (query->text);
-                query->prepared_words = g_strsplit (prepared_string, " ", -1);
-		g_free (prepared_string);
-	}
+        g_return_val_if_fail (NAUTILUS_IS_QUERY (query), NULL);
 
-	prepared_string = prepare_string_for_compare (string);
-	found = TRUE;
-	ptr = NULL;
-	nonexact_malus = 0;
+        g_mutex_lock (&query->matcher_mutex);
+        matcher = query->matcher != NULL ? nautilus_query_matcher_ref (query->matcher) : NULL;
+        g_mutex_unlock (&query->matcher_mutex);
 
-        for (idx = 0; query->prepared_words[idx] != NULL; idx++) {
-                if ((ptr = strstr (prepared_string, query->prepared_words[idx])) == NULL) {
-			found = FALSE;
-			break;
-		}
+        return matcher;
+}
 
-                nonexact_malus += strlen (ptr) - strlen (query->prepared_words[idx]);
-	}
-        g_mutex_unlock (&query->prepared_words_mutex);
+gdouble
+nautilus_query_matches_string (NautilusQuery *query,
+			       const gchar *string)
+{
+        NautilusQueryMatcher *matcher;
+        gdouble retval;
 
-	if (!found) {
-		g_free (prepared_string);
-		return -1;
-	}
+        matcher = nautilus_query_get_matcher (query);
+        if (matcher == NULL) {
+                return -1;
+        }
 
-	retval = MAX (10.0, 50.0 - (gdouble) (ptr - prepared_string) - nonexact_malus);
-	g_free (prepared_string);
+        retval = nautilus_query_matcher_match (matcher, string);
+        nautilus_query_matcher_unref (matcher);
 
-	return retval;
+        return retval;
 }
 
 NautilusQuery *
@@ -381,15 +642,21 @@ nautilus_query_get_text (NautilusQuery *query)
 void 
 nautilus_query_set_text (NautilusQuery *query, const char *text)
 {
+        NautilusQueryMatcher *matcher, *old_matcher;
+
         g_return_if_fail (NAUTILUS_IS_QUERY (query));
 
         g_free (query->text);
         query->text = g_strstrip (g_strdup (text));
 
-        g_mutex_lock (&query->prepared_words_mutex);
-        g_strfreev (query->prepared_words);
-        query->prepared_words = NULL;
-        g_mutex_unlock (&query->prepared_words_mutex);
+        matcher = query->text != NULL ? nautilus_query_matcher_new (query->text) : NULL;
+
+        g_mutex_lock (&query->matcher_mutex);
+        old_matcher = query->matcher;
+        query->matcher = matcher;
+        g_mutex_unlock (&query->matcher_mutex);
+
+        g_clear_pointer (&old_matcher, nautilus_query_matcher_unref);
 
         g_object_notify (G_OBJECT (query), "text");
 }
@@ -612,3 +879,164 @@ nautilus_query_is_empty (NautilusQuery *query)
 
         return FALSE;
 }
+
+/**
+ * nautilus_query_copy:
+ * @query: a #NautilusQuery
+ *
+ * Returns: (transfer full): a new #NautilusQuery with the same search
+ * parameters as @query. The "searching" state is not copied.
+ */
+NautilusQuery *
+nautilus_query_copy (NautilusQuery *query)
+{
+        NautilusQuery *copy;
+
+        g_return_val_if_fail (NAUTILUS_IS_QUERY (query), NULL);
+
+        copy = nautilus_query_new ();
+        copy->text = g_strdup (query->text);
+        g_set_object (&copy->location, query->location);
+        copy->mime_types = g_list_copy_deep (query->mime_types, (GCopyFunc) g_strdup, NULL);
+        copy->show_hidden = query->show_hidden;
+        copy->date_range = query->date_range != NULL ? g_ptr_array_ref (query->date_range) : NULL;
+        copy->search_type = query->search_type;
+        copy->search_content = query->search_content;
+        copy->recursive = query->recursive;
+        copy->matcher = nautilus_query_get_matcher (query);
+
+        return copy;
+}
+
+static gboolean
+matcher_is_refinement_of (NautilusQueryMatcher *matcher,
+                          NautilusQueryMatcher *previous)
+{
+        guint i, j;
+
+        if (previous == NULL) {
+                return matcher == NULL;
+        }
+
+        if (matcher == NULL) {
+                return FALSE;
+        }
+
+        /* Every name containing all the new words also contains all the
+         * previous ones if each previous word is part of a new one. */
+        for (i = 0; i < previous->n_words; i++) {
+                for (j = 0; j < matcher->n_words; j++) {
+                        if (find_substring (matcher->words[j], matcher->word_lengths[j],
+                                            previous->words[i], previous->word_lengths[i]) != NULL) {
+                                break;
+                        }
+                }
+
+                if (j == matcher->n_words) {
+                        return FALSE;
+                }
+        }
+
+        return TRUE;
+}
+
+static gboolean
+mime_types_are_refinement_of (GList *mime_types,
+                              GList *previous)
+{
+        GList *l, *m;
+
+        if (previous == NULL) {
+                return TRUE;
+        }
+
+        if (mime_types == NULL) {
+                return FALSE;
+        }
+
+        for (l = mime_types; l != NULL; l = l->next) {
+                for (m = previous; m != NULL; m = m->next) {
+                        if (g_content_type_is_a (l->data, m->data)) {
+                                break;
+                        }
+                }
+
+                if (m == NULL) {
+                        return FALSE;
+                }
+        }
+
+        return TRUE;
+}
+
+static gboolean
+date_range_is_refinement_of (GPtrArray *date_range,
+                             GPtrArray *previous)
+{
+        if (previous == NULL) {
+                return TRUE;
+        }
+
+        if (date_range == NULL) {
+                return FALSE;
+        }
+
+        return g_date_time_compare (g_ptr_array_index (date_range, 0),
+                                    g_ptr_array_index (previous, 0)) >= 0 &&
+               g_date_time_compare (g_ptr_array_index (date_range, 1),
+                                    g_ptr_array_index (previous, 1)) <= 0;
+}
+
+/**
+ * nautilus_query_is_refinement_of:
+ * @query: a #NautilusQuery
+ * @previous: the query that was searched before
+ *
+ * Checks whether every file matching @query also matches @previous, so
+ * the results of @previous can be filtered instead of searching again.
+ * That's the case when more text is typed, or when the mime type or
+ * date filters get tighter.
+ *
+ * Returns: %TRUE if @query is narrower than or equal to @previous.
+ */
+gboolean
+nautilus_query_is_refinement_of (NautilusQuery *query,
+                                 NautilusQuery *previous)
+{
+        NautilusQueryMatcher *matcher, *previous_matcher;
+        gboolean retval;
+
+        g_return_val_if_fail (NAUTILUS_IS_QUERY (query), FALSE);
+        g_return_val_if_fail (NAUTILUS_IS_QUERY (previous), FALSE);
+
+        if (query->recursive != previous->recursive ||
+            query->search_content != previous->search_content ||
+            (query->show_hidden && !previous->show_hidden)) {
+                return FALSE;
+        }
+
+        if ((query->location == NULL) != (previous->location == NULL) ||
+            (query->location != NULL && !g_file_equal (query->location, previous->location))) {
+                return FALSE;
+        }
+
+        if (query->date_range != NULL && previous->date_range != NULL &&
+            query->search_type != previous->search_type) {
+                return FALSE;
+        }
+
+        if (!mime_types_are_refinement_of (query->mime_types, previous->mime_types) ||
+            !date_range_is_refinement_of (query->date_range, previous->date_range)) {
+                return FALSE;
+        }
+
+        matcher = nautilus_query_get_matcher (query);
+        previous_matcher = nautilus_query_get_matcher (previous);
+
+        retval = matcher_is_refinement_of (matcher, previous_matcher);
+
+        g_clear_pointer (&matcher, nautilus_query_matcher_unref);
+        g_clear_pointer (&previous_matcher, nautilus_query_matcher_unref);
+
+        return retval;
+}
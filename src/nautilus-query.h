@@ -39,6 +39,14 @@ typedef enum {
 
 G_DECLARE_FINAL_TYPE (NautilusQuery, nautilus_query, NAUTILUS, QUERY, GObject)
 
+typedef struct _NautilusQueryMatcher NautilusQueryMatcher;
+
+NautilusQueryMatcher * nautilus_query_matcher_new   (const char           *text);
+NautilusQueryMatcher * nautilus_query_matcher_ref   (NautilusQueryMatcher *matcher);
+void                   nautilus_query_matcher_unref (NautilusQueryMatcher *matcher);
+gdouble                nautilus_query_matcher_match (NautilusQueryMatcher *matcher,
+                                                     const gchar          *string);
+
 NautilusQuery* nautilus_query_new      (void);
 
 char *         nautilus_query_get_text           (NautilusQuery *query);
@@ -78,9 +86,15 @@ void           nautilus_query_set_searching      (NautilusQuery *query,
                                                   gboolean       searching);
 
 gdouble        nautilus_query_matches_string     (NautilusQuery *query, const gchar *string);
+NautilusQueryMatcher *
+               nautilus_query_get_matcher        (NautilusQuery *query);
 
 char *         nautilus_query_to_readable_string (NautilusQuery *query);
 
 gboolean       nautilus_query_is_empty           (NautilusQuery *query);
 
+NautilusQuery* nautilus_query_copy               (NautilusQuery *query);
+gboolean       nautilus_query_is_refinement_of   (NautilusQuery *query,
+                                                  NautilusQuery *previous);
+
 #endif /* NAUTILUS_QUERY_H */
@@ -28,6 +28,7 @@
 #include "nautilus-search-provider.h"
 #include "nautilus-search-engine.h"
 #include "nautilus-search-engine-model.h"
+#include "nautilus-ui-utilities.h"
 
 #include <eel/eel-glib-extensions.h>
 #include <gtk/gtk.h>
@@ -60,6 +61,20 @@ struct NautilusSearchDirectoryDetails {
 	GList *files;
 	GHashTable *files_hash;
 
+	/* Copy of the query the current files were searched with. When the
+	 * query gets narrower, e.g. while typing, the files are filtered and
+	 * the running search is refined instead of starting over. */
+	NautilusQuery *search_query;
+	gboolean search_finished;
+	/* The engine started with a broader query, so hits need filtering */
+	gboolean refined;
+	/* Such hits whose information is still loading */
+	GHashTable *refined_pending_hash;
+	/* Clients reload after the query changed, see stop_search() */
+	gboolean refining;
+	guint stop_search_id;
+	guint refine_done_id;
+
 	GList *monitor_list;
 	GList *callback_list;
 	GList *pending_callback_list;
@@ -108,6 +123,9 @@ static void search_engine_hits_added (NautilusSearchEngine *engine, GList *hits,
 static void search_engine_error (NautilusSearchEngine *engine, const char *error, NautilusSearchDirectory *search);
 static void search_callback_file_ready_callback (NautilusFile *file, gpointer data);
 static void file_changed (NautilusFile *file, NautilusSearchDirectory *search);
+static void refined_hit_ready (NautilusFile *file, gpointer data);
+static void stop_search (NautilusSearchDirectory *search);
+static void on_search_directory_search_ready_and_valid (NautilusSearchDirectory *search);
 
 static void
 reset_file_list (NautilusSearchDirectory *search)
@@ -115,6 +133,8 @@ reset_file_list (NautilusSearchDirectory *search)
 	GList *list, *monitor_list;
 	NautilusFile *file;
 	SearchMonitor *monitor;
+	GHashTableIter iter;
+	gpointer key;
 
 	/* Remove file connections */
 	for (list = search->details->files; list != NULL; list = list->next) {
@@ -135,6 +155,13 @@ reset_file_list (NautilusSearchDirectory *search)
 	search->details->files = NULL;
 
 	g_hash_table_remove_all (search->details->files_hash);
+
+	/* Drop refined hits still waiting for their information */
+	g_hash_table_iter_init (&iter, search->details->refined_pending_hash);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		nautilus_file_cancel_call_when_ready (key, refined_hit_ready, search);
+	}
+	g_hash_table_remove_all (search->details->refined_pending_hash);
 }
 
 static void
@@ -156,6 +183,36 @@ set_hidden_files (NautilusSearchDirectory *search)
 	nautilus_query_set_show_hidden_files (search->details->query, monitor_hidden);
 }
 
+static gboolean
+refine_done_idle (gpointer user_data)
+{
+	NautilusSearchDirectory *search = user_data;
+
+	search->details->refine_done_id = 0;
+
+	on_search_directory_search_ready_and_valid (search);
+	nautilus_directory_emit_done_loading (NAUTILUS_DIRECTORY (search));
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+finish_refining (NautilusSearchDirectory *search)
+{
+	if (search->details->stop_search_id != 0) {
+		g_source_remove (search->details->stop_search_id);
+		search->details->stop_search_id = 0;
+	}
+
+	search->details->refining = FALSE;
+
+	/* The client reloaded, and nothing else will tell it that the
+	 * filtered results are complete */
+	if (search->details->search_finished && search->details->refine_done_id == 0) {
+		search->details->refine_done_id = g_idle_add (refine_done_idle, search);
+	}
+}
+
 static void
 start_search (NautilusSearchDirectory *search)
 {
@@ -168,6 +225,9 @@ start_search (NautilusSearchDirectory *search)
 	}
 
 	if (search->details->search_running) {
+		if (search->details->refining) {
+			finish_refining (search);
+		}
 		return;
 	}
 
@@ -183,6 +243,11 @@ start_search (NautilusSearchDirectory *search)
 	nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (search->details->engine),
 					    search->details->query);
 
+	g_clear_object (&search->details->search_query);
+	search->details->search_query = nautilus_query_copy (search->details->query);
+	search->details->search_finished = FALSE;
+	search->details->refined = FALSE;
+
 	model_provider = nautilus_search_engine_get_model_provider (search->details->engine);
 	nautilus_search_engine_model_set_model (model_provider, search->details->base_model);
 
@@ -195,6 +260,19 @@ start_search (NautilusSearchDirectory *search)
 	nautilus_search_provider_start (NAUTILUS_SEARCH_PROVIDER (search->details->engine));
 }
 
+static gboolean
+stop_search_idle (gpointer user_data)
+{
+	NautilusSearchDirectory *search = user_data;
+
+	search->details->stop_search_id = 0;
+	search->details->refining = FALSE;
+
+	stop_search (search);
+
+	return G_SOURCE_REMOVE;
+}
+
 static void
 stop_search (NautilusSearchDirectory *search)
 {
@@ -202,12 +280,172 @@ stop_search (NautilusSearchDirectory *search)
 		return;
 	}
 
+	if (search->details->refining) {
+		/* The client is reloading with the refined query. Keep the
+		 * files and the running search until it connects again. */
+		if (search->details->stop_search_id == 0) {
+			search->details->stop_search_id = g_idle_add (stop_search_idle, search);
+		}
+		return;
+	}
+
 	search->details->search_running = FALSE;
 	nautilus_search_provider_stop (NAUTILUS_SEARCH_PROVIDER (search->details->engine));
 
+	if (search->details->refine_done_id != 0) {
+		g_source_remove (search->details->refine_done_id);
+		search->details->refine_done_id = 0;
+	}
+	g_clear_object (&search->details->search_query);
+	search->details->search_finished = FALSE;
+	search->details->refined = FALSE;
+
 	reset_file_list (search);
 }
 
+static gboolean
+file_matches_query (NautilusFile  *file,
+		    NautilusQuery *query,
+		    gdouble       *match)
+{
+	GList *mime_types, *l;
+	GPtrArray *date_range;
+	char *display_name;
+	guint64 file_time;
+	gboolean found;
+
+	if (!nautilus_query_get_show_hidden_files (query) &&
+	    nautilus_file_is_hidden_file (file)) {
+		return FALSE;
+	}
+
+	display_name = nautilus_file_get_display_name (file);
+	*match = nautilus_query_matches_string (query, display_name);
+	g_free (display_name);
+
+	found = (*match > -1);
+
+	mime_types = nautilus_query_get_mime_types (query);
+	if (found && mime_types != NULL) {
+		found = FALSE;
+
+		for (l = mime_types; l != NULL; l = l->next) {
+			if (nautilus_file_is_mime_type (file, l->data)) {
+				found = TRUE;
+				break;
+			}
+		}
+	}
+	g_list_free_full (mime_types, g_free);
+
+	date_range = nautilus_query_get_date_range (query);
+	if (found && date_range != NULL) {
+		if (nautilus_query_get_search_type (query) == NAUTILUS_QUERY_SEARCH_TYPE_LAST_ACCESS) {
+			file_time = nautilus_file_get_atime (file);
+		} else {
+			file_time = nautilus_file_get_mtime (file);
+		}
+
+		found = nautilus_file_date_in_between (file_time,
+						       g_ptr_array_index (date_range, 0),
+						       g_ptr_array_index (date_range, 1));
+	}
+	g_clear_pointer (&date_range, g_ptr_array_unref);
+
+	return found;
+}
+
+static void
+update_search_relevance (NautilusSearchDirectory *search,
+			 NautilusFile            *file,
+			 gdouble                  match)
+{
+	NautilusSearchHit *hit;
+	GDateTime *date;
+	char *uri;
+
+	uri = nautilus_file_get_uri (file);
+	hit = nautilus_search_hit_new (uri);
+	g_free (uri);
+
+	nautilus_search_hit_set_fts_rank (hit, match);
+	date = g_date_time_new_from_unix_local (nautilus_file_get_mtime (file));
+	nautilus_search_hit_set_modification_time (hit, date);
+	g_date_time_unref (date);
+
+	nautilus_search_hit_compute_scores (hit, search->details->query);
+	nautilus_file_set_search_relevance (file, nautilus_search_hit_get_relevance (hit));
+
+	g_object_unref (hit);
+}
+
+static void
+remove_file (NautilusSearchDirectory *search,
+	     GList                   *link)
+{
+	NautilusFile *file;
+	GList *monitor_list;
+
+	file = link->data;
+
+	g_signal_handlers_disconnect_by_func (file, file_changed, search);
+	for (monitor_list = search->details->monitor_list; monitor_list != NULL;
+	     monitor_list = monitor_list->next) {
+		nautilus_file_monitor_remove (file, monitor_list->data);
+	}
+
+	g_hash_table_remove (search->details->files_hash, file);
+	search->details->files = g_list_delete_link (search->details->files, link);
+	nautilus_file_unref (file);
+}
+
+/* Narrows the current results down to the query, if it only got more
+ * restrictive since they were searched. A running search continues
+ * with the new query where it is, instead of walking everything again. */
+static gboolean
+refine_search (NautilusSearchDirectory *search)
+{
+	GList *l, *next;
+	NautilusFile *file;
+	gdouble match;
+
+	if (!search->details->search_running ||
+	    search->details->search_query == NULL) {
+		return FALSE;
+	}
+
+	set_hidden_files (search);
+	if (!nautilus_query_is_refinement_of (search->details->query,
+					      search->details->search_query)) {
+		return FALSE;
+	}
+
+	if (!search->details->search_finished) {
+		if (!nautilus_search_engine_refine (search->details->engine,
+						    search->details->query)) {
+			return FALSE;
+		}
+		search->details->refined = TRUE;
+	}
+
+	for (l = search->details->files; l != NULL; l = next) {
+		next = l->next;
+		file = l->data;
+
+		if (file_matches_query (file, search->details->query, &match)) {
+			update_search_relevance (search, file, match);
+		} else {
+			remove_file (search, l);
+		}
+	}
+
+	g_clear_object (&search->details->search_query);
+	search->details->search_query = nautilus_query_copy (search->details->query);
+	search->details->refining = TRUE;
+
+	return TRUE;
+}
+
 static void
 file_changed (NautilusFile *file, NautilusSearchDirectory *search)
 {
@@ -544,6 +782,74 @@ on_search_directory_search_ready_and_valid (NautilusSearchDirectory *search)
         search->details->search_ready_and_valid = TRUE;
 }
 
+static void
+add_files (NautilusSearchDirectory *search,
+	   GList                   *file_list)
+{
+	GList *l, *monitor_list;
+	NautilusFile *file;
+	SearchMonitor *monitor;
+
+	for (l = file_list; l != NULL; l = l->next) {
+		file = l->data;
+
+		for (monitor_list = search->details->monitor_list; monitor_list; monitor_list = monitor_list->next) {
+			monitor = monitor_list->data;
+
+			/* Add monitors */
+			nautilus_file_monitor_add (file, monitor, monitor->monitor_attributes);
+		}
+
+		g_signal_connect (file, "changed", G_CALLBACK (file_changed), search),
+
+		g_hash_table_add (search->details->files_hash, file);
+	}
+
+	search->details->files = g_list_concat (search->details->files, file_list);
+
+	nautilus_directory_emit_files_added (NAUTILUS_DIRECTORY (search), file_list);
+
+	file = nautilus_directory_get_corresponding_file (NAUTILUS_DIRECTORY (search));
+	nautilus_file_emit_changed (file);
+	nautilus_file_unref (file);
+
+        search_directory_add_pending_files_callbacks (search);
+}
+
+/* Checks a hit found before the engine was refined against the current
+ * query. Takes the reference to file. */
+static gboolean
+refined_hit_matches (NautilusSearchDirectory *search,
+		     NautilusFile            *file)
+{
+	gdouble match;
+
+	if (g_hash_table_contains (search->details->files_hash, file) ||
+	    !file_matches_query (file, search->details->query, &match)) {
+		nautilus_file_unref (file);
+		return FALSE;
+	}
+
+	/* The rank the engine gave is for the broader query */
+	update_search_relevance (search, file, match);
+
+	return TRUE;
+}
+
+static void
+refined_hit_ready (NautilusFile *file,
+		   gpointer      data)
+{
+	NautilusSearchDirectory *search = data;
+
+	nautilus_file_ref (file);
+	g_hash_table_remove (search->details->refined_pending_hash, file);
+
+	if (refined_hit_matches (search, file)) {
+		add_files (search, g_list_prepend (NULL, file));
+	}
+}
+
 static void
 search_engine_hits_added (NautilusSearchEngine *engine, GList *hits, 
 			  NautilusSearchDirectory *search)
@@ -551,8 +857,6 @@ search_engine_hits_added (NautilusSearchEngine *engine, GList *hits,
 	GList *hit_list;
 	GList *file_list;
 	NautilusFile *file;
-	SearchMonitor *monitor;
-	GList *monitor_list;
 
 	file_list = NULL;
 
@@ -566,33 +870,31 @@ search_engine_hits_added (NautilusSearchEngine *engine, GList *hits,
 			continue;
 		}
 
-		nautilus_search_hit_compute_scores (hit, search->details->query);
-
 		file = nautilus_file_get_by_uri (uri);
-		nautilus_file_set_search_relevance (file, nautilus_search_hit_get_relevance (hit));
-
-		for (monitor_list = search->details->monitor_list; monitor_list; monitor_list = monitor_list->next) {
-			monitor = monitor_list->data;
 
-			/* Add monitors */
-			nautilus_file_monitor_add (file, monitor, monitor->monitor_attributes);
+		if (search->details->refined) {
+			/* Hits found before the engine was refined. The type,
+			 * dates and hidden state need the file information, so
+			 * wait for it when it isn't loaded yet. */
+			if (g_hash_table_contains (search->details->refined_pending_hash, file)) {
+				nautilus_file_unref (file);
+			} else if (!nautilus_file_check_if_ready (file, NAUTILUS_FILE_ATTRIBUTE_INFO)) {
+				g_hash_table_add (search->details->refined_pending_hash, file);
+				nautilus_file_call_when_ready (file, NAUTILUS_FILE_ATTRIBUTE_INFO,
+							       refined_hit_ready, search);
+			} else if (refined_hit_matches (search, file)) {
+				file_list = g_list_prepend (file_list, file);
+			}
+			continue;
 		}
 
-		g_signal_connect (file, "changed", G_CALLBACK (file_changed), search),
+		nautilus_search_hit_compute_scores (hit, search->details->query);
+		nautilus_file_set_search_relevance (file, nautilus_search_hit_get_relevance (hit));
 
 		file_list = g_list_prepend (file_list, file);
-		g_hash_table_add (search->details->files_hash, file);
 	}
-	
-	search->details->files = g_list_concat (search->details->files, file_list);
 
-	nautilus_directory_emit_files_added (NAUTILUS_DIRECTORY (search), file_list);
-
-	file = nautilus_directory_get_corresponding_file (NAUTILUS_DIRECTORY (search));
-	nautilus_file_emit_changed (file);
-	nautilus_file_unref (file);
-
-        search_directory_add_pending_files_callbacks (search);
+	add_files (search, file_list);
 }
 
 static void
@@ -621,6 +923,7 @@ search_engine_finished (NautilusSearchEngine         *engine,
          * that it finished the current search, not an old one like it's actually
          * happening. */
         if (status == NAUTILUS_SEARCH_PROVIDER_STATUS_NORMAL) {
+                search->details->search_finished = TRUE;
                 on_search_directory_search_ready_and_valid (search);
 	        nautilus_directory_emit_done_loading (NAUTILUS_DIRECTORY (search));
         } else if (status == NAUTILUS_SEARCH_PROVIDER_STATUS_RESTARTING) {
@@ -643,6 +946,7 @@ search_force_reload (NautilusDirectory *directory)
 	}
 	
 	search->details->search_ready_and_valid = FALSE;
+	search->details->refining = FALSE;
 
 	/* Remove file monitors */
 	reset_file_list (search);
@@ -819,6 +1123,11 @@ search_dispose (GObject *object)
 	}
 
 	g_clear_object (&search->details->query);
+	if (search->details->stop_search_id != 0) {
+		g_source_remove (search->details->stop_search_id);
+		search->details->stop_search_id = 0;
+	}
+	search->details->refining = FALSE;
 	stop_search (search);
         search_disconnect_engine(search);
 
@@ -835,6 +1144,7 @@ search_finalize (GObject *object)
 	search = NAUTILUS_SEARCH_DIRECTORY (object);
 
 	g_hash_table_destroy (search->details->files_hash);
+	g_hash_table_destroy (search->details->refined_pending_hash);
 
 	G_OBJECT_CLASS (nautilus_search_directory_parent_class)->finalize (object);
 }
@@ -846,6 +1156,8 @@ nautilus_search_directory_init (NautilusSearchDirectory *search)
 						       NautilusSearchDirectoryDetails);
 
 	search->details->files_hash = g_hash_table_new (g_direct_hash, g_direct_equal);
+	search->details->refined_pending_hash = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+								       (GDestroyNotify) nautilus_file_unref, NULL);
 
         search->details->engine = nautilus_search_engine_new ();
         search_connect_engine (search);
@@ -971,6 +1283,12 @@ nautilus_search_directory_set_query (NautilusSearchDirectory *search,
 	        g_clear_object (&old_query);
 	}
 
+	/* Clients reload after changing the query, which picks up the
+	 * filtered files */
+	if (query != NULL) {
+		refine_search (search);
+	}
+
 	file = nautilus_directory_get_existing_corresponding_file (NAUTILUS_DIRECTORY (search));
 	if (file != NULL) {
 		nautilus_search_directory_file_update_display_name (NAUTILUS_SEARCH_DIRECTORY_FILE (file));
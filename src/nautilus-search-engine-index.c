@@ -0,0 +1,493 @@
+/*
+ * Copyright (C) 2016 Red Hat, Inc
+ *
+ * Nautilus is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * Nautilus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; see the file COPYING.  If not,
+ * see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+#include "nautilus-search-hit.h"
+#include "nautilus-search-provider.h"
+#include "nautilus-search-engine-index.h"
+#include "nautilus-search-index.h"
+#include "nautilus-ui-utilities.h"
+#define DEBUG_FLAG NAUTILUS_DEBUG_SEARCH
+#include "nautilus-debug.h"
+
+#include <string.h>
+#include <glib.h>
+#include <gio/gio.h>
+
+#define BATCH_SIZE 500
+
+enum {
+	PROP_0,
+	PROP_RUNNING,
+	LAST_PROP
+};
+
+typedef struct {
+	NautilusSearchEngineIndex *engine;
+	GCancellable *cancellable;
+
+	NautilusSearchIndex *index;
+	NautilusQuery *query;
+	NautilusQueryMatcher *matcher;
+	GFile *location;
+
+	GList *mime_types;
+	GPtrArray *date_range;
+	NautilusQuerySearchType search_type;
+	gboolean show_hidden;
+
+	gint n_processed_files;
+	GList *hits;
+} SearchThreadData;
+
+struct NautilusSearchEngineIndexDetails {
+	NautilusQuery *query;
+
+	SearchThreadData *active_search;
+	guint finished_id;
+};
+
+static void nautilus_search_provider_init (NautilusSearchProviderInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (NautilusSearchEngineIndex,
+			 nautilus_search_engine_index,
+			 G_TYPE_OBJECT,
+			 G_IMPLEMENT_INTERFACE (NAUTILUS_TYPE_SEARCH_PROVIDER,
+						nautilus_search_provider_init))
+
+static void
+finalize (GObject *object)
+{
+	NautilusSearchEngineIndex *engine;
+
+	engine = NAUTILUS_SEARCH_ENGINE_INDEX (object);
+
+	if (engine->details->finished_id != 0) {
+		g_source_remove (engine->details->finished_id);
+		engine->details->finished_id = 0;
+	}
+
+	g_clear_object (&engine->details->query);
+
+	G_OBJECT_CLASS (nautilus_search_engine_index_parent_class)->finalize (object);
+}
+
+static SearchThreadData *
+search_thread_data_new (NautilusSearchEngineIndex *engine,
+			NautilusSearchIndex       *index,
+			NautilusQuery             *query)
+{
+	SearchThreadData *data;
+
+	data = g_new0 (SearchThreadData, 1);
+
+	data->engine = g_object_ref (engine);
+	data->cancellable = g_cancellable_new ();
+	data->index = nautilus_search_index_ref (index);
+	data->query = g_object_ref (query);
+	data->matcher = nautilus_query_get_matcher (query);
+	data->location = nautilus_query_get_location (query);
+	data->mime_types = nautilus_query_get_mime_types (query);
+	data->date_range = nautilus_query_get_date_range (query);
+	data->search_type = nautilus_query_get_search_type (query);
+	data->show_hidden = nautilus_query_get_show_hidden_files (query);
+
+	return data;
+}
+
+static void
+search_thread_data_free (SearchThreadData *data)
+{
+	g_object_unref (data->cancellable);
+	nautilus_search_index_unref (data->index);
+	g_object_unref (data->query);
+	g_clear_pointer (&data->matcher, nautilus_query_matcher_unref);
+	g_object_unref (data->location);
+	g_list_free_full (data->mime_types, g_free);
+	g_clear_pointer (&data->date_range, g_ptr_array_unref);
+	g_list_free_full (data->hits, g_object_unref);
+	g_object_unref (data->engine);
+
+	g_free (data);
+}
+
+static gboolean
+search_thread_done_idle (gpointer user_data)
+{
+	SearchThreadData *data = user_data;
+	NautilusSearchEngineIndex *engine = data->engine;
+
+	if (g_cancellable_is_cancelled (data->cancellable)) {
+		DEBUG ("Index engine finished and cancelled");
+	} else {
+		DEBUG ("Index engine finished");
+		/* Look for changes we were not told about, for next time */
+		nautilus_search_index_schedule_revalidate (data->index);
+	}
+	engine->details->active_search = NULL;
+	nautilus_search_provider_finished (NAUTILUS_SEARCH_PROVIDER (engine),
+					   NAUTILUS_SEARCH_PROVIDER_STATUS_NORMAL);
+
+	g_object_notify (G_OBJECT (engine), "running");
+
+	search_thread_data_free (data);
+
+	return FALSE;
+}
+
+typedef struct {
+	GList *hits;
+	SearchThreadData *thread_data;
+} SearchHitsData;
+
+static gboolean
+search_thread_add_hits_idle (gpointer user_data)
+{
+	SearchHitsData *data = user_data;
+
+	if (!g_cancellable_is_cancelled (data->thread_data->cancellable)) {
+		DEBUG ("Index engine add hits");
+		nautilus_search_provider_hits_added (NAUTILUS_SEARCH_PROVIDER (data->thread_data->engine),
+						     data->hits);
+	}
+
+	g_list_free_full (data->hits, g_object_unref);
+	g_free (data);
+
+	return FALSE;
+}
+
+static void
+send_batch (SearchThreadData *thread_data)
+{
+	SearchHitsData *data;
+
+	thread_data->n_processed_files = 0;
+
+	if (thread_data->hits) {
+		data = g_new (SearchHitsData, 1);
+		data->hits = thread_data->hits;
+		data->thread_data = thread_data;
+		g_idle_add (search_thread_add_hits_idle, data);
+	}
+	thread_data->hits = NULL;
+}
+
+static gboolean
+entry_matches_mime_types (const NautilusSearchIndexEntry *entry,
+			  GList                          *mime_types)
+{
+	GList *l;
+
+	if (entry->content_type == NULL) {
+		return FALSE;
+	}
+
+	for (l = mime_types; l != NULL; l = l->next) {
+		if (g_content_type_is_a (entry->content_type, l->data)) {
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+static gboolean
+visit_entry (NautilusSearchIndex            *index,
+	     const NautilusSearchIndexEntry *entry,
+	     gpointer                        user_data)
+{
+	SearchThreadData *data;
+	NautilusSearchHit *hit;
+	GDateTime *date;
+	guint64 current_file_time;
+	gdouble match;
+	gboolean found;
+	char *uri;
+
+	data = user_data;
+
+	/* Like the simple engine, don't descend into hidden directories */
+	if (entry->is_hidden && !data->show_hidden) {
+		return FALSE;
+	}
+
+	match = nautilus_query_matcher_match (data->matcher, entry->display_name);
+	found = (match > -1);
+
+	if (found && data->mime_types != NULL) {
+		found = entry_matches_mime_types (entry, data->mime_types);
+	}
+
+	if (found && data->date_range != NULL) {
+		if (data->search_type == NAUTILUS_QUERY_SEARCH_TYPE_LAST_ACCESS) {
+			current_file_time = entry->atime;
+		} else {
+			current_file_time = entry->mtime;
+		}
+		found = nautilus_file_date_in_between (current_file_time,
+						       g_ptr_array_index (data->date_range, 0),
+						       g_ptr_array_index (data->date_range, 1));
+	}
+
+	if (found) {
+		uri = nautilus_search_index_entry_get_uri (index, entry);
+		hit = nautilus_search_hit_new (uri);
+		g_free (uri);
+		nautilus_search_hit_set_fts_rank (hit, match);
+		date = g_date_time_new_from_unix_local (entry->mtime);
+		nautilus_search_hit_set_modification_time (hit, date);
+		g_date_time_unref (date);
+
+		data->hits = g_list_prepend (data->hits, hit);
+	}
+
+	data->n_processed_files++;
+	if (data->n_processed_files > BATCH_SIZE) {
+		send_batch (data);
+	}
+
+	return TRUE;
+}
+
+static gpointer
+search_thread_func (gpointer user_data)
+{
+	SearchThreadData *data;
+
+	data = user_data;
+
+	nautilus_search_index_foreach (data->index, data->location,
+				       visit_entry, data,
+				       data->cancellable);
+
+	if (!g_cancellable_is_cancelled (data->cancellable)) {
+		send_batch (data);
+	}
+
+	g_idle_add (search_thread_done_idle, data);
+
+	return NULL;
+}
+
+static NautilusSearchIndex *
+get_index_for_query (NautilusQuery *query)
+{
+	NautilusSearchIndex *index;
+	GFile *location;
+
+	if (query == NULL || !nautilus_query_get_recursive (query)) {
+		return NULL;
+	}
+
+	location = nautilus_query_get_location (query);
+	index = nautilus_search_index_lookup (location);
+	g_object_unref (location);
+
+	return index;
+}
+
+static gboolean
+search_finished (NautilusSearchEngineIndex *engine)
+{
+	engine->details->finished_id = 0;
+
+	g_object_notify (G_OBJECT (engine), "running");
+
+	DEBUG ("Index engine finished without index");
+	nautilus_search_provider_finished (NAUTILUS_SEARCH_PROVIDER (engine),
+					   NAUTILUS_SEARCH_PROVIDER_STATUS_NORMAL);
+	g_object_unref (engine);
+
+	return FALSE;
+}
+
+static void
+nautilus_search_engine_index_start (NautilusSearchProvider *provider)
+{
+	NautilusSearchEngineIndex *engine;
+	NautilusSearchIndex *index;
+	SearchThreadData *data;
+	GThread *thread;
+	GFile *location;
+
+	engine = NAUTILUS_SEARCH_ENGINE_INDEX (provider);
+
+	if (engine->details->active_search != NULL ||
+	    engine->details->finished_id != 0) {
+		return;
+	}
+
+	DEBUG ("Index engine start");
+
+	index = get_index_for_query (engine->details->query);
+	if (index != NULL && nautilus_search_index_needs_rebuild (index)) {
+		nautilus_search_index_schedule_rebuild (index);
+	}
+
+	if (index == NULL || !nautilus_search_index_is_usable (index)) {
+		/* Let the other providers answer this time, and have an
+		 * index loaded, or built, for the next search. */
+		if (index == NULL && nautilus_query_get_recursive (engine->details->query)) {
+			location = nautilus_query_get_location (engine->details->query);
+			nautilus_search_index_schedule_load (location);
+			g_object_unref (location);
+		}
+		g_clear_pointer (&index, nautilus_search_index_unref);
+
+		engine->details->finished_id = g_idle_add ((GSourceFunc) search_finished,
+							   g_object_ref (engine));
+		g_object_notify (G_OBJECT (provider), "running");
+		return;
+	}
+
+	data = search_thread_data_new (engine, index, engine->details->query);
+	nautilus_search_index_unref (index);
+
+	thread = g_thread_new ("nautilus-search-index", search_thread_func, data);
+	engine->details->active_search = data;
+
+	g_object_notify (G_OBJECT (provider), "running");
+
+	g_thread_unref (thread);
+}
+
+static void
+nautilus_search_engine_index_stop (NautilusSearchProvider *provider)
+{
+	NautilusSearchEngineIndex *engine;
+
+	engine = NAUTILUS_SEARCH_ENGINE_INDEX (provider);
+
+	if (engine->details->active_search != NULL) {
+		DEBUG ("Index engine stop");
+		g_cancellable_cancel (engine->details->active_search->cancellable);
+	}
+}
+
+static void
+nautilus_search_engine_index_set_query (NautilusSearchProvider *provider,
+					NautilusQuery          *query)
+{
+	NautilusSearchEngineIndex *engine;
+
+	engine = NAUTILUS_SEARCH_ENGINE_INDEX (provider);
+
+	g_object_ref (query);
+	g_clear_object (&engine->details->query);
+	engine->details->query = query;
+}
+
+static gboolean
+nautilus_search_engine_index_is_running (NautilusSearchProvider *provider)
+{
+	NautilusSearchEngineIndex *engine;
+
+	engine = NAUTILUS_SEARCH_ENGINE_INDEX (provider);
+
+	return engine->details->active_search != NULL ||
+		engine->details->finished_id != 0;
+}
+
+static void
+nautilus_search_provider_init (NautilusSearchProviderInterface *iface)
+{
+	iface->set_query = nautilus_search_engine_index_set_query;
+	iface->start = nautilus_search_engine_index_start;
+	iface->stop = nautilus_search_engine_index_stop;
+	iface->is_running = nautilus_search_engine_index_is_running;
+}
+
+static void
+nautilus_search_engine_index_get_property (GObject    *object,
+					   guint       prop_id,
+					   GValue     *value,
+					   GParamSpec *pspec)
+{
+	NautilusSearchProvider *self = NAUTILUS_SEARCH_PROVIDER (object);
+
+	switch (prop_id) {
+	case PROP_RUNNING:
+		g_value_set_boolean (value, nautilus_search_engine_index_is_running (self));
+		break;
+
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+	}
+}
+
+static void
+nautilus_search_engine_index_class_init (NautilusSearchEngineIndexClass *class)
+{
+	GObjectClass *gobject_class;
+
+	gobject_class = G_OBJECT_CLASS (class);
+	gobject_class->finalize = finalize;
+	gobject_class->get_property = nautilus_search_engine_index_get_property;
+
+	/**
+	 * NautilusSearchEngine::running:
+	 *
+	 * Whether the search engine is running a search.
+	 */
+	g_object_class_override_property (gobject_class, PROP_RUNNING, "running");
+
+	g_type_class_add_private (class, sizeof (NautilusSearchEngineIndexDetails));
+}
+
+static void
+nautilus_search_engine_index_init (NautilusSearchEngineIndex *engine)
+{
+	engine->details = G_TYPE_INSTANCE_GET_PRIVATE (engine, NAUTILUS_TYPE_SEARCH_ENGINE_INDEX,
+						       NautilusSearchEngineIndexDetails);
+}
+
+NautilusSearchEngineIndex *
+nautilus_search_engine_index_new (void)
+{
+	NautilusSearchEngineIndex *engine;
+
+	engine = g_object_new (NAUTILUS_TYPE_SEARCH_ENGINE_INDEX, NULL);
+
+	return engine;
+}
+
+/**
+ * nautilus_search_engine_index_can_search:
+ * @engine: a #NautilusSearchEngineIndex
+ *
+ * Returns: %TRUE if an up to date index covers the current query, so
+ * there is no need to walk the file system for it.
+ */
+gboolean
+nautilus_search_engine_index_can_search (NautilusSearchEngineIndex *engine)
+{
+	NautilusSearchIndex *index;
+	gboolean usable;
+
+	index = get_index_for_query (engine->details->query);
+	if (index == NULL) {
+		return FALSE;
+	}
+
+	usable = nautilus_search_index_is_usable (index);
+	nautilus_search_index_unref (index);
+
+	return usable;
+}
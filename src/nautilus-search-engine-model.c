@@ -131,16 +131,18 @@ model_directory_ready_cb (NautilusDirectory	*directory,
         GDateTime *initial_date;
         GDateTime *end_date;
         GPtrArray *date_range;
+        NautilusQueryMatcher *matcher;
 
 	files = nautilus_directory_get_file_list (directory);
 	mime_types = nautilus_query_get_mime_types (model->details->query);
+	matcher = nautilus_query_get_matcher (model->details->query);
 	hits = NULL;
 
 	for (l = files; l != NULL; l = l->next) {
 		file = l->data;
 
 		display_name = nautilus_file_get_display_name (file);
-		match = nautilus_query_matches_string (model->details->query, display_name);
+		match = nautilus_query_matcher_match (matcher, display_name);
 		found = (match > -1);
 
 		if (found && mime_types) {
@@ -186,6 +188,7 @@ model_directory_ready_cb (NautilusDirectory	*directory,
 		g_free (display_name);
 	}
 
+	g_clear_pointer (&matcher, nautilus_query_matcher_unref);
 	g_list_free_full (mime_types, g_free);
 	nautilus_file_list_free (files);
 	model->details->hits = hits;
@@ -33,29 +33,78 @@
 
 #define BATCH_SIZE 500
 
+/* Bounds for the number of threads walking the tree of a recursive
+ * search. Directory enumeration is mostly I/O bound, so even on
+ * machines with few cores we use a couple of workers to hide latency. */
+#define MIN_SEARCH_WORKERS 2
+#define MAX_SEARCH_WORKERS 8
+
+/* How long an idle worker sleeps before looking for work to steal again */
+#define IDLE_WORKER_TIMEOUT_USEC (50 * G_TIME_SPAN_MILLISECOND)
+
 enum {
 	PROP_RECURSIVE = 1,
         PROP_RUNNING,
 	NUM_PROPERTIES
 };
 
+typedef struct SearchThreadData SearchThreadData;
+
+/* What the files are matched against. Read from the query once, so
+ * workers don't contend on it, and swapped as a whole when a running
+ * search is refined. */
 typedef struct {
+	gint ref_count;
+
+	NautilusQueryMatcher *matcher;
+	GList *mime_types;
+	GPtrArray *date_range;
+	NautilusQuerySearchType search_type;
+	gboolean show_hidden;
+} SearchFilter;
+
+/* Each worker owns a deque of directories still to be visited. The owner
+ * pushes and pops at the tail, so it walks its part of the tree depth
+ * first, while idle workers steal from the head, which holds the
+ * directories closest to the root and thus the largest chunks of work.
+ */
+typedef struct {
+	SearchThreadData *thread_data;
+	guint index;
+
+	GMutex mutex;
+	GQueue directories; /* GFiles */
+
+	gint n_processed_files;
+	GList *hits;
+} SearchWorker;
+
+struct SearchThreadData {
 	NautilusSearchEngineSimple *engine;
 	GCancellable *cancellable;
 
-	GList *mime_types;
 	GList *found_list;
 
-	GQueue *directories; /* GFiles */
+	SearchWorker *workers;
+	guint n_workers;
+
+	/* Directories queued or being visited, across all workers.
+	 * The traversal is complete once this drops to zero. */
+	gint n_pending_directories;
+	gint n_running_workers;
+	gint n_idle_workers;
+	GMutex idle_mutex;
+	GCond idle_cond;
 
 	GHashTable *visited;
+	GMutex visited_mutex;
 
 	gboolean recursive;
-	gint n_processed_files;
-	GList *hits;
 
 	NautilusQuery *query;
-} SearchThreadData;
+	SearchFilter *filter;
+	GMutex filter_mutex;
+};
 
 
 struct NautilusSearchEngineSimpleDetails {
@@ -86,24 +135,100 @@ finalize (GObject *object)
 	G_OBJECT_CLASS (nautilus_search_engine_simple_parent_class)->finalize (object);
 }
 
+static SearchFilter *
+search_filter_new (NautilusQuery *query)
+{
+	SearchFilter *filter;
+
+	filter = g_new0 (SearchFilter, 1);
+	filter->ref_count = 1;
+	filter->matcher = nautilus_query_get_matcher (query);
+	filter->mime_types = nautilus_query_get_mime_types (query);
+	filter->date_range = nautilus_query_get_date_range (query);
+	filter->search_type = nautilus_query_get_search_type (query);
+	filter->show_hidden = nautilus_query_get_show_hidden_files (query);
+
+	return filter;
+}
+
+static SearchFilter *
+search_filter_ref (SearchFilter *filter)
+{
+	g_atomic_int_inc (&filter->ref_count);
+
+	return filter;
+}
+
+static void
+search_filter_unref (SearchFilter *filter)
+{
+	if (!g_atomic_int_dec_and_test (&filter->ref_count)) {
+		return;
+	}
+
+	g_clear_pointer (&filter->matcher, nautilus_query_matcher_unref);
+	g_list_free_full (filter->mime_types, g_free);
+	g_clear_pointer (&filter->date_range, g_ptr_array_unref);
+	g_free (filter);
+}
+
+static SearchFilter *
+search_thread_data_get_filter (SearchThreadData *data)
+{
+	SearchFilter *filter;
+
+	g_mutex_lock (&data->filter_mutex);
+	filter = search_filter_ref (data->filter);
+	g_mutex_unlock (&data->filter_mutex);
+
+	return filter;
+}
+
+static guint
+get_n_workers (NautilusSearchEngineSimple *engine)
+{
+	if (!engine->details->recursive) {
+		return 1;
+	}
+
+	return CLAMP (g_get_num_processors (), MIN_SEARCH_WORKERS, MAX_SEARCH_WORKERS);
+}
+
 static SearchThreadData *
 search_thread_data_new (NautilusSearchEngineSimple *engine,
 			NautilusQuery *query)
 {
 	SearchThreadData *data;
+	SearchWorker *worker;
 	GFile *location;
+	guint i;
 	
 	data = g_new0 (SearchThreadData, 1);
 
 	data->engine = g_object_ref (engine);
-	data->directories = g_queue_new ();
 	data->visited = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	g_mutex_init (&data->visited_mutex);
+	g_mutex_init (&data->idle_mutex);
+	g_cond_init (&data->idle_cond);
 	data->query = g_object_ref (query);
 
+	data->n_workers = get_n_workers (engine);
+	data->n_running_workers = data->n_workers;
+	data->workers = g_new0 (SearchWorker, data->n_workers);
+	for (i = 0; i < data->n_workers; i++) {
+		worker = &data->workers[i];
+		worker->thread_data = data;
+		worker->index = i;
+		g_mutex_init (&worker->mutex);
+		g_queue_init (&worker->directories);
+	}
+
 	location = nautilus_query_get_location (query);
 
-	g_queue_push_tail (data->directories, location);
-	data->mime_types = nautilus_query_get_mime_types (query);
+	g_queue_push_tail (&data->workers[0].directories, location);
+	data->n_pending_directories = 1;
+	data->filter = search_filter_new (query);
+	g_mutex_init (&data->filter_mutex);
 
 	data->cancellable = g_cancellable_new ();
 	
@@ -113,14 +238,27 @@ search_thread_data_new (NautilusSearchEngineSimple *engine,
 static void 
 search_thread_data_free (SearchThreadData *data)
 {
-	g_queue_foreach (data->directories,
-			 (GFunc)g_object_unref, NULL);
-	g_queue_free (data->directories);
+	SearchWorker *worker;
+	guint i;
+
+	for (i = 0; i < data->n_workers; i++) {
+		worker = &data->workers[i];
+		g_queue_foreach (&worker->directories,
+				 (GFunc)g_object_unref, NULL);
+		g_queue_clear (&worker->directories);
+		g_list_free_full (worker->hits, g_object_unref);
+		g_mutex_clear (&worker->mutex);
+	}
+	g_free (data->workers);
+
 	g_hash_table_destroy (data->visited);
+	g_mutex_clear (&data->visited_mutex);
+	g_mutex_clear (&data->idle_mutex);
+	g_cond_clear (&data->idle_cond);
 	g_object_unref (data->cancellable);
 	g_object_unref (data->query);
-	g_list_free_full (data->mime_types, g_free);
-	g_list_free_full (data->hits, g_object_unref);
+	search_filter_unref (data->filter);
+	g_mutex_clear (&data->filter_mutex);
 	g_object_unref (data->engine);
 
 	g_free (data);
@@ -172,20 +310,94 @@ search_thread_add_hits_idle (gpointer user_data)
 	return FALSE;
 }
 
+/* Every worker collects its own hits and hands them to the main loop in
+ * independent batches, so the order in which batches arrive does not
+ * matter and no lock is needed on the hit lists. */
 static void
-send_batch (SearchThreadData *thread_data)
+send_batch (SearchWorker *worker)
 {
 	SearchHitsData *data;
 	
-	thread_data->n_processed_files = 0;
+	worker->n_processed_files = 0;
 	
-	if (thread_data->hits) {
+	if (worker->hits) {
 		data = g_new (SearchHitsData, 1);
-		data->hits = thread_data->hits;
-		data->thread_data = thread_data;
+		data->hits = worker->hits;
+		data->thread_data = worker->thread_data;
 		g_idle_add (search_thread_add_hits_idle, data);
 	}
-	thread_data->hits = NULL;
+	worker->hits = NULL;
+}
+
+static void
+worker_push_directory (SearchWorker *worker,
+		       GFile        *dir)
+{
+	SearchThreadData *data;
+
+	data = worker->thread_data;
+
+	g_atomic_int_inc (&data->n_pending_directories);
+
+	g_mutex_lock (&worker->mutex);
+	g_queue_push_tail (&worker->directories, g_object_ref (dir));
+	g_mutex_unlock (&worker->mutex);
+
+	if (g_atomic_int_get (&data->n_idle_workers) > 0) {
+		g_mutex_lock (&data->idle_mutex);
+		g_cond_signal (&data->idle_cond);
+		g_mutex_unlock (&data->idle_mutex);
+	}
+}
+
+static GFile *
+worker_pop_directory (SearchWorker *worker)
+{
+	GFile *dir;
+
+	g_mutex_lock (&worker->mutex);
+	dir = g_queue_pop_tail (&worker->directories);
+	g_mutex_unlock (&worker->mutex);
+
+	return dir;
+}
+
+static GFile *
+worker_steal_directory (SearchWorker *worker)
+{
+	SearchThreadData *data;
+	SearchWorker *victim;
+	GFile *dir;
+	guint i;
+
+	data = worker->thread_data;
+	dir = NULL;
+
+	for (i = 1; dir == NULL && i < data->n_workers; i++) {
+		victim = &data->workers[(worker->index + i) % data->n_workers];
+
+		g_mutex_lock (&victim->mutex);
+		dir = g_queue_pop_head (&victim->directories);
+		g_mutex_unlock (&victim->mutex);
+	}
+
+	return dir;
+}
+
+static gboolean
+mark_visited (SearchThreadData *data,
+	      const char       *id)
+{
+	gboolean visited;
+
+	g_mutex_lock (&data->visited_mutex);
+	visited = g_hash_table_contains (data->visited, id);
+	if (!visited) {
+		g_hash_table_add (data->visited, g_strdup (id));
+	}
+	g_mutex_unlock (&data->visited_mutex);
+
+	return visited;
 }
 
 #define STD_ATTRIBUTES \
@@ -199,8 +411,10 @@ send_batch (SearchThreadData *thread_data)
 	G_FILE_ATTRIBUTE_ID_FILE
 
 static void
-visit_directory (GFile *dir, SearchThreadData *data)
+visit_directory (GFile *dir, SearchWorker *worker)
 {
+	SearchThreadData *data;
+	SearchFilter *filter;
 	GFileEnumerator *enumerator;
 	GFileInfo *info;
 	GFile *child;
@@ -212,13 +426,15 @@ visit_directory (GFile *dir, SearchThreadData *data)
 	gboolean visited;
 	guint64 atime;
 	guint64 mtime;
-        GPtrArray *date_range;
         GDateTime *initial_date;
         GDateTime *end_date;
 
+	data = worker->thread_data;
+	/* Picks up refinements of the query from the next directory on */
+	filter = search_thread_data_get_filter (data);
 
 	enumerator = g_file_enumerate_children (dir,
-						data->mime_types != NULL ?
+						filter->mime_types != NULL ?
 						STD_ATTRIBUTES ","
 						G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE
 						:
@@ -228,6 +444,7 @@ visit_directory (GFile *dir, SearchThreadData *data)
 						data->cancellable, NULL);
 	
 	if (enumerator == NULL) {
+		search_filter_unref (filter);
 		return;
 	}
 
@@ -238,19 +455,19 @@ visit_directory (GFile *dir, SearchThreadData *data)
 		}
 
 		is_hidden = g_file_info_get_is_hidden (info) || g_file_info_get_is_backup (info);
-		if (is_hidden && !nautilus_query_get_show_hidden_files (data->query)) {
+		if (is_hidden && !filter->show_hidden) {
 			goto next;
 		}
 
-		child = g_file_get_child (dir, g_file_info_get_name (info));
-		match = nautilus_query_matches_string (data->query, display_name);
+		child = NULL;
+		match = nautilus_query_matcher_match (filter->matcher, display_name);
 		found = (match > -1);
 
-		if (found && data->mime_types) {
+		if (found && filter->mime_types) {
 			mime_type = g_file_info_get_content_type (info);
 			found = FALSE;
 			
-			for (l = data->mime_types; mime_type != NULL && l != NULL; l = l->next) {
+			for (l = filter->mime_types; mime_type != NULL && l != NULL; l = l->next) {
 				if (g_content_type_is_a (mime_type, l->data)) {
 					found = TRUE;
 					break;
@@ -261,16 +478,13 @@ visit_directory (GFile *dir, SearchThreadData *data)
 		mtime = g_file_info_get_attribute_uint64 (info, "time::modified");
 		atime = g_file_info_get_attribute_uint64 (info, "time::access");
 
-                date_range = nautilus_query_get_date_range (data->query);
-                if (found && date_range != NULL) {
-                        NautilusQuerySearchType type;
+                if (found && filter->date_range != NULL) {
                         guint64 current_file_time;
 
-                        initial_date = g_ptr_array_index (date_range, 0);
-                        end_date = g_ptr_array_index (date_range, 1);
-                        type = nautilus_query_get_search_type (data->query);
+                        initial_date = g_ptr_array_index (filter->date_range, 0);
+                        end_date = g_ptr_array_index (filter->date_range, 1);
 
-                        if (type == NAUTILUS_QUERY_SEARCH_TYPE_LAST_ACCESS) {
+                        if (filter->search_type == NAUTILUS_QUERY_SEARCH_TYPE_LAST_ACCESS) {
                                 current_file_time = atime;
                         } else {
                                 current_file_time = mtime;
@@ -278,7 +492,6 @@ visit_directory (GFile *dir, SearchThreadData *data)
                         found = nautilus_file_date_in_between (current_file_time,
                                                                initial_date,
                                                                end_date);
-                        g_ptr_array_unref (date_range);
                 }
 
 		if (found) {
@@ -286,6 +499,7 @@ visit_directory (GFile *dir, SearchThreadData *data)
 			GDateTime *date;
 			char *uri;
 
+			child = g_file_get_child (dir, g_file_info_get_name (info));
 			uri = g_file_get_uri (child);
 			hit = nautilus_search_hit_new (uri);
 			g_free (uri);
@@ -294,39 +508,111 @@ visit_directory (GFile *dir, SearchThreadData *data)
 			nautilus_search_hit_set_modification_time (hit, date);
 			g_date_time_unref (date);
 
-			data->hits = g_list_prepend (data->hits, hit);
+			worker->hits = g_list_prepend (worker->hits, hit);
 		}
 		
-		data->n_processed_files++;
-		if (data->n_processed_files > BATCH_SIZE) {
-			send_batch (data);
+		worker->n_processed_files++;
+		if (worker->n_processed_files > BATCH_SIZE) {
+			send_batch (worker);
 		}
 
 		if (data->engine->details->recursive && g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY) {
 			id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILE);
 			visited = FALSE;
 			if (id) {
-				if (g_hash_table_lookup_extended (data->visited,
-								  id, NULL, NULL)) {
-					visited = TRUE;
-				} else {
-					g_hash_table_insert (data->visited, g_strdup (id), NULL);
-				}
+				visited = mark_visited (data, id);
 			}
 			
 			if (!visited) {
-				g_queue_push_tail (data->directories, g_object_ref (child));
+				if (child == NULL) {
+					child = g_file_get_child (dir, g_file_info_get_name (info));
+				}
+				worker_push_directory (worker, child);
 			}
 		}
 		
-		g_object_unref (child);
+		g_clear_object (&child);
 	next:
 		g_object_unref (info);
 	}
 
 	g_object_unref (enumerator);
+	search_filter_unref (filter);
+}
+
+
+static void
+worker_wait_for_work (SearchWorker *worker)
+{
+	SearchThreadData *data;
+	gint64 end_time;
+
+	data = worker->thread_data;
+	end_time = g_get_monotonic_time () + IDLE_WORKER_TIMEOUT_USEC;
+
+	g_mutex_lock (&data->idle_mutex);
+	g_atomic_int_inc (&data->n_idle_workers);
+	if (g_atomic_int_get (&data->n_pending_directories) > 0 &&
+	    !g_cancellable_is_cancelled (data->cancellable)) {
+		g_cond_wait_until (&data->idle_cond, &data->idle_mutex, end_time);
+	}
+	g_atomic_int_add (&data->n_idle_workers, -1);
+	g_mutex_unlock (&data->idle_mutex);
+}
+
+static void
+worker_run (SearchWorker *worker)
+{
+	SearchThreadData *data;
+	GFile *dir;
+
+	data = worker->thread_data;
+
+	while (!g_cancellable_is_cancelled (data->cancellable)) {
+		dir = worker_pop_directory (worker);
+		if (dir == NULL) {
+			dir = worker_steal_directory (worker);
+		}
+
+		if (dir != NULL) {
+			visit_directory (dir, worker);
+			g_object_unref (dir);
+
+			if (g_atomic_int_dec_and_test (&data->n_pending_directories)) {
+				/* Traversal complete, let the idle workers exit */
+				g_mutex_lock (&data->idle_mutex);
+				g_cond_broadcast (&data->idle_cond);
+				g_mutex_unlock (&data->idle_mutex);
+			}
+			continue;
+		}
+
+		if (g_atomic_int_get (&data->n_pending_directories) == 0) {
+			break;
+		}
+
+		worker_wait_for_work (worker);
+	}
+
+	if (!g_cancellable_is_cancelled (data->cancellable)) {
+		send_batch (worker);
+	}
+
+	/* The last worker out reports the end of the search. Every worker
+	 * queued its hits before getting here, so all batches reach the
+	 * main loop before the finished signal. */
+	if (g_atomic_int_dec_and_test (&data->n_running_workers)) {
+		g_idle_add (search_thread_done_idle, data);
+	}
 }
 
+static gpointer
+search_worker_thread_func (gpointer user_data)
+{
+	worker_run (user_data);
+
+	return NULL;
+}
 
 static gpointer 
 search_thread_func (gpointer user_data)
@@ -334,32 +620,32 @@ search_thread_func (gpointer user_data)
 	SearchThreadData *data;
 	GFile *dir;
 	GFileInfo *info;
+	GThread *thread;
 	const char *id;
+	guint i;
 
 	data = user_data;
 
 	/* Insert id for toplevel directory into visited */
-	dir = g_queue_peek_head (data->directories);
+	dir = g_queue_peek_head (&data->workers[0].directories);
 	info = g_file_query_info (dir, G_FILE_ATTRIBUTE_ID_FILE, 0, data->cancellable, NULL);
 	if (info) {
 		id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILE);
 		if (id) {
-			g_hash_table_insert (data->visited, g_strdup (id), NULL);
+			mark_visited (data, id);
 		}
 		g_object_unref (info);
 	}
-	
-	while (!g_cancellable_is_cancelled (data->cancellable) &&
-	       (dir = g_queue_pop_head (data->directories)) != NULL) {
-		visit_directory (dir, data);
-		g_object_unref (dir);
-	}
 
-	if (!g_cancellable_is_cancelled (data->cancellable)) {
-		send_batch (data);
+	/* This thread runs the first worker, the others steal from it */
+	for (i = 1; i < data->n_workers; i++) {
+		thread = g_thread_new ("nautilus-search-simple-worker",
+				       search_worker_thread_func,
+				       &data->workers[i]);
+		g_thread_unref (thread);
 	}
 
-	g_idle_add (search_thread_done_idle, data);
+	worker_run (&data->workers[0]);
 	
 	return NULL;
 }
@@ -381,6 +667,8 @@ nautilus_search_engine_simple_start (NautilusSearchProvider *provider)
 	
 	data = search_thread_data_new (simple, simple->details->query);
 
+	DEBUG ("Simple engine using %u workers", data->n_workers);
+
 	thread = g_thread_new ("nautilus-search-simple", search_thread_func, data);
 	simple->details->active_search = data;
 
@@ -523,3 +811,38 @@ nautilus_search_engine_simple_new (void)
 
 	return engine;
 }
+
+/**
+ * nautilus_search_engine_simple_refine:
+ * @simple: a #NautilusSearchEngineSimple
+ * @query: a query narrower than the one being searched
+ *
+ * Makes a running search match @query from now on. Directories still
+ * to be visited are kept, so only the unfinished part of the tree is
+ * walked. Hits reported earlier may not match @query.
+ */
+void
+nautilus_search_engine_simple_refine (NautilusSearchEngineSimple *simple,
+				      NautilusQuery              *query)
+{
+	SearchThreadData *data;
+	SearchFilter *old_filter;
+
+	g_return_if_fail (NAUTILUS_IS_SEARCH_ENGINE_SIMPLE (simple));
+
+	nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (simple), query);
+
+	data = simple->details->active_search;
+	if (data == NULL) {
+		return;
+	}
+
+	DEBUG ("Simple engine refine");
+
+	g_mutex_lock (&data->filter_mutex);
+	old_filter = data->filter;
+	data->filter = search_filter_new (query);
+	g_mutex_unlock (&data->filter_mutex);
+
+	search_filter_unref (old_filter);
+}
@@ -26,6 +26,8 @@
 #include "nautilus-search-engine.h"
 #include "nautilus-search-engine-simple.h"
 #include "nautilus-search-engine-model.h"
+#include "nautilus-search-engine-index.h"
+#include "nautilus-search-index.h"
 #define DEBUG_FLAG NAUTILUS_DEBUG_SEARCH
 #include "nautilus-debug.h"
 
@@ -40,6 +42,7 @@ struct NautilusSearchEngineDetails
 #endif
 	NautilusSearchEngineSimple *simple;
 	NautilusSearchEngineModel *model;
+	NautilusSearchEngineIndex *index;
 
 	GHashTable *uris;
 	guint providers_running;
@@ -75,12 +78,15 @@ nautilus_search_engine_set_query (NautilusSearchProvider *provider,
 	nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (engine->details->tracker), query);
 #endif
 	nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (engine->details->model), query);
+	nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (engine->details->index), query);
 	nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (engine->details->simple), query);
 }
 
 static void
 search_engine_start_real (NautilusSearchEngine *engine)
 {
+	gboolean use_index;
+
 	engine->details->providers_running = 0;
 	engine->details->providers_finished = 0;
 	engine->details->providers_error = 0;
@@ -90,6 +96,7 @@ search_engine_start_real (NautilusSearchEngine *engine)
 	DEBUG ("Search engine start real");
 
 	g_object_ref (engine);
+	nautilus_search_index_search_started ();
 
 #ifdef ENABLE_TRACKER
 	nautilus_search_provider_start (NAUTILUS_SEARCH_PROVIDER (engine->details->tracker));
@@ -100,8 +107,18 @@ search_engine_start_real (NautilusSearchEngine *engine)
 		engine->details->providers_running++;
 	}
 
-	nautilus_search_provider_start (NAUTILUS_SEARCH_PROVIDER (engine->details->simple));
+	/* When an up to date index covers the query there is no need to
+	 * walk the tree. Otherwise the index provider finishes right away,
+	 * and builds an index for the next search in the background. */
+	use_index = nautilus_search_engine_index_can_search (engine->details->index);
+
+	nautilus_search_provider_start (NAUTILUS_SEARCH_PROVIDER (engine->details->index));
 	engine->details->providers_running++;
+
+	if (!use_index) {
+		nautilus_search_provider_start (NAUTILUS_SEARCH_PROVIDER (engine->details->simple));
+		engine->details->providers_running++;
+	}
 }
 
 static void
@@ -145,6 +162,7 @@ nautilus_search_engine_stop (NautilusSearchProvider *provider)
 	nautilus_search_provider_stop (NAUTILUS_SEARCH_PROVIDER (engine->details->tracker));
 #endif
 	nautilus_search_provider_stop (NAUTILUS_SEARCH_PROVIDER (engine->details->model));
+	nautilus_search_provider_stop (NAUTILUS_SEARCH_PROVIDER (engine->details->index));
 	nautilus_search_provider_stop (NAUTILUS_SEARCH_PROVIDER (engine->details->simple));
 
 	engine->details->running = FALSE;
@@ -218,6 +236,7 @@ check_providers_status (NautilusSearchEngine *engine)
 		nautilus_search_engine_start (NAUTILUS_SEARCH_PROVIDER (engine));
 	}
 
+	nautilus_search_index_search_finished ();
 	g_object_unref (engine);
 }
 
@@ -290,6 +309,7 @@ nautilus_search_engine_finalize (GObject *object)
 	g_clear_object (&engine->details->tracker);
 #endif
 	g_clear_object (&engine->details->model);
+	g_clear_object (&engine->details->index);
 	g_clear_object (&engine->details->simple);
 
 	G_OBJECT_CLASS (nautilus_search_engine_parent_class)->finalize (object);
@@ -349,6 +369,9 @@ nautilus_search_engine_init (NautilusSearchEngine *engine)
 	engine->details->model = nautilus_search_engine_model_new ();
 	connect_provider_signals (engine, NAUTILUS_SEARCH_PROVIDER (engine->details->model));
 
+	engine->details->index = nautilus_search_engine_index_new ();
+	connect_provider_signals (engine, NAUTILUS_SEARCH_PROVIDER (engine->details->index));
+
 	engine->details->simple = nautilus_search_engine_simple_new ();
 	connect_provider_signals (engine, NAUTILUS_SEARCH_PROVIDER (engine->details->simple));
 }
@@ -374,3 +397,48 @@ nautilus_search_engine_get_simple_provider (NautilusSearchEngine *engine)
 {
 	return engine->details->simple;
 }
+
+/**
+ * nautilus_search_engine_refine:
+ * @engine: a #NautilusSearchEngine
+ * @query: a query narrower than the one being searched, see
+ * nautilus_query_is_refinement_of()
+ *
+ * Tries to make the running search match @query without starting over.
+ * Hits already reported, and some reported shortly after this call,
+ * might still match only the previous query, so callers must filter
+ * them.
+ *
+ * Returns: %TRUE if the search continues with @query, %FALSE if it
+ * has to be restarted.
+ */
+gboolean
+nautilus_search_engine_refine (NautilusSearchEngine *engine,
+			       NautilusQuery        *query)
+{
+	g_return_val_if_fail (NAUTILUS_IS_SEARCH_ENGINE (engine), FALSE);
+
+	if (!engine->details->running || engine->details->restart) {
+		return FALSE;
+	}
+
+#ifdef ENABLE_TRACKER
+	if (nautilus_search_provider_is_running (NAUTILUS_SEARCH_PROVIDER (engine->details->tracker))) {
+		return FALSE;
+	}
+#endif
+	/* Walking the index is quick, restarting it is cheaper than
+	 * keeping track of what it already reported. */
+	if (nautilus_search_provider_is_running (NAUTILUS_SEARCH_PROVIDER (engine->details->index))) {
+		return FALSE;
+	}
+
+	DEBUG ("Search engine refine");
+
+	/* The model provider reads the query once its directory is ready */
+	nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (engine->details->model), query);
+	nautilus_search_provider_set_query (NAUTILUS_SEARCH_PROVIDER (engine->details->index), query);
+	nautilus_search_engine_simple_refine (engine->details->simple, query);
+
+	return TRUE;
+}
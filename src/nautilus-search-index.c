@@ -0,0 +1,1644 @@
+/*
+ * Copyright (C) 2016 Red Hat, Inc
+ *
+ * Nautilus is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * Nautilus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; see the file COPYING.  If not,
+ * see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+#include "nautilus-search-index.h"
+
+#include "nautilus-directory-notify.h"
+#include "nautilus-global-preferences.h"
+#define DEBUG_FLAG NAUTILUS_DEBUG_SEARCH
+#include "nautilus-debug.h"
+
+#include <string.h>
+#include <glib/gstdio.h>
+
+/* The index file is a header followed by a flat array of entries and a
+ * pool of NUL terminated strings the entries point into. Entries are
+ * stored breadth first, so the children of a directory are contiguous
+ * and sorted by name. This lets us find a location with one binary
+ * search per path component, and walk any subtree without having to
+ * load anything but the pages it touches.
+ *
+ * The file is written once per build and never modified in place.
+ * Changes reported after the build are kept in memory: a tombstone bit
+ * per entry hides removed or changed entries, and an overlay table holds
+ * the new state of changed and added files.
+ *
+ * Searches trust the index and the overlay. Changes made behind our
+ * back are found after a search, by comparing the modification times of
+ * a bounded number of indexed directories at a time, and make the next
+ * search rebuild the index.
+ */
+
+#define INDEX_MAGIC "NAUTIDX"
+#define INDEX_VERSION 2
+
+/* Indexes older than this are rebuilt in the background, but still used
+ * to answer searches in the meantime. */
+#define INDEX_REFRESH_AGE G_TIME_SPAN_HOUR
+/* Past this age we don't trust the index anymore and walk the tree */
+#define INDEX_EXPIRE_AGE G_TIME_SPAN_DAY
+/* Indexes are rebuilt whenever they are used, so the ones not written
+ * for this long are of locations not searched anymore, and removed */
+#define INDEX_UNUSED_AGE (7 * G_TIME_SPAN_DAY)
+
+/* Directories checked for changes after each search */
+#define REVALIDATE_MAX_DIRECTORIES 1000
+
+#define INDEX_MAX_ENTRIES (1 << 26)
+/* Past this many changes it is cheaper to rebuild than to keep the overlay */
+#define INDEX_MAX_OVERLAY_ENTRIES 10000
+
+#define INVALID_ENTRY G_MAXUINT32
+
+#define INDEX_ATTRIBUTES \
+	G_FILE_ATTRIBUTE_STANDARD_NAME "," \
+	G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME "," \
+	G_FILE_ATTRIBUTE_STANDARD_IS_BACKUP "," \
+	G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN "," \
+	G_FILE_ATTRIBUTE_STANDARD_TYPE "," \
+	G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE "," \
+	G_FILE_ATTRIBUTE_TIME_MODIFIED "," \
+	G_FILE_ATTRIBUTE_TIME_ACCESS "," \
+	G_FILE_ATTRIBUTE_ID_FILE
+
+enum {
+	ENTRY_IS_DIRECTORY = 1 << 0,
+	ENTRY_IS_HIDDEN = 1 << 1
+};
+
+typedef struct {
+	gchar magic[8];
+	guint32 version;
+	guint32 n_entries;
+	guint32 strings_size;
+	guint32 root_uri;
+	gint64 build_time;
+} IndexHeader;
+
+typedef struct {
+	/* In seconds since the epoch */
+	guint64 mtime;
+	guint64 atime;
+	guint32 parent;
+	guint32 first_child;
+	guint32 n_children;
+	/* Offsets into the string pool */
+	guint32 name;
+	guint32 display_name;
+	guint32 content_type;
+	guint32 flags;
+} IndexEntry;
+
+typedef struct {
+	char *uri;
+	char *name;
+	char *display_name;
+	char *content_type;
+	guint64 mtime;
+	guint64 atime;
+	guint32 flags;
+} OverlayEntry;
+
+struct NautilusSearchIndex {
+	gint ref_count;
+
+	GFile *root;
+	char *root_uri;
+
+	GMappedFile *mapped_file;
+	guint32 n_entries;
+	const IndexEntry *entries;
+	const char *strings;
+	gint64 build_time;
+
+	/* One bit per entry, set when the entry was removed or changed */
+	guint *tombstones;
+	/* One bit per directory entry, set when we were told about changes
+	 * in it, which the overlay has */
+	guint *known_changes;
+
+	/* Set while revalidating, see revalidate_thread_func() */
+	GCancellable *revalidate_cancellable;
+	guint32 revalidate_next;
+
+	GMutex overlay_mutex;
+	GHashTable *overlay; /* uri -> OverlayEntry */
+
+	gboolean dirty;
+};
+
+typedef struct {
+	GFile *root;
+	char *root_uri;
+	char *path;
+	NautilusSearchIndex *index;
+} IndexBuildData;
+
+typedef struct {
+	GFile *location;
+	char *uri;
+	/* Root uris of the indexes already loaded */
+	GHashTable *loaded;
+	NautilusSearchIndex *index;
+} IndexLoadData;
+
+typedef struct {
+	guint32 id;
+	GFile *location;
+} PendingDirectory;
+
+typedef struct {
+	NautilusSearchIndex *index;
+	GFile *location;
+	gboolean added;
+} PendingUpdate;
+
+/* All of these are only accessed from the main thread */
+static GHashTable *indexes; /* root uri -> NautilusSearchIndex */
+static GHashTable *builds_in_progress; /* root uri set */
+static GHashTable *loads_in_progress; /* location uri set */
+
+static guint n_searches_running;
+/* Waiting for the searches to finish */
+static GList *deferred_builds; /* IndexBuildData */
+static GList *deferred_revalidations; /* NautilusSearchIndex */
+static GList *revalidating_indexes; /* NautilusSearchIndex */
+
+static void start_build (IndexBuildData *data);
+static void start_revalidate (NautilusSearchIndex *index);
+
+static gboolean
+is_indexing_allowed (GFile *location)
+{
+	GFile *home;
+	gboolean allowed;
+
+	if (!g_file_is_native (location) || nautilus_preferences == NULL) {
+		return FALSE;
+	}
+
+	switch (g_settings_get_enum (nautilus_preferences, NAUTILUS_PREFERENCES_SEARCH_INDEX)) {
+	case NAUTILUS_SEARCH_INDEX_ALWAYS:
+		return TRUE;
+	case NAUTILUS_SEARCH_INDEX_HOME_ONLY:
+		home = g_file_new_for_path (g_get_home_dir ());
+		allowed = g_file_equal (location, home) || g_file_has_prefix (location, home);
+		g_object_unref (home);
+		return allowed;
+	default:
+		return FALSE;
+	}
+}
+
+static char *
+get_index_path (const char *root_uri)
+{
+	char *checksum, *basename, *path;
+
+	checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA1, root_uri, -1);
+	basename = g_strconcat (checksum, ".idx", NULL);
+	path = g_build_filename (g_get_user_cache_dir (), "nautilus", "search-index",
+				 basename, NULL);
+	g_free (basename);
+	g_free (checksum);
+
+	return path;
+}
+
+static void
+overlay_entry_free (OverlayEntry *entry)
+{
+	g_free (entry->uri);
+	g_free (entry->name);
+	g_free (entry->display_name);
+	g_free (entry->content_type);
+	g_slice_free (OverlayEntry, entry);
+}
+
+static OverlayEntry *
+overlay_entry_copy (OverlayEntry *entry)
+{
+	OverlayEntry *copy;
+
+	copy = g_slice_new (OverlayEntry);
+	copy->uri = g_strdup (entry->uri);
+	copy->name = g_strdup (entry->name);
+	copy->display_name = g_strdup (entry->display_name);
+	copy->content_type = g_strdup (entry->content_type);
+	copy->mtime = entry->mtime;
+	copy->atime = entry->atime;
+	copy->flags = entry->flags;
+
+	return copy;
+}
+
+static guint32
+get_flags_from_info (GFileInfo *info)
+{
+	guint32 flags;
+
+	flags = 0;
+	if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY) {
+		flags |= ENTRY_IS_DIRECTORY;
+	}
+	if (g_file_info_get_is_hidden (info) || g_file_info_get_is_backup (info)) {
+		flags |= ENTRY_IS_HIDDEN;
+	}
+
+	return flags;
+}
+
+/* Checks that walking the entries can neither read out of the file nor
+ * loop: the strings are in the pool, and the parent of an entry and its
+ * children are before and after it, as breadth first order has them.
+ */
+static gboolean
+entries_are_valid (const IndexEntry *entries,
+		   guint32           n_entries,
+		   guint32           strings_size)
+{
+	const IndexEntry *entry;
+	guint32 id;
+
+	if (entries[0].parent != INVALID_ENTRY) {
+		return FALSE;
+	}
+
+	for (id = 0; id < n_entries; id++) {
+		entry = &entries[id];
+
+		if (id > 0 && entry->parent >= id) {
+			return FALSE;
+		}
+
+		if (entry->n_children > 0 &&
+		    (entry->first_child <= id ||
+		     (guint64) entry->first_child + entry->n_children > n_entries)) {
+			return FALSE;
+		}
+
+		if (entry->name >= strings_size ||
+		    entry->display_name >= strings_size ||
+		    entry->content_type >= strings_size) {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static NautilusSearchIndex *
+nautilus_search_index_load (GFile *root)
+{
+	NautilusSearchIndex *index;
+	GMappedFile *mapped_file;
+	const IndexHeader *header;
+	const char *contents, *strings;
+	char *root_uri, *path;
+	gsize length, expected_length;
+
+	root_uri = g_file_get_uri (root);
+	path = get_index_path (root_uri);
+	mapped_file = g_mapped_file_new (path, FALSE, NULL);
+	g_free (path);
+
+	if (mapped_file == NULL) {
+		g_free (root_uri);
+		return NULL;
+	}
+
+	contents = g_mapped_file_get_contents (mapped_file);
+	length = g_mapped_file_get_length (mapped_file);
+	header = (const IndexHeader *) contents;
+
+	if (length < sizeof (IndexHeader) ||
+	    strncmp (header->magic, INDEX_MAGIC, sizeof (header->magic)) != 0 ||
+	    header->version != INDEX_VERSION ||
+	    header->n_entries == 0 ||
+	    header->n_entries > INDEX_MAX_ENTRIES ||
+	    header->strings_size == 0) {
+		goto invalid;
+	}
+
+	expected_length = sizeof (IndexHeader) +
+		(gsize) header->n_entries * sizeof (IndexEntry) +
+		header->strings_size;
+	if (length != expected_length) {
+		goto invalid;
+	}
+
+	strings = contents + sizeof (IndexHeader) + (gsize) header->n_entries * sizeof (IndexEntry);
+	if (strings[header->strings_size - 1] != '\0' ||
+	    header->root_uri >= header->strings_size ||
+	    strcmp (strings + header->root_uri, root_uri) != 0) {
+		goto invalid;
+	}
+
+	if (!entries_are_valid ((const IndexEntry *) (contents + sizeof (IndexHeader)),
+				header->n_entries, header->strings_size)) {
+		goto invalid;
+	}
+
+	index = g_new0 (NautilusSearchIndex, 1);
+	index->ref_count = 1;
+	index->root = g_object_ref (root);
+	index->root_uri = root_uri;
+	index->mapped_file = mapped_file;
+	index->n_entries = header->n_entries;
+	index->entries = (const IndexEntry *) (contents + sizeof (IndexHeader));
+	index->strings = strings;
+	index->build_time = header->build_time;
+	index->tombstones = g_new0 (guint, (index->n_entries + 31) / 32);
+	index->known_changes = g_new0 (guint, (index->n_entries + 31) / 32);
+	g_mutex_init (&index->overlay_mutex);
+	index->overlay = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+						(GDestroyNotify) overlay_entry_free);
+
+	DEBUG ("Loaded search index for %s with %u entries", root_uri, index->n_entries);
+
+	return index;
+
+ invalid:
+	DEBUG ("Ignoring invalid search index for %s", root_uri);
+	g_mapped_file_unref (mapped_file);
+	g_free (root_uri);
+
+	return NULL;
+}
+
+NautilusSearchIndex *
+nautilus_search_index_ref (NautilusSearchIndex *index)
+{
+	g_atomic_int_inc (&index->ref_count);
+
+	return index;
+}
+
+void
+nautilus_search_index_unref (NautilusSearchIndex *index)
+{
+	if (!g_atomic_int_dec_and_test (&index->ref_count)) {
+		return;
+	}
+
+	g_hash_table_destroy (index->overlay);
+	g_mutex_clear (&index->overlay_mutex);
+	g_free (index->tombstones);
+	g_free (index->known_changes);
+	g_mapped_file_unref (index->mapped_file);
+	g_object_unref (index->root);
+	g_free (index->root_uri);
+	g_free (index);
+}
+
+static gboolean
+is_tombstoned (NautilusSearchIndex *index,
+	       guint32              id)
+{
+	guint bits;
+
+	bits = (guint) g_atomic_int_get ((gint *) &index->tombstones[id / 32]);
+
+	return (bits & (1u << (id % 32))) != 0;
+}
+
+static void
+set_tombstone (NautilusSearchIndex *index,
+	       guint32              id)
+{
+	g_atomic_int_or (&index->tombstones[id / 32], 1u << (id % 32));
+}
+
+static gboolean
+has_known_changes (NautilusSearchIndex *index,
+		   guint32              id)
+{
+	guint bits;
+
+	bits = (guint) g_atomic_int_get ((gint *) &index->known_changes[id / 32]);
+
+	return (bits & (1u << (id % 32))) != 0;
+}
+
+static void
+set_known_changes (NautilusSearchIndex *index,
+		   guint32              id)
+{
+	g_atomic_int_or (&index->known_changes[id / 32], 1u << (id % 32));
+}
+
+static guint32
+find_child (NautilusSearchIndex *index,
+	    guint32              parent,
+	    const char          *name)
+{
+	const IndexEntry *entry;
+	guint32 low, high, middle;
+	int cmp;
+
+	entry = &index->entries[parent];
+	low = entry->first_child;
+	high = entry->first_child + entry->n_children;
+
+	while (low < high) {
+		middle = low + (high - low) / 2;
+		cmp = strcmp (name, index->strings + index->entries[middle].name);
+		if (cmp == 0) {
+			return middle;
+		} else if (cmp < 0) {
+			high = middle;
+		} else {
+			low = middle + 1;
+		}
+	}
+
+	return INVALID_ENTRY;
+}
+
+static guint32
+lookup_entry (NautilusSearchIndex *index,
+	      GFile               *location)
+{
+	char *relative_path;
+	char **components;
+	guint32 id;
+	int i;
+
+	if (g_file_equal (index->root, location)) {
+		return 0;
+	}
+
+	relative_path = g_file_get_relative_path (index->root, location);
+	if (relative_path == NULL) {
+		return INVALID_ENTRY;
+	}
+
+	components = g_strsplit (relative_path, G_DIR_SEPARATOR_S, -1);
+	id = 0;
+	for (i = 0; components[i] != NULL && id != INVALID_ENTRY; i++) {
+		if (components[i][0] == '\0') {
+			continue;
+		}
+		id = find_child (index, id, components[i]);
+	}
+
+	g_strfreev (components);
+	g_free (relative_path);
+
+	return id;
+}
+
+gboolean
+nautilus_search_index_is_usable (NautilusSearchIndex *index)
+{
+	return g_get_real_time () - index->build_time < INDEX_EXPIRE_AGE;
+}
+
+gboolean
+nautilus_search_index_needs_rebuild (NautilusSearchIndex *index)
+{
+	return index->dirty ||
+		g_get_real_time () - index->build_time > INDEX_REFRESH_AGE;
+}
+
+/**
+ * nautilus_search_index_lookup:
+ * @location: the location to search in
+ *
+ * Finds a loaded index covering @location. The closest indexed ancestor
+ * wins. Never touches the disk, see nautilus_search_index_schedule_load().
+ *
+ * Returns: (transfer full): the index, or %NULL if there is none.
+ */
+NautilusSearchIndex *
+nautilus_search_index_lookup (GFile *location)
+{
+	NautilusSearchIndex *index;
+	GFile *file, *parent;
+	char *uri;
+
+	if (indexes == NULL || !is_indexing_allowed (location)) {
+		return NULL;
+	}
+
+	index = NULL;
+	file = g_object_ref (location);
+	while (file != NULL && index == NULL) {
+		uri = g_file_get_uri (file);
+		index = g_hash_table_lookup (indexes, uri);
+		g_free (uri);
+
+		if (index != NULL && lookup_entry (index, location) == INVALID_ENTRY) {
+			index = NULL;
+		}
+
+		parent = g_file_get_parent (file);
+		g_object_unref (file);
+		file = parent;
+	}
+	g_clear_object (&file);
+
+	return index != NULL ? nautilus_search_index_ref (index) : NULL;
+}
+
+static void
+add_loaded_uri (const char *uri,
+		gpointer    index,
+		GHashTable *loaded)
+{
+	g_hash_table_add (loaded, g_strdup (uri));
+}
+
+static void
+ensure_tables (void)
+{
+	if (indexes == NULL) {
+		indexes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+						 (GDestroyNotify) nautilus_search_index_unref);
+	}
+	if (builds_in_progress == NULL) {
+		builds_in_progress = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	}
+	if (loads_in_progress == NULL) {
+		loads_in_progress = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	}
+}
+
+static gboolean
+load_done_idle (gpointer user_data)
+{
+	IndexLoadData *data;
+
+	data = user_data;
+
+	g_hash_table_remove (loads_in_progress, data->uri);
+
+	if (data->index == NULL) {
+		nautilus_search_index_schedule_build (data->location);
+	} else if (!g_hash_table_contains (indexes, data->index->root_uri)) {
+		g_hash_table_insert (indexes, g_strdup (data->index->root_uri), data->index);
+	} else {
+		/* A build finished first */
+		nautilus_search_index_unref (data->index);
+	}
+
+	g_object_unref (data->location);
+	g_free (data->uri);
+	g_hash_table_destroy (data->loaded);
+	g_free (data);
+
+	return FALSE;
+}
+
+static gpointer
+load_thread_func (gpointer user_data)
+{
+	IndexLoadData *data;
+	GFile *file, *parent;
+	char *uri;
+
+	data = user_data;
+
+	file = g_object_ref (data->location);
+	while (file != NULL && data->index == NULL) {
+		uri = g_file_get_uri (file);
+		if (!g_hash_table_contains (data->loaded, uri)) {
+			data->index = nautilus_search_index_load (file);
+		}
+		g_free (uri);
+
+		if (data->index != NULL &&
+		    lookup_entry (data->index, data->location) == INVALID_ENTRY) {
+			g_clear_pointer (&data->index, nautilus_search_index_unref);
+		}
+
+		parent = g_file_get_parent (file);
+		g_object_unref (file);
+		file = parent;
+	}
+	g_clear_object (&file);
+
+	g_idle_add (load_done_idle, data);
+
+	return NULL;
+}
+
+/**
+ * nautilus_search_index_schedule_load:
+ * @location: the location to search in
+ *
+ * Loads the index covering @location that a previous session stored, in
+ * a background thread, for nautilus_search_index_lookup() to find it
+ * next time. If there is none, one is built.
+ */
+void
+nautilus_search_index_schedule_load (GFile *location)
+{
+	IndexLoadData *data;
+	GThread *thread;
+	char *uri;
+
+	if (!is_indexing_allowed (location)) {
+		return;
+	}
+
+	ensure_tables ();
+
+	uri = g_file_get_uri (location);
+	if (g_hash_table_contains (loads_in_progress, uri)) {
+		g_free (uri);
+		return;
+	}
+	g_hash_table_add (loads_in_progress, g_strdup (uri));
+
+	data = g_new0 (IndexLoadData, 1);
+	data->location = g_object_ref (location);
+	data->uri = uri;
+	data->loaded = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	g_hash_table_foreach (indexes, (GHFunc) add_loaded_uri, data->loaded);
+
+	thread = g_thread_new ("nautilus-search-index", load_thread_func, data);
+	g_thread_unref (thread);
+}
+
+static void
+fill_entry (NautilusSearchIndex      *index,
+	    guint32                   id,
+	    NautilusSearchIndexEntry *entry)
+{
+	const IndexEntry *index_entry;
+
+	index_entry = &index->entries[id];
+
+	entry->id = id;
+	entry->uri = NULL;
+	entry->name = index->strings + index_entry->name;
+	entry->display_name = index->strings + index_entry->display_name;
+	entry->content_type = index_entry->content_type != 0 ?
+		index->strings + index_entry->content_type : NULL;
+	entry->mtime = index_entry->mtime;
+	entry->atime = index_entry->atime;
+	entry->is_directory = (index_entry->flags & ENTRY_IS_DIRECTORY) != 0;
+	entry->is_hidden = (index_entry->flags & ENTRY_IS_HIDDEN) != 0;
+}
+
+static GList *
+get_overlay_entries (NautilusSearchIndex *index,
+		     GFile               *location)
+{
+	GHashTableIter iter;
+	OverlayEntry *overlay_entry;
+	GList *entries;
+	char *uri, *prefix;
+
+	uri = g_file_get_uri (location);
+	prefix = g_str_has_suffix (uri, "/") ? g_strdup (uri) : g_strconcat (uri, "/", NULL);
+	entries = NULL;
+
+	g_mutex_lock (&index->overlay_mutex);
+	g_hash_table_iter_init (&iter, index->overlay);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &overlay_entry)) {
+		if (g_str_has_prefix (overlay_entry->uri, prefix)) {
+			entries = g_list_prepend (entries, overlay_entry_copy (overlay_entry));
+		}
+	}
+	g_mutex_unlock (&index->overlay_mutex);
+
+	g_free (prefix);
+	g_free (uri);
+
+	return entries;
+}
+
+/* Returns FALSE if the directory is gone */
+static gboolean
+get_directory_mtime (GFile        *location,
+		     GCancellable *cancellable,
+		     guint64      *mtime)
+{
+	GFileInfo *info;
+
+	info = g_file_query_info (location, G_FILE_ATTRIBUTE_TIME_MODIFIED,
+				  G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+				  cancellable, NULL);
+	if (info == NULL) {
+		return FALSE;
+	}
+
+	*mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+	g_object_unref (info);
+
+	return TRUE;
+}
+
+/**
+ * nautilus_search_index_foreach:
+ * @index: a #NautilusSearchIndex
+ * @location: the directory to walk
+ * @func: called for every entry below @location
+ * @user_data: data for @func
+ * @cancellable: a #GCancellable
+ *
+ * Walks the indexed entries below @location, including the changes
+ * recorded since the index was built. Only the pages of the index are
+ * read, not the file system. Safe to call from any thread, but it
+ * blocks.
+ */
+void
+nautilus_search_index_foreach (NautilusSearchIndex            *index,
+			       GFile                          *location,
+			       NautilusSearchIndexForeachFunc  func,
+			       gpointer                        user_data,
+			       GCancellable                   *cancellable)
+{
+	NautilusSearchIndexEntry entry;
+	const IndexEntry *parent;
+	GArray *stack;
+	GList *overlay_entries, *l;
+	OverlayEntry *overlay_entry;
+	guint32 start, id, child, end;
+
+	start = lookup_entry (index, location);
+	stack = g_array_new (FALSE, FALSE, sizeof (guint32));
+	if (start != INVALID_ENTRY && !is_tombstoned (index, start)) {
+		g_array_append_val (stack, start);
+	}
+
+	while (stack->len > 0) {
+		if (g_cancellable_is_cancelled (cancellable)) {
+			g_array_free (stack, TRUE);
+			return;
+		}
+
+		id = g_array_index (stack, guint32, stack->len - 1);
+		g_array_set_size (stack, stack->len - 1);
+
+		parent = &index->entries[id];
+		end = parent->first_child + parent->n_children;
+		for (child = parent->first_child; child < end; child++) {
+			if (is_tombstoned (index, child)) {
+				continue;
+			}
+
+			fill_entry (index, child, &entry);
+			if (func (index, &entry, user_data) && entry.is_directory) {
+				g_array_append_val (stack, child);
+			}
+		}
+	}
+	g_array_free (stack, TRUE);
+
+	overlay_entries = get_overlay_entries (index, location);
+	for (l = overlay_entries; l != NULL; l = l->next) {
+		overlay_entry = l->data;
+
+		entry.id = INVALID_ENTRY;
+		entry.uri = overlay_entry->uri;
+		entry.name = overlay_entry->name;
+		entry.display_name = overlay_entry->display_name;
+		entry.content_type = overlay_entry->content_type;
+		entry.mtime = overlay_entry->mtime;
+		entry.atime = overlay_entry->atime;
+		entry.is_directory = (overlay_entry->flags & ENTRY_IS_DIRECTORY) != 0;
+		entry.is_hidden = (overlay_entry->flags & ENTRY_IS_HIDDEN) != 0;
+
+		func (index, &entry, user_data);
+	}
+	g_list_free_full (overlay_entries, (GDestroyNotify) overlay_entry_free);
+}
+
+char *
+nautilus_search_index_entry_get_uri (NautilusSearchIndex            *index,
+				     const NautilusSearchIndexEntry *entry)
+{
+	GPtrArray *names;
+	GString *path;
+	GFile *file;
+	char *uri;
+	guint32 id;
+	guint i;
+
+	if (entry->uri != NULL) {
+		return g_strdup (entry->uri);
+	}
+
+	if (entry->id == 0) {
+		return g_strdup (index->root_uri);
+	}
+
+	names = g_ptr_array_new ();
+	for (id = entry->id; id != 0; id = index->entries[id].parent) {
+		g_ptr_array_add (names, (gpointer) (index->strings + index->entries[id].name));
+	}
+
+	path = g_string_new (NULL);
+	for (i = names->len; i > 0; i--) {
+		if (path->len > 0) {
+			g_string_append_c (path, G_DIR_SEPARATOR);
+		}
+		g_string_append (path, g_ptr_array_index (names, i - 1));
+	}
+
+	file = g_file_resolve_relative_path (index->root, path->str);
+	uri = g_file_get_uri (file);
+
+	g_object_unref (file);
+	g_string_free (path, TRUE);
+	g_ptr_array_free (names, TRUE);
+
+	return uri;
+}
+
+static guint32
+append_string (GString    *strings,
+	       const char *string)
+{
+	guint32 offset;
+
+	offset = strings->len;
+	g_string_append_len (strings, string, strlen (string) + 1);
+
+	return offset;
+}
+
+static guint32
+intern_string (GString    *strings,
+	       GHashTable *interned,
+	       const char *string)
+{
+	gpointer offset;
+
+	if (g_hash_table_lookup_extended (interned, string, NULL, &offset)) {
+		return GPOINTER_TO_UINT (offset);
+	}
+
+	offset = GUINT_TO_POINTER (append_string (strings, string));
+	g_hash_table_insert (interned, g_strdup (string), offset);
+
+	return GPOINTER_TO_UINT (offset);
+}
+
+static int
+compare_info_names (gconstpointer a,
+		    gconstpointer b)
+{
+	GFileInfo *info_a = *(GFileInfo **) a;
+	GFileInfo *info_b = *(GFileInfo **) b;
+
+	return strcmp (g_file_info_get_name (info_a),
+		       g_file_info_get_name (info_b));
+}
+
+static gboolean
+mark_visited (GHashTable *visited,
+	      GFileInfo  *info)
+{
+	const char *id;
+
+	id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILE);
+	if (id == NULL) {
+		return FALSE;
+	}
+
+	if (g_hash_table_contains (visited, id)) {
+		return TRUE;
+	}
+
+	g_hash_table_add (visited, g_strdup (id));
+
+	return FALSE;
+}
+
+static gboolean
+write_index (IndexBuildData *data,
+	     GArray         *entries,
+	     GString        *strings,
+	     guint32         root_uri)
+{
+	IndexHeader header;
+	GFileOutputStream *stream;
+	GFile *file;
+	GError *error;
+	char *dirname;
+	gboolean success;
+
+	memset (&header, 0, sizeof (header));
+	memcpy (header.magic, INDEX_MAGIC, sizeof (INDEX_MAGIC));
+	header.version = INDEX_VERSION;
+	header.n_entries = entries->len;
+	header.strings_size = strings->len;
+	header.root_uri = root_uri;
+	header.build_time = g_get_real_time ();
+
+	dirname = g_path_get_dirname (data->path);
+	g_mkdir_with_parents (dirname, 0700);
+	g_free (dirname);
+
+	/* g_file_replace() writes to a temporary file and renames it on
+	 * close, so concurrent readers never see a partial index. */
+	error = NULL;
+	file = g_file_new_for_path (data->path);
+	stream = g_file_replace (file, NULL, FALSE, G_FILE_CREATE_PRIVATE, NULL, &error);
+	g_object_unref (file);
+
+	if (stream == NULL) {
+		DEBUG ("Failed to write search index: %s", error->message);
+		g_error_free (error);
+		return FALSE;
+	}
+
+	success = g_output_stream_write_all (G_OUTPUT_STREAM (stream),
+					     &header, sizeof (header),
+					     NULL, NULL, &error) &&
+		g_output_stream_write_all (G_OUTPUT_STREAM (stream),
+					   entries->data, entries->len * sizeof (IndexEntry),
+					   NULL, NULL, &error) &&
+		g_output_stream_write_all (G_OUTPUT_STREAM (stream),
+					   strings->str, strings->len,
+					   NULL, NULL, &error);
+
+	if (success) {
+		success = g_output_stream_close (G_OUTPUT_STREAM (stream), NULL, &error);
+	} else {
+		/* Cancelling the close discards the temporary file */
+		GCancellable *cancellable;
+
+		cancellable = g_cancellable_new ();
+		g_cancellable_cancel (cancellable);
+		g_output_stream_close (G_OUTPUT_STREAM (stream), cancellable, NULL);
+		g_object_unref (cancellable);
+	}
+
+	if (!success) {
+		DEBUG ("Failed to write search index: %s", error->message);
+		g_error_free (error);
+	}
+
+	g_object_unref (stream);
+
+	return success;
+}
+
+static void
+build_index (IndexBuildData *data)
+{
+	GArray *entries;
+	GString *strings;
+	GHashTable *content_types, *visited;
+	GQueue pending;
+	PendingDirectory *directory, *child_directory;
+	GFileEnumerator *enumerator;
+	GFileInfo *info;
+	GPtrArray *children;
+	IndexEntry entry, *parent;
+	const char *name, *display_name, *content_type;
+	guint32 root_uri, first_child;
+	gboolean too_big;
+	guint i;
+
+	entries = g_array_new (FALSE, TRUE, sizeof (IndexEntry));
+	strings = g_string_new (NULL);
+	content_types = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	visited = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	g_queue_init (&pending);
+	too_big = FALSE;
+
+	/* Offset 0 is the empty string, used for missing values */
+	g_string_append_c (strings, '\0');
+	root_uri = append_string (strings, data->root_uri);
+
+	memset (&entry, 0, sizeof (entry));
+	entry.parent = INVALID_ENTRY;
+	entry.flags = ENTRY_IS_DIRECTORY;
+
+	info = g_file_query_info (data->root,
+				  G_FILE_ATTRIBUTE_ID_FILE ","
+				  G_FILE_ATTRIBUTE_TIME_MODIFIED,
+				  0, NULL, NULL);
+	if (info != NULL) {
+		mark_visited (visited, info);
+		entry.mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+		g_object_unref (info);
+	}
+
+	g_array_append_val (entries, entry);
+
+	directory = g_slice_new (PendingDirectory);
+	directory->id = 0;
+	directory->location = g_object_ref (data->root);
+	g_queue_push_tail (&pending, directory);
+
+	while ((directory = g_queue_pop_head (&pending)) != NULL) {
+		if (too_big) {
+			goto next;
+		}
+
+		enumerator = g_file_enumerate_children (directory->location, INDEX_ATTRIBUTES,
+							G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+							NULL, NULL);
+		if (enumerator == NULL) {
+			goto next;
+		}
+
+		children = g_ptr_array_new_with_free_func (g_object_unref);
+		while ((info = g_file_enumerator_next_file (enumerator, NULL, NULL)) != NULL) {
+			if (g_file_info_get_name (info) == NULL) {
+				g_object_unref (info);
+				continue;
+			}
+			g_ptr_array_add (children, info);
+		}
+		g_object_unref (enumerator);
+
+		g_ptr_array_sort (children, compare_info_names);
+
+		first_child = entries->len;
+		if (first_child + children->len > INDEX_MAX_ENTRIES ||
+		    strings->len > G_MAXUINT32 / 2) {
+			too_big = TRUE;
+			g_ptr_array_unref (children);
+			goto next;
+		}
+
+		for (i = 0; i < children->len; i++) {
+			info = g_ptr_array_index (children, i);
+
+			name = g_file_info_get_name (info);
+			display_name = g_file_info_get_display_name (info);
+			content_type = g_file_info_get_attribute_string (info,
+									 G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE);
+
+			entry.parent = directory->id;
+			entry.first_child = 0;
+			entry.n_children = 0;
+			entry.name = append_string (strings, name);
+			if (display_name == NULL || strcmp (display_name, name) == 0) {
+				entry.display_name = entry.name;
+			} else {
+				entry.display_name = append_string (strings, display_name);
+			}
+			entry.content_type = content_type != NULL ?
+				intern_string (strings, content_types, content_type) : 0;
+			entry.mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+			entry.atime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_ACCESS);
+			entry.flags = get_flags_from_info (info);
+			g_array_append_val (entries, entry);
+
+			if ((entry.flags & ENTRY_IS_DIRECTORY) && !mark_visited (visited, info)) {
+				child_directory = g_slice_new (PendingDirectory);
+				child_directory->id = first_child + i;
+				child_directory->location = g_file_get_child (directory->location, name);
+				g_queue_push_tail (&pending, child_directory);
+			}
+		}
+
+		parent = &g_array_index (entries, IndexEntry, directory->id);
+		parent->first_child = first_child;
+		parent->n_children = children->len;
+
+		g_ptr_array_unref (children);
+	next:
+		g_object_unref (directory->location);
+		g_slice_free (PendingDirectory, directory);
+	}
+
+	if (too_big) {
+		DEBUG ("Not indexing %s, too many files", data->root_uri);
+	} else {
+		DEBUG ("Built search index for %s with %u entries", data->root_uri, entries->len);
+		if (write_index (data, entries, strings, root_uri)) {
+			data->index = nautilus_search_index_load (data->root);
+		}
+	}
+
+	g_hash_table_destroy (visited);
+	g_hash_table_destroy (content_types);
+	g_string_free (strings, TRUE);
+	g_array_free (entries, TRUE);
+}
+
+static gboolean
+build_done_idle (gpointer user_data)
+{
+	IndexBuildData *data;
+
+	data = user_data;
+
+	g_hash_table_remove (builds_in_progress, data->root_uri);
+
+	if (data->index != NULL) {
+		/* Searches still holding the old index keep their mapping alive */
+		g_hash_table_replace (indexes, g_strdup (data->root_uri), data->index);
+	}
+
+	g_object_unref (data->root);
+	g_free (data->root_uri);
+	g_free (data->path);
+	g_free (data);
+
+	return FALSE;
+}
+
+/* Removes the indexes of the locations not searched for a while, next
+ * to the one at @path */
+static void
+remove_unused_indexes (const char *path)
+{
+	GDir *dir;
+	GStatBuf buf;
+	const char *name;
+	char *dirname, *index_path;
+	gint64 now;
+
+	dirname = g_path_get_dirname (path);
+	dir = g_dir_open (dirname, 0, NULL);
+	if (dir == NULL) {
+		g_free (dirname);
+		return;
+	}
+
+	now = g_get_real_time () / G_USEC_PER_SEC;
+	while ((name = g_dir_read_name (dir)) != NULL) {
+		if (!g_str_has_suffix (name, ".idx")) {
+			continue;
+		}
+
+		index_path = g_build_filename (dirname, name, NULL);
+		if (g_stat (index_path, &buf) == 0 &&
+		    now - buf.st_mtime > INDEX_UNUSED_AGE / G_USEC_PER_SEC) {
+			DEBUG ("Removing unused search index %s", index_path);
+			g_unlink (index_path);
+		}
+		g_free (index_path);
+	}
+
+	g_dir_close (dir);
+	g_free (dirname);
+}
+
+static gpointer
+build_thread_func (gpointer user_data)
+{
+	IndexBuildData *data;
+
+	data = user_data;
+
+	remove_unused_indexes (data->path);
+	build_index (data);
+
+	g_idle_add (build_done_idle, user_data);
+
+	return NULL;
+}
+
+static void
+start_build (IndexBuildData *data)
+{
+	GThread *thread;
+
+	DEBUG ("Building search index for %s", data->root_uri);
+
+	thread = g_thread_new ("nautilus-search-index", build_thread_func, data);
+	g_thread_unref (thread);
+}
+
+/**
+ * nautilus_search_index_schedule_build:
+ * @location: the root of the new index
+ *
+ * Indexes the tree below @location in a background thread, once no
+ * search is running. Nothing happens if a build for @location is already
+ * pending, or if the settings don't allow indexing @location.
+ */
+void
+nautilus_search_index_schedule_build (GFile *location)
+{
+	IndexBuildData *data;
+	char *uri;
+
+	if (!is_indexing_allowed (location)) {
+		return;
+	}
+
+	ensure_tables ();
+
+	uri = g_file_get_uri (location);
+	if (g_hash_table_contains (builds_in_progress, uri)) {
+		g_free (uri);
+		return;
+	}
+
+	g_hash_table_add (builds_in_progress, g_strdup (uri));
+
+	data = g_new0 (IndexBuildData, 1);
+	data->root = g_object_ref (location);
+	data->root_uri = uri;
+	data->path = get_index_path (uri);
+
+	if (n_searches_running > 0) {
+		deferred_builds = g_list_append (deferred_builds, data);
+	} else {
+		start_build (data);
+	}
+}
+
+void
+nautilus_search_index_schedule_rebuild (NautilusSearchIndex *index)
+{
+	nautilus_search_index_schedule_build (index->root);
+}
+
+static gboolean
+revalidate_done_idle (gpointer user_data)
+{
+	NautilusSearchIndex *index;
+
+	index = user_data;
+
+	revalidating_indexes = g_list_remove (revalidating_indexes, index);
+	g_clear_object (&index->revalidate_cancellable);
+	nautilus_search_index_unref (index);
+
+	return FALSE;
+}
+
+/* Compares the modification times of the next indexed directories with
+ * the file system, going on where the previous revalidation stopped. The
+ * ones we were told about changes in are skipped, the overlay has them.
+ * Finding a change is enough to have the index rebuilt.
+ */
+static gpointer
+revalidate_thread_func (gpointer user_data)
+{
+	NautilusSearchIndex *index;
+	NautilusSearchIndexEntry entry;
+	GCancellable *cancellable;
+	GFile *location;
+	guint64 mtime;
+	guint32 id, n_visited, n_checked;
+	gboolean exists;
+	char *uri;
+
+	index = user_data;
+	cancellable = index->revalidate_cancellable;
+
+	id = index->revalidate_next;
+	n_checked = 0;
+	for (n_visited = 0; n_visited < index->n_entries; n_visited++) {
+		if (n_checked >= REVALIDATE_MAX_DIRECTORIES ||
+		    g_cancellable_is_cancelled (cancellable)) {
+			break;
+		}
+
+		if ((index->entries[id].flags & ENTRY_IS_DIRECTORY) &&
+		    !is_tombstoned (index, id) && !has_known_changes (index, id)) {
+			fill_entry (index, id, &entry);
+			uri = nautilus_search_index_entry_get_uri (index, &entry);
+			location = g_file_new_for_uri (uri);
+			exists = get_directory_mtime (location, cancellable, &mtime);
+			g_object_unref (location);
+			g_free (uri);
+
+			if (g_cancellable_is_cancelled (cancellable)) {
+				/* Check it again next time */
+				break;
+			}
+			if (!exists || mtime != index->entries[id].mtime) {
+				DEBUG ("Search index for %s is out of date", index->root_uri);
+				g_atomic_int_set (&index->dirty, TRUE);
+				break;
+			}
+			n_checked++;
+		}
+
+		id = id + 1 < index->n_entries ? id + 1 : 0;
+	}
+	index->revalidate_next = id;
+
+	g_idle_add (revalidate_done_idle, index);
+
+	return NULL;
+}
+
+static void
+start_revalidate (NautilusSearchIndex *index)
+{
+	GThread *thread;
+
+	if (index->revalidate_cancellable != NULL || index->dirty) {
+		return;
+	}
+
+	index->revalidate_cancellable = g_cancellable_new ();
+	revalidating_indexes = g_list_prepend (revalidating_indexes, index);
+
+	thread = g_thread_new ("nautilus-search-index", revalidate_thread_func,
+			       nautilus_search_index_ref (index));
+	g_thread_unref (thread);
+}
+
+/**
+ * nautilus_search_index_schedule_revalidate:
+ * @index: a #NautilusSearchIndex
+ *
+ * Looks for changes made behind our back in a background thread once no
+ * search is running, after @index answered one. It is rebuilt on the
+ * next search if there are.
+ */
+void
+nautilus_search_index_schedule_revalidate (NautilusSearchIndex *index)
+{
+	if (n_searches_running == 0) {
+		start_revalidate (index);
+	} else if (g_list_find (deferred_revalidations, index) == NULL) {
+		deferred_revalidations = g_list_prepend (deferred_revalidations,
+							 nautilus_search_index_ref (index));
+	}
+}
+
+void
+nautilus_search_index_search_started (void)
+{
+	GList *l;
+
+	n_searches_running++;
+
+	/* It goes on where it stopped next time */
+	for (l = revalidating_indexes; l != NULL; l = l->next) {
+		g_cancellable_cancel (((NautilusSearchIndex *) l->data)->revalidate_cancellable);
+	}
+}
+
+void
+nautilus_search_index_search_finished (void)
+{
+	GList *builds, *revalidations, *l;
+
+	g_return_if_fail (n_searches_running > 0);
+
+	n_searches_running--;
+	if (n_searches_running > 0) {
+		return;
+	}
+
+	builds = deferred_builds;
+	deferred_builds = NULL;
+	for (l = builds; l != NULL; l = l->next) {
+		start_build (l->data);
+	}
+	g_list_free (builds);
+
+	revalidations = deferred_revalidations;
+	deferred_revalidations = NULL;
+	for (l = revalidations; l != NULL; l = l->next) {
+		start_revalidate (l->data);
+	}
+	g_list_free_full (revalidations, (GDestroyNotify) nautilus_search_index_unref);
+}
+
+static gboolean
+overlay_entry_is_below (gpointer key,
+			gpointer value,
+			gpointer user_data)
+{
+	const char *uri = key;
+	const char *removed_uri = user_data;
+	gsize length;
+
+	length = strlen (removed_uri);
+
+	return strncmp (uri, removed_uri, length) == 0 &&
+		(uri[length] == '\0' || uri[length] == '/');
+}
+
+static void
+index_remove_location (NautilusSearchIndex *index,
+		       GFile               *location)
+{
+	GFile *parent;
+	guint32 id;
+	char *uri;
+
+	id = lookup_entry (index, location);
+	if (id != INVALID_ENTRY) {
+		set_tombstone (index, id);
+		if (id == 0) {
+			index->dirty = TRUE;
+		}
+	}
+
+	/* The modification time of the parent changes, which is no reason
+	 * to rebuild when revalidating */
+	parent = g_file_get_parent (location);
+	if (parent != NULL) {
+		id = lookup_entry (index, parent);
+		if (id != INVALID_ENTRY) {
+			set_known_changes (index, id);
+		}
+		g_object_unref (parent);
+	}
+
+	uri = g_file_get_uri (location);
+	g_mutex_lock (&index->overlay_mutex);
+	g_hash_table_foreach_remove (index->overlay, overlay_entry_is_below, uri);
+	g_mutex_unlock (&index->overlay_mutex);
+	g_free (uri);
+}
+
+static void
+update_info_ready (GObject      *source_object,
+		   GAsyncResult *res,
+		   gpointer      user_data)
+{
+	PendingUpdate *update;
+	NautilusSearchIndex *index;
+	OverlayEntry *overlay_entry;
+	GFileInfo *info;
+	const char *content_type;
+
+	update = user_data;
+	index = update->index;
+
+	info = g_file_query_info_finish (G_FILE (source_object), res, NULL);
+	if (info != NULL) {
+		content_type = g_file_info_get_attribute_string (info,
+								 G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE);
+
+		overlay_entry = g_slice_new0 (OverlayEntry);
+		overlay_entry->uri = g_file_get_uri (update->location);
+		overlay_entry->name = g_strdup (g_file_info_get_name (info));
+		overlay_entry->display_name = g_strdup (g_file_info_get_display_name (info));
+		overlay_entry->content_type = g_strdup (content_type);
+		overlay_entry->mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+		overlay_entry->atime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_ACCESS);
+		overlay_entry->flags = get_flags_from_info (info);
+
+		/* We don't know what is inside of a new directory */
+		if (update->added && (overlay_entry->flags & ENTRY_IS_DIRECTORY)) {
+			index->dirty = TRUE;
+		}
+
+		g_mutex_lock (&index->overlay_mutex);
+		g_hash_table_replace (index->overlay, overlay_entry->uri, overlay_entry);
+		if (g_hash_table_size (index->overlay) > INDEX_MAX_OVERLAY_ENTRIES) {
+			index->dirty = TRUE;
+		}
+		g_mutex_unlock (&index->overlay_mutex);
+
+		g_object_unref (info);
+	}
+
+	nautilus_search_index_unref (index);
+	g_object_unref (update->location);
+	g_slice_free (PendingUpdate, update);
+}
+
+static void
+index_update_location (NautilusSearchIndex *index,
+		       GFile               *location,
+		       gboolean             added)
+{
+	PendingUpdate *update;
+	guint32 id;
+
+	id = lookup_entry (index, location);
+	if (id != INVALID_ENTRY && !is_tombstoned (index, id)) {
+		/* Tombstoning a directory would hide everything below it,
+		 * and a change notification never renames anything. */
+		if (index->entries[id].flags & ENTRY_IS_DIRECTORY) {
+			return;
+		}
+		added = FALSE;
+	}
+
+	index_remove_location (index, location);
+
+	update = g_slice_new (PendingUpdate);
+	update->index = nautilus_search_index_ref (index);
+	update->location = g_object_ref (location);
+	update->added = added;
+
+	g_file_query_info_async (location, INDEX_ATTRIBUTES,
+				 G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+				 G_PRIORITY_LOW, NULL,
+				 update_info_ready, update);
+}
+
+static GList *
+get_indexes_containing (GFile *location)
+{
+	GHashTableIter iter;
+	NautilusSearchIndex *index;
+	GList *result;
+
+	result = NULL;
+	g_hash_table_iter_init (&iter, indexes);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &index)) {
+		if (g_file_has_prefix (location, index->root) ||
+		    g_file_equal (location, index->root)) {
+			result = g_list_prepend (result, index);
+		}
+	}
+
+	return result;
+}
+
+static void
+notify_files (GList    *files,
+	      gboolean  removed,
+	      gboolean  added)
+{
+	GList *l, *containing, *i;
+	GFile *location;
+
+	if (indexes == NULL || g_hash_table_size (indexes) == 0) {
+		return;
+	}
+
+	for (l = files; l != NULL; l = l->next) {
+		location = l->data;
+
+		containing = get_indexes_containing (location);
+		for (i = containing; i != NULL; i = i->next) {
+			if (removed) {
+				index_remove_location (i->data, location);
+			} else {
+				index_update_location (i->data, location, added);
+			}
+		}
+		g_list_free (containing);
+	}
+}
+
+void
+nautilus_search_index_notify_files_added (GList *files)
+{
+	notify_files (files, FALSE, TRUE);
+}
+
+void
+nautilus_search_index_notify_files_changed (GList *files)
+{
+	notify_files (files, FALSE, FALSE);
+}
+
+void
+nautilus_search_index_notify_files_removed (GList *files)
+{
+	notify_files (files, TRUE, FALSE);
+}
+
+void
+nautilus_search_index_notify_files_moved (GList *file_pairs)
+{
+	GList *l, *containing, *i;
+	NautilusSearchIndex *index;
+	GFilePair *pair;
+	guint32 id;
+
+	if (indexes == NULL || g_hash_table_size (indexes) == 0) {
+		return;
+	}
+
+	for (l = file_pairs; l != NULL; l = l->next) {
+		pair = l->data;
+
+		containing = get_indexes_containing (pair->from);
+		for (i = containing; i != NULL; i = i->next) {
+			index = i->data;
+
+			/* The children move along, we only learn about them on rebuild */
+			id = lookup_entry (index, pair->from);
+			if (id != INVALID_ENTRY &&
+			    (index->entries[id].flags & ENTRY_IS_DIRECTORY)) {
+				index->dirty = TRUE;
+			}
+
+			index_remove_location (index, pair->from);
+		}
+		g_list_free (containing);
+
+		containing = get_indexes_containing (pair->to);
+		for (i = containing; i != NULL; i = i->next) {
+			index_update_location (i->data, pair->to, TRUE);
+		}
+		g_list_free (containing);
+	}
+}
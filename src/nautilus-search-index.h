@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2016 Red Hat, Inc
+ *
+ * Nautilus is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * Nautilus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; see the file COPYING.  If not,
+ * see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* nautilus-search-index.h: persistent, memory-mapped index of the file
+ * names below a directory, used to answer recursive searches without
+ * walking the file system.
+ */
+
+#ifndef NAUTILUS_SEARCH_INDEX_H
+#define NAUTILUS_SEARCH_INDEX_H
+
+#include <glib.h>
+#include <gio/gio.h>
+
+typedef struct NautilusSearchIndex NautilusSearchIndex;
+
+typedef struct {
+	guint32 id;
+	/* Only set for entries recorded after the index was built */
+	const char *uri;
+
+	const char *name;
+	const char *display_name;
+	const char *content_type;
+	guint64 mtime;
+	guint64 atime;
+	gboolean is_directory;
+	gboolean is_hidden;
+} NautilusSearchIndexEntry;
+
+/* Called for every entry below the searched location. For directories,
+ * returning FALSE skips the whole subtree. */
+typedef gboolean (* NautilusSearchIndexForeachFunc) (NautilusSearchIndex            *index,
+						     const NautilusSearchIndexEntry *entry,
+						     gpointer                        user_data);
+
+NautilusSearchIndex *nautilus_search_index_lookup         (GFile                          *location);
+void                 nautilus_search_index_schedule_load  (GFile                          *location);
+NautilusSearchIndex *nautilus_search_index_ref            (NautilusSearchIndex            *index);
+void                 nautilus_search_index_unref          (NautilusSearchIndex            *index);
+
+gboolean             nautilus_search_index_is_usable      (NautilusSearchIndex            *index);
+gboolean             nautilus_search_index_needs_rebuild  (NautilusSearchIndex            *index);
+void                 nautilus_search_index_schedule_build (GFile                          *location);
+void                 nautilus_search_index_schedule_rebuild (NautilusSearchIndex          *index);
+void                 nautilus_search_index_schedule_revalidate (NautilusSearchIndex       *index);
+
+/* Building and revalidating the indexes waits while searches run, so
+ * they don't compete with them for the disk */
+void                 nautilus_search_index_search_started  (void);
+void                 nautilus_search_index_search_finished (void);
+
+void                 nautilus_search_index_foreach        (NautilusSearchIndex            *index,
+							   GFile                          *location,
+							   NautilusSearchIndexForeachFunc  func,
+							   gpointer                        user_data,
+							   GCancellable                   *cancellable);
+char *               nautilus_search_index_entry_get_uri  (NautilusSearchIndex            *index,
+							   const NautilusSearchIndexEntry *entry);
+
+/* Keep the loaded indexes in sync with the change notifications */
+void                 nautilus_search_index_notify_files_added   (GList *files);
+void                 nautilus_search_index_notify_files_changed (GList *files);
+void                 nautilus_search_index_notify_files_removed (GList *files);
+void                 nautilus_search_index_notify_files_moved   (GList *file_pairs);
+
+#endif /* NAUTILUS_SEARCH_INDEX_H */
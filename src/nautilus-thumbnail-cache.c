@@ -0,0 +1,262 @@
+/*
+   Copyright (C) 2016 Red Hat, Inc
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <config.h>
+#include "nautilus-thumbnail-cache.h"
+
+#include "nautilus-global-preferences.h"
+
+typedef struct {
+	int size;
+	GdkPixbuf *pixbuf;
+} ScaledThumbnail;
+
+typedef struct {
+	char *uri;
+	time_t mtime;
+	GdkPixbuf *thumbnail;
+	/* Of ScaledThumbnail, one per size the thumbnail is shown at */
+	GSList *scaled;
+	gsize n_bytes;
+} CachedThumbnail;
+
+/* Both of these are only used from the main thread. The queue is most
+ * recently used first, and the table maps uris to its links.
+ */
+static GHashTable *cached_thumbnails;
+static GQueue lru_queue = G_QUEUE_INIT;
+
+static gsize cached_bytes;
+
+static gsize
+pixbuf_get_n_bytes (GdkPixbuf *pixbuf)
+{
+	return gdk_pixbuf_get_byte_length (pixbuf);
+}
+
+static void
+cache_size_changed_callback (gpointer callback_data);
+
+static gsize
+get_max_cached_bytes (void)
+{
+	static gsize max_cached_bytes;
+	static gboolean cache_size_changed_callback_installed = FALSE;
+
+	if (!cache_size_changed_callback_installed) {
+		g_signal_connect_swapped (nautilus_preferences,
+					  "changed::" NAUTILUS_PREFERENCES_THUMBNAIL_CACHE_SIZE,
+					  G_CALLBACK (cache_size_changed_callback),
+					  &max_cached_bytes);
+
+		cache_size_changed_callback_installed = TRUE;
+
+		cache_size_changed_callback (&max_cached_bytes);
+	}
+
+	return max_cached_bytes;
+}
+
+static void
+scaled_thumbnail_free (gpointer data)
+{
+	ScaledThumbnail *scaled;
+
+	scaled = data;
+	g_object_unref (scaled->pixbuf);
+	g_free (scaled);
+}
+
+static void
+remove_link (GList *link)
+{
+	CachedThumbnail *cached;
+
+	cached = link->data;
+	g_hash_table_remove (cached_thumbnails, cached->uri);
+	g_queue_delete_link (&lru_queue, link);
+	cached_bytes -= cached->n_bytes;
+
+	g_free (cached->uri);
+	g_object_unref (cached->thumbnail);
+	g_slist_free_full (cached->scaled, scaled_thumbnail_free);
+	g_free (cached);
+}
+
+static void
+evict (void)
+{
+	gsize max_cached_bytes;
+
+	max_cached_bytes = get_max_cached_bytes ();
+
+	/* Keep the most recent thumbnail, even if it is too big alone */
+	while (cached_bytes > max_cached_bytes && lru_queue.length > 1) {
+		remove_link (lru_queue.tail);
+	}
+}
+
+static void
+cache_size_changed_callback (gpointer callback_data)
+{
+	gsize *max_cached_bytes;
+
+	max_cached_bytes = callback_data;
+	*max_cached_bytes = (gsize) g_settings_get_uint (nautilus_preferences,
+							 NAUTILUS_PREFERENCES_THUMBNAIL_CACHE_SIZE) << 20;
+
+	evict ();
+}
+
+/* Returns the link of @uri, made the most recent, or NULL */
+static GList *
+lookup_link (const char *uri,
+	     time_t      mtime)
+{
+	GList *link;
+	CachedThumbnail *cached;
+
+	if (cached_thumbnails == NULL) {
+		return NULL;
+	}
+
+	link = g_hash_table_lookup (cached_thumbnails, uri);
+	if (link == NULL) {
+		return NULL;
+	}
+
+	cached = link->data;
+	if (cached->mtime != mtime) {
+		remove_link (link);
+		return NULL;
+	}
+
+	g_queue_unlink (&lru_queue, link);
+	g_queue_push_head_link (&lru_queue, link);
+
+	return link;
+}
+
+GdkPixbuf *
+nautilus_thumbnail_cache_lookup (const char *uri,
+				 time_t      mtime,
+				 int         size)
+{
+	GList *link;
+	CachedThumbnail *cached;
+	ScaledThumbnail *scaled;
+	GSList *l;
+
+	link = lookup_link (uri, mtime);
+	if (link == NULL) {
+		return NULL;
+	}
+
+	cached = link->data;
+	if (size == 0) {
+		return g_object_ref (cached->thumbnail);
+	}
+
+	for (l = cached->scaled; l != NULL; l = l->next) {
+		scaled = l->data;
+		if (scaled->size == size) {
+			return g_object_ref (scaled->pixbuf);
+		}
+	}
+
+	return NULL;
+}
+
+void
+nautilus_thumbnail_cache_insert (const char *uri,
+				 time_t      mtime,
+				 GdkPixbuf  *thumbnail)
+{
+	GList *link;
+	CachedThumbnail *cached;
+
+	if (cached_thumbnails == NULL) {
+		cached_thumbnails = g_hash_table_new (g_str_hash, g_str_equal);
+	}
+
+	/* Loading the same thumbnail again keeps its scaled copies */
+	link = lookup_link (uri, mtime);
+	if (link != NULL) {
+		cached = link->data;
+		if (cached->thumbnail == thumbnail) {
+			return;
+		}
+	}
+
+	nautilus_thumbnail_cache_remove (uri);
+
+	cached = g_new0 (CachedThumbnail, 1);
+	cached->uri = g_strdup (uri);
+	cached->mtime = mtime;
+	cached->thumbnail = g_object_ref (thumbnail);
+	cached->n_bytes = pixbuf_get_n_bytes (thumbnail);
+	cached_bytes += cached->n_bytes;
+
+	g_queue_push_head (&lru_queue, cached);
+	g_hash_table_insert (cached_thumbnails, cached->uri, lru_queue.head);
+
+	evict ();
+}
+
+void
+nautilus_thumbnail_cache_add_scaled (const char *uri,
+				     time_t      mtime,
+				     int         size,
+				     GdkPixbuf  *pixbuf)
+{
+	GList *link;
+	CachedThumbnail *cached;
+	ScaledThumbnail *scaled;
+	gsize n_bytes;
+
+	link = lookup_link (uri, mtime);
+	if (link == NULL) {
+		return;
+	}
+
+	scaled = g_new (ScaledThumbnail, 1);
+	scaled->size = size;
+	scaled->pixbuf = g_object_ref (pixbuf);
+
+	n_bytes = pixbuf_get_n_bytes (pixbuf);
+	cached = link->data;
+	cached->scaled = g_slist_prepend (cached->scaled, scaled);
+	cached->n_bytes += n_bytes;
+	cached_bytes += n_bytes;
+
+	evict ();
+}
+
+void
+nautilus_thumbnail_cache_remove (const char *uri)
+{
+	GList *link;
+
+	if (cached_thumbnails == NULL) {
+		return;
+	}
+
+	link = g_hash_table_lookup (cached_thumbnails, uri);
+	if (link != NULL) {
+		remove_link (link);
+	}
+}
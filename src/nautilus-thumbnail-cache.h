@@ -0,0 +1,46 @@
+/*
+   Copyright (C) 2016 Red Hat, Inc
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* nautilus-thumbnail-cache.h: the thumbnails loaded recently, and their
+   scaled copies, kept within a memory budget for all files and views.
+*/
+
+#ifndef NAUTILUS_THUMBNAIL_CACHE_H
+#define NAUTILUS_THUMBNAIL_CACHE_H
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <time.h>
+
+/* Returns a new reference to the thumbnail of @uri as loaded, when
+ * @size is 0, or to its copy scaled to @size pixels on the longest
+ * side. Returns NULL unless it was cached for the same @mtime.
+ */
+GdkPixbuf *nautilus_thumbnail_cache_lookup     (const char *uri,
+						time_t      mtime,
+						int         size);
+/* Replaces the thumbnail of @uri, and with it all its scaled copies */
+void       nautilus_thumbnail_cache_insert     (const char *uri,
+						time_t      mtime,
+						GdkPixbuf  *thumbnail);
+/* Adds a scaled copy of the thumbnail of @uri, if it is still cached */
+void       nautilus_thumbnail_cache_add_scaled (const char *uri,
+						time_t      mtime,
+						int         size,
+						GdkPixbuf  *pixbuf);
+void       nautilus_thumbnail_cache_remove     (const char *uri);
+
+#endif /* NAUTILUS_THUMBNAIL_CACHE_H */
@@ -26,6 +26,7 @@
 #define GNOME_DESKTOP_USE_UNSTABLE_API
 
 #include "nautilus-directory-notify.h"
+#include "nautilus-embedded-preview.h"
 #include "nautilus-global-preferences.h"
 #include "nautilus-file-utilities.h"
 #include <math.h>
@@ -55,6 +56,19 @@
 /* Cool-off period between last file modification time and thumbnail creation */
 #define THUMBNAIL_CREATION_DELAY_SECS 3
 
+/* Types that take longer than this on average are expensive to
+ * thumbnail, and only half the threads may work on those at once, so
+ * that a few videos don't hold up a folder full of photos.
+ */
+#define EXPENSIVE_THUMBNAIL_USEC (500 * G_TIME_SPAN_MILLISECOND)
+
+/* How far down the queue a thread looks for a cheap thumbnail when it
+ * can't take an expensive one. */
+#define THUMBNAIL_LOOKAHEAD 32
+
+/* The pixel size of the thumbnails the factory makes */
+#define THUMBNAIL_SIZE_LARGE 256
+
 static void thumbnail_thread_func (GTask        *task,
                                    gpointer      source_object,
                                    gpointer      task_data,
@@ -66,35 +80,46 @@ typedef struct {
 	char *image_uri;
 	char *mime_type;
 	time_t original_file_mtime;
+	gboolean can_load_internally;
+	/* Its link in thumbnails_to_make, or NULL while it is being made */
+	GList *node;
+	gboolean expensive;
 } NautilusThumbnailInfo;
 
+/* The average time it takes to make a thumbnail of a MIME type */
+typedef struct {
+	gint64 usec;
+	guint n_samples;
+} ThumbnailCost;
+
 /*
  * Thumbnail thread state.
  */
 
-/* The id of the idle handler used to start the thumbnail thread, or 0 if no
+/* The id of the idle handler used to start thumbnail threads, or 0 if no
    idle handler is currently registered. */
 static guint thumbnail_thread_starter_id = 0;
 
 /* Our mutex used when accessing data shared between the main thread and the
-   thumbnail thread, i.e. the thumbnail_thread_is_running flag and the
-   thumbnails_to_make list. */
+   thumbnail threads, i.e. all of the below. */
 static GMutex thumbnails_mutex;
 
-/* A flag to indicate whether a thumbnail thread is running, so we don't
-   start more than one. Lock thumbnails_mutex when accessing this. */
-static volatile gboolean thumbnail_thread_is_running = FALSE;
+/* How many thumbnail threads are running, how many may run, and how many
+   are making expensive thumbnails. */
+static guint n_thumbnail_threads = 0;
+static guint max_thumbnail_threads = 0;
+static guint n_expensive_thumbnails = 0;
 
-/* The list of NautilusThumbnailInfo structs containing information about the
-   thumbnails we are making. Lock thumbnails_mutex when accessing this. */
-static volatile GQueue thumbnails_to_make = G_QUEUE_INIT;
+/* The queue of NautilusThumbnailInfo structs containing information about
+   the thumbnails we are going to make, most urgent first. */
+static GQueue thumbnails_to_make = G_QUEUE_INIT;
 
-/* Quickly check if uri is in thumbnails_to_make list */
+/* Maps uris to their NautilusThumbnailInfo, both the queued ones and the
+   ones being made, so that neither is added again. */
 static GHashTable *thumbnails_to_make_hash = NULL;
 
-/* The currently thumbnailed icon. it also exists in the thumbnails_to_make list
- * to avoid adding it again. Lock thumbnails_mutex when accessing this. */
-static NautilusThumbnailInfo *currently_thumbnailing = NULL;
+/* MIME types to their ThumbnailCost */
+static GHashTable *thumbnail_costs = NULL;
 
 static GnomeDesktopThumbnailFactory *thumbnail_factory = NULL;
 
@@ -144,42 +169,88 @@ get_thumbnail_factory (void)
 }
 
 
+static void
+thumbnail_threads_changed_callback (gpointer callback_data)
+{
+	guint n_threads;
+
+	n_threads = g_settings_get_uint (nautilus_preferences,
+					 NAUTILUS_PREFERENCES_THUMBNAIL_THREADS);
+	if (n_threads == 0) {
+		n_threads = g_get_num_processors ();
+	}
+
+	g_mutex_lock (&thumbnails_mutex);
+	max_thumbnail_threads = n_threads;
+	g_mutex_unlock (&thumbnails_mutex);
+}
+
+/* Called on the main thread */
+static guint
+get_max_thumbnail_threads (void)
+{
+	static gboolean thumbnail_threads_changed_callback_installed = FALSE;
+
+	if (!thumbnail_threads_changed_callback_installed) {
+		g_signal_connect_swapped (nautilus_preferences,
+					  "changed::" NAUTILUS_PREFERENCES_THUMBNAIL_THREADS,
+					  G_CALLBACK (thumbnail_threads_changed_callback),
+					  NULL);
+
+		thumbnail_threads_changed_callback_installed = TRUE;
+
+		thumbnail_threads_changed_callback (NULL);
+	}
+
+	return max_thumbnail_threads;
+}
+
 /* This function is added as a very low priority idle function to start the
-   thread to create any needed thumbnails. It is added with a very low priority
+   threads to create any needed thumbnails. It is added with a very low priority
    so that it doesn't delay showing the directory in the icon/list views.
    We want to show the files in the directory as quickly as possible. */
 static gboolean
 thumbnail_thread_starter_cb (gpointer data)
 {
 	GTask *task;
+	guint n_threads;
 
 	/* Don't do this in thread, since g_object_ref is not threadsafe */
 	if (thumbnail_factory == NULL) {
 		thumbnail_factory = get_thumbnail_factory ();
 	}
 
+	n_threads = get_max_thumbnail_threads ();
+
+	g_mutex_lock (&thumbnails_mutex);
+
+	/* There is no point in more threads than thumbnails */
+	n_threads = MIN (n_threads, g_queue_get_length (&thumbnails_to_make));
+
+	while (n_thumbnail_threads < n_threads) {
 #ifdef DEBUG_THUMBNAILS
-	g_message ("(Main Thread) Creating thumbnails thread\n");
+		g_message ("(Main Thread) Creating thumbnails thread\n");
 #endif
-	/* We set a flag to indicate the thread is running, so we don't create
-	   a new one. We don't need to lock a mutex here, as the thumbnail
-	   thread isn't running yet. And we know we won't create the thread
-	   twice, as we also check thumbnail_thread_starter_id before
-	   scheduling this idle function. */
-	thumbnail_thread_is_running = TRUE;
-	task = g_task_new (NULL, NULL, NULL, NULL);
-	g_task_run_in_thread (task, thumbnail_thread_func);
+		/* Count the thread right away, so we don't create too many */
+		n_thumbnail_threads++;
+		task = g_task_new (NULL, NULL, NULL, NULL);
+		g_task_run_in_thread (task, thumbnail_thread_func);
+		g_object_unref (task);
+	}
+
 	thumbnail_thread_starter_id = 0;
 
-	g_object_unref (task);
+	g_mutex_unlock (&thumbnails_mutex);
 
 	return FALSE;
 }
 
-void
+/* Returns FALSE if the thumbnail wasn't queued, or is being made already */
+gboolean
 nautilus_thumbnail_remove_from_queue (const char *file_uri)
 {
-	GList *node;
+	NautilusThumbnailInfo *info;
+	gboolean removed = FALSE;
 	
 #ifdef DEBUG_THUMBNAILS
 	g_message ("(Remove from queue) Locking mutex\n");
@@ -191,12 +262,14 @@ nautilus_thumbnail_remove_from_queue (const char *file_uri)
 	 *********************************/
 
 	if (thumbnails_to_make_hash) {
-		node = g_hash_table_lookup (thumbnails_to_make_hash, file_uri);
+		info = g_hash_table_lookup (thumbnails_to_make_hash, file_uri);
 		
-		if (node && node->data != currently_thumbnailing) {
+		/* Those being made are left alone */
+		if (info && info->node != NULL) {
 			g_hash_table_remove (thumbnails_to_make_hash, file_uri);
-			free_thumbnail_info (node->data);
-			g_queue_delete_link ((GQueue *)&thumbnails_to_make, node);
+			g_queue_delete_link (&thumbnails_to_make, info->node);
+			free_thumbnail_info (info);
+			removed = TRUE;
 		}
 	}
 	
@@ -208,12 +281,14 @@ nautilus_thumbnail_remove_from_queue (const char *file_uri)
 	g_message ("(Remove from queue) Unlocking mutex\n");
 #endif
 	g_mutex_unlock (&thumbnails_mutex);
+
+	return removed;
 }
 
 void
 nautilus_thumbnail_prioritize (const char *file_uri)
 {
-	GList *node;
+	NautilusThumbnailInfo *info;
 
 #ifdef DEBUG_THUMBNAILS
 	g_message ("(Prioritize) Locking mutex\n");
@@ -225,11 +300,11 @@ nautilus_thumbnail_prioritize (const char *file_uri)
 	 *********************************/
 
 	if (thumbnails_to_make_hash) {
-		node = g_hash_table_lookup (thumbnails_to_make_hash, file_uri);
+		info = g_hash_table_lookup (thumbnails_to_make_hash, file_uri);
 		
-		if (node && node->data != currently_thumbnailing) {
-			g_queue_unlink ((GQueue *)&thumbnails_to_make, node);
-			g_queue_push_head_link ((GQueue *)&thumbnails_to_make, node);
+		if (info && info->node != NULL) {
+			g_queue_unlink (&thumbnails_to_make, info->node);
+			g_queue_push_head_link (&thumbnails_to_make, info->node);
 		}
 	}
 	
@@ -367,14 +442,17 @@ nautilus_create_thumbnail (NautilusFile *file)
 {
 	time_t file_mtime = 0;
 	NautilusThumbnailInfo *info;
-	NautilusThumbnailInfo *existing_info;
-	GList *existing, *node;
+	NautilusThumbnailInfo *existing;
+	guint max_threads;
 
 	nautilus_file_set_is_thumbnailing (file, TRUE);
 
 	info = g_new0 (NautilusThumbnailInfo, 1);
 	info->image_uri = nautilus_file_get_uri (file);
 	info->mime_type = nautilus_file_get_mime_type (file);
+	/* Until we have timed a type, guess that the ones we load
+	   ourselves are cheap, and the ones needing a thumbnailer aren't */
+	info->can_load_internally = pixbuf_can_load_type (info->mime_type);
 	
 	/* Hopefully the NautilusFile will already have the image file mtime,
 	   so we can just use that. Otherwise we have to get it ourselves. */
@@ -388,6 +466,7 @@ nautilus_create_thumbnail (NautilusFile *file)
 	
 	info->original_file_mtime = file_mtime;
 
+	max_threads = get_max_thumbnail_threads ();
 
 #ifdef DEBUG_THUMBNAILS
 	g_message ("(Main Thread) Locking mutex\n");
@@ -411,16 +490,16 @@ nautilus_create_thumbnail (NautilusFile *file)
 		g_message ("(Main Thread) Adding thumbnail: %s\n",
 			   info->image_uri);
 #endif
-		g_queue_push_tail ((GQueue *)&thumbnails_to_make, info);
-		node = g_queue_peek_tail_link ((GQueue *)&thumbnails_to_make);
+		g_queue_push_tail (&thumbnails_to_make, info);
+		info->node = g_queue_peek_tail_link (&thumbnails_to_make);
 		g_hash_table_insert (thumbnails_to_make_hash,
 				     info->image_uri,
-				     node);
-		/* If the thumbnail thread isn't running, and we haven't
-		   scheduled an idle function to start it up, do that now.
-		   We don't want to start it until all the other work is done,
+				     info);
+		/* If not all the thumbnail threads are running, and we haven't
+		   scheduled an idle function to start more, do that now.
+		   We don't want to start them until all the other work is done,
 		   so the GUI will be updated as quickly as possible.*/
-		if (thumbnail_thread_is_running == FALSE &&
+		if (n_thumbnail_threads < max_threads &&
 		    thumbnail_thread_starter_id == 0) {
 			thumbnail_thread_starter_id = g_idle_add_full (G_PRIORITY_LOW, thumbnail_thread_starter_cb, NULL, NULL);
 		}
@@ -430,8 +509,7 @@ nautilus_create_thumbnail (NautilusFile *file)
 			   info->image_uri);
 #endif
 		/* The file in the queue might need a new original mtime */
-		existing_info = existing->data;
-		existing_info->original_file_mtime = info->original_file_mtime;
+		existing->original_file_mtime = info->original_file_mtime;
 		free_thumbnail_info (info);
 	}   
 
@@ -445,7 +523,107 @@ nautilus_create_thumbnail (NautilusFile *file)
 	g_mutex_unlock (&thumbnails_mutex);
 }
 
-/* thumbnail_thread is invoked as a separate thread to to make thumbnails. */
+static gboolean
+is_expensive (NautilusThumbnailInfo *info)
+{
+	ThumbnailCost *cost;
+
+	cost = g_hash_table_lookup (thumbnail_costs, info->mime_type);
+	if (cost != NULL) {
+		return cost->usec > EXPENSIVE_THUMBNAIL_USEC;
+	}
+
+	return !info->can_load_internally;
+}
+
+static void
+update_thumbnail_cost (const char *mime_type,
+		       gint64      usec)
+{
+	ThumbnailCost *cost;
+
+	cost = g_hash_table_lookup (thumbnail_costs, mime_type);
+	if (cost == NULL) {
+		cost = g_new0 (ThumbnailCost, 1);
+		g_hash_table_insert (thumbnail_costs, g_strdup (mime_type), cost);
+	}
+
+	/* A moving average, so that a type's cost follows what it is like
+	   in the folders being looked at right now */
+	if (cost->n_samples == 0) {
+		cost->usec = usec;
+	} else {
+		cost->usec = (cost->usec * 3 + usec) / 4;
+	}
+	cost->n_samples++;
+}
+
+/* Takes the most urgent thumbnail off the queue, passing over the
+   expensive ones if enough threads are busy with those already. Called
+   with the mutex held. */
+static NautilusThumbnailInfo *
+take_next_thumbnail (void)
+{
+	NautilusThumbnailInfo *info;
+	guint max_expensive;
+	GList *node;
+	int i;
+
+	if (thumbnail_costs == NULL) {
+		thumbnail_costs = g_hash_table_new_full (g_str_hash, g_str_equal,
+							 g_free, g_free);
+	}
+
+	max_expensive = MAX (1, max_thumbnail_threads / 2);
+
+	for (node = thumbnails_to_make.head, i = 0;
+	     node != NULL && i < THUMBNAIL_LOOKAHEAD;
+	     node = node->next, i++) {
+		info = node->data;
+
+		info->expensive = is_expensive (info);
+		if (info->expensive && n_expensive_thumbnails >= max_expensive) {
+			continue;
+		}
+
+		/* It stays in the hash table while it is being made, so the
+		   main thread doesn't add it again */
+		g_queue_delete_link (&thumbnails_to_make, node);
+		info->node = NULL;
+		if (info->expensive) {
+			n_expensive_thumbnails++;
+		}
+
+		return info;
+	}
+
+	return NULL;
+}
+
+static GdkPixbuf *
+generate_thumbnail (NautilusThumbnailInfo *info)
+{
+	GFile *location;
+	GdkPixbuf *pixbuf;
+
+	/* Photos usually carry a preview large enough for the thumbnail,
+	   which is much faster to load than the photo itself */
+	if (nautilus_embedded_preview_is_supported_type (info->mime_type)) {
+		location = g_file_new_for_uri (info->image_uri);
+		pixbuf = nautilus_embedded_preview_load (location, THUMBNAIL_SIZE_LARGE, NULL);
+		g_object_unref (location);
+
+		if (pixbuf != NULL) {
+			return pixbuf;
+		}
+	}
+
+	return gnome_desktop_thumbnail_factory_generate_thumbnail (thumbnail_factory,
+								   info->image_uri,
+								   info->mime_type);
+}
+
+/* thumbnail_thread is invoked as several separate threads to make thumbnails. */
 static void
 thumbnail_thread_func (GTask        *task,
                        gpointer      source_object,
@@ -456,10 +634,10 @@ thumbnail_thread_func (GTask        *task,
 	GdkPixbuf *pixbuf;
 	time_t current_orig_mtime = 0;
 	time_t current_time;
-	GList *node;
+	gint64 start, generation_time = -1;
 
-	/* We loop until there are no more thumbails to make, at which point
-	   we exit the thread. */
+	/* We loop until there are no more thumbails for this thread to
+	   make, at which point we exit the thread. */
 	for (;;) {
 #ifdef DEBUG_THUMBNAILS
 		g_message ("(Thumbnail Thread) Locking mutex\n");
@@ -470,42 +648,58 @@ thumbnail_thread_func (GTask        *task,
 		 * MUTEX LOCKED
 		 *********************************/
 
-		/* Pop the last thumbnail we just made off the head of the
-		   list and free it. I did this here so we only have to lock
-		   the mutex once per thumbnail, rather than once before
-		   creating it and once after.
-		   Don't pop the thumbnail off the queue if the original file
-		   mtime of the request changed. Then we need to redo the thumbnail.
+		/* Forget the last thumbnail we just made and free it. I did
+		   this here so we only have to lock the mutex once per
+		   thumbnail, rather than once before creating it and once after.
+		   If the original file mtime of the request changed, put it
+		   back at the head of the queue instead. Then we need to redo
+		   the thumbnail.
 		*/
-		if (currently_thumbnailing &&
-		    currently_thumbnailing->original_file_mtime == current_orig_mtime) {
-			g_assert (info == currently_thumbnailing);
-			node = g_hash_table_lookup (thumbnails_to_make_hash, info->image_uri);
-			g_assert (node != NULL);
-			g_hash_table_remove (thumbnails_to_make_hash, info->image_uri);
-			free_thumbnail_info (info);
-			g_queue_delete_link ((GQueue *)&thumbnails_to_make, node);
+		if (info != NULL) {
+			if (info->expensive) {
+				n_expensive_thumbnails--;
+			}
+			if (generation_time >= 0) {
+				update_thumbnail_cost (info->mime_type, generation_time);
+			}
+
+			if (info->original_file_mtime == current_orig_mtime) {
+				g_hash_table_remove (thumbnails_to_make_hash, info->image_uri);
+				free_thumbnail_info (info);
+			} else {
+				g_queue_push_head (&thumbnails_to_make, info);
+				info->node = g_queue_peek_head_link (&thumbnails_to_make);
+			}
 		}
-		currently_thumbnailing = NULL;
 
-		/* If there are no more thumbnails to make, reset the
-		   thumbnail_thread_is_running flag, unlock the mutex, and
-		   exit the thread. */
-		if (g_queue_is_empty ((GQueue *)&thumbnails_to_make)) {
+		/* Get the next one to make, unless there are more threads than
+		   allowed now. If there is nothing this thread can make, drop
+		   the thread count, unlock the mutex, and exit the thread.
+		   The threads making the expensive thumbnails will take the
+		   rest when they are done. */
+		info = NULL;
+		if (n_thumbnail_threads <= max_thumbnail_threads) {
+			info = take_next_thumbnail ();
+		}
+		if (info == NULL) {
 #ifdef DEBUG_THUMBNAILS
 			g_message ("(Thumbnail Thread) Exiting\n");
 #endif
-			thumbnail_thread_is_running = FALSE;
+			n_thumbnail_threads--;
 			g_mutex_unlock (&thumbnails_mutex);
 			return;
 		}
 
-		/* Get the next one to make. We leave it on the list until it
-		   is created so the main thread doesn't add it again while we
-		   are creating it. */
-		info = g_queue_peek_head ((GQueue *)&thumbnails_to_make);
-		currently_thumbnailing = info;
+		/* Threads that ran out of cheap thumbnails to make have
+		   exited, so start them again when there are some */
+		if (!g_queue_is_empty (&thumbnails_to_make) &&
+		    n_thumbnail_threads < max_thumbnail_threads &&
+		    thumbnail_thread_starter_id == 0) {
+			thumbnail_thread_starter_id = g_idle_add_full (G_PRIORITY_LOW, thumbnail_thread_starter_cb, NULL, NULL);
+		}
+
 		current_orig_mtime = info->original_file_mtime;
+		generation_time = -1;
 		/*********************************
 		 * MUTEX UNLOCKED
 		 *********************************/
@@ -537,9 +731,9 @@ thumbnail_thread_func (GTask        *task,
 			   info->image_uri);
 #endif
 
-		pixbuf = gnome_desktop_thumbnail_factory_generate_thumbnail (thumbnail_factory,
-									     info->image_uri,
-									     info->mime_type);
+		start = g_get_monotonic_time ();
+		pixbuf = generate_thumbnail (info);
+		generation_time = g_get_monotonic_time () - start;
 
 		if (pixbuf) {
 #ifdef DEBUG_THUMBNAILS
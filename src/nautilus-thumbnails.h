@@ -33,7 +33,7 @@ gboolean   nautilus_thumbnail_is_mimetype_limited_by_size
 						    (const char *mime_type);
 
 /* Queue handling: */
-void       nautilus_thumbnail_remove_from_queue     (const char   *file_uri);
+gboolean   nautilus_thumbnail_remove_from_queue     (const char   *file_uri);
 void       nautilus_thumbnail_prioritize            (const char   *file_uri);
 
 
@@ -133,7 +133,7 @@ vfs_is_not_empty (NautilusDirectory *directory)
 	g_assert (NAUTILUS_IS_VFS_DIRECTORY (directory));
 	g_assert (nautilus_directory_is_anyone_monitoring_file_list (directory));
 
-	return directory->details->file_list != NULL;
+	return nautilus_file_table_get_length (directory->details->file_table) != 0;
 }
 
 static void
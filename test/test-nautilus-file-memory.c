@@ -0,0 +1,103 @@
+/* Reports the memory NautilusFile objects take, by making files from
+ * infos like the ones a directory load gets, and comparing the resident
+ * size of the process before and after.
+ *
+ * Usage: test-nautilus-file-memory [N_FILES]
+ */
+
+#include <src/nautilus-directory.h>
+#include <src/nautilus-file-private.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define DEFAULT_N_FILES 1000000
+
+static gsize
+get_resident_bytes (void)
+{
+	char *contents;
+	unsigned long size, resident;
+
+	resident = 0;
+	if (g_file_get_contents ("/proc/self/statm", &contents, NULL, NULL)) {
+		if (sscanf (contents, "%lu %lu", &size, &resident) != 2) {
+			resident = 0;
+		}
+		g_free (contents);
+	}
+
+	return (gsize) resident * sysconf (_SC_PAGESIZE);
+}
+
+static GFileInfo *
+make_info (guint i)
+{
+	GFileInfo *info;
+	char *name;
+
+	info = g_file_info_new ();
+
+	name = g_strdup_printf ("file-%08u.txt", i);
+	g_file_info_set_name (info, name);
+	g_file_info_set_display_name (info, name);
+	g_free (name);
+
+	g_file_info_set_file_type (info, G_FILE_TYPE_REGULAR);
+	g_file_info_set_content_type (info, "text/plain");
+	g_file_info_set_size (info, i);
+	g_file_info_set_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED, 1450000000 + i);
+	g_file_info_set_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_MODE, 0100644);
+	g_file_info_set_attribute_boolean (info, G_FILE_ATTRIBUTE_ACCESS_CAN_READ, TRUE);
+	g_file_info_set_attribute_boolean (info, G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE, TRUE);
+
+	return info;
+}
+
+int
+main (int argc, char **argv)
+{
+	NautilusDirectory *directory;
+	NautilusFile **files;
+	GFileInfo *info;
+	guint n_files, i;
+	gsize before, after;
+
+	n_files = argc > 1 ? strtoul (argv[1], NULL, 10) : DEFAULT_N_FILES;
+	/* One made before measuring, and at least one measured */
+	n_files = MAX (n_files, 2);
+
+	directory = nautilus_directory_get_by_uri ("file:///tmp");
+	files = g_new (NautilusFile *, n_files);
+
+	/* Make the first one before measuring, for the types and the
+	 * interned strings all of them share */
+	info = make_info (0);
+	nautilus_file_prepare_info (info);
+	files[0] = nautilus_file_new_from_info (directory, info);
+	g_object_unref (info);
+
+	before = get_resident_bytes ();
+
+	for (i = 1; i < n_files; i++) {
+		info = make_info (i);
+		nautilus_file_prepare_info (info);
+		files[i] = nautilus_file_new_from_info (directory, info);
+		g_object_unref (info);
+	}
+
+	after = get_resident_bytes ();
+
+	g_print ("NautilusFileDetails     %5" G_GSIZE_FORMAT " bytes\n", sizeof (NautilusFileDetails));
+	g_print ("NautilusFileColdDetails %5" G_GSIZE_FORMAT " bytes, only when needed\n",
+		 sizeof (NautilusFileColdDetails));
+	/* Signed, the resident size may have shrunk meanwhile */
+	g_print ("%u files: %.1f bytes per file resident\n",
+		 n_files, ((double) after - (double) before) / (n_files - 1));
+
+	/* The files aren't in the directory, so leave them for the
+	 * process exit rather than finalizing them. */
+	g_free (files);
+
+	return 0;
+}
@@ -0,0 +1,193 @@
+/* Compares the packed file table of NautilusDirectory with the list and
+ * name hash table it replaced, for loading a directory, looking up every
+ * file by name, and sweeping the files that are gone after a reload.
+ *
+ * Usage: test-nautilus-file-table [N_FILES...]
+ */
+
+#include <src/nautilus-file-private.h>
+#include <src/nautilus-file-table.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* 1% of the files are gone when sweeping */
+#define GONE_INTERVAL 100
+
+/* The table only looks at the names of the files, so allocate just
+ * enough of the details to hold them, to be able to test a million
+ * files without a million real NautilusFile objects.
+ */
+#define DETAILS_SIZE (G_STRUCT_OFFSET (NautilusFileDetails, name) + sizeof (eel_ref_str))
+
+typedef struct {
+	NautilusFile *files;
+	char *details;
+	guint n_files;
+} FakeFiles;
+
+static FakeFiles *
+fake_files_new (guint n_files)
+{
+	FakeFiles *fake;
+	NautilusFileDetails *details;
+	char *name;
+	guint i;
+
+	fake = g_new0 (FakeFiles, 1);
+	fake->n_files = n_files;
+	fake->files = g_new0 (NautilusFile, n_files);
+	fake->details = g_malloc0 (DETAILS_SIZE * n_files);
+
+	for (i = 0; i < n_files; i++) {
+		details = (NautilusFileDetails *) (fake->details + DETAILS_SIZE * i);
+		name = g_strdup_printf ("file-%08u.txt", i);
+		details->name = eel_ref_str_new (name);
+		g_free (name);
+		fake->files[i].details = details;
+	}
+
+	return fake;
+}
+
+static void
+fake_files_free (FakeFiles *fake)
+{
+	guint i;
+
+	for (i = 0; i < fake->n_files; i++) {
+		eel_ref_str_unref (fake->files[i].details->name);
+	}
+	g_free (fake->details);
+	g_free (fake->files);
+	g_free (fake);
+}
+
+static const char *
+file_name (NautilusFile *file)
+{
+	return eel_ref_str_peek (file->details->name);
+}
+
+static gboolean
+is_gone (NautilusFile *file)
+{
+	/* Reads the file, like checking the unconfirmed flag would */
+	return (file_name (file)[11] - '0') == 0 &&
+	       (file_name (file)[12] - '0') == 0;
+}
+
+static gdouble
+elapsed_ms (gint64 start)
+{
+	return (g_get_monotonic_time () - start) / 1000.0;
+}
+
+static void
+run_list (FakeFiles *fake)
+{
+	GList *list, *node, *next;
+	GHashTable *hash;
+	gint64 start;
+	guint i, found;
+	gdouble load, lookup, sweep;
+
+	start = g_get_monotonic_time ();
+	list = NULL;
+	hash = g_hash_table_new (g_str_hash, g_str_equal);
+	for (i = 0; i < fake->n_files; i++) {
+		list = g_list_prepend (list, &fake->files[i]);
+		g_hash_table_insert (hash, (char *) file_name (&fake->files[i]), list);
+	}
+	load = elapsed_ms (start);
+
+	start = g_get_monotonic_time ();
+	found = 0;
+	for (i = 0; i < fake->n_files; i++) {
+		found += g_hash_table_lookup (hash, file_name (&fake->files[i])) != NULL;
+	}
+	lookup = elapsed_ms (start);
+	g_assert (found == fake->n_files);
+
+	start = g_get_monotonic_time ();
+	for (node = list; node != NULL; node = next) {
+		next = node->next;
+		if (is_gone (node->data)) {
+			g_hash_table_remove (hash, file_name (node->data));
+			list = g_list_delete_link (list, node);
+		}
+	}
+	sweep = elapsed_ms (start);
+
+	g_print ("  list+hash  load %9.2f ms  lookup %9.2f ms  sweep %9.2f ms\n",
+		 load, lookup, sweep);
+
+	g_hash_table_destroy (hash);
+	g_list_free (list);
+}
+
+static void
+run_table (FakeFiles *fake)
+{
+	NautilusFileTable *table;
+	NautilusFileTableIter iter;
+	NautilusFile *file;
+	gint64 start;
+	guint i, found;
+	gdouble load, lookup, sweep;
+
+	start = g_get_monotonic_time ();
+	table = nautilus_file_table_new ();
+	for (i = 0; i < fake->n_files; i++) {
+		nautilus_file_table_add (table, &fake->files[i]);
+	}
+	load = elapsed_ms (start);
+
+	start = g_get_monotonic_time ();
+	found = 0;
+	for (i = 0; i < fake->n_files; i++) {
+		found += nautilus_file_table_lookup (table, file_name (&fake->files[i])) != NULL;
+	}
+	lookup = elapsed_ms (start);
+	g_assert (found == fake->n_files);
+
+	start = g_get_monotonic_time ();
+	nautilus_file_table_iter_init (&iter, table);
+	while (nautilus_file_table_iter_next (&iter, &file)) {
+		if (is_gone (file)) {
+			nautilus_file_table_remove (table, file);
+		}
+	}
+	sweep = elapsed_ms (start);
+
+	g_assert (nautilus_file_table_get_length (table) ==
+		  fake->n_files - (fake->n_files + GONE_INTERVAL - 1) / GONE_INTERVAL);
+
+	g_print ("  file table load %9.2f ms  lookup %9.2f ms  sweep %9.2f ms\n",
+		 load, lookup, sweep);
+
+	nautilus_file_table_destroy (table);
+}
+
+int
+main (int argc, char **argv)
+{
+	static const guint default_sizes[] = { 10000, 100000, 1000000 };
+	FakeFiles *fake;
+	guint n_files;
+	int i, n_sizes;
+
+	n_sizes = argc > 1 ? argc - 1 : G_N_ELEMENTS (default_sizes);
+
+	for (i = 0; i < n_sizes; i++) {
+		n_files = argc > 1 ? strtoul (argv[i + 1], NULL, 10) : default_sizes[i];
+
+		g_print ("%u files\n", n_files);
+
+		fake = fake_files_new (n_files);
+		run_list (fake);
+		run_table (fake);
+		fake_files_free (fake);
+	}
+
+	return 0;
+}